@@ -143,13 +143,15 @@ typedef ptrdiff_t INT;
 #define RSWAP(x,y) {R* NFFT_SWAP_temp__; NFFT_SWAP_temp__=(x); \
   (x)=(y); (y)=NFFT_SWAP_temp__;}
 
-/* macros for window functions */
+/* macros for window functions, WINDOW_HELP_DECAY(s) is the rate in m at
+ * which the approximation error decays for oversampling factor s */
 
 #if defined(DIRAC_DELTA)
   #define PHI_HUT(n,k,d) K(1.0)
   #define PHI(n,x,d) IF(FABS((x)) < K(10E-8),K(1.0),K(0.0))
   #define WINDOW_HELP_INIT(d)
   #define WINDOW_HELP_FINALIZE
+  #define WINDOW_HELP_DECAY(s) K(1.0)
   #define WINDOW_HELP_ESTIMATE_m 0
 #elif defined(GAUSSIAN)
   #define PHI_HUT(n,k,d) ((R)EXP(-(POW(KPI*(k)/n,K(2.0))*ths->b[d])))
@@ -164,6 +166,7 @@ typedef ptrdiff_t INT;
           (K(2.0)*ths->sigma[WINDOW_idx] - K(1.0)) * (((R)ths->m) / KPI); \
     }
   #define WINDOW_HELP_FINALIZE {Y(free)(ths->b);}
+  #define WINDOW_HELP_DECAY(s) (K(1.0) - K(1.0) / (K(2.0) * (s) - K(1.0)))
 #if defined(NFFT_LDOUBLE)
   #define WINDOW_HELP_ESTIMATE_m 17
 #elif defined(NFFT_SINGLE)
@@ -179,6 +182,7 @@ typedef ptrdiff_t INT;
     (R)ths->m) / n)
   #define WINDOW_HELP_INIT
   #define WINDOW_HELP_FINALIZE
+  #define WINDOW_HELP_DECAY(s) LOG(K(2.0) * (s) - K(1.0))
 #if defined(NFFT_LDOUBLE)
   #define WINDOW_HELP_ESTIMATE_m 11
 #elif defined(NFFT_SINGLE)
@@ -197,6 +201,7 @@ typedef ptrdiff_t INT;
     n))
   #define WINDOW_HELP_INIT
   #define WINDOW_HELP_FINALIZE
+  #define WINDOW_HELP_DECAY(s) LOG(K(2.0) * (s) - K(1.0))
 #if defined(NFFT_LDOUBLE)
   #define WINDOW_HELP_ESTIMATE_m 13
 #elif defined(NFFT_SINGLE)
@@ -221,6 +226,7 @@ typedef ptrdiff_t INT;
         ths->b[WINDOW_idx] = (KPI * (K(2.0) - K(1.0) / ths->sigma[WINDOW_idx])); \
   }
   #define WINDOW_HELP_FINALIZE {Y(free)(ths->b);}
+  #define WINDOW_HELP_DECAY(s) SQRT(K(1.0) - K(1.0) / (s))
   #if defined(NFFT_LDOUBLE)
     #define WINDOW_HELP_ESTIMATE_m 9
   #elif defined(NFFT_SINGLE)
@@ -1452,6 +1458,28 @@ R Y(error_l_2_complex)(const C *x, const C *y, const INT n);
 void Y(sort_node_indices_radix_msdf)(INT n, INT *keys0, INT *keys1, INT rhigh);
 void Y(sort_node_indices_radix_lsdf)(INT n, INT *keys0, INT *keys1, INT rhigh);
 
+/* thread.c */
+/** Pins the calling thread to the CPU, if the system supports it. */
+void Y(pin_thread)(const int cpu);
+/** Pins thread t of a team of nthreads threads, the calling thread being
+ *  thread 0, to cpus[t] and returns the previous affinities for
+ *  Y(unpin_threads), NULL if the system does not support it. */
+void *Y(pin_threads)(const int *cpus, const int nthreads);
+/** Gives the threads of a team of nthreads threads back the affinities saved
+ *  by Y(pin_threads) and frees them. */
+void Y(unpin_threads)(void *saved, const int nthreads);
+
+/* memory.c */
+/** Applies the parts of a memory policy other than
+ *  NFFT_MEMORY_HUGE_PAGES_EXPLICIT to the pages of a buffer, returns the
+ *  parts that took effect. First touch places only the pages that were not
+ *  written before, so it is applied to fresh buffers. */
+unsigned Y(memory_policy_apply)(void *p, const size_t n, const unsigned policy);
+/** Allocates n bytes in explicit huge pages, NULL if there are none. */
+void *Y(malloc_huge)(const size_t n);
+/** Frees a buffer of n bytes from Y(malloc_huge). */
+void Y(free_huge)(void *p, const size_t n);
+
 /* assert.c */
 void Y(assertion_failed)(const char *s, int line, const char *file);
 
@@ -140,7 +140,9 @@ typedef struct\
     set */\
 \
   /* internal use only */\
-  Y(plan) my_fftw_plan1; /**< Forward FFTW plan */\
+  Y(plan) my_fftw_plan1; /**< Forward FFTW plan, with flag
+                              NFFT_SHARED_FFTW_PLAN shared by all plans with
+                              the same grid and fftw_flags */\
   Y(plan) my_fftw_plan2; /**< Backward FFTW plan */\
 \
   R **c_phi_inv; /**< Precomputed data for the diagonal matrix \f$D\f$, size \
@@ -152,12 +154,74 @@ typedef struct\
 \
   C *g; /**< Oversampled vector of samples, size is \ref n_total double complex */\
   C *g_hat; /**< Zero-padded vector of Fourier coefficients, size is \ref n_total fftw_complex */\
-  C *g1; /**< Input of fftw */\
+  C *g1; /**< Input of fftw, with flag NFFT_SHARED_GRID g1 and g2 are shared
+               by all plans with the same grid and fftw_flags, which then must
+               not run concurrently */\
   C *g2; /**< Output of fftw */\
 \
   R *spline_coeffs; /**< Input for de Boor algorithm if B_SPLINE or SINC_POWER is defined */\
 \
-  NFFT_INT *index_x; /**< Index array for nodes x used when flag \ref NFFT_SORT_NODES is set. */\
+  NFFT_INT *index_x; /**< Index array for nodes x used when flag \ref NFFT_SORT_NODES is set,
+                         sorted by the precomputation, see nfft_precompute_one_psi;
+                         the transforms only read it. */\
+\
+  unsigned window; /**< Window function, one of the NFFT_WINDOW_* constants.
+                        Defaults to the window selected at configure time. */\
+\
+  NFFT_INT howmany; /**< Number of vectors transformed at once over the same
+                         nodes. f_hat and f hold howmany consecutive blocks of
+                         N_total and M_total coefficients, default is 1. */\
+\
+  Y(plan) *pruned_plan1; /**< Forward FFTW plans per dimension for flag
+                              NFFT_PRUNED_FFT */\
+  Y(plan) *pruned_plan2; /**< Backward FFTW plans per dimension for flag
+                              NFFT_PRUNED_FFT */\
+  R *f_real; /**< Real samples, size M_total, for flag NFFT_REAL; f_hat then\
+                  holds only the coefficients with k_{d-1} >= 0 */\
+\
+  NFFT_INT *perm_x; /**< Permutation for flag NFFT_REORDER_NODES, x[j] is the
+                         node given at position perm_x[j] of x before the last
+                         precomputation, which permutes x in place */\
+  C *f_perm; /**< Samples f in the order of the reordered nodes, used
+                   without flag NFFT_SORTED_IO */\
+  R psi_scale; /**< Scaling of psi for flag NFFT_PSI_FLOAT */\
+  NFFT_INT *psi_offset; /**< Offsets of the window relative to its first grid
+                            point for flag NFFT_PSI_BASE_INDEX, psi_index_g then
+                            holds one base index per node */\
+  C *g_ghost; /**< Oversampled grid with 2m+2 ghost cells per dimension for
+                  flag NFFT_GHOST_CELLS */\
+  const void *b_kernels; /**< B-step kernels specialised for d and m, NULL
+                              for the generic B-step */\
+  NFFT_INT nthreads; /**< Threads of the OpenMP regions and the FFTW plans of
+                         the plan, 0 for the global setting, see
+                         nfft_set_threads */\
+  int *cpus; /**< CPUs the threads are pinned to while a function of the
+                  plan runs, thread t to cpus[t] with the calling thread as
+                  thread 0, NULL for none; see nfft_set_threads */\
+  int g_hat_zero_padded; /**< Whether g1 is zero outside the coefficients
+                             written by the D-step, kept from the last
+                             transform with FFTW_PRESERVE_INPUT */\
+  unsigned memory_policy; /**< Memory policy of g1, g2, psi and psi_index_g,
+                              see nfft_set_memory_policy */\
+  unsigned memory_applied; /**< Parts of memory_policy that took effect on
+                                g1 and g2 */\
+  unsigned psi_applied; /**< Parts of memory_policy that took effect on psi
+                             and psi_index_g, placed when they are allocated,
+                             before the precomputation writes them */\
+  const void *grid_plan; /**< For a node set, the plan whose f_hat and grid
+                              it evaluates, see nfft_init_node_set */\
+  unsigned simd; /**< Instruction set of the SIMD kernels of the d = 1, 2, 3
+                     trafo B-step, see nfft_set_simd */\
+  NFFT_INT *tile_ptr; /**< Nodes of tile i of the tiled adjoint are
+                          tile_nodes[tile_ptr[i]], ..., for flag
+                          NFFT_OMP_TILED_ADJOINT with precomputed psi */\
+  NFFT_INT *tile_nodes; /**< Nodes binned by tile, see tile_ptr */\
+  int index_x_sorted; /**< Whether index_x is sorted for the nodes x, by the
+                          precomputation or else by the first transform */\
+  NFFT_INT poly_degree; /**< Degree of the window polynomials for flag
+                           PRE_POLY_PSI */\
+  int psi_current; /**< Whether psi is precomputed for the nodes x, so that
+                       nfft_set_nodes recomputes the moved nodes only */\
 } X(plan); \
 \
 NFFT_EXTERN void X(trafo_direct)(const X(plan) *ths);\
@@ -170,15 +234,61 @@ NFFT_EXTERN void X(adjoint)(X(plan) *ths);\
 NFFT_EXTERN void X(adjoint_1d)(X(plan) *ths);\
 NFFT_EXTERN void X(adjoint_2d)(X(plan) *ths);\
 NFFT_EXTERN void X(adjoint_3d)(X(plan) *ths);\
+/* Re-entrant transforms on caller-owned f_hat, f (R* for NFFT_REAL) and a \
+   workspace of workspace_size bytes from nfft_malloc. The plan is only read, \
+   so concurrent calls with distinct arrays may share one precomputed plan; \
+   with NFFT_SORT_NODES its nodes must be sorted by nfft_precompute_one_psi. */\
+NFFT_EXTERN size_t X(workspace_size)(const X(plan) *ths);\
+NFFT_EXTERN void X(trafo_execute)(const X(plan) *ths, C *f_hat, C *f, \
+  void *work);\
+NFFT_EXTERN void X(adjoint_execute)(const X(plan) *ths, C *f_hat, C *f, \
+  void *work);\
 NFFT_EXTERN void X(init_1d)(X(plan) *ths, int N1, int M);\
 NFFT_EXTERN void X(init_2d)(X(plan) *ths, int N1, int N2, int M);\
 NFFT_EXTERN void X(init_3d)(X(plan) *ths, int N1, int N2, int N3, int M);\
 NFFT_EXTERN void X(init)(X(plan) *ths, int d, int *N, int M);\
 NFFT_EXTERN void X(init_guru)(X(plan) *ths, int d, int *N, int M, int *n, \
   int m, unsigned flags, unsigned fftw_flags);\
+NFFT_EXTERN void X(init_many)(X(plan) *ths, int d, int *N, int M, \
+  int howmany);\
+NFFT_EXTERN void X(init_sigma)(X(plan) *ths, int d, int *N, int M, \
+  double sigma);\
+NFFT_EXTERN void X(init_guru_window)(X(plan) *ths, int d, int *N, int M, \
+  int *n, int m, unsigned window, unsigned flags, unsigned fftw_flags);\
+NFFT_EXTERN void X(init_guru_many)(X(plan) *ths, int d, int *N, int M, \
+  int *n, int m, int howmany, unsigned window, unsigned flags, \
+  unsigned fftw_flags);\
 NFFT_EXTERN void X(init_lin)(X(plan) *ths, int d, int *N, int M, int *n, \
   int m, int K, unsigned flags, unsigned fftw_flags); \
+NFFT_EXTERN void X(init_tol)(X(plan) *ths, int d, int *N, int M, double eps, \
+  size_t memory, unsigned fftw_flags);\
+NFFT_EXTERN char* X(export_wisdom_to_string)(void);\
+NFFT_EXTERN int X(import_wisdom_from_string)(const char *s);\
+NFFT_EXTERN void X(forget_wisdom)(void);\
 NFFT_EXTERN void X(precompute_one_psi)(X(plan) *ths);\
+/* set_nodes compares x with the nodes of the plan and recomputes only the \
+   moved ones if MALLOC_X is set and x is not the plan's own array; otherwise \
+   it precomputes all nodes. After changing the nodes of the plan in place, \
+   set_moved_nodes recomputes the listed nodes only, with any x. */\
+NFFT_EXTERN void X(set_nodes)(X(plan) *ths, R *x, int M);\
+NFFT_EXTERN void X(set_moved_nodes)(X(plan) *ths, const int *moved, \
+  int num_moved);\
+NFFT_EXTERN void X(set_threads)(X(plan) *ths, int nthreads, const int *cpus);\
+NFFT_EXTERN void X(set_memory_policy)(X(plan) *ths, unsigned policy);\
+NFFT_EXTERN void X(interp)(X(plan) *ths, C *g);\
+NFFT_EXTERN void X(spread)(X(plan) *ths, C *g);\
+NFFT_EXTERN void X(init_node_set)(X(plan) *ths, const X(plan) *grid_plan, int M_total);\
+NFFT_EXTERN void X(trafo_points)(const X(plan) *ths, int M, const R *x, C *f);\
+NFFT_EXTERN void X(trafo_D)(X(plan) *ths);\
+NFFT_EXTERN void X(trafo_fft)(X(plan) *ths);\
+NFFT_EXTERN void X(trafo_B)(X(plan) *ths);\
+NFFT_EXTERN void X(adjoint_B)(X(plan) *ths);\
+NFFT_EXTERN void X(adjoint_fft)(X(plan) *ths);\
+NFFT_EXTERN void X(adjoint_D)(X(plan) *ths);\
+NFFT_EXTERN void X(trafo_pipeline)(const X(plan) *ths, int count, C **f_hat, C **f);\
+NFFT_EXTERN void X(adjoint_pipeline)(const X(plan) *ths, int count, C **f_hat, C **f);\
+NFFT_EXTERN unsigned X(memory_policy)(const X(plan) *ths);\
+NFFT_EXTERN unsigned X(set_simd)(X(plan) *ths, unsigned level);\
 NFFT_EXTERN void X(precompute_psi)(X(plan) *ths);\
 NFFT_EXTERN void X(precompute_full_psi)(X(plan) *ths);\
 NFFT_EXTERN void X(precompute_fg_psi)(X(plan) *ths); \
@@ -205,8 +315,40 @@ NFFT_DEFINE_API(NFFT_MANGLE_LONG_DOUBLE,FFTW_MANGLE_LONG_DOUBLE,long double,fftw
 #define FFTW_INIT                  (1U<<10)
 #define NFFT_SORT_NODES            (1U<<11)
 #define NFFT_OMP_BLOCKWISE_ADJOINT (1U<<12)
+#define NFFT_OMP_TILED_ADJOINT     (1U<<13) /* also without OpenMP */
+#define PRE_POLY_PSI               (1U<<14)
+#define NFFT_PRUNED_FFT            (1U<<15)
+#define NFFT_REAL                  (1U<<16)
+#define NFFT_REORDER_NODES         (1U<<17)
+#define NFFT_SORTED_IO             (1U<<18)
+#define NFFT_PSI_FLOAT             (1U<<19) /* PRE_PSI or PRE_FULL_PSI */
+#define NFFT_PSI_INDEX_32          (1U<<20) /* PRE_FULL_PSI */
+#define NFFT_PSI_BASE_INDEX        (1U<<21) /* PRE_FULL_PSI, slower for small n */
+#define NFFT_GHOST_CELLS           (1U<<22)
+#define NFFT_SHARED_FFTW_PLAN      (1U<<23)
+#define NFFT_SHARED_GRID           (1U<<24)
+#define NFFT_FFT_ORDER             (1U<<25)
 #define PRE_ONE_PSI (PRE_LIN_PSI| PRE_FG_PSI| PRE_PSI| PRE_FULL_PSI)
 
+/* Window functions for nfft_init_guru_window. */
+#define NFFT_WINDOW_DEFAULT       0U /* window selected at configure time */
+#define NFFT_WINDOW_KAISER_BESSEL 1U
+#define NFFT_WINDOW_GAUSSIAN      2U
+#define NFFT_WINDOW_B_SPLINE      3U
+#define NFFT_WINDOW_SINC_POWER    4U
+#define NFFT_WINDOW_ES            5U /* exponential of semicircle */
+
+/* Memory policies for nfft_set_memory_policy. */
+#define NFFT_MEMORY_FIRST_TOUCH         (1U<<0) /* pages placed by the threads using them */
+#define NFFT_MEMORY_INTERLEAVE          (1U<<1) /* pages spread over the NUMA nodes */
+#define NFFT_MEMORY_HUGE_PAGES          (1U<<2) /* transparent huge pages */
+#define NFFT_MEMORY_HUGE_PAGES_EXPLICIT (1U<<3) /* reserved 2 MB pages for g1 and g2 */
+
+/* Instruction sets of the trafo B-step for nfft_set_simd. */
+#define NFFT_SIMD_GENERIC 0U
+#define NFFT_SIMD_AVX2    1U /* AVX2 and FMA */
+#define NFFT_SIMD_AVX512  2U /* AVX-512F */
+
 /* nfct */
 
 /* name mangling macros */
@@ -861,6 +1003,16 @@ void Y(vpr_complex)(C *x, const NFFT_INT n, const char *text); \
 NFFT_INT Y(get_num_threads)(void); \
 void Y(set_num_threads)(NFFT_INT nthreads); \
 NFFT_INT Y(has_threads_enabled)(void); \
+/* wisdom.c */ \
+/** Sets the file of FFTW wisdom, which overrides the environment variable \
+ *  NFFT_WISDOM_FILE (NFFTF_WISDOM_FILE, NFFTL_WISDOM_FILE for single and \
+ *  long double precision). NULL disables the file. */ \
+void Y(set_fftw_wisdom_file)(const char *filename); \
+/** Imports the wisdom file once, done by all plans before FFTW planning. */ \
+void Y(load_fftw_wisdom)(void); \
+/** Writes the accumulated FFTW wisdom to the wisdom file, returns 1 on \
+ *  success and 0 without file or on error. */ \
+int Y(export_fftw_wisdom)(void); \
 /* time.c */ \
 R Y(clock_gettime_seconds)(void); \
 /* error.c: */ \
@@ -870,6 +1022,7 @@ R Y(error_l_infty_1_complex)(const C *x, const C *y, const NFFT_INT n, \
 /* int.c: */ \
 NFFT_INT Y(exp2i)(const NFFT_INT a); \
 NFFT_INT Y(next_power_of_2)(const NFFT_INT N); \
+NFFT_INT Y(next_fft_size)(const NFFT_INT N); \
 /* vector1.c */ \
 /** Computes the inner/dot product \f$x^H x\f$. */ \
 R Y(dot_complex)(C *x, NFFT_INT n); \
@@ -28,6 +28,9 @@ FFT_OUT_OF_PLACE = UInt32(1)<<9
 FFTW_INIT = UInt32(1)<<10
 NFFT_SORT_NODES = UInt32(1)<<11
 NFFT_OMP_BLOCKWISE_ADJOINT = UInt32(1)<<12
+NFFT_OMP_TILED_ADJOINT = UInt32(1)<<13
+PRE_POLY_PSI = UInt32(1)<<14
+NFFT_PRUNED_FFT = UInt32(1)<<15
 PRE_ONE_PSI = (PRE_LIN_PSI| PRE_FG_PSI| PRE_PSI| PRE_FULL_PSI)
 
 # FFTW flags
@@ -857,6 +857,8 @@ fpt_set fpt_init(const int M, const int t, const unsigned int flags)
   set->work = (double _Complex*) nfft_malloc((2*set->N)*sizeof(double _Complex));
   set->result = (double _Complex*) nfft_malloc((2*set->N)*sizeof(double _Complex));
 
+  X(load_fftw_wisdom)();
+
   set->plans_dct2 = (fftw_plan*) nfft_malloc(sizeof(fftw_plan)*(set->t/*-1*/));
   set->kindsr     = (fftw_r2r_kind*) nfft_malloc(2*sizeof(fftw_r2r_kind));
   set->kindsr[0]  = FFTW_REDFT10;
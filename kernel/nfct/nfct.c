@@ -984,6 +984,8 @@ static inline void init_help(X(plan) *ths)
 
   if (ths->flags & FFTW_INIT)
   {
+    Y(load_fftw_wisdom)();
+
     ths->g1 = (R*)Y(malloc)((size_t)(ths->n_total) * sizeof(R));
 
     if (ths->flags & FFT_OUT_OF_PLACE)
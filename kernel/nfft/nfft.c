@@ -32,6 +32,8 @@
 #include "nfft3.h"
 #include "infft.h"
 
+#include <limits.h>
+
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -43,6 +45,375 @@
 #undef X
 #define X(name) NFFT(name)
 
+/* Runtime window selection. The configure-time window (PHI, PHI_HUT from
+ * infft.h) stays the default; the other windows can be chosen per plan via
+ * nfft_init_guru_window. */
+
+#if defined(DIRAC_DELTA)
+  #define WINDOW_CONFIGURED NFFT_WINDOW_DEFAULT
+#elif defined(GAUSSIAN)
+  #define WINDOW_CONFIGURED NFFT_WINDOW_GAUSSIAN
+#elif defined(B_SPLINE)
+  #define WINDOW_CONFIGURED NFFT_WINDOW_B_SPLINE
+#elif defined(SINC_POWER)
+  #define WINDOW_CONFIGURED NFFT_WINDOW_SINC_POWER
+#else
+  #define WINDOW_CONFIGURED NFFT_WINDOW_KAISER_BESSEL
+#endif
+
+/** Window function of the configured kind, see infft.h. */
+static inline R phi_configured(const X(plan) *ths, const INT n, const R x,
+  const INT d)
+{
+  UNUSED(ths);
+  return PHI(n,x,d);
+}
+
+/** Fourier coefficients of the configured window, see infft.h. */
+static inline R phi_hut_configured(const X(plan) *ths, const INT n, const R k,
+  const INT d)
+{
+  UNUSED(ths);
+  return PHI_HUT(n,k,d);
+}
+
+#undef PHI
+#undef PHI_HUT
+#undef WINDOW_HELP_INIT
+#undef WINDOW_HELP_FINALIZE
+
+/** Kaiser-Bessel window. */
+static inline R phi_kaiser_bessel(const X(plan) *ths, const INT n, const R x,
+  const INT d)
+{
+  const R r = (R)(ths->m) * (R)(ths->m) - x * (R)(n) * x * (R)(n);
+
+  if (r > K(0.0))
+    return SINH(ths->b[d] * SQRT(r)) / (KPI * SQRT(r));
+  else if (r < K(0.0))
+    return SIN(ths->b[d] * SQRT(-r)) / (KPI * SQRT(-r));
+  else
+    return ths->b[d] / KPI;
+}
+
+/** Exponential of semicircle window
+ *  \f$ \varphi(x) = {\rm e}^{\beta(\sqrt{1-(nx/m)^2}-1)} \f$, \f$|nx|<m\f$. */
+static inline R phi_es(const X(plan) *ths, const INT n, const R x,
+  const INT d)
+{
+  const R z = x * (R)(n) / (R)(ths->m);
+
+  if (z * z >= K(1.0))
+    return K(0.0);
+
+  return EXP(ths->b[d] * (SQRT(K(1.0) - z * z) - K(1.0)));
+}
+
+/** Number of Gauss-Legendre nodes for the Fourier coefficients of the
+ *  exponential of semicircle window. */
+#define ES_QUADRATURE_NODES(m) (4 * (m) + 24)
+
+/**
+ * Gauss-Legendre nodes and weights for the substituted integral
+ * \f$ \int_0^{\pi/2} \ldots {\rm d}\theta \f$, \f$ z = \sin\theta \f$, which
+ * removes the square root singularity of the exponential of semicircle window
+ * at the boundary of its support. Returns \f$ z_i \f$ in z and
+ * \f$ w_i \cos\theta_i \f$ in w.
+ */
+static void es_quadrature(const INT nq, R *z, R *w)
+{
+  INT i, j, it;
+
+  for (i = 0; i < nq; i++)
+  {
+    /* Newton iteration for the i-th root of the Legendre polynomial */
+    R t = COS(KPI * ((R)(i) + K(0.75)) / ((R)(nq) + K(0.5))), dp = K(1.0);
+
+    for (it = 0; it < 100; it++)
+    {
+      R p0 = K(1.0), p1 = t, dt;
+
+      for (j = 2; j <= nq; j++)
+      {
+        const R p2 = ((K(2.0) * (R)(j) - K(1.0)) * t * p1 - ((R)(j) - K(1.0)) * p0)
+          / (R)(j);
+        p0 = p1;
+        p1 = p2;
+      }
+
+      dp = (R)(nq) * (t * p1 - p0) / (t * t - K(1.0));
+      dt = p1 / dp;
+      t -= dt;
+
+      if (FABS(dt) <= K(4.0) * Y(float_property)(NFFT_EPSILON))
+        break;
+    }
+
+    {
+      const R theta = KPI / K(4.0) * (t + K(1.0));
+      z[i] = SIN(theta);
+      w[i] = KPI / K(4.0) * K(2.0) / ((K(1.0) - t * t) * dp * dp) * COS(theta);
+    }
+  }
+}
+
+/** Fourier coefficient of the exponential of semicircle window, computed by
+ *  quadrature from the nodes and weights of es_quadrature. */
+static R phi_hut_es_quadrature(const X(plan) *ths, const INT n, const R k,
+  const INT d, const INT nq, const R *z, const R *w)
+{
+  const R omega = K2PI * k * (R)(ths->m) / (R)(n);
+  R s = K(0.0);
+  INT i;
+
+  for (i = 0; i < nq; i++)
+    s += w[i] * EXP(ths->b[d] * (SQRT(K(1.0) - z[i] * z[i]) - K(1.0)))
+      * COS(omega * z[i]);
+
+  return K(2.0) * (R)(ths->m) * s;
+}
+
+static R phi_hut_es(const X(plan) *ths, const INT n, const R k, const INT d)
+{
+  const INT nq = ES_QUADRATURE_NODES(ths->m);
+  R z[nq], w[nq];
+
+  es_quadrature(nq, z, w);
+
+  return phi_hut_es_quadrature(ths, n, k, d, nq, z, w);
+}
+
+/** Window function \f$\varphi\f$ selected by ths->window. */
+static inline R phi(const X(plan) *ths, const INT n, const R x, const INT d)
+{
+  switch (ths->window)
+  {
+    case NFFT_WINDOW_KAISER_BESSEL:
+      return phi_kaiser_bessel(ths, n, x, d);
+    case NFFT_WINDOW_GAUSSIAN:
+      return (R)EXP(-(x * (R)(n)) * (x * (R)(n)) / ths->b[d])
+        / SQRT(KPI * ths->b[d]);
+    case NFFT_WINDOW_B_SPLINE:
+      return Y(bsplines)(2 * ths->m, x * (R)(n) + (R)(ths->m)) / (R)(n);
+    case NFFT_WINDOW_SINC_POWER:
+    {
+      const R c = (R)(n) / ths->sigma[d] * (K(2.0) * ths->sigma[d] - K(1.0))
+        / (K(2.0) * (R)(ths->m));
+      return c * POW(Y(sinc)(KPI * c * x), (R)(2 * ths->m)) / (R)(n);
+    }
+    case NFFT_WINDOW_ES:
+      return phi_es(ths, n, x, d);
+    default:
+      return phi_configured(ths, n, x, d);
+  }
+}
+
+/** Fourier coefficients \f$\hat\varphi(k)\f$ of the window selected by
+ *  ths->window. */
+static inline R phi_hut(const X(plan) *ths, const INT n, const R k,
+  const INT d)
+{
+  switch (ths->window)
+  {
+    case NFFT_WINDOW_KAISER_BESSEL:
+    {
+      const R w = K2PI * k / (R)(n);
+      return Y(bessel_i0)((R)(ths->m) * SQRT(ths->b[d] * ths->b[d] - w * w));
+    }
+    case NFFT_WINDOW_GAUSSIAN:
+      return (R)EXP(-(KPI * k / (R)(n)) * (KPI * k / (R)(n)) * ths->b[d]);
+    case NFFT_WINDOW_B_SPLINE:
+      if (k == K(0.0))
+        return K(1.0) / (R)(n);
+      return POW(SIN(k * KPI / (R)(n)) / (k * KPI / (R)(n)), K(2.0) * (R)(ths->m))
+        / (R)(n);
+    case NFFT_WINDOW_SINC_POWER:
+      return Y(bsplines)(2 * ths->m, (K(2.0) * (R)(ths->m) * k)
+        / ((K(2.0) * ths->sigma[d] - K(1.0)) * (R)(n) / ths->sigma[d])
+        + (R)(ths->m));
+    case NFFT_WINDOW_ES:
+      return phi_hut_es(ths, n, k, d);
+    default:
+      return phi_hut_configured(ths, n, k, d);
+  }
+}
+
+#define PHI(n,x,d) phi(ths, (n), (x), (d))
+#define PHI_HUT(n,k,d) phi_hut(ths, (n), (R)(k), (d))
+
+/** Sets the shape parameters ths->b of the selected window. */
+static void window_init(X(plan) *ths)
+{
+  INT t;
+
+  if (ths->window == NFFT_WINDOW_DEFAULT)
+    ths->window = WINDOW_CONFIGURED;
+
+  ths->b = (R*) Y(malloc)((size_t)(ths->d) * sizeof(R));
+
+  for (t = 0; t < ths->d; t++)
+  {
+    switch (ths->window)
+    {
+      case NFFT_WINDOW_KAISER_BESSEL:
+        ths->b[t] = KPI * (K(2.0) - K(1.0) / ths->sigma[t]);
+        break;
+      case NFFT_WINDOW_GAUSSIAN:
+        ths->b[t] = (K(2.0) * ths->sigma[t]) / (K(2.0) * ths->sigma[t] - K(1.0))
+          * (((R)ths->m) / KPI);
+        break;
+      case NFFT_WINDOW_ES:
+        /* beta = 2.30 * (2m) for sigma = 2, cf. Barnett et al. (FINUFFT) */
+        ths->b[t] = K(0.97) * KPI * (R)(ths->m) * (K(2.0) - K(1.0) / ths->sigma[t]);
+        break;
+      default:
+        ths->b[t] = K(0.0);
+    }
+  }
+
+  /* The Fourier coefficients of the exponential of semicircle window are
+   * computed by quadrature, always tabulate them. */
+  if (ths->window == NFFT_WINDOW_ES)
+    ths->flags |= PRE_PHI_HUT;
+}
+
+static void window_finalize(X(plan) *ths)
+{
+  Y(free)(ths->b);
+}
+
+/* ## piecewise polynomial window for PRE_POLY_PSI  ######################### */
+
+/** Maximal degree of the polynomials fitted for PRE_POLY_PSI. */
+#define POLY_PSI_MAX_DEGREE 31
+
+/**
+ * Fits the window for flag PRE_POLY_PSI. For a node x = (c+z)/n with
+ * 0 <= z < 1, the value at the l-th grid point of its stencil is
+ * PHI((z+m-l)/n), l = 0,...,2m+1, a smooth function of z. Each of them is
+ * interpolated in s = 2z-1 at POLY_PSI_MAX_DEGREE+1 Chebyshev points, the
+ * Chebyshev series are truncated to a common degree where their coefficients
+ * reach the rounding level, and converted to the monomial basis.
+ *
+ * The coefficient of s^k for grid point l in dimension t is stored in
+ * psi[(t*(K+1)+k)*(2m+2)+l] with the degree K = poly_degree.
+ */
+static void poly_psi_init(X(plan) *ths)
+{
+  const INT w = 2 * ths->m + 2, np = POLY_PSI_MAX_DEGREE + 1;
+  R *cheb = (R*) Y(malloc)((size_t)(ths->d * w * np) * sizeof(R));
+  R val[np];
+  R cmax = K(0.0);
+  INT t, l, k, i, p = 0;
+
+  for (t = 0; t < ths->d; t++)
+  {
+    for (l = 0; l < w; l++)
+    {
+      R *c = cheb + (t * w + l) * np;
+
+      for (i = 0; i < np; i++)
+      {
+        const R s = COS(KPI * ((R)i + K(0.5)) / (R)np);
+        val[i] = PHI(ths->n[t], ((s + K(1.0)) / K(2.0) + (R)(ths->m - l))
+          / (R)ths->n[t], t);
+      }
+
+      for (k = 0; k < np; k++)
+      {
+        c[k] = K(0.0);
+        for (i = 0; i < np; i++)
+          c[k] += val[i] * COS(KPI * (R)k * ((R)i + K(0.5)) / (R)np);
+        c[k] *= (k == 0 ? K(1.0) : K(2.0)) / (R)np;
+        cmax = MAX(cmax, FABS(c[k]));
+      }
+    }
+  }
+
+  for (i = 0; i < ths->d * w; i++)
+    for (k = np - 1; k > p; k--)
+      if (FABS(cheb[i * np + k]) > K(10.0) * EPSILON * cmax)
+      {
+        p = k;
+        break;
+      }
+
+  ths->poly_degree = p;
+  ths->psi = (R*) Y(malloc)((size_t)(ths->d * (p + 1) * w) * sizeof(R));
+  memset(ths->psi, 0, (size_t)(ths->d * (p + 1) * w) * sizeof(R));
+
+  /* monomial coefficients by the three term recurrence of T_k */
+  for (t = 0; t < ths->d; t++)
+  {
+    R *a = ths->psi + t * (p + 1) * w;
+
+    for (l = 0; l < w; l++)
+    {
+      const R *c = cheb + (t * w + l) * np;
+      R T0[p + 2], T1[p + 2], T2[p + 2];
+
+      memset(T0, 0, sizeof(T0));
+      memset(T1, 0, sizeof(T1));
+      memset(T2, 0, sizeof(T2));
+      T0[0] = K(1.0);
+      T1[1] = K(1.0);
+
+      a[l] = c[0];
+
+      for (k = 1; k <= p; k++)
+      {
+        if (k > 1)
+        {
+          T2[0] = -T0[0];
+          for (i = 1; i <= k; i++)
+            T2[i] = K(2.0) * T1[i - 1] - T0[i];
+          memcpy(T0, T1, sizeof(T0));
+          memcpy(T1, T2, sizeof(T1));
+        }
+
+        for (i = 0; i <= k; i++)
+          a[i * w + l] += c[k] * T1[i];
+      }
+    }
+  }
+
+  Y(free)(cheb);
+}
+
+/**
+ * Window values psij[l] = PHI(x-(u+l)/n), l = 0,...,2m+1, of one node in
+ * dimension t, where u is the first grid point of its stencil. They are
+ * evaluated by Horner's scheme for all grid points at once for PRE_POLY_PSI,
+ * and by PHI otherwise.
+ */
+static inline void window_taps(const X(plan) *ths, const R x, const INT u,
+  const INT t, R *psij)
+{
+  const INT w = 2 * ths->m + 2;
+  INT l;
+
+  if (ths->flags & PRE_POLY_PSI)
+  {
+    const R s = K(2.0) * ((R)(ths->n[t]) * x - (R)(u + ths->m)) - K(1.0);
+    const R *a = ths->psi + t * (ths->poly_degree + 1) * w;
+    R acc[w];
+    INT k;
+
+    for (l = 0; l < w; l++)
+      acc[l] = a[ths->poly_degree * w + l];
+
+    for (k = ths->poly_degree - 1; k >= 0; k--)
+      for (l = 0; l < w; l++)
+        acc[l] = acc[l] * s + a[k * w + l];
+
+    memcpy(psij, acc, (size_t)(w) * sizeof(R));
+    return;
+  }
+
+  for (l = 0; l < w; l++)
+    psij[l] = PHI(ths->n[t], x - ((R)(u + l)) / ((R)ths->n[t]), t);
+}
+
 /** Compute aggregated product of integer array. */
 static inline INT intprod(const INT *vec, const INT a, const INT d)
 {
@@ -112,14 +483,160 @@ static inline void sort0(const INT d, const INT *n, const INT m,
  * Sort nodes (index) to get better cache utilization during multiplication
  * with matrix B.
  * The resulting index set is written to ths->index_x[2*j+1], the nodes array
- * remains unchanged.
+ * remains unchanged. The precomputations sort, once per set of nodes; the
+ * B-steps only read index_x.
  *
  * \arg ths nfft_plan
  */
-static inline void sort(const X(plan) *ths)
+static inline void sort(X(plan) *ths)
 {
   if (ths->flags & NFFT_SORT_NODES)
+  {
     sort0(ths->d, ths->n, ths->m, ths->M_total, ths->x, ths->index_x);
+    ths->index_x_sorted = 1;
+  }
+}
+
+/** Sorts the nodes of a plan without precomputation, or whose nodes were
+ *  not sorted yet, before its first B-step. */
+static inline void sort_once(X(plan) *ths)
+{
+  if ((ths->flags & NFFT_SORT_NODES) && !ths->index_x_sorted)
+    sort(ths);
+}
+
+/**
+ * Key of node j for flag NFFT_REORDER_NODES: the bits of the grid cell
+ * indices u_t are interleaved (Morton order), so that nodes close in space
+ * share cache lines of g. If the interleaved key does not fit, the row-major
+ * cell index of sort0 is used instead.
+ */
+static INT reorder_key(const X(plan) *ths, const INT j, const INT bits)
+{
+  INT t, b, key = 0;
+  INT u[ths->d];
+
+  for (t = 0; t < ths->d; t++)
+  {
+    const INT help = (INT) LRINT(FLOOR((R)(ths->n[t]) * ths->x[ths->d * j + t]
+      - (R)(ths->m)));
+    u[t] = (help % ths->n[t] + ths->n[t]) % ths->n[t];
+  }
+
+  if (bits * ths->d > (INT)(8 * sizeof(INT)) - 2)
+  {
+    for (t = 0; t < ths->d; t++)
+      key = key * ths->n[t] + u[t];
+    return key;
+  }
+
+  for (b = bits - 1; b >= 0; b--)
+    for (t = 0; t < ths->d; t++)
+      key = (key << 1) | ((u[t] >> b) & 1);
+
+  return key;
+}
+
+/**
+ * Physically reorders the nodes x for flag NFFT_REORDER_NODES, so that the
+ * B-step and all precomputed data run through the nodes sequentially.
+ * ths->x is permuted in place and ths->perm_x is set such that x[j] is the
+ * node found at position perm_x[j] of x before the call; the order of an
+ * earlier precomputation is not composed with, as the caller may have
+ * written new nodes into x since.
+ */
+static void reorder_nodes(X(plan) *ths)
+{
+  const INT d = ths->d, M = ths->M_total;
+  INT j, t, bits = 0, rhigh;
+  INT *keys = (INT*) Y(malloc)(2 * (size_t)(M) * sizeof(INT));
+  INT *keys_temp = (INT*) Y(malloc)(2 * (size_t)(M) * sizeof(INT));
+  R *x = (R*) Y(malloc)((size_t)(d * M) * sizeof(R));
+
+  for (t = 0; t < d; t++)
+  {
+    INT n2, bits_t;
+    Y(next_power_of_2_exp)(ths->n[t], &n2, &bits_t);
+    bits = MAX(bits, bits_t);
+  }
+
+  for (j = 0; j < M; j++)
+  {
+    keys[2 * j] = reorder_key(ths, j, bits);
+    keys[2 * j + 1] = j;
+  }
+
+  if (bits * d > (INT)(8 * sizeof(INT)) - 2)
+    rhigh = (INT) LRINT(CEIL(LOG2((R)(ths->n_total)))) - 1;
+  else
+    rhigh = bits * d - 1;
+
+  Y(sort_node_indices_radix_lsdf)(M, keys, keys_temp, rhigh);
+
+  memcpy(x, ths->x, (size_t)(d * M) * sizeof(R));
+
+  for (j = 0; j < M; j++)
+  {
+    const INT j_old = keys[2 * j + 1];
+
+    for (t = 0; t < d; t++)
+      ths->x[d * j + t] = x[d * j_old + t];
+
+    ths->perm_x[j] = j_old;
+  }
+
+  Y(free)(x);
+  Y(free)(keys_temp);
+  Y(free)(keys);
+}
+
+/** Whether f is exchanged with the caller in its own order, flag
+ *  NFFT_REORDER_NODES without NFFT_SORTED_IO. */
+static inline int permute_f(const X(plan) *ths)
+{
+  return (ths->flags & NFFT_REORDER_NODES) && !(ths->flags & NFFT_SORTED_IO);
+}
+
+/** Gathers f from the caller order into the node order in ths->f_perm. */
+static void f_to_node_order(const X(plan) *ths)
+{
+  const INT howmany = (ths->flags & NFFT_REAL) ? 1 : ths->howmany;
+  INT j;
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) private(j)
+#endif
+  for (j = 0; j < ths->M_total; j++)
+  {
+    INT k;
+
+    if (ths->flags & NFFT_REAL)
+      ((R*)ths->f_perm)[j] = ths->f_real[ths->perm_x[j]];
+    else
+      for (k = 0; k < howmany; k++)
+        ths->f_perm[k * ths->M_total + j] = ths->f[k * ths->M_total + ths->perm_x[j]];
+  }
+}
+
+/** Scatters ths->f_perm from the node order back into the caller order. */
+static void f_from_node_order(const X(plan) *ths)
+{
+  const INT howmany = (ths->flags & NFFT_REAL) ? 1 : ths->howmany;
+  INT j;
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) private(j)
+#endif
+  for (j = 0; j < ths->M_total; j++)
+  {
+    INT k;
+
+    if (ths->flags & NFFT_REAL)
+      ths->f_real[ths->perm_x[j]] = ((R*)ths->f_perm)[j];
+    else
+      for (k = 0; k < howmany; k++)
+        ths->f[k * ths->M_total + ths->perm_x[j]] = ths->f_perm[k * ths->M_total + j];
+  }
 }
 
 /** direct computation of non equispaced fourier transforms
@@ -142,10 +659,8 @@ static inline void sort(const X(plan) *ths)
  * for k in I_N^d
  *  f_hat[k] = sum_{j=0}^{M_total-1} f[j] * exp(-2(pi) k x[j])
  */
-void X(trafo_direct)(const X(plan) *ths)
+static void trafo_direct_help(const X(plan) *ths, C *f_hat, C *f)
 {
-  C *f_hat = (C*)ths->f_hat, *f = (C*)ths->f;
-
   memset(f, 0, (size_t)(ths->M_total) * sizeof(C));
 
   if (ths->d == 1)
@@ -204,10 +719,8 @@ void X(trafo_direct)(const X(plan) *ths)
   }
 }
 
-void X(adjoint_direct)(const X(plan) *ths)
+static void adjoint_direct_help(const X(plan) *ths, C *f_hat, C *f)
 {
-  C *f_hat = (C*)ths->f_hat, *f = (C*)ths->f;
-
   memset(f_hat, 0, (size_t)(ths->N_total) * sizeof(C));
 
   if (ths->d == 1)
@@ -296,47 +809,230 @@ void X(adjoint_direct)(const X(plan) *ths)
   }
 }
 
-/** fast computation of non-equispaced fourier transforms
- *  require O(N^d log(N) + M_total) arithmetical operations
- *
- * fast computation of the nfft_trafo and nfft_conjugated, formula (1.1)
- * nfft_trafo:
- * for j=0,...,M_total-1
- *  f[j] = sum_{k in I_N^d} f_hat[k] * exp(-2 (pi) k x[j])
- * nfft_conjugated:
- * for j=0,...,M_total-1
- *  f[j] = sum_{k in I_N^d} f_hat[k] * exp(+2 (pi) k x[j])
- *
- * direct computation of the nfft_adjoint and nfft_transposed, formula (1.2)
- * nfft_adjoint:
- * for k in I_N^d
- *  f_hat[k] = sum_{j=0}^{M_total-1} f[j] * exp(+2(pi) k x[j])
- * nfft_transposed:
- * for k in I_N^d
- *  f_hat[k] = sum_{j=0}^{M_total-1} f[j] * exp(-2(pi) k x[j])
- */
-
-/** macros and small sub routines for the fast transforms
- */
-
-/** computes 2m+2 indices for the matrix B
- */
-static inline void uo(const X(plan) *ths, const INT j, INT *up, INT *op,
-  const INT act_dim)
+/** Direct transforms for flag NFFT_REAL, where f_hat holds the coefficients
+ *  with k_{d-1} >= 0 and the others follow from f_hat_{-k} = conj(f_hat_k). */
+static void trafo_direct_real(const X(plan) *ths)
 {
-  const R xj = ths->x[j * ths->d + act_dim];
-  INT c = LRINT(FLOOR(xj * (R)(ths->n[act_dim])));
+  const INT N_hat = ths->N_total / ths->N[ths->d - 1] * (ths->N[ths->d - 1] / 2);
+  INT j;
 
-  (*up) = c - (ths->m);
-  (*op) = c + 1 + (ths->m);
-}
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) private(j)
+#endif
+  for (j = 0; j < ths->M_total; j++)
+  {
+    R fj = K(0.0);
+    INT k_L;
 
-static inline void uo2(INT *u, INT *o, const R x, const INT n, const INT m)
-{
-  INT c = LRINT(FLOOR(x * (R)(n)));
+    for (k_L = 0; k_L < N_hat; k_L++)
+    {
+      INT t, k_temp = k_L, k_last = 0;
+      R omega = K(0.0);
 
-  *u = (c - m + n) % n;
-  *o = (c + 1 + m + n) % n;
+      for (t = ths->d - 1; t >= 0; t--)
+      {
+        const INT N_t = (t == ths->d - 1) ? ths->N[t] / 2 : ths->N[t];
+        const INT k_t = k_temp % N_t - ((t == ths->d - 1) ? 0 : ths->N[t] / 2);
+        omega += (R)k_t * K2PI * ths->x[j * ths->d + t];
+        k_temp /= N_t;
+        if (t == ths->d - 1)
+          k_last = k_t;
+      }
+
+      fj += (k_last == 0 ? K(1.0) : K(2.0))
+        * CREAL(ths->f_hat[k_L] * BASE(-II * omega));
+    }
+
+    ths->f_real[j] = fj;
+  }
+}
+
+static void adjoint_direct_real(const X(plan) *ths)
+{
+  const INT N_hat = ths->N_total / ths->N[ths->d - 1] * (ths->N[ths->d - 1] / 2);
+  INT k_L;
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) private(k_L)
+#endif
+  for (k_L = 0; k_L < N_hat; k_L++)
+  {
+    INT t, j, k[ths->d], k_temp = k_L;
+    C f_hat_k = K(0.0);
+
+    for (t = ths->d - 1; t >= 0; t--)
+    {
+      const INT N_t = (t == ths->d - 1) ? ths->N[t] / 2 : ths->N[t];
+      k[t] = k_temp % N_t - ((t == ths->d - 1) ? 0 : ths->N[t] / 2);
+      k_temp /= N_t;
+    }
+
+    for (j = 0; j < ths->M_total; j++)
+    {
+      R omega = K(0.0);
+
+      for (t = 0; t < ths->d; t++)
+        omega += (R)k[t] * K2PI * ths->x[j * ths->d + t];
+
+      f_hat_k += ths->f_real[j] * BASE(II * omega);
+    }
+
+    ths->f_hat[k_L] = f_hat_k;
+  }
+}
+
+/** Direct transforms with f in the order of the nodes x. */
+static void trafo_direct_nodes(const X(plan) *ths)
+{
+  INT k;
+
+  if (ths->flags & NFFT_REAL)
+  {
+    trafo_direct_real(ths);
+    return;
+  }
+
+  if (ths->flags & NFFT_FFT_ORDER)
+  {
+    /* the direct transforms work on f_hat in centred order */
+    C *f_hat = (C*) Y(malloc)((size_t)(ths->N_total) * sizeof(C));
+
+    for (k = 0; k < ths->howmany; k++)
+    {
+      memcpy(f_hat, ths->f_hat + k * ths->N_total, (size_t)(ths->N_total) * sizeof(C));
+      Y(fftshift_complex)(f_hat, ths->d, ths->N);
+      trafo_direct_help(ths, f_hat, ths->f + k * ths->M_total);
+    }
+
+    Y(free)(f_hat);
+    return;
+  }
+
+  for (k = 0; k < ths->howmany; k++)
+    trafo_direct_help(ths, ths->f_hat + k * ths->N_total,
+      ths->f + k * ths->M_total);
+}
+
+static void adjoint_direct_nodes(const X(plan) *ths)
+{
+  INT k;
+
+  if (ths->flags & NFFT_REAL)
+  {
+    adjoint_direct_real(ths);
+    return;
+  }
+
+  for (k = 0; k < ths->howmany; k++)
+  {
+    adjoint_direct_help(ths, ths->f_hat + k * ths->N_total,
+      ths->f + k * ths->M_total);
+
+    if (ths->flags & NFFT_FFT_ORDER)
+      Y(fftshift_complex)(ths->f_hat + k * ths->N_total, ths->d, ths->N);
+  }
+}
+
+static void trafo_direct(const X(plan) *ths)
+{
+  if (permute_f(ths))
+  {
+    X(plan) p = *ths;
+    p.f = ths->f_perm;
+    p.f_real = (R*)ths->f_perm;
+    trafo_direct_nodes(&p);
+    f_from_node_order(ths);
+  }
+  else
+    trafo_direct_nodes(ths);
+}
+
+static void adjoint_direct(const X(plan) *ths)
+{
+  if (permute_f(ths))
+  {
+    X(plan) p = *ths;
+    f_to_node_order(ths);
+    p.f = ths->f_perm;
+    p.f_real = (R*)ths->f_perm;
+    adjoint_direct_nodes(&p);
+  }
+  else
+    adjoint_direct_nodes(ths);
+}
+
+/** fast computation of non-equispaced fourier transforms
+ *  require O(N^d log(N) + M_total) arithmetical operations
+ *
+ * fast computation of the nfft_trafo and nfft_conjugated, formula (1.1)
+ * nfft_trafo:
+ * for j=0,...,M_total-1
+ *  f[j] = sum_{k in I_N^d} f_hat[k] * exp(-2 (pi) k x[j])
+ * nfft_conjugated:
+ * for j=0,...,M_total-1
+ *  f[j] = sum_{k in I_N^d} f_hat[k] * exp(+2 (pi) k x[j])
+ *
+ * direct computation of the nfft_adjoint and nfft_transposed, formula (1.2)
+ * nfft_adjoint:
+ * for k in I_N^d
+ *  f_hat[k] = sum_{j=0}^{M_total-1} f[j] * exp(+2(pi) k x[j])
+ * nfft_transposed:
+ * for k in I_N^d
+ *  f_hat[k] = sum_{j=0}^{M_total-1} f[j] * exp(-2(pi) k x[j])
+ */
+
+/** macros and small sub routines for the fast transforms
+ */
+
+/** computes 2m+2 indices for the matrix B
+ */
+static inline void uo(const X(plan) *ths, const INT j, INT *up, INT *op,
+  const INT act_dim)
+{
+  const R xj = ths->x[j * ths->d + act_dim];
+  INT c = LRINT(FLOOR(xj * (R)(ths->n[act_dim])));
+
+  (*up) = c - (ths->m);
+  (*op) = c + 1 + (ths->m);
+}
+
+static inline void uo2(INT *u, INT *o, const R x, const INT n, const INT m)
+{
+  INT c = LRINT(FLOOR(x * (R)(n)));
+
+  *u = (c - m + n) % n;
+  *o = (c + 1 + m + n) % n;
+}
+
+/** Start in f_hat of the negative (nonneg = 0) or non-negative (nonneg = 1)
+ *  frequencies of dimension t. Flag NFFT_FFT_ORDER swaps the two halves. */
+static inline INT f_hat_half(const X(plan) *ths, const INT t, const int nonneg)
+{
+  return (nonneg == !(ths->flags & NFFT_FFT_ORDER)) ? ths->N[t] / 2 : 0;
+}
+
+/** Index in f_hat of the frequency with centred index ks and index kp in FFT
+ *  order. */
+#define F_HAT_INDEX(kp, ks) ((ths->flags & NFFT_FFT_ORDER) ? (kp) : (ks))
+
+/** Zero g_hat before the D-step writes the coefficients, unless its zero
+ *  padding is left from the last transform. */
+static void g_hat_clear(X(plan) *ths)
+{
+  if (ths->g_hat_zero_padded)
+    return;
+
+#ifdef _OPENMP
+  {
+    INT k;
+
+    #pragma omp parallel for default(shared) private(k)
+    for (k = 0; k < ths->n_total; k++)
+      ths->g_hat[k] = K(0.0);
+  }
+#else
+  memset(ths->g_hat, 0, (size_t)(ths->n_total) * sizeof(C));
+#endif
 }
 
 #define MACRO_D_compute_A \
@@ -349,7 +1045,7 @@ static inline void uo2(INT *u, INT *o, const R x, const INT n, const INT m)
   f_hat[ks_plain[ths->d]] = g_hat[k_plain[ths->d]] * c_phi_inv_k[ths->d]; \
 }
 
-#define MACRO_D_init_result_A memset(g_hat, 0, (size_t)(ths->n_total) * sizeof(C));
+#define MACRO_D_init_result_A g_hat_clear(ths);
 
 #define MACRO_D_init_result_T memset(f_hat, 0, (size_t)(ths->N_total) * sizeof(C));
 
@@ -372,7 +1068,7 @@ static inline void uo2(INT *u, INT *o, const R x, const INT n, const INT m)
   for (t2 = t; t2 < ths->d; t2++) \
   { \
     c_phi_inv_k[t2+1] = c_phi_inv_k[t2] MACRO_ ##which_one; \
-    ks_plain[t2+1] = ks_plain[t2]*ths->N[t2] + ks[t2]; \
+    ks_plain[t2+1] = ks_plain[t2]*ths->N[t2] + F_HAT_INDEX(kp[t2], ks[t2]); \
     k_plain[t2+1] = k_plain[t2]*ths->n[t2] + k[t2]; \
   } \
 }
@@ -443,7 +1139,7 @@ static inline void D_openmp_A(X(plan) *ths)
   INT k_L;                              /**< plain index                    */
 
   f_hat = (C*)ths->f_hat; g_hat = (C*)ths->g_hat;
-  memset(g_hat, 0, ths->n_total * sizeof(C));
+  g_hat_clear(ths);
 
   if (ths->flags & PRE_PHI_HUT)
   {
@@ -473,7 +1169,7 @@ static inline void D_openmp_A(X(plan) *ths)
       for (t = 0; t < ths->d; t++)
       {
         c_phi_inv_k_val *= ths->c_phi_inv[t][ks[t]];
-        ks_plain_val = ks_plain_val*ths->N[t] + ks[t];
+        ks_plain_val = ks_plain_val*ths->N[t] + F_HAT_INDEX(kp[t], ks[t]);
         k_plain_val = k_plain_val*ths->n[t] + k[t];
       }
 
@@ -508,7 +1204,7 @@ static inline void D_openmp_A(X(plan) *ths)
       for (t = 0; t < ths->d; t++)
       {
         c_phi_inv_k_val /= (PHI_HUT(ths->n[t],ks[t]-(ths->N[t]/2),t));
-        ks_plain_val = ks_plain_val*ths->N[t] + ks[t];
+        ks_plain_val = ks_plain_val*ths->N[t] + F_HAT_INDEX(kp[t], ks[t]);
         k_plain_val = k_plain_val*ths->n[t] + k[t];
       }
 
@@ -568,7 +1264,7 @@ static void D_openmp_T(X(plan) *ths)
       for (t = 0; t < ths->d; t++)
       {
         c_phi_inv_k_val *= ths->c_phi_inv[t][ks[t]];
-        ks_plain_val = ks_plain_val*ths->N[t] + ks[t];
+        ks_plain_val = ks_plain_val*ths->N[t] + F_HAT_INDEX(kp[t], ks[t]);
         k_plain_val = k_plain_val*ths->n[t] + k[t];
       }
 
@@ -603,7 +1299,7 @@ static void D_openmp_T(X(plan) *ths)
       for (t = 0; t < ths->d; t++)
       {
         c_phi_inv_k_val /= (PHI_HUT(ths->n[t],ks[t]-(ths->N[t]/2),t));
-        ks_plain_val = ks_plain_val*ths->N[t] + ks[t];
+        ks_plain_val = ks_plain_val*ths->N[t] + F_HAT_INDEX(kp[t], ks[t]);
         k_plain_val = k_plain_val*ths->n[t] + k[t];
       }
 
@@ -832,8 +1528,6 @@ static inline void B_serial_ ## which_one (X(plan) *ths) \
 \
   if (ths->flags & PRE_PSI) \
   { \
-    sort(ths); \
- \
     for (k = 0; k < ths->M_total; k++) \
     { \
       INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k; \
@@ -847,8 +1541,6 @@ static inline void B_serial_ ## which_one (X(plan) *ths) \
  \
   if (ths->flags & PRE_FG_PSI) \
   { \
-    sort(ths); \
- \
     for(t2 = 0; t2 < ths->d; t2++) \
     { \
       tmpEXP2 = EXP(K(-1.0) / ths->b[t2]); \
@@ -888,8 +1580,6 @@ static inline void B_serial_ ## which_one (X(plan) *ths) \
  \
   if (ths->flags & FG_PSI) \
   { \
-    sort(ths); \
- \
     for (t2 = 0; t2 < ths->d; t2++) \
     { \
       tmpEXP2 = EXP(K(-1.0)/ths->b[t2]); \
@@ -931,8 +1621,6 @@ static inline void B_serial_ ## which_one (X(plan) *ths) \
  \
   if (ths->flags & PRE_LIN_PSI) \
   { \
-    sort(ths); \
- \
     for (k = 0; k<ths->M_total; k++) \
     { \
       INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k; \
@@ -957,8 +1645,6 @@ static inline void B_serial_ ## which_one (X(plan) *ths) \
     } /* for(j) */ \
     return; \
   } /* if(PRE_LIN_PSI) */ \
- \
-  sort(ths); \
  \
   /* no precomputed psi at all */ \
   for (k = 0; k < ths->M_total; k++) \
@@ -971,10 +1657,8 @@ static inline void B_serial_ ## which_one (X(plan) *ths) \
  \
     for (t2 = 0; t2 < ths->d; t2++) \
     { \
-      INT lj_t; \
-      for (lj_t = 0; lj_t < 2*ths->m+2; lj_t++) \
-        psij_const[t2 * (2*ths->m+2) + lj_t] = PHI(ths->n[t2], ths->x[j*ths->d+t2] \
-                - ((R) (lj_t+u[t2]))/((R)ths->n[t2]), t2); \
+      window_taps(ths, ths->x[j*ths->d+t2], u[t2], t2, \
+        psij_const + t2 * (2*ths->m+2)); \
     } \
  \
     MACRO_B_COMPUTE_ONE_NODE(which_one,without_PRE_PSI_improved); \
@@ -1058,10 +1742,8 @@ MACRO_B(A)
 #define MACRO_B_openmp_A_COMPUTE_BEFORE_LOOP_without_PRE_PSI \
     for (t2 = 0; t2 < ths->d; t2++) \
     { \
-      INT lj_t; \
-      for (lj_t = 0; lj_t < 2*ths->m+2; lj_t++) \
-        psij_const[t2 * (2*ths->m+2) + lj_t] = PHI(ths->n[t2], ths->x[j*ths->d+t2] \
-                - ((R) (lj_t+u[t2]))/((R)ths->n[t2]), t2); \
+      window_taps(ths, ths->x[j*ths->d+t2], u[t2], t2, \
+        psij_const + t2 * (2*ths->m+2)); \
     }
 #define MACRO_B_openmp_A_COMPUTE_UPDATE_without_PRE_PSI \
   MACRO_update_phi_prod_ll_plain(without_PRE_PSI_improved);
@@ -1228,8 +1910,6 @@ static inline void B_openmp_A (X(plan) *ths)
     INT t, t2; /* index dimensions */
     R fg_exp_l[ths->d][2*ths->m+2];
 
-    sort(ths);
-
     MACRO_B_openmp_A_COMPUTE_INIT_FG_PSI
 
     #pragma omp parallel for default(shared) private(k,t,t2)
@@ -1246,8 +1926,6 @@ static inline void B_openmp_A (X(plan) *ths)
 
   if (ths->flags & PRE_LIN_PSI)
   {
-    sort(ths);
-
     #pragma omp parallel for default(shared) private(k)
     for (k = 0; k<ths->M_total; k++)
     {
@@ -1265,8 +1943,6 @@ static inline void B_openmp_A (X(plan) *ths)
   } /* if(PRE_LIN_PSI) */
 
   /* no precomputed psi at all */
-  sort(ths);
-
   #pragma omp parallel for default(shared) private(k)
   for (k = 0; k < ths->M_total; k++)
   {
@@ -1661,10 +2337,8 @@ MACRO_B(T)
       R psij_const[ths->d * (2*ths->m+2)]; \
       for (t2 = 0; t2 < ths->d; t2++) \
       { \
-        INT lj_t; \
-        for (lj_t = 0; lj_t < 2*ths->m+2; lj_t++) \
-          psij_const[t2 * (2*ths->m+2) + lj_t] = PHI(ths->n[t2], ths->x[j*ths->d+t2] \
-                  - ((R) (lj_t+u[t2]))/((R)ths->n[t2]), t2); \
+        window_taps(ths, ths->x[j*ths->d+t2], u[t2], t2, \
+          psij_const + t2 * (2*ths->m+2)); \
       }
 #define MACRO_adjoint_nd_B_OMP_COMPUTE_UPDATE_without_PRE_PSI \
   MACRO_update_phi_prod_ll_plain(without_PRE_PSI_improved);
@@ -2038,8 +2712,6 @@ static inline void B_openmp_T(X(plan) *ths)
     INT t, t2; /* index dimensions */
     R fg_exp_l[ths->d][2*ths->m+2];
 
-    sort(ths);
-
     for (t2 = 0; t2 < ths->d; t2++)
     {
       INT lj_fg;
@@ -2069,8 +2741,6 @@ static inline void B_openmp_T(X(plan) *ths)
 
   if (ths->flags & PRE_LIN_PSI)
   {
-    sort(ths);
-
     MACRO_adjoint_nd_B_OMP_BLOCKWISE(with_PRE_LIN_PSI);
 
     #pragma omp parallel for default(shared) private(k)
@@ -2084,8 +2754,6 @@ static inline void B_openmp_T(X(plan) *ths)
   } /* if(PRE_LIN_PSI) */
 
   /* no precomputed psi at all */
-  sort(ths);
-
   MACRO_adjoint_nd_B_OMP_BLOCKWISE(without_PRE_PSI);
 
   #pragma omp parallel for default(shared) private(k)
@@ -2098,2374 +2766,5033 @@ static inline void B_openmp_T(X(plan) *ths)
 }
 #endif
 
-static void B_T(X(plan) *ths)
+/* ## tiled adjoint B-step  ################################################# */
+
+/** Target edge length of the tiles of the tiled adjoint B-step, chosen such
+ *  that a padded tile stays in the L2 cache. */
+static inline INT tile_length(const INT d)
 {
-#ifdef _OPENMP
-  B_openmp_T(ths);
-#else
-  B_serial_T(ths);
-#endif
+  return d == 1 ? 1024 : (d == 2 ? 64 : (d == 3 ? 16 : 8));
 }
 
-/* ## specialized version for d=1  ########################################### */
-
-static void nfft_1d_init_fg_exp_l(R *fg_exp_l, const INT m, const R b)
+/** Tile of node j in dimension t. Returns the offset of the first grid point
+ *  of the stencil of x_j relative to the start of the tile in lo. */
+static inline INT tile_of_node(const X(plan) *ths, const INT j, const INT t,
+  const INT nt, const INT *start, INT *lo)
 {
-  const INT tmp2 = 2*m+2;
-  INT l;
-  R fg_exp_b0, fg_exp_b1, fg_exp_b2, fg_exp_b0_sq;
+  const INT n = ths->n[t];
+  INT u, o, i;
 
-  fg_exp_b0 = EXP(K(-1.0)/b);
-  fg_exp_b0_sq = fg_exp_b0*fg_exp_b0;
-  fg_exp_b1 = fg_exp_b2 =fg_exp_l[0] = K(1.0);
+  uo(ths, j, &u, &o, t);
+  u = ((u % n) + n) % n;
 
-  for (l = 1; l < tmp2; l++)
-  {
-    fg_exp_b2 = fg_exp_b1*fg_exp_b0;
-    fg_exp_b1 *= fg_exp_b0_sq;
-    fg_exp_l[l] = fg_exp_l[l-1]*fg_exp_b2;
-  }
-}
+  for (i = (u * nt) / n; start[i + 1] <= u; i++) ;
+  for (; start[i] > u; i--) ;
 
+  *lo = u - start[i];
+  return i;
+}
 
-static void nfft_trafo_1d_compute(C *fj, const C *g,const R *psij_const,
-  const R *xj, const INT n, const INT m)
+/** Tiling of the grid for the tiled adjoint B-step, nt[t] tiles in dimension
+ *  t, an even number unless there is only one. Tile i of dimension t starts
+ *  at grid point (*start)[start_off[t] + i]. Returns the number of tiles. */
+static INT tiles(const X(plan) *ths, INT *nt, INT *start_off, INT **start)
 {
-  INT u, o, l;
-  const C *gj;
-  const R *psij;
-  psij = psij_const;
-
-  uo2(&u, &o, *xj, n, m);
+  const INT d = ths->d, ghost = 2 * ths->m + 1;
+  INT t, i, ntiles;
 
-  if (u < o)
+  for (t = 0, ntiles = 1, start_off[0] = 0; t < d; t++)
   {
-    for (l = 1, gj = g + u, (*fj) = (*psij++) * (*gj++); l <= 2*m+1; l++)
-      (*fj) += (*psij++) * (*gj++);
-  }
-  else
-  {
-    for (l = 1, gj = g + u, (*fj) = (*psij++) * (*gj++); l < 2*m+1 - o; l++)
-      (*fj) += (*psij++) * (*gj++);
-    for (l = 0, gj = g; l <= o; l++)
-      (*fj) += (*psij++) * (*gj++);
+    nt[t] = ths->n[t] / MAX(tile_length(d), ghost);
+    if (nt[t] > 1)
+      nt[t] -= nt[t] % 2;
+    nt[t] = MAX(nt[t], 1);
+
+    ntiles *= nt[t];
+    start_off[t + 1] = start_off[t] + nt[t] + 1;
   }
+
+  *start = (INT*) Y(malloc)((size_t)(start_off[d]) * sizeof(INT));
+
+  for (t = 0; t < d; t++)
+    for (i = 0; i <= nt[t]; i++)
+      (*start)[start_off[t] + i] = (i * ths->n[t]) / nt[t];
+
+  return ntiles;
 }
 
-#ifndef _OPENMP
-static void nfft_adjoint_1d_compute_serial(const C *fj, C *g,
-    const R *psij_const, const R *xj, const INT n, const INT m)
+/** Bins the nodes by the tile that holds the first point of their stencil,
+ *  keeping their order within a tile. The nodes of tile i are tile_nodes[k]
+ *  for tile_ptr[i] <= k < tile_ptr[i + 1]. */
+static void tiles_bin(const X(plan) *ths, const INT *nt, const INT *start_off,
+  const INT *start, const INT ntiles, INT *tile_ptr, INT *tile_nodes)
 {
-  INT u,o,l;
-  C *gj;
-  const R *psij;
-  psij = psij_const;
-
-  uo2(&u,&o,*xj, n, m);
+  INT *node_tile = (INT*) Y(malloc)((size_t)(ths->M_total) * sizeof(INT));
+  INT j, t;
 
-  if (u < o)
-  {
-    for (l = 0, gj = g+u; l <= 2*m+1; l++)
-      (*gj++) += (*psij++) * (*fj);
-  }
-  else
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) private(j,t)
+#endif
+  for (j = 0; j < ths->M_total; j++)
   {
-    for (l = 0, gj = g+u; l < 2*m+1-o; l++)
-      (*gj++) += (*psij++) * (*fj);
-    for (l = 0, gj = g; l <= o; l++)
-      (*gj++) += (*psij++) * (*fj);
+    INT tile = 0, lo;
+
+    for (t = 0; t < ths->d; t++)
+      tile = tile * nt[t] + tile_of_node(ths, j, t, nt[t],
+        start + start_off[t], &lo);
+
+    node_tile[j] = tile;
   }
+
+  memset(tile_ptr, 0, (size_t)(ntiles + 1) * sizeof(INT));
+
+  for (j = 0; j < ths->M_total; j++)
+    tile_ptr[node_tile[j] + 1]++;
+
+  for (j = 0; j < ntiles; j++)
+    tile_ptr[j + 1] += tile_ptr[j];
+
+  for (j = 0; j < ths->M_total; j++)
+    tile_nodes[tile_ptr[node_tile[j]]++] = j;
+
+  for (j = ntiles; j > 0; j--)
+    tile_ptr[j] = tile_ptr[j - 1];
+
+  tile_ptr[0] = 0;
+
+  Y(free)(node_tile);
 }
-#endif
 
-#ifdef _OPENMP
-/* adjoint NFFT one-dimensional case with OpenMP atomic operations */
-static void nfft_adjoint_1d_compute_omp_atomic(const C f, C *g,
-    const R *psij_const, const R *xj, const INT n, const INT m)
+/** Bins the nodes once for flag NFFT_OMP_TILED_ADJOINT with precomputed psi.
+ *  Without, the nodes may change between transforms and B_tiled_T bins them
+ *  on every call. */
+static void precompute_tiles(X(plan) *ths)
 {
-  INT u,o,l;
-  C *gj;
-  INT index_temp[2*m+2];
+  INT nt[ths->d], start_off[ths->d + 1], ntiles;
+  INT *start;
 
-  uo2(&u,&o,*xj, n, m);
+  Y(free)(ths->tile_ptr);
+  Y(free)(ths->tile_nodes);
+  ths->tile_ptr = ths->tile_nodes = NULL;
 
-  for (l=0; l<=2*m+1; l++)
-    index_temp[l] = (l+u)%n;
+  if (!(ths->flags & NFFT_OMP_TILED_ADJOINT) || !(ths->flags & PRE_ONE_PSI))
+    return;
 
-  for (l = 0, gj = g+u; l <= 2*m+1; l++)
-  {
-    INT i = index_temp[l];
-    C *lhs = g+i;
-    R *lhs_real = (R*)lhs;
-    C val = psij_const[l] * f;
-    #pragma omp atomic
-    lhs_real[0] += CREAL(val);
+  ntiles = tiles(ths, nt, start_off, &start);
 
-    #pragma omp atomic
-    lhs_real[1] += CIMAG(val);
-  }
+  ths->tile_ptr = (INT*) Y(malloc)((size_t)(ntiles + 1) * sizeof(INT));
+  ths->tile_nodes = (INT*) Y(malloc)((size_t)(ths->M_total) * sizeof(INT));
+  tiles_bin(ths, nt, start_off, start, ntiles, ths->tile_ptr, ths->tile_nodes);
+
+  Y(free)(start);
 }
-#endif
 
-#ifdef _OPENMP
 /**
- * Adjoint NFFT for one-dimensional case updating only a specified range of
- * vector g.
+ * Adjoint B-step with private tiles, used for flag NFFT_OMP_TILED_ADJOINT.
  *
- * \arg f input coefficient f[j]
- * \arg g output vector g
- * \arg psij_const vector of window function values
- * \arg xj node x[j]
- * \arg n FFTW length (number oversampled Fourier coefficients)
- * \arg m window length
- * \arg my_u0 lowest index the current thread writes to in g
- * \arg my_o0 highest index the current thread writes to in g
+ * The oversampled grid is split into tiles of at least 2m+1 points per
+ * dimension and the nodes are binned by the tile that holds the first point
+ * of their stencil. A tile is spread into a private buffer padded by 2m+1
+ * ghost points per dimension, so that no write goes to shared memory. The
+ * buffer is added to g afterwards, wrapping around periodically. Since it
+ * overlaps the next tile only, tiles are processed in 2^d colours by the
+ * parity of their multi index (with an even number of tiles per dimension),
+ * and tiles of one colour are added concurrently without any atomics. The
+ * result does not depend on the number of threads.
  *
- * \author Toni Volkmer
+ * The flag takes effect without OpenMP as well, where the tiles keep the
+ * writes to g within the cache. The bins are kept in the plan, see
+ * precompute_tiles, the tile buffers are allocated per call such that
+ * nfft_adjoint_execute stays re-entrant.
+ *
+ * The window values are read from psi for PRE_PSI and PRE_FULL_PSI and are
+ * evaluated otherwise.
  */
-static void nfft_adjoint_1d_compute_omp_blockwise(const C f, C *g,
-    const R *psij_const, const R *xj, const INT n, const INT m,
-    const INT my_u0, const INT my_o0)
+static void B_tiled_T(X(plan) *ths)
 {
-  INT ar_u,ar_o,l;
+  const INT d = ths->d, w = 2 * ths->m + 2, ghost = 2 * ths->m + 1;
+  INT nt[d], start_off[d + 1];
+  INT t, ntiles, lprod, buf_size, colour;
+  INT *start, *tile_ptr, *tile_nodes;
 
-  uo2(&ar_u,&ar_o,*xj, n, m);
+  memset(ths->g, 0, (size_t)(ths->n_total) * sizeof(C));
 
-  if (ar_u < ar_o)
+  ntiles = tiles(ths, nt, start_off, &start);
+
+  for (t = 0, lprod = 1, buf_size = 1; t < d; t++)
   {
-    INT u = MAX(my_u0,ar_u);
-    INT o = MIN(my_o0,ar_o);
-    INT offset_psij = u-ar_u;
-#ifdef OMP_ASSERT
-    assert(offset_psij >= 0);
-    assert(o-u <= 2*m+1);
-    assert(offset_psij+o-u <= 2*m+1);
-#endif
+    lprod *= w;
+    buf_size *= (ths->n[t] + nt[t] - 1) / nt[t] + ghost;
+  }
 
-    for (l = 0; l <= o-u; l++)
-      g[u+l] += psij_const[offset_psij+l] * f;
+  if (ths->tile_ptr)
+  {
+    tile_ptr = ths->tile_ptr;
+    tile_nodes = ths->tile_nodes;
   }
   else
   {
-    INT u = MAX(my_u0,ar_u);
-    INT o = my_o0;
-    INT offset_psij = u-ar_u;
-#ifdef OMP_ASSERT
-    assert(offset_psij >= 0);
-    assert(o-u <= 2*m+1);
-    assert(offset_psij+o-u <= 2*m+1);
-#endif
-
-    for (l = 0; l <= o-u; l++)
-      g[u+l] += psij_const[offset_psij+l] * f;
-
-    u = my_u0;
-    o = MIN(my_o0,ar_o);
-    offset_psij += my_u0-ar_u+n;
-
-#ifdef OMP_ASSERT
-    if (u <= o)
-    {
-      assert(o-u <= 2*m+1);
-      if (offset_psij+o-u > 2*m+1)
-      {
-        fprintf(stderr, "ERR: %d %d %d %d %d %d %d\n", ar_u, ar_o, my_u0, my_o0, u, o, offset_psij);
-      }
-      assert(offset_psij+o-u <= 2*m+1);
-    }
-#endif
-    for (l = 0; l <= o-u; l++)
-      g[u+l] += psij_const[offset_psij+l] * f;
+    tile_ptr = (INT*) Y(malloc)((size_t)(ntiles + 1) * sizeof(INT));
+    tile_nodes = (INT*) Y(malloc)((size_t)(ths->M_total) * sizeof(INT));
+    tiles_bin(ths, nt, start_off, start, ntiles, tile_ptr, tile_nodes);
   }
-}
-#endif
-
-static void nfft_trafo_1d_B(X(plan) *ths)
-{
-  const INT n = ths->n[0], M = ths->M_total, m = ths->m, m2p2 = 2*m+2;
-  const C *g = (C*)ths->g;
 
-  if (ths->flags & PRE_FULL_PSI)
-  {
-    INT k;
 #ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
+  #pragma omp parallel default(shared) private(colour,t)
 #endif
-    for (k = 0; k < M; k++)
+  {
+    C *buf = (C*) Y(malloc)((size_t)(buf_size) * sizeof(C));
+    R psij[d * w];
+    INT it[d], ext[d], lo[d], lj[d];
+
+    for (colour = 0; colour < (1 << d); colour++)
     {
-      INT l;
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      ths->f[j] = K(0.0);
-      for (l = 0; l < m2p2; l++)
-        ths->f[j] += ths->psi[j*m2p2+l] * g[ths->psi_index_g[j*m2p2+l]];
-    }
-    return;
-  } /* if(PRE_FULL_PSI) */
+      INT tile;
 
-  if (ths->flags & PRE_PSI)
-  {
-    INT k;
 #ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
+      #pragma omp for schedule(dynamic)
 #endif
-    for (k = 0; k < M; k++)
-    {
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      nfft_trafo_1d_compute(&ths->f[j], g, ths->psi + j * (2 * m + 2),
-        &ths->x[j], n, m);
-    }
-    return;
-  } /* if(PRE_PSI) */
+      for (tile = 0; tile < ntiles; tile++)
+      {
+        INT k, r, size, rows, tc;
 
-  if (ths->flags & PRE_FG_PSI)
-  {
-    INT k;
-    R fg_exp_l[m2p2];
+        if (tile_ptr[tile] == tile_ptr[tile + 1])
+          continue;
 
-    nfft_1d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+        for (t = d - 1, tc = tile; t >= 0; t--)
+        {
+          it[t] = tc % nt[t];
+          tc /= nt[t];
+        }
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      const R fg_psij0 = ths->psi[2 * j], fg_psij1 = ths->psi[2 * j + 1];
-      R fg_psij2 = K(1.0);
-      R psij_const[m2p2];
-      INT l;
+        for (t = 0, tc = 0; t < d; t++)
+          tc |= (it[t] & 1) << t;
 
-      psij_const[0] = fg_psij0;
+        if (tc != colour)
+          continue;
 
-      for (l = 1; l < m2p2; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[l] = fg_psij0 * fg_psij2 * fg_exp_l[l];
-      }
+        for (t = 0, size = 1; t < d; t++)
+        {
+          ext[t] = start[start_off[t] + it[t] + 1] - start[start_off[t] + it[t]]
+            + ghost;
+          size *= ext[t];
+        }
 
-      nfft_trafo_1d_compute(&ths->f[j], g, psij_const, &ths->x[j], n, m);
-    }
+        memset(buf, 0, (size_t)(size) * sizeof(C));
 
-    return;
-  } /* if(PRE_FG_PSI) */
+        /* spread the nodes of the tile into the buffer */
+        for (k = tile_ptr[tile]; k < tile_ptr[tile + 1]; k++)
+        {
+          const INT j = tile_nodes[k];
+          const C fj = ths->f[j];
+          INT l;
 
-  if (ths->flags & FG_PSI)
-  {
-    INT k;
-    R fg_exp_l[m2p2];
+          for (t = 0; t < d; t++)
+          {
+            INT u, o;
 
-    sort(ths);
+            tile_of_node(ths, j, t, nt[t], start + start_off[t], &lo[t]);
 
-    nfft_1d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+            if (ths->flags & PRE_FULL_PSI)
+              continue;
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      INT u, o, l;
-      R fg_psij0, fg_psij1, fg_psij2;
-      R psij_const[m2p2];
+            uo(ths, j, &u, &o, t);
 
-      uo(ths, (INT)j, &u, &o, (INT)0);
-      fg_psij0 = (PHI(ths->n[0], ths->x[j] - ((R)(u))/(R)(n), 0));
-      fg_psij1 = EXP(K(2.0) * ((R)(n) * ths->x[j] - (R)(u)) / ths->b[0]);
-      fg_psij2  = K(1.0);
+            if (ths->flags & PRE_PSI)
+              memcpy(psij + t * w, ths->psi + (j * d + t) * w,
+                (size_t)(w) * sizeof(R));
+            else
+              window_taps(ths, ths->x[j * d + t], u, t, psij + t * w);
+          }
 
-      psij_const[0] = fg_psij0;
+          for (r = 0; r < lprod / w; r++)
+          {
+            INT rr = r, base = 0;
+            R s = K(1.0);
+            C *b;
 
-      for (l = 1; l < m2p2; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[l] = fg_psij0 * fg_psij2 * fg_exp_l[l];
-      }
+            for (t = d - 2; t >= 0; t--)
+            {
+              lj[t] = rr % w;
+              rr /= w;
+            }
 
-      nfft_trafo_1d_compute(&ths->f[j], g, psij_const, &ths->x[j], n, m);
-    }
-    return;
-  } /* if(FG_PSI) */
+            for (t = 0; t < d - 1; t++)
+            {
+              base = base * ext[t] + lo[t] + lj[t];
+              s *= psij[t * w + lj[t]];
+            }
 
-  if (ths->flags & PRE_LIN_PSI)
-  {
-    const INT K = ths->K, ip_s = K / (m + 2);
-    INT k;
+            b = buf + base * ext[d - 1] + lo[d - 1];
 
-    sort(ths);
+            if (ths->flags & PRE_FULL_PSI)
+            {
+              const R *psi = ths->psi + j * lprod + r * w;
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      INT u, o, l;
-      R ip_y, ip_w;
-      INT ip_u;
-      R psij_const[m2p2];
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+              for (l = 0; l < w; l++)
+                b[l] += psi[l] * fj;
+            }
+            else
+            {
+              const R *psi = psij + (d - 1) * w;
+              const C sf = s * fj;
 
-      uo(ths, (INT)j, &u, &o, (INT)0);
+              for (l = 0; l < w; l++)
+                b[l] += psi[l] * sf;
+            }
+          }
+        }
 
-      ip_y = FABS((R)(n) * ths->x[j] - (R)(u)) * ((R)ip_s);
-      ip_u = (INT)(LRINT(FLOOR(ip_y)));
-      ip_w = ip_y - (R)(ip_u);
+        /* add the buffer including its ghost points to g */
+        for (r = 0, rows = size / ext[d - 1]; r < rows; r++)
+        {
+          const INT n_last = ths->n[d - 1];
+          const C *b = buf + r * ext[d - 1];
+          INT rr = r, base = 0, l, gl;
+          C *g;
 
-      for (l = 0; l < m2p2; l++)
-        psij_const[l] = ths->psi[ABS(ip_u-l*ip_s)] * (K(1.0) - ip_w)
-          + ths->psi[ABS(ip_u-l*ip_s+1)] * (ip_w);
+          for (t = d - 2; t >= 0; t--)
+          {
+            lj[t] = rr % ext[t];
+            rr /= ext[t];
+          }
+
+          for (t = 0; t < d - 1; t++)
+            base = base * ths->n[t]
+              + (start[start_off[t] + it[t]] + lj[t]) % ths->n[t];
+
+          g = ths->g + base * n_last;
+          gl = start[start_off[d - 1] + it[d - 1]];
 
-      nfft_trafo_1d_compute(&ths->f[j], g, psij_const, &ths->x[j], n, m);
+          for (l = 0; l < ext[d - 1]; l++)
+          {
+            g[gl] += b[l];
+            if (++gl == n_last)
+              gl = 0;
+          }
+        }
+      }
     }
-    return;
-  } /* if(PRE_LIN_PSI) */
-  else
+
+    Y(free)(buf);
+  }
+
+  if (!ths->tile_ptr)
   {
-    /* no precomputed psi at all */
-    INT k;
+    Y(free)(tile_nodes);
+    Y(free)(tile_ptr);
+  }
 
-    sort(ths);
+  Y(free)(start);
+}
+
+static void B_T(X(plan) *ths)
+{
+  if (ths->flags & NFFT_OMP_TILED_ADJOINT)
+  {
+    B_tiled_T(ths);
+    return;
+  }
 
 #ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
+  B_openmp_T(ths);
+#else
+  B_serial_T(ths);
 #endif
-    for (k = 0; k < M; k++)
-    {
-      R psij_const[m2p2];
-      INT u, o, l;
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+}
 
-      uo(ths, (INT)j, &u, &o, (INT)0);
+/* ## batched version for howmany > 1  ####################################### */
 
-      for (l = 0; l < m2p2; l++)
-        psij_const[l] = (PHI(ths->n[0], ths->x[j] - ((R)((u+l))) / (R)(n), 0));
+/** Whether psi or psi_index_g are stored compactly, flags NFFT_PSI_FLOAT,
+ *  NFFT_PSI_INDEX_32 and NFFT_PSI_BASE_INDEX. The specialised kernels read
+ *  the float psi of PRE_PSI through real_node_taps; the compact PRE_FULL_PSI
+ *  holds tensor products, which only the loops of B_compact_A and
+ *  B_compact_T read. */
+static inline int psi_compact(const X(plan) *ths)
+{
+  return ((ths->flags & (NFFT_PSI_FLOAT | NFFT_PSI_INDEX_32 | NFFT_PSI_BASE_INDEX))
+    && (ths->flags & (PRE_PSI | PRE_FULL_PSI)));
+}
 
-      nfft_trafo_1d_compute(&ths->f[j], g, psij_const, &ths->x[j], n, m);
-    }
-  }
+/** Size in bytes of one precomputed window value. */
+static inline size_t psi_size(const X(plan) *ths)
+{
+  return (ths->flags & NFFT_PSI_FLOAT) ? sizeof(float) : sizeof(R);
 }
 
+/** Size in bytes of the entries of psi_index_g per node, lprod = (2m+2)^d. */
+static inline size_t psi_index_size(const X(plan) *ths, const INT lprod)
+{
+  if (ths->flags & NFFT_PSI_BASE_INDEX)
+    return sizeof(INT);
 
-#define MACRO_adjoint_1d_B_OMP_BLOCKWISE_COMPUTE_PRE_PSI \
-{ \
-            nfft_adjoint_1d_compute_omp_blockwise(ths->f[j], g, \
-                ths->psi + j * (2 * m + 2), ths->x + j, n, m, my_u0, my_o0); \
+  return (size_t)(lprod) * ((ths->flags & NFFT_PSI_INDEX_32) ? sizeof(int) : sizeof(INT));
 }
 
-#define MACRO_adjoint_1d_B_OMP_BLOCKWISE_COMPUTE_PRE_FG_PSI \
-{ \
-            R psij_const[2 * m + 2]; \
-            INT l; \
-            R fg_psij0 = ths->psi[2 * j]; \
-            R fg_psij1 = ths->psi[2 * j + 1]; \
-            R fg_psij2 = K(1.0); \
- \
-            psij_const[0] = fg_psij0; \
-            for (l = 1; l <= 2 * m + 1; l++) \
-            { \
-              fg_psij2 *= fg_psij1; \
-              psij_const[l] = fg_psij0 * fg_psij2 * fg_exp_l[l]; \
-            } \
- \
-            nfft_adjoint_1d_compute_omp_blockwise(ths->f[j], g, psij_const, \
-                ths->x + j, n, m, my_u0, my_o0); \
+/** Loads len precomputed window values from position i of psi. */
+static inline void psi_load(const X(plan) *ths, const INT i, const INT len,
+  R *psij)
+{
+  INT l;
+
+  if (ths->flags & NFFT_PSI_FLOAT)
+  {
+    const float *psi = (const float*) ths->psi + i;
+    for (l = 0; l < len; l++)
+      psij[l] = (R) psi[l] * ths->psi_scale;
+  }
+  else
+    memcpy(psij, ths->psi + i, (size_t)(len) * sizeof(R));
 }
 
-#define MACRO_adjoint_1d_B_OMP_BLOCKWISE_COMPUTE_FG_PSI \
-{ \
-            R psij_const[2 * m + 2]; \
-            R fg_psij0, fg_psij1, fg_psij2; \
-            INT u, o, l; \
- \
-            uo(ths, j, &u, &o, (INT)0); \
-            fg_psij0 = (PHI(ths->n[0],ths->x[j]-((R)u)/((R)n),0)); \
-            fg_psij1 = EXP(K(2.0) * (((R)n) * (ths->x[j]) - (R)u) / ths->b[0]); \
-            fg_psij2 = K(1.0); \
-            psij_const[0] = fg_psij0; \
-            for (l = 1; l <= 2 * m + 1; l++) \
-            { \
-              fg_psij2 *= fg_psij1; \
-              psij_const[l] = fg_psij0 * fg_psij2 * fg_exp_l[l]; \
-            } \
- \
-            nfft_adjoint_1d_compute_omp_blockwise(ths->f[j], g, psij_const, \
-                ths->x + j, n, m, my_u0, my_o0); \
-}
+/** Stores len window values at position i of psi. */
+static inline void psi_store(X(plan) *ths, const INT i, const INT len,
+  const R *psij)
+{
+  INT l;
 
-#define MACRO_adjoint_1d_B_OMP_BLOCKWISE_COMPUTE_PRE_LIN_PSI \
-{ \
-            R psij_const[2 * m + 2]; \
-            INT ip_u; \
-            R ip_y, ip_w; \
-            INT u, o, l; \
- \
-            uo(ths, j, &u, &o, (INT)0); \
- \
-            ip_y = FABS(((R)n) * ths->x[j] - (R)u) * ((R)ip_s); \
-            ip_u = LRINT(FLOOR(ip_y)); \
-            ip_w = ip_y - ip_u; \
-            for (l = 0; l < 2 * m + 2; l++) \
-              psij_const[l] \
-                  = ths->psi[ABS(ip_u-l*ip_s)] * (K(1.0) - ip_w) \
-                      + ths->psi[ABS(ip_u-l*ip_s+1)] * (ip_w); \
- \
-            nfft_adjoint_1d_compute_omp_blockwise(ths->f[j], g, psij_const, \
-                ths->x + j, n, m, my_u0, my_o0); \
+  if (ths->flags & NFFT_PSI_FLOAT)
+  {
+    float *psi = (float*) ths->psi + i;
+    for (l = 0; l < len; l++)
+      psi[l] = (float) (psij[l] / ths->psi_scale);
+  }
+  else
+    memcpy(ths->psi + i, psij, (size_t)(len) * sizeof(R));
 }
 
-#define MACRO_adjoint_1d_B_OMP_BLOCKWISE_COMPUTE_NO_PSI \
-{ \
-            R psij_const[2 * m + 2]; \
-            INT u, o, l; \
- \
-            uo(ths, j, &u, &o, (INT)0); \
- \
-            for (l = 0; l <= 2 * m + 1; l++) \
-              psij_const[l] = (PHI(ths->n[0],ths->x[j]-((R)((u+l)))/((R)n),0)); \
- \
-            nfft_adjoint_1d_compute_omp_blockwise(ths->f[j], g, psij_const, \
-                ths->x + j, n, m, my_u0, my_o0); \
-}
+/** Loads len grid indices from position i of psi_index_g. */
+static inline void psi_index_load(const X(plan) *ths, const INT i,
+  const INT len, INT *idx)
+{
+  INT l;
 
-#define MACRO_adjoint_1d_B_OMP_BLOCKWISE(whichone) \
-{ \
-    if (ths->flags & NFFT_OMP_BLOCKWISE_ADJOINT) \
-    { \
-      _Pragma("omp parallel private(k)") \
-      { \
-        INT my_u0, my_o0, min_u_a, max_u_a, min_u_b, max_u_b; \
-        INT *ar_x = ths->index_x; \
- \
-        nfft_adjoint_B_omp_blockwise_init(&my_u0, &my_o0, &min_u_a, &max_u_a, \
-        		                          &min_u_b, &max_u_b, 1, &n, m); \
- \
-        if (min_u_a != -1) \
-        { \
-          k = index_x_binary_search(ar_x, M, min_u_a); \
- \
-          MACRO_adjoint_nd_B_OMP_BLOCKWISE_ASSERT_A \
- \
-          while (k < M) \
-          { \
-            INT u_prod = ar_x[2*k]; \
-            INT j = ar_x[2*k+1]; \
- \
-            if (u_prod < min_u_a || u_prod > max_u_a) \
-              break; \
- \
-            MACRO_adjoint_1d_B_OMP_BLOCKWISE_COMPUTE_ ##whichone \
- \
-            k++; \
-          } \
-        } \
- \
-        if (min_u_b != -1) \
-        { \
-          k = index_x_binary_search(ar_x, M, min_u_b); \
- \
-          MACRO_adjoint_nd_B_OMP_BLOCKWISE_ASSERT_B \
- \
-          while (k < M) \
-          { \
-            INT u_prod = ar_x[2*k]; \
-            INT j = ar_x[2*k+1]; \
- \
-            if (u_prod < min_u_b || u_prod > max_u_b) \
-              break; \
- \
-            MACRO_adjoint_1d_B_OMP_BLOCKWISE_COMPUTE_ ##whichone \
- \
-            k++; \
-          } \
-        } \
-      } /* omp parallel */ \
-      return; \
-    } /* if(NFFT_OMP_BLOCKWISE_ADJOINT) */ \
+  if (ths->flags & NFFT_PSI_INDEX_32)
+  {
+    const int *psi_index_g = (const int*) ths->psi_index_g + i;
+    for (l = 0; l < len; l++)
+      idx[l] = (INT) psi_index_g[l];
+  }
+  else
+    memcpy(idx, ths->psi_index_g + i, (size_t)(len) * sizeof(INT));
 }
 
-static void nfft_adjoint_1d_B(X(plan) *ths)
+/**
+ * Grid indices idx[l] of the window of node j, l = 0,...,(2m+2)^d-1, where
+ * the stencil wraps around the periodic grid. The first grid point u_t of
+ * each dimension is recomputed from x.
+ */
+static void psi_wrap_index(const X(plan) *ths, const INT j, INT *idx)
 {
-  const INT n = ths->n[0], M = ths->M_total, m = ths->m;
-  INT k;
-  C *g = (C*)ths->g;
-
-  memset(g, 0, (size_t)(ths->n_total) * sizeof(C));
+  const INT d = ths->d, w = 2 * ths->m + 2;
+  INT l_t[d * w], lj[d], ll_plain[d + 1], t, l, l_L, lprod;
 
-  if (ths->flags & PRE_FULL_PSI)
+  for (t = 0, lprod = 1; t < d; t++)
   {
-    nfft_adjoint_B_compute_full_psi(g, ths->psi_index_g, ths->psi, ths->f, M,
-        (INT)1, ths->n, m, ths->flags, ths->index_x);
-    return;
-  } /* if(PRE_FULL_PSI) */
+    INT u, o;
 
-  if (ths->flags & PRE_PSI)
+    uo(ths, j, &u, &o, t);
+
+    for (l = 0; l < w; l++)
+      l_t[t * w + l] = (u + l + ths->n[t]) % ths->n[t];
+
+    lj[t] = 0;
+    lprod *= w;
+  }
+
+  ll_plain[0] = 0;
+  t = 0;
+
+  for (l_L = 0; l_L < lprod; l_L++)
   {
-#ifdef _OPENMP
-    MACRO_adjoint_1d_B_OMP_BLOCKWISE(PRE_PSI)
-#endif
+    INT t2;
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-#ifdef _OPENMP
-      nfft_adjoint_1d_compute_omp_atomic(ths->f[j], g, ths->psi + j * (2 * m + 2), ths->x + j, n, m);
-#else
-      nfft_adjoint_1d_compute_serial(ths->f + j, g, ths->psi + j * (2 * m + 2), ths->x + j, n, m);
-#endif
-    }
+    for (t2 = t; t2 < d; t2++)
+      ll_plain[t2 + 1] = ll_plain[t2] * ths->n[t2] + l_t[t2 * w + lj[t2]];
 
-    return;
-  } /* if(PRE_PSI) */
+    idx[l_L] = ll_plain[d];
 
-  if (ths->flags & PRE_FG_PSI)
+    for (t = d - 1; (t > 0) && (lj[t] == w - 1); t--)
+      lj[t] = 0;
+
+    lj[t]++;
+  }
+}
+
+/**
+ * Base index of node j for flag NFFT_PSI_BASE_INDEX, the plain index of the
+ * first grid point of its window. Windows that wrap around the periodic grid
+ * are marked by a negative value.
+ */
+static INT psi_base_index(const X(plan) *ths, const INT j)
+{
+  INT t, base = 0, wrap = 0;
+
+  for (t = 0; t < ths->d; t++)
   {
-    R fg_exp_l[2 * m + 2];
+    INT u, o;
 
-    nfft_1d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+    uo(ths, j, &u, &o, t);
+    u = (u + ths->n[t]) % ths->n[t];
+    wrap |= (u + 2 * ths->m + 2 > ths->n[t]);
+    base = base * ths->n[t] + u;
+  }
 
-#ifdef _OPENMP
-    MACRO_adjoint_1d_B_OMP_BLOCKWISE(PRE_FG_PSI)
-#endif
+  return wrap ? -1 : base;
+}
 
+/** Grid indices of the window of node j in PRE_FULL_PSI. */
+static inline void psi_index_node(const X(plan) *ths, const INT j,
+  const INT lprod, INT *idx)
+{
+  if (ths->flags & NFFT_PSI_BASE_INDEX)
+  {
+    const INT base = ths->psi_index_g[j];
+    INT l;
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      R psij_const[2 * m + 2];
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      INT l;
-      R fg_psij0 = ths->psi[2 * j];
-      R fg_psij1 = ths->psi[2 * j + 1];
-      R fg_psij2 = K(1.0);
+    if (base < 0)
+      psi_wrap_index(ths, j, idx);
+    else
+      for (l = 0; l < lprod; l++)
+        idx[l] = base + ths->psi_offset[l];
+  }
+  else
+    psi_index_load(ths, j * lprod, lprod, idx);
+}
 
-      psij_const[0] = fg_psij0;
-      for (l = 1; l <= 2 * m + 1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[l] = fg_psij0 * fg_psij2 * fg_exp_l[l];
-      }
+/** Stores len grid indices at position i of psi_index_g. */
+static inline void psi_index_store(X(plan) *ths, const INT i, const INT len,
+  const INT *idx)
+{
+  INT l;
 
-#ifdef _OPENMP
-      nfft_adjoint_1d_compute_omp_atomic(ths->f[j], g, psij_const, ths->x + j, n, m);
-#else
-      nfft_adjoint_1d_compute_serial(ths->f + j, g, psij_const, ths->x + j, n, m);
-#endif
-    }
+  if (ths->flags & NFFT_PSI_INDEX_32)
+  {
+    int *psi_index_g = (int*) ths->psi_index_g + i;
+    for (l = 0; l < len; l++)
+      psi_index_g[l] = (int) idx[l];
+  }
+  else
+    memcpy(ths->psi_index_g + i, idx, (size_t)(len) * sizeof(INT));
+}
+
+/**
+ * Computes the tensor product window values psij and the plain indices idx in
+ * g of all (2m+2)^d grid points next to node j. The values are read from the
+ * precomputed psi for PRE_PSI and PRE_FULL_PSI, and evaluated otherwise.
+ */
+static void B_many_stencil(const X(plan) *ths, const INT j, const INT lprod,
+  R *psij, INT *idx)
+{
+  const INT w = 2 * ths->m + 2;
+  INT t, l_L;
+  INT lj[ths->d];
+  R phi_prod[ths->d + 1];
+  INT ll_plain[ths->d + 1];
+  R psi_t[ths->d * w];
+  INT l_t[ths->d * w];
 
+  if (ths->flags & PRE_FULL_PSI)
+  {
+    psi_load(ths, j * lprod, lprod, psij);
+    psi_index_node(ths, j, lprod, idx);
     return;
-  } /* if(PRE_FG_PSI) */
+  }
 
-  if (ths->flags & FG_PSI)
+  for (t = 0; t < ths->d; t++)
   {
-    R fg_exp_l[2 * m + 2];
+    INT u, o, l;
 
-    nfft_1d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+    uo(ths, j, &u, &o, t);
 
-    sort(ths);
+    for (l = 0; l < w; l++)
+      l_t[t * w + l] = (u + l + ths->n[t]) % ths->n[t];
 
-#ifdef _OPENMP
-    MACRO_adjoint_1d_B_OMP_BLOCKWISE(FG_PSI)
-#endif
+    if (ths->flags & PRE_PSI)
+      psi_load(ths, (j * ths->d + t) * w, w, psi_t + t * w);
+    else
+      window_taps(ths, ths->x[j * ths->d + t], u, t, psi_t + t * w);
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      INT u,o,l;
-      R psij_const[2 * m + 2];
-      R fg_psij0, fg_psij1, fg_psij2;
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+    lj[t] = 0;
+  }
 
-      uo(ths, j, &u, &o, (INT)0);
-      fg_psij0 = (PHI(ths->n[0], ths->x[j] - ((R)u) / (R)(n),0));
-      fg_psij1 = EXP(K(2.0) * ((R)(n) * (ths->x[j]) - (R)(u)) / ths->b[0]);
-      fg_psij2 = K(1.0);
-      psij_const[0] = fg_psij0;
-      for (l = 1; l <= 2 * m + 1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[l] = fg_psij0 * fg_psij2 * fg_exp_l[l];
-      }
+  phi_prod[0] = K(1.0);
+  ll_plain[0] = 0;
+  t = 0;
 
-#ifdef _OPENMP
-      nfft_adjoint_1d_compute_omp_atomic(ths->f[j], g, psij_const, ths->x + j, n, m);
-#else
-      nfft_adjoint_1d_compute_serial(ths->f + j, g, psij_const, ths->x + j, n, m);
-#endif
+  for (l_L = 0; l_L < lprod; l_L++)
+  {
+    INT t2;
+
+    for (t2 = t; t2 < ths->d; t2++)
+    {
+      phi_prod[t2 + 1] = phi_prod[t2] * psi_t[t2 * w + lj[t2]];
+      ll_plain[t2 + 1] = ll_plain[t2] * ths->n[t2] + l_t[t2 * w + lj[t2]];
     }
 
-    return;
-  } /* if(FG_PSI) */
+    psij[l_L] = phi_prod[ths->d];
+    idx[l_L] = ll_plain[ths->d];
 
-  if (ths->flags & PRE_LIN_PSI)
-  {
-    const INT K = ths->K;
-    const INT ip_s = K / (m + 2);
+    for (t = ths->d - 1; (t > 0) && (lj[t] == w - 1); t--)
+      lj[t] = 0;
 
-    sort(ths);
+    lj[t]++;
+  }
+}
 
-#ifdef _OPENMP
-    MACRO_adjoint_1d_B_OMP_BLOCKWISE(PRE_LIN_PSI)
-#endif
-
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      INT u,o,l;
-      INT ip_u;
-      R ip_y, ip_w;
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      R psij_const[2 * m + 2];
+/** Node j in the order used by the B-step, sorted if NFFT_SORT_NODES is set. */
+static inline INT B_many_node(const X(plan) *ths, const INT jj)
+{
+  return (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2 * jj + 1] : jj;
+}
 
-      uo(ths, j, &u, &o, (INT)0);
+/**
+ * Window values and grid indices of node j per dimension t in psi_t[t*w+l]
+ * and l_t[t*w+l] with w = 2m+2, for the B-steps that traverse the tensor
+ * product window line by line.
+ */
+static void real_node_taps(const X(plan) *ths, const INT j, R *psi_t, INT *l_t)
+{
+  const INT w = 2 * ths->m + 2;
+  INT t, l, u, o;
 
-      ip_y = FABS((R)(n) * ths->x[j] - (R)(u)) * ((R)ip_s);
-      ip_u = (INT)(LRINT(FLOOR(ip_y)));
-      ip_w = ip_y - (R)(ip_u);
-      for (l = 0; l < 2 * m + 2; l++)
-        psij_const[l]
-            = ths->psi[ABS(ip_u-l*ip_s)] * (K(1.0) - ip_w)
-                + ths->psi[ABS(ip_u-l*ip_s+1)] * (ip_w);
+  for (t = 0; t < ths->d; t++)
+  {
+    uo(ths, j, &u, &o, t);
 
-#ifdef _OPENMP
-      nfft_adjoint_1d_compute_omp_atomic(ths->f[j], g, psij_const, ths->x + j, n, m);
-#else
-      nfft_adjoint_1d_compute_serial(ths->f + j, g, psij_const, ths->x + j, n, m);
-#endif
-    }
-    return;
-  } /* if(PRE_LIN_PSI) */
+    for (l = 0; l < w; l++)
+      l_t[t * w + l] = (u + l + ths->n[t]) % ths->n[t];
 
-  /* no precomputed psi at all */
-  sort(ths);
+    if (ths->flags & PRE_PSI)
+      psi_load(ths, (j * ths->d + t) * w, w, psi_t + t * w);
+    else
+      window_taps(ths, ths->x[j * ths->d + t], u, t, psi_t + t * w);
+  }
+}
 
-#ifdef _OPENMP
-  MACRO_adjoint_1d_B_OMP_BLOCKWISE(NO_PSI)
-#endif
+/** Loop of the B-step over the window of node j in PRE_FULL_PSI, for psi
+ *  stored with type psi_type and grid indices index of type index_type
+ *  relative to g_base. */
+#define MACRO_B_COMPACT_FULL_A(psi_type, index_type, g_base, index) \
+{ \
+  const psi_type *psij = (const psi_type*) ths->psi + j * lprod; \
+  const index_type *idx = (index); \
+  const C *gb = (g_base); \
+ \
+  for (l = 0; l < lprod; l++) \
+    fj += (R) psij[l] * gb[idx[l]]; \
+}
 
 #ifdef _OPENMP
-  #pragma omp parallel for default(shared) private(k)
+#define MACRO_B_COMPACT_FULL_T(psi_type, index_type, g_base, index) \
+{ \
+  const psi_type *psij = (const psi_type*) ths->psi + j * lprod; \
+  const index_type *idx = (index); \
+  C *gb = (g_base); \
+ \
+  for (l = 0; l < lprod; l++) \
+  { \
+    R *gl = (R*) (gb + idx[l]); \
+    _Pragma("omp atomic") \
+    gl[0] += (R) psij[l] * CREAL(fj); \
+    _Pragma("omp atomic") \
+    gl[1] += (R) psij[l] * CIMAG(fj); \
+  } \
+}
+#else
+#define MACRO_B_COMPACT_FULL_T(psi_type, index_type, g_base, index) \
+{ \
+  const psi_type *psij = (const psi_type*) ths->psi + j * lprod; \
+  const index_type *idx = (index); \
+  C *gb = (g_base); \
+ \
+  for (l = 0; l < lprod; l++) \
+    gb[idx[l]] += (R) psij[l] * fj; \
+}
 #endif
-  for (k = 0; k < M; k++)
-  {
-    INT u,o,l;
-    R psij_const[2 * m + 2];
-    INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
 
-    uo(ths, j, &u, &o, (INT)0);
+/** Sum over the window of node j on the grid g, the window values are those
+ *  of PRE_PSI and the tensor product is formed line by line. */
+static C B_compact_psi_A(const X(plan) *ths, const INT j, const C *g)
+{
+  const INT d = ths->d, w = 2 * ths->m + 2;
+  R psi_t[d * w], phi_prod[d];
+  INT l_t[d * w], lj[d], ll_plain[d], l_L, l, t, s = 0, lprod;
+  const R *psi_last = psi_t + (d - 1) * w;
+  const INT *l_last = l_t + (d - 1) * w;
+  C fj = K(0.0);
 
-    for (l = 0; l <= 2 * m + 1; l++)
-      psij_const[l] = (PHI(ths->n[0], ths->x[j] - ((R)((u+l))) / (R)(n),0));
+  for (t = 0, lprod = 1; t < d - 1; t++)
+    lprod *= w;
 
-#ifdef _OPENMP
-    nfft_adjoint_1d_compute_omp_atomic(ths->f[j], g, psij_const, ths->x + j, n, m);
-#else
-    nfft_adjoint_1d_compute_serial(ths->f + j, g, psij_const, ths->x + j, n, m);
-#endif
-  }
-}
+  real_node_taps(ths, j, psi_t, l_t);
 
-void X(trafo_1d)(X(plan) *ths)
-{
-  if((ths->N[0] <= ths->m) || (ths->n[0] <= 2*ths->m+2))
-  {
-    X(trafo_direct)(ths);
-    return;
-  }
-  
-  const INT N = ths->N[0], N2 = N/2, n = ths->n[0];
-  C *f_hat1 = (C*)ths->f_hat, *f_hat2 = (C*)&ths->f_hat[N2];
+  for (t = 0; t < d; t++)
+    lj[t] = 0;
 
-  ths->g_hat = ths->g1;
-  ths->g = ths->g2;
+  phi_prod[0] = K(1.0);
+  ll_plain[0] = 0;
 
+  for (l_L = 0; l_L < lprod; l_L++)
   {
-    C *g_hat1 = (C*)&ths->g_hat[n-N/2], *g_hat2 = (C*)ths->g_hat;
-    R *c_phi_inv1, *c_phi_inv2;
+    C line = K(0.0);
 
-    TIC(0)
-#ifdef _OPENMP
+    for (t = s; t < d - 1; t++)
     {
-      INT k;
-      #pragma omp parallel for default(shared) private(k)
-      for (k = 0; k < ths->n_total; k++)
-        ths->g_hat[k] = 0.0;
+      phi_prod[t + 1] = phi_prod[t] * psi_t[t * w + lj[t]];
+      ll_plain[t + 1] = (ll_plain[t] + l_t[t * w + lj[t]]) * ths->n[t + 1];
     }
-#else
-    memset(ths->g_hat, 0, (size_t)(ths->n_total) * sizeof(C));
-#endif
-    if(ths->flags & PRE_PHI_HUT)
+
+    if (l_last[0] < l_last[w - 1])
     {
-      INT k;
-      c_phi_inv1 = ths->c_phi_inv[0];
-      c_phi_inv2 = &ths->c_phi_inv[0][N2];
+      const C *g_line = g + ll_plain[d - 1] + l_last[0];
 
-#ifdef _OPENMP
-      #pragma omp parallel for default(shared) private(k)
-#endif
-      for (k = 0; k < N2; k++)
-      {
-        g_hat1[k] = f_hat1[k] * c_phi_inv1[k];
-        g_hat2[k] = f_hat2[k] * c_phi_inv2[k];
-      }
+      for (l = 0; l < w; l++)
+        line += psi_last[l] * g_line[l];
     }
     else
-    {
-      INT k;
-#ifdef _OPENMP
-      #pragma omp parallel for default(shared) private(k)
-#endif
-      for (k = 0; k < N2; k++)
-      {
-        g_hat1[k] = f_hat1[k] / (PHI_HUT(ths->n[0],k-N2,0));
-        g_hat2[k] = f_hat2[k] / (PHI_HUT(ths->n[0],k,0));
-      }
-    }
-    TOC(0)
+      for (l = 0; l < w; l++)
+        line += psi_last[l] * g[ll_plain[d - 1] + l_last[l]];
 
-    TIC_FFTW(1)
-    FFTW(execute)(ths->my_fftw_plan1);
-    TOC_FFTW(1);
+    fj += phi_prod[d - 1] * line;
 
-    TIC(2);
-    nfft_trafo_1d_B(ths);
-    TOC(2);
+    for (s = d - 2; (s > 0) && (lj[s] == w - 1); s--)
+      lj[s] = 0;
+
+    if (s >= 0)
+      lj[s]++;
+    else
+      s = 0;
   }
+
+  return fj;
 }
 
-void X(adjoint_1d)(X(plan) *ths)
+/** Adds f_j times the window of node j to the grid g, see B_compact_psi_A. */
+static void B_compact_psi_T(const X(plan) *ths, const INT j, C *g, const C fj)
 {
-  if((ths->N[0] <= ths->m) || (ths->n[0] <= 2*ths->m+2))
-  {
-    X(adjoint_direct)(ths);
-    return;
-  }
-  
-  INT n,N;
-  C *g_hat1,*g_hat2,*f_hat1,*f_hat2;
-  R *c_phi_inv1, *c_phi_inv2;
+  const INT d = ths->d, w = 2 * ths->m + 2;
+  R psi_t[d * w], phi_prod[d];
+  INT l_t[d * w], lj[d], ll_plain[d], l_L, l, t, s = 0, lprod;
+  const R *psi_last = psi_t + (d - 1) * w;
+  const INT *l_last = l_t + (d - 1) * w;
 
-  N=ths->N[0];
-  n=ths->n[0];
-
-  ths->g_hat=ths->g1;
-  ths->g=ths->g2;
+  for (t = 0, lprod = 1; t < d - 1; t++)
+    lprod *= w;
 
-  f_hat1=(C*)ths->f_hat;
-  f_hat2=(C*)&ths->f_hat[N/2];
-  g_hat1=(C*)&ths->g_hat[n-N/2];
-  g_hat2=(C*)ths->g_hat;
+  real_node_taps(ths, j, psi_t, l_t);
 
-  TIC(2)
-  nfft_adjoint_1d_B(ths);
-  TOC(2)
+  for (t = 0; t < d; t++)
+    lj[t] = 0;
 
-  TIC_FFTW(1)
-  FFTW(execute)(ths->my_fftw_plan2);
-  TOC_FFTW(1);
+  phi_prod[0] = K(1.0);
+  ll_plain[0] = 0;
 
-  TIC(0)
-  if(ths->flags & PRE_PHI_HUT)
+  for (l_L = 0; l_L < lprod; l_L++)
   {
-    INT k;
-    c_phi_inv1=ths->c_phi_inv[0];
-    c_phi_inv2=&ths->c_phi_inv[0][N/2];
+    for (t = s; t < d - 1; t++)
+    {
+      phi_prod[t + 1] = phi_prod[t] * psi_t[t * w + lj[t]];
+      ll_plain[t + 1] = (ll_plain[t] + l_t[t * w + lj[t]]) * ths->n[t + 1];
+    }
 
+    for (l = 0; l < w; l++)
+    {
+      const C v = phi_prod[d - 1] * psi_last[l] * fj;
 #ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
+      R *gl = (R*) (g + ll_plain[d - 1] + l_last[l]);
+      #pragma omp atomic
+      gl[0] += CREAL(v);
+      #pragma omp atomic
+      gl[1] += CIMAG(v);
+#else
+      g[ll_plain[d - 1] + l_last[l]] += v;
 #endif
-    for (k = 0; k < N/2; k++)
-    {
-      f_hat1[k] = g_hat1[k] * c_phi_inv1[k];
-      f_hat2[k] = g_hat2[k] * c_phi_inv2[k];
     }
+
+    for (s = d - 2; (s > 0) && (lj[s] == w - 1); s--)
+      lj[s] = 0;
+
+    if (s >= 0)
+      lj[s]++;
+    else
+      s = 0;
   }
-  else
+}
+
+/**
+ * B-step for compactly stored psi or psi_index_g, flags NFFT_PSI_FLOAT,
+ * NFFT_PSI_INDEX_32 and NFFT_PSI_BASE_INDEX, for all howmany vectors.
+ * PRE_FULL_PSI is read directly from the compact arrays. With base indices,
+ * the shared offsets psi_offset are added to the base index of a node,
+ * windows that wrap around the grid are indexed explicitly.
+ */
+static void B_compact_A(X(plan) *ths)
+{
+  INT t, lprod;
+
+  for (t = 0, lprod = 1; t < ths->d; t++)
+    lprod *= 2 * ths->m + 2;
+
+#ifdef _OPENMP
+  #pragma omp parallel default(shared)
+#endif
   {
-    INT k;
+    INT *idx_w = (ths->flags & NFFT_PSI_BASE_INDEX)
+      ? (INT*) Y(malloc)((size_t)(lprod) * sizeof(INT)) : NULL;
+    INT jj;
 
 #ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
+    #pragma omp for
 #endif
-    for (k = 0; k < N/2; k++)
+    for (jj = 0; jj < ths->M_total; jj++)
     {
-      f_hat1[k] = g_hat1[k] / (PHI_HUT(ths->n[0],k-N/2,0));
-      f_hat2[k] = g_hat2[k] / (PHI_HUT(ths->n[0],k,0));
-    }
-  }
-  TOC(0)
-}
+      const INT j = B_many_node(ths, jj);
+      const INT *idx_b = NULL;
+      INT k, l, base = 0;
 
+      if ((ths->flags & PRE_FULL_PSI) && (ths->flags & NFFT_PSI_BASE_INDEX))
+      {
+        base = ths->psi_index_g[j];
 
-/* ################################################ SPECIFIC VERSIONS FOR d=2 */
+        if (base < 0)
+        {
+          psi_wrap_index(ths, j, idx_w);
+          idx_b = idx_w;
+          base = 0;
+        }
+        else
+          idx_b = ths->psi_offset;
+      }
 
-static void nfft_2d_init_fg_exp_l(R *fg_exp_l, const INT m, const R b)
-{
-  INT l;
-  R fg_exp_b0, fg_exp_b1, fg_exp_b2, fg_exp_b0_sq;
+      for (k = 0; k < ths->howmany; k++)
+      {
+        const C *g = ths->g + k * ths->n_total;
+        C fj = K(0.0);
+
+        if (!(ths->flags & PRE_FULL_PSI))
+          fj = B_compact_psi_A(ths, j, g);
+        else if (idx_b && (ths->flags & NFFT_PSI_FLOAT))
+          MACRO_B_COMPACT_FULL_A(float, INT, g + base, idx_b)
+        else if (idx_b)
+          MACRO_B_COMPACT_FULL_A(R, INT, g + base, idx_b)
+        else if ((ths->flags & NFFT_PSI_FLOAT) && (ths->flags & NFFT_PSI_INDEX_32))
+          MACRO_B_COMPACT_FULL_A(float, int, g, (const int*) ths->psi_index_g + j * lprod)
+        else if (ths->flags & NFFT_PSI_FLOAT)
+          MACRO_B_COMPACT_FULL_A(float, INT, g, ths->psi_index_g + j * lprod)
+        else
+          MACRO_B_COMPACT_FULL_A(R, int, g, (const int*) ths->psi_index_g + j * lprod)
 
-  fg_exp_b0 = EXP(K(-1.0)/b);
-  fg_exp_b0_sq = fg_exp_b0*fg_exp_b0;
-  fg_exp_b1 = K(1.0);
-  fg_exp_b2 = K(1.0);
-  fg_exp_l[0] = K(1.0);
-  for(l=1; l <= 2*m+1; l++)
-    {
-      fg_exp_b2 = fg_exp_b1*fg_exp_b0;
-      fg_exp_b1 *= fg_exp_b0_sq;
-      fg_exp_l[l] = fg_exp_l[l-1]*fg_exp_b2;
+        ths->f[k * ths->M_total + j] = (ths->flags & PRE_FULL_PSI)
+          ? fj * ths->psi_scale : fj;
+      }
     }
+
+    Y(free)(idx_w);
+  }
 }
 
-static void nfft_trafo_2d_compute(C *fj, const C *g, const R *psij_const0,
-    const R *psij_const1, const R *xj0, const R *xj1, const INT n0,
-    const INT n1, const INT m)
+static void B_compact_T(X(plan) *ths)
 {
-  INT u0,o0,l0,u1,o1,l1;
-  const C *gj;
-  const R *psij0,*psij1;
+  INT t, lprod;
 
-  psij0=psij_const0;
-  psij1=psij_const1;
+  for (t = 0, lprod = 1; t < ths->d; t++)
+    lprod *= 2 * ths->m + 2;
 
-  uo2(&u0,&o0,*xj0, n0, m);
-  uo2(&u1,&o1,*xj1, n1, m);
+  memset(ths->g, 0, (size_t)(ths->n_total * ths->howmany) * sizeof(C));
 
-  *fj=0;
+#ifdef _OPENMP
+  #pragma omp parallel default(shared)
+#endif
+  {
+    INT *idx_w = (ths->flags & NFFT_PSI_BASE_INDEX)
+      ? (INT*) Y(malloc)((size_t)(lprod) * sizeof(INT)) : NULL;
+    INT jj;
 
-  if (u0 < o0)
-      if(u1 < o1)
-    for(l0=0; l0<=2*m+1; l0++,psij0++)
-    {
-        psij1=psij_const1;
-        gj=g+(u0+l0)*n1+u1;
-        for(l1=0; l1<=2*m+1; l1++)
-      (*fj) += (*psij0) * (*psij1++) * (*gj++);
-    }
-      else
-    for(l0=0; l0<=2*m+1; l0++,psij0++)
+#ifdef _OPENMP
+    #pragma omp for
+#endif
+    for (jj = 0; jj < ths->M_total; jj++)
     {
-        psij1=psij_const1;
-        gj=g+(u0+l0)*n1+u1;
-        for(l1=0; l1<2*m+1-o1; l1++)
-      (*fj) += (*psij0) * (*psij1++) * (*gj++);
-        gj=g+(u0+l0)*n1;
-        for(l1=0; l1<=o1; l1++)
-      (*fj) += (*psij0) * (*psij1++) * (*gj++);
-    }
-  else
-      if(u1<o1)
+      const INT j = B_many_node(ths, jj);
+      const INT *idx_b = NULL;
+      INT k, l, base = 0;
+
+      if ((ths->flags & PRE_FULL_PSI) && (ths->flags & NFFT_PSI_BASE_INDEX))
       {
-    for(l0=0; l0<2*m+1-o0; l0++,psij0++)
-    {
-        psij1=psij_const1;
-        gj=g+(u0+l0)*n1+u1;
-        for(l1=0; l1<=2*m+1; l1++)
-      (*fj) += (*psij0) * (*psij1++) * (*gj++);
-    }
-    for(l0=0; l0<=o0; l0++,psij0++)
-    {
-        psij1=psij_const1;
-        gj=g+l0*n1+u1;
-        for(l1=0; l1<=2*m+1; l1++)
-      (*fj) += (*psij0) * (*psij1++) * (*gj++);
-    }
+        base = ths->psi_index_g[j];
+
+        if (base < 0)
+        {
+          psi_wrap_index(ths, j, idx_w);
+          idx_b = idx_w;
+          base = 0;
+        }
+        else
+          idx_b = ths->psi_offset;
       }
-      else
+
+      for (k = 0; k < ths->howmany; k++)
       {
-    for(l0=0; l0<2*m+1-o0; l0++,psij0++)
-    {
-        psij1=psij_const1;
-        gj=g+(u0+l0)*n1+u1;
-        for(l1=0; l1<2*m+1-o1; l1++)
-      (*fj) += (*psij0) * (*psij1++) * (*gj++);
-        gj=g+(u0+l0)*n1;
-        for(l1=0; l1<=o1; l1++)
-      (*fj) += (*psij0) * (*psij1++) * (*gj++);
-    }
-    for(l0=0; l0<=o0; l0++,psij0++)
-    {
-        psij1=psij_const1;
-        gj=g+l0*n1+u1;
-        for(l1=0; l1<2*m+1-o1; l1++)
-      (*fj) += (*psij0) * (*psij1++) * (*gj++);
-        gj=g+l0*n1;
-        for(l1=0; l1<=o1; l1++)
-      (*fj) += (*psij0) * (*psij1++) * (*gj++);
-    }
+        C *g = ths->g + k * ths->n_total;
+        C fj = ths->f[k * ths->M_total + j];
+
+        if (!(ths->flags & PRE_FULL_PSI))
+        {
+          B_compact_psi_T(ths, j, g, fj);
+          continue;
+        }
+
+        fj *= ths->psi_scale;
+
+        if (idx_b && (ths->flags & NFFT_PSI_FLOAT))
+          MACRO_B_COMPACT_FULL_T(float, INT, g + base, idx_b)
+        else if (idx_b)
+          MACRO_B_COMPACT_FULL_T(R, INT, g + base, idx_b)
+        else if ((ths->flags & NFFT_PSI_FLOAT) && (ths->flags & NFFT_PSI_INDEX_32))
+          MACRO_B_COMPACT_FULL_T(float, int, g, (const int*) ths->psi_index_g + j * lprod)
+        else if (ths->flags & NFFT_PSI_FLOAT)
+          MACRO_B_COMPACT_FULL_T(float, INT, g, ths->psi_index_g + j * lprod)
+        else
+          MACRO_B_COMPACT_FULL_T(R, int, g, (const int*) ths->psi_index_g + j * lprod)
       }
+    }
+
+    Y(free)(idx_w);
+  }
 }
 
-#ifdef _OPENMP
-/* adjoint NFFT two-dimensional case with OpenMP atomic operations */
-static void nfft_adjoint_2d_compute_omp_atomic(const C f, C *g,
-            const R *psij_const0, const R *psij_const1, const R *xj0,
-            const R *xj1, const INT n0, const INT n1, const INT m)
-{
-  INT u0,o0,l0,u1,o1,l1;
+/* ## B-step kernels specialised for d and m ################################ */
 
-  INT index_temp0[2*m+2];
-  INT index_temp1[2*m+2];
+/**
+ * B-step kernels for fixed dimension d = 1,...,6 and window width w = 2m+2,
+ * m = 2,...,12, instantiated below. All loop bounds are constants, so that the
+ * compiler unrolls the stencil completely. The window values of node j are
+ * passed per dimension in psi_t[t*w+l] and its grid indices in l_t[t*w+l],
+ * multiplied by the stride of dimension t in g. Lines of the last dimension
+ * that do not wrap around are read contiguously. The adjoint kernels spread
+ * the rows l0_lo,...,l0_hi-1 of the first dimension only, which lets the
+ * threads of the blockwise adjoint share a node.
+ */
+#define MACRO_B_FIXED_KERNELS(w) \
+static inline C B_fixed_line_A_ ## w(const R *psi, const C *g, const INT *l) \
+{ \
+  C s = K(0.0); \
+  INT i; \
+\
+  if (l[0] < l[w - 1]) \
+  { \
+    const C *gl = g + l[0]; \
+    for (i = 0; i < w; i++) \
+      s += psi[i] * gl[i]; \
+  } \
+  else \
+    for (i = 0; i < w; i++) \
+      s += psi[i] * g[l[i]]; \
+\
+  return s; \
+} \
+\
+static inline void B_fixed_line_T_ ## w(const R *psi, C *g, const INT *l, \
+  const C f) \
+{ \
+  INT i; \
+\
+  if (l[0] < l[w - 1]) \
+  { \
+    C *gl = g + l[0]; \
+    for (i = 0; i < w; i++) \
+      gl[i] += psi[i] * f; \
+  } \
+  else \
+    for (i = 0; i < w; i++) \
+      g[l[i]] += psi[i] * f; \
+} \
+\
+static void B_fixed_A_1_ ## w(C *fj, const C *g, const R *psi_t, \
+  const INT *l_t) \
+{ \
+  *fj = B_fixed_line_A_ ## w(psi_t, g, l_t); \
+} \
+\
+static void B_fixed_A_2_ ## w(C *fj, const C *g, const R *psi_t, \
+  const INT *l_t) \
+{ \
+  C s = K(0.0); \
+  INT l0; \
+\
+  for (l0 = 0; l0 < w; l0++) \
+    s += psi_t[l0] * B_fixed_line_A_ ## w(psi_t + w, g + l_t[l0], l_t + w); \
+\
+  *fj = s; \
+} \
+\
+static void B_fixed_A_3_ ## w(C *fj, const C *g, const R *psi_t, \
+  const INT *l_t) \
+{ \
+  C s = K(0.0); \
+  INT l0, l1; \
+\
+  for (l0 = 0; l0 < w; l0++) \
+    for (l1 = 0; l1 < w; l1++) \
+      s += psi_t[l0] * psi_t[w + l1] * B_fixed_line_A_ ## w(psi_t + 2 * w, \
+        g + l_t[l0] + l_t[w + l1], l_t + 2 * w); \
+\
+  *fj = s; \
+} \
+\
+static void B_fixed_A_4_ ## w(C *fj, const C *g, const R *psi_t, \
+  const INT *l_t) \
+{ \
+  C s = K(0.0); \
+  INT l0, l1, l2; \
+\
+  for (l0 = 0; l0 < w; l0++) \
+    for (l1 = 0; l1 < w; l1++) \
+    { \
+      const R p01 = psi_t[l0] * psi_t[w + l1]; \
+      const C *g01 = g + l_t[l0] + l_t[w + l1]; \
+\
+      for (l2 = 0; l2 < w; l2++) \
+        s += p01 * psi_t[2 * w + l2] * B_fixed_line_A_ ## w(psi_t + 3 * w, \
+          g01 + l_t[2 * w + l2], l_t + 3 * w); \
+    } \
+\
+  *fj = s; \
+} \
+\
+static void B_fixed_A_5_ ## w(C *fj, const C *g, const R *psi_t, \
+  const INT *l_t) \
+{ \
+  C s = K(0.0); \
+  INT l0, l1, l2, l3; \
+\
+  for (l0 = 0; l0 < w; l0++) \
+    for (l1 = 0; l1 < w; l1++) \
+    { \
+      const R p01 = psi_t[l0] * psi_t[w + l1]; \
+      const C *g01 = g + l_t[l0] + l_t[w + l1]; \
+\
+      for (l2 = 0; l2 < w; l2++) \
+        for (l3 = 0; l3 < w; l3++) \
+          s += p01 * psi_t[2 * w + l2] * psi_t[3 * w + l3] \
+            * B_fixed_line_A_ ## w(psi_t + 4 * w, \
+            g01 + l_t[2 * w + l2] + l_t[3 * w + l3], l_t + 4 * w); \
+    } \
+\
+  *fj = s; \
+} \
+\
+static void B_fixed_A_6_ ## w(C *fj, const C *g, const R *psi_t, \
+  const INT *l_t) \
+{ \
+  C s = K(0.0); \
+  INT l0, l1, l2, l3, l4; \
+\
+  for (l0 = 0; l0 < w; l0++) \
+    for (l1 = 0; l1 < w; l1++) \
+      for (l2 = 0; l2 < w; l2++) \
+      { \
+        const R p012 = psi_t[l0] * psi_t[w + l1] * psi_t[2 * w + l2]; \
+        const C *g012 = g + l_t[l0] + l_t[w + l1] + l_t[2 * w + l2]; \
+\
+        for (l3 = 0; l3 < w; l3++) \
+          for (l4 = 0; l4 < w; l4++) \
+            s += p012 * psi_t[3 * w + l3] * psi_t[4 * w + l4] \
+              * B_fixed_line_A_ ## w(psi_t + 5 * w, \
+              g012 + l_t[3 * w + l3] + l_t[4 * w + l4], l_t + 5 * w); \
+      } \
+\
+  *fj = s; \
+} \
+\
+static void B_fixed_T_1_ ## w(C *g, const C fj, const R *psi_t, \
+  const INT *l_t, const INT l0_lo, const INT l0_hi) \
+{ \
+  INT l0; \
+\
+  if (l0_lo == 0 && l0_hi == w) \
+    B_fixed_line_T_ ## w(psi_t, g, l_t, fj); \
+  else \
+    for (l0 = l0_lo; l0 < l0_hi; l0++) \
+      g[l_t[l0]] += psi_t[l0] * fj; \
+} \
+\
+static void B_fixed_T_2_ ## w(C *g, const C fj, const R *psi_t, \
+  const INT *l_t, const INT l0_lo, const INT l0_hi) \
+{ \
+  INT l0; \
+\
+  for (l0 = l0_lo; l0 < l0_hi; l0++) \
+    B_fixed_line_T_ ## w(psi_t + w, g + l_t[l0], l_t + w, psi_t[l0] * fj); \
+} \
+\
+static void B_fixed_T_3_ ## w(C *g, const C fj, const R *psi_t, \
+  const INT *l_t, const INT l0_lo, const INT l0_hi) \
+{ \
+  INT l0, l1; \
+\
+  for (l0 = l0_lo; l0 < l0_hi; l0++) \
+    for (l1 = 0; l1 < w; l1++) \
+      B_fixed_line_T_ ## w(psi_t + 2 * w, g + l_t[l0] + l_t[w + l1], \
+        l_t + 2 * w, psi_t[l0] * psi_t[w + l1] * fj); \
+} \
+\
+static void B_fixed_T_4_ ## w(C *g, const C fj, const R *psi_t, \
+  const INT *l_t, const INT l0_lo, const INT l0_hi) \
+{ \
+  INT l0, l1, l2; \
+\
+  for (l0 = l0_lo; l0 < l0_hi; l0++) \
+    for (l1 = 0; l1 < w; l1++) \
+    { \
+      const C f01 = psi_t[l0] * psi_t[w + l1] * fj; \
+      C *g01 = g + l_t[l0] + l_t[w + l1]; \
+\
+      for (l2 = 0; l2 < w; l2++) \
+        B_fixed_line_T_ ## w(psi_t + 3 * w, g01 + l_t[2 * w + l2], \
+          l_t + 3 * w, psi_t[2 * w + l2] * f01); \
+    } \
+} \
+\
+static void B_fixed_T_5_ ## w(C *g, const C fj, const R *psi_t, \
+  const INT *l_t, const INT l0_lo, const INT l0_hi) \
+{ \
+  INT l0, l1, l2, l3; \
+\
+  for (l0 = l0_lo; l0 < l0_hi; l0++) \
+    for (l1 = 0; l1 < w; l1++) \
+    { \
+      const C f01 = psi_t[l0] * psi_t[w + l1] * fj; \
+      C *g01 = g + l_t[l0] + l_t[w + l1]; \
+\
+      for (l2 = 0; l2 < w; l2++) \
+        for (l3 = 0; l3 < w; l3++) \
+          B_fixed_line_T_ ## w(psi_t + 4 * w, \
+            g01 + l_t[2 * w + l2] + l_t[3 * w + l3], l_t + 4 * w, \
+            psi_t[2 * w + l2] * psi_t[3 * w + l3] * f01); \
+    } \
+} \
+\
+static void B_fixed_T_6_ ## w(C *g, const C fj, const R *psi_t, \
+  const INT *l_t, const INT l0_lo, const INT l0_hi) \
+{ \
+  INT l0, l1, l2, l3, l4; \
+\
+  for (l0 = l0_lo; l0 < l0_hi; l0++) \
+    for (l1 = 0; l1 < w; l1++) \
+      for (l2 = 0; l2 < w; l2++) \
+      { \
+        const C f012 = psi_t[l0] * psi_t[w + l1] * psi_t[2 * w + l2] * fj; \
+        C *g012 = g + l_t[l0] + l_t[w + l1] + l_t[2 * w + l2]; \
+\
+        for (l3 = 0; l3 < w; l3++) \
+          for (l4 = 0; l4 < w; l4++) \
+            B_fixed_line_T_ ## w(psi_t + 5 * w, \
+              g012 + l_t[3 * w + l3] + l_t[4 * w + l4], l_t + 5 * w, \
+              psi_t[3 * w + l3] * psi_t[4 * w + l4] * f012); \
+      } \
+}
 
-  uo2(&u0,&o0,*xj0, n0, m);
-  uo2(&u1,&o1,*xj1, n1, m);
+MACRO_B_FIXED_KERNELS(6)
+MACRO_B_FIXED_KERNELS(8)
+MACRO_B_FIXED_KERNELS(10)
+MACRO_B_FIXED_KERNELS(12)
+MACRO_B_FIXED_KERNELS(14)
+MACRO_B_FIXED_KERNELS(16)
+MACRO_B_FIXED_KERNELS(18)
+MACRO_B_FIXED_KERNELS(20)
+MACRO_B_FIXED_KERNELS(22)
+MACRO_B_FIXED_KERNELS(24)
+MACRO_B_FIXED_KERNELS(26)
+
+typedef struct
+{
+  void (*trafo)(C *fj, const C *g, const R *psi_t, const INT *l_t);
+  void (*adjoint)(C *g, const C fj, const R *psi_t, const INT *l_t,
+    const INT l0_lo, const INT l0_hi);
+} B_fixed_kernels;
 
-  for (l0=0; l0<=2*m+1; l0++)
-    index_temp0[l0] = (u0+l0)%n0;
+#define B_FIXED_KERNELS(d, w) {B_fixed_A_ ## d ## _ ## w, B_fixed_T_ ## d ## _ ## w}
 
-  for (l1=0; l1<=2*m+1; l1++)
-    index_temp1[l1] = (u1+l1)%n1;
+#define B_FIXED_KERNELS_M(d) \
+  {B_FIXED_KERNELS(d, 6), B_FIXED_KERNELS(d, 8), B_FIXED_KERNELS(d, 10), \
+    B_FIXED_KERNELS(d, 12), B_FIXED_KERNELS(d, 14), B_FIXED_KERNELS(d, 16), \
+    B_FIXED_KERNELS(d, 18), B_FIXED_KERNELS(d, 20), B_FIXED_KERNELS(d, 22), \
+    B_FIXED_KERNELS(d, 24), B_FIXED_KERNELS(d, 26)}
 
-  for(l0=0; l0<=2*m+1; l0++)
-  {
-    for(l1=0; l1<=2*m+1; l1++)
-    {
-      INT i = index_temp0[l0] * n1 + index_temp1[l1];
-      C *lhs = g+i;
-      R *lhs_real = (R*)lhs;
-      C val = psij_const0[l0] * psij_const1[l1] * f;
+#define B_FIXED_D_MAX 6
+#define B_FIXED_M_MIN 2
+#define B_FIXED_M_MAX 12
 
-      #pragma omp atomic
-      lhs_real[0] += CREAL(val);
+/** Size of the tap arrays psi_t and l_t of the specialised kernels. */
+#define B_FIXED_TAPS (B_FIXED_D_MAX * (2 * B_FIXED_M_MAX + 2))
 
-      #pragma omp atomic
-      lhs_real[1] += CIMAG(val);
-    }
-  }
-}
-#endif
+/** Kernels by dimension d-1 and cut-off m-B_FIXED_M_MIN. */
+static const B_fixed_kernels B_fixed_table[B_FIXED_D_MAX]
+  [B_FIXED_M_MAX - B_FIXED_M_MIN + 1] =
+{
+  B_FIXED_KERNELS_M(1), B_FIXED_KERNELS_M(2), B_FIXED_KERNELS_M(3),
+  B_FIXED_KERNELS_M(4), B_FIXED_KERNELS_M(5), B_FIXED_KERNELS_M(6)
+};
 
-#ifdef _OPENMP
-/** 
- * Adjoint NFFT for two-dimensional case updating only a specified range of
- * vector g.
- *
- * \arg f input coefficient f[j]
- * \arg g output vector g
- * \arg psij_const0 vector of window function values first component
- * \arg psij_const1 vector of window function values second component
- * \arg xj0 node x[2*j]
- * \arg xj1 node x[2*j+1]
- * \arg n0 FFTW length (number oversampled Fourier coefficients) first comp.
- * \arg n1 FFTW length (number oversampled Fourier coefficients) second comp.
- * \arg m window length
- * \arg my_u0 lowest index (first component) the current thread writes to
- * \arg my_o0 highest index (second component) the current thread writes to
- *
- * \author Toni Volkmer
+/**
+ * Selects the specialised kernels of the plan, or NULL for the generic
+ * B-step. They need the window values per dimension, which are read from
+ * PRE_PSI, also with NFFT_PSI_FLOAT, or computed by window_taps, so the other
+ * precomputations of psi keep the generic B-steps. PRE_FULL_PSI reads
+ * (2m+2)^d values per node where PRE_PSI reads d(2m+2), so the compact
+ * layouts of PRE_FULL_PSI save memory but stay slower than PRE_PSI with
+ * these kernels.
  */
-static void nfft_adjoint_2d_compute_omp_blockwise(const C f, C *g,
-            const R *psij_const0, const R *psij_const1, const R *xj0,
-            const R *xj1, const INT n0, const INT n1, const INT m,
-            const INT my_u0, const INT my_o0)
+static const B_fixed_kernels *B_fixed_select(const X(plan) *ths)
 {
-  INT ar_u0,ar_o0,l0,u1,o1,l1;
-  INT index_temp1[2*m+2];
+  if (ths->d > B_FIXED_D_MAX || ths->m < B_FIXED_M_MIN || ths->m > B_FIXED_M_MAX)
+    return NULL;
 
-  uo2(&ar_u0,&ar_o0,*xj0, n0, m);
-  uo2(&u1,&o1,*xj1, n1, m);
+  if (ths->flags & (PRE_FULL_PSI | PRE_LIN_PSI | PRE_FG_PSI | FG_PSI | NFFT_REAL))
+    return NULL;
 
-  for (l1 = 0; l1 <= 2*m+1; l1++)
-    index_temp1[l1] = (u1+l1)%n1;
+  return &B_fixed_table[ths->d - 1][ths->m - B_FIXED_M_MIN];
+}
 
-  if(ar_u0 < ar_o0)
-  {
-    INT u0 = MAX(my_u0,ar_u0);
-    INT o0 = MIN(my_o0,ar_o0);
-    INT offset_psij = u0-ar_u0;
-#ifdef OMP_ASSERT
-    assert(offset_psij >= 0);
-    assert(o0-u0 <= 2*m+1);
-    assert(offset_psij+o0-u0 <= 2*m+1);
-#endif
+/** Window values and grid indices of node j for the specialised kernels,
+ *  the indices are multiplied by the strides of g. */
+static inline void B_fixed_taps(const X(plan) *ths, const INT j, R *psi_t,
+  INT *l_t)
+{
+  const INT w = 2 * ths->m + 2;
+  INT t, l, stride = 1;
 
-    for (l0 = 0; l0 <= o0-u0; l0++)
-    {
-      INT i0 = (u0+l0) * n1;
-      const C val0 = psij_const0[offset_psij+l0];
+  real_node_taps(ths, j, psi_t, l_t);
 
-      for(l1=0; l1<=2*m+1; l1++)
-        g[i0 + index_temp1[l1]] += val0 * psij_const1[l1] * f;
-    }
-  }
-  else
+  for (t = ths->d - 2; t >= 0; t--)
   {
-    INT u0 = MAX(my_u0,ar_u0);
-    INT o0 = my_o0;
-    INT offset_psij = u0-ar_u0;
-#ifdef OMP_ASSERT
-    assert(offset_psij >= 0);
-    assert(o0-u0 <= 2*m+1);
-    assert(offset_psij+o0-u0 <= 2*m+1);
-#endif
+    stride *= ths->n[t + 1];
 
-    for (l0 = 0; l0 <= o0-u0; l0++)
-    {
-      INT i0 = (u0+l0) * n1;
-      const C val0 = psij_const0[offset_psij+l0];
+    for (l = 0; l < w; l++)
+      l_t[t * w + l] *= stride;
+  }
+}
 
-      for(l1=0; l1<=2*m+1; l1++)
-        g[i0 + index_temp1[l1]] += val0 * psij_const1[l1] * f;
-    }
+/**
+ * Whether a single vector is transformed with the specialised kernels. They
+ * are faster than the B-steps for d = 3 and the generic one for d >= 4, but
+ * not than the SIMD kernels for d = 1,2.
+ */
+static inline int B_fixed_single(const X(plan) *ths, const int adjoint)
+{
+  if (!ths->b_kernels || ths->d < 3)
+    return 0;
 
-    u0 = my_u0;
-    o0 = MIN(my_o0,ar_o0);
-    offset_psij += my_u0-ar_u0+n0;
+  return !adjoint || !(ths->flags & NFFT_OMP_TILED_ADJOINT);
+}
 
-#ifdef OMP_ASSERT
-    if (u0<=o0)
-    {
-      assert(o0-u0 <= 2*m+1);
-      assert(offset_psij+o0-u0 <= 2*m+1);
-    }
+/** B-step with the specialised kernels for all howmany vectors. */
+static void B_fixed_A(X(plan) *ths)
+{
+  const B_fixed_kernels *kernels = (const B_fixed_kernels*) ths->b_kernels;
+  INT jj;
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) private(jj)
 #endif
+  for (jj = 0; jj < ths->M_total; jj++)
+  {
+    const INT j = B_many_node(ths, jj);
+    R psi_t[B_FIXED_TAPS];
+    INT l_t[B_FIXED_TAPS], k;
 
-    for (l0 = 0; l0 <= o0-u0; l0++)
-    {
-      INT i0 = (u0+l0) * n1;
-      const C val0 = psij_const0[offset_psij+l0];
+    B_fixed_taps(ths, j, psi_t, l_t);
 
-      for(l1=0; l1<=2*m+1; l1++)
-        g[i0 + index_temp1[l1]] += val0 * psij_const1[l1] * f;
-    }
+    for (k = 0; k < ths->howmany; k++)
+      kernels->trafo(ths->f + k * ths->M_total + j, ths->g + k * ths->n_total,
+        psi_t, l_t);
   }
 }
-#endif
 
-#ifndef _OPENMP
-static void nfft_adjoint_2d_compute_serial(const C *fj, C *g,
-            const R *psij_const0, const R *psij_const1, const R *xj0,
-            const R *xj1, const INT n0, const INT n1, const INT m)
+/** Adjoint B-step with the specialised kernels for the vectors k_lo,...,
+ *  k_hi-1, which are spread by the calling thread only. */
+static void B_fixed_T(X(plan) *ths, const INT k_lo, const INT k_hi)
 {
-  INT u0,o0,l0,u1,o1,l1;
-  C *gj;
-  const R *psij0,*psij1;
+  const B_fixed_kernels *kernels = (const B_fixed_kernels*) ths->b_kernels;
+  const INT w = 2 * ths->m + 2;
+  INT jj, k;
 
-  psij0=psij_const0;
-  psij1=psij_const1;
+  for (k = k_lo; k < k_hi; k++)
+    memset(ths->g + k * ths->n_total, 0, (size_t)(ths->n_total) * sizeof(C));
 
-  uo2(&u0,&o0,*xj0, n0, m);
-  uo2(&u1,&o1,*xj1, n1, m);
+  for (jj = 0; jj < ths->M_total; jj++)
+  {
+    const INT j = B_many_node(ths, jj);
+    R psi_t[B_FIXED_TAPS];
+    INT l_t[B_FIXED_TAPS];
 
-  if(u0<o0)
-      if(u1<o1)
-    for(l0=0; l0<=2*m+1; l0++,psij0++)
-    {
-        psij1=psij_const1;
-        gj=g+(u0+l0)*n1+u1;
-        for(l1=0; l1<=2*m+1; l1++)
-    (*gj++) += (*psij0) * (*psij1++) * (*fj);
-    }
-      else
-    for(l0=0; l0<=2*m+1; l0++,psij0++)
+    B_fixed_taps(ths, j, psi_t, l_t);
+
+    for (k = k_lo; k < k_hi; k++)
+      kernels->adjoint(ths->g + k * ths->n_total, ths->f[k * ths->M_total + j],
+        psi_t, l_t, 0, w);
+  }
+}
+
+#ifdef _OPENMP
+/**
+ * Spreads node j with the specialised kernels into the rows my_u0,...,my_o0
+ * of the first dimension of g, the block of the calling thread.
+ */
+static inline void B_fixed_block_node(const X(plan) *ths, const INT j, C *g,
+  const C fj, const INT my_u0, const INT my_o0)
+{
+  const B_fixed_kernels *kernels = (const B_fixed_kernels*) ths->b_kernels;
+  const INT w = 2 * ths->m + 2, n0 = ths->n[0];
+  INT u, o, a_lo, a_hi, b_lo, b_hi;
+
+  uo(ths, j, &u, &o, 0);
+  u = (u + n0) % n0;
+
+  /* rows u+l for l < n0-u, and u+l-n0 for the rows that wrap around */
+  a_lo = MAX(0, my_u0 - u);
+  a_hi = MIN(MIN(w, n0 - u), my_o0 - u + 1);
+  b_lo = MAX(n0 - u, my_u0 + n0 - u);
+  b_hi = MIN(w, my_o0 + n0 - u + 1);
+
+  if (a_lo < a_hi || b_lo < b_hi)
+  {
+    R psi_t[B_FIXED_TAPS];
+    INT l_t[B_FIXED_TAPS];
+
+    B_fixed_taps(ths, j, psi_t, l_t);
+
+    if (a_lo < a_hi)
+      kernels->adjoint(g, fj, psi_t, l_t, a_lo, a_hi);
+
+    if (b_lo < b_hi)
+      kernels->adjoint(g, fj, psi_t, l_t, b_lo, b_hi);
+  }
+}
+
+/**
+ * Adjoint B-step with the specialised kernels for the vector k, parallelised
+ * like NFFT_OMP_BLOCKWISE_ADJOINT. Every thread owns a block of rows of the
+ * first dimension of g and spreads the parts of the windows that fall into
+ * it. With sorted nodes, the nodes that reach the block are found by binary
+ * search, otherwise every thread checks all nodes.
+ */
+static void B_fixed_blockwise_T(X(plan) *ths, const INT k)
+{
+  C *g = ths->g + k * ths->n_total;
+  const C *f = ths->f + k * ths->M_total;
+
+  memset(g, 0, (size_t)(ths->n_total) * sizeof(C));
+
+  #pragma omp parallel default(shared)
+  {
+    INT my_u0, my_o0, min_u[2], max_u[2], r, jj;
+    const INT *ar_x = ths->index_x;
+
+    nfft_adjoint_B_omp_blockwise_init(&my_u0, &my_o0, &min_u[0], &max_u[0],
+      &min_u[1], &max_u[1], ths->d, ths->n, ths->m);
+
+    if (my_u0 != -1 && (ths->flags & NFFT_SORT_NODES))
     {
-        psij1=psij_const1;
-        gj=g+(u0+l0)*n1+u1;
-        for(l1=0; l1<2*m+1-o1; l1++)
-      (*gj++) += (*psij0) * (*psij1++) * (*fj);
-        gj=g+(u0+l0)*n1;
-        for(l1=0; l1<=o1; l1++)
-      (*gj++) += (*psij0) * (*psij1++) * (*fj);
-    }
-  else
-      if(u1<o1)
+      for (r = 0; r < 2; r++)
       {
-    for(l0=0; l0<2*m+1-o0; l0++,psij0++)
-    {
-        psij1=psij_const1;
-        gj=g+(u0+l0)*n1+u1;
-        for(l1=0; l1<=2*m+1; l1++)
-      (*gj++) += (*psij0) * (*psij1++) * (*fj);
-    }
-    for(l0=0; l0<=o0; l0++,psij0++)
-    {
-        psij1=psij_const1;
-        gj=g+l0*n1+u1;
-        for(l1=0; l1<=2*m+1; l1++)
-      (*gj++) += (*psij0) * (*psij1++) * (*fj);
-    }
+        if (min_u[r] == -1)
+          continue;
+
+        for (jj = index_x_binary_search(ar_x, ths->M_total, min_u[r]);
+          jj < ths->M_total; jj++)
+        {
+          if (ar_x[2 * jj] < min_u[r] || ar_x[2 * jj] > max_u[r])
+            break;
+
+          B_fixed_block_node(ths, ar_x[2 * jj + 1], g, f[ar_x[2 * jj + 1]],
+            my_u0, my_o0);
+        }
       }
-      else
-      {
-    for(l0=0; l0<2*m+1-o0; l0++,psij0++)
-    {
-        psij1=psij_const1;
-        gj=g+(u0+l0)*n1+u1;
-        for(l1=0; l1<2*m+1-o1; l1++)
-      (*gj++) += (*psij0) * (*psij1++) * (*fj);
-        gj=g+(u0+l0)*n1;
-        for(l1=0; l1<=o1; l1++)
-      (*gj++) += (*psij0) * (*psij1++) * (*fj);
     }
-    for(l0=0; l0<=o0; l0++,psij0++)
+    else if (my_u0 != -1)
     {
-        psij1=psij_const1;
-        gj=g+l0*n1+u1;
-        for(l1=0; l1<2*m+1-o1; l1++)
-      (*gj++) += (*psij0) * (*psij1++) * (*fj);
-        gj=g+l0*n1;
-        for(l1=0; l1<=o1; l1++)
-      (*gj++) += (*psij0) * (*psij1++) * (*fj);
+      for (jj = 0; jj < ths->M_total; jj++)
+        B_fixed_block_node(ths, jj, g, f[jj], my_u0, my_o0);
     }
-      }
+  }
 }
 #endif
 
-static void nfft_trafo_2d_B(X(plan) *ths)
+/* ## grid with ghost cells, flag NFFT_GHOST_CELLS ########################### */
+
+/** Length of dimension t of the grid with ghost cells. */
+static inline INT ghost_n(const X(plan) *ths, const INT t)
 {
-  const C *g = (C*)ths->g;
-  const INT n0 = ths->n[0];
-  const INT n1 = ths->n[1];
-  const INT M = ths->M_total;
-  const INT m = ths->m;
+  return ths->n[t] + 2 * ths->m + 2;
+}
 
-  INT k;
+/** Position of grid point 0 in dimension t of the grid with ghost cells. The
+ *  windows of all nodes in [-0.5,0.5) then lie inside the grid. */
+static inline INT ghost_shift(const X(plan) *ths, const INT t)
+{
+  return (ths->n[t] + 1) / 2 + ths->m;
+}
 
-  if(ths->flags & PRE_FULL_PSI)
+/** Number of points of the grid with ghost cells. */
+static INT ghost_total(const X(plan) *ths)
+{
+  INT t, total = 1;
+
+  for (t = 0; t < ths->d; t++)
+    total *= ghost_n(ths, t);
+
+  return total;
+}
+
+/** Copies the periodic line src of length n to the line dst of length ng with
+ *  ghost cells, dst[p] = src[(p-s) mod n]. */
+static inline void ghost_line_fill(C *dst, const C *src, const INT n,
+  const INT ng, const INT s)
+{
+  INT p = 0, i = (n - s % n) % n;
+
+  while (p < ng)
   {
-    const INT lprod = (2*m+2) * (2*m+2);
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      INT l;
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      ths->f[j] = K(0.0);
-      for (l = 0; l < lprod; l++)
-        ths->f[j] += ths->psi[j*lprod+l] * g[ths->psi_index_g[j*lprod+l]];
-    }
-    return;
-  } /* if(PRE_FULL_PSI) */
+    const INT len = MIN(ng - p, n - i);
+    memcpy(dst + p, src + i, (size_t)(len) * sizeof(C));
+    p += len;
+    i = 0;
+  }
+}
 
-  if(ths->flags & PRE_PSI)
+/** Adds the line src with ghost cells to the periodic line dst,
+ *  dst[(p-s) mod n] += src[p]. */
+static inline void ghost_line_fold(C *dst, const C *src, const INT n,
+  const INT ng, const INT s)
+{
+  INT p = 0, i = (n - s % n) % n;
+
+  while (p < ng)
   {
+    const INT len = MIN(ng - p, n - i);
+    INT l;
+
+    for (l = 0; l < len; l++)
+      dst[i + l] += src[p + l];
+
+    p += len;
+    i = 0;
+  }
+}
+
+/** Periodic copy of the grid g to the grid gg with ghost cells. */
+static void ghost_fill(const X(plan) *ths, const C *g, C *gg)
+{
+  const INT d = ths->d, ng = ghost_n(ths, d - 1);
+  const INT lines = ghost_total(ths) / ng;
+  INT r;
+
 #ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
+  #pragma omp parallel for default(shared) private(r)
 #endif
-    for (k = 0; k < M; k++)
+  for (r = 0; r < lines; r++)
+  {
+    INT t, r_temp = r, src = 0, stride = ths->n[d - 1];
+
+    for (t = d - 2; t >= 0; t--)
     {
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      nfft_trafo_2d_compute(ths->f+j, g, ths->psi+j*2*(2*m+2), ths->psi+(j*2+1)*(2*m+2), ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+      const INT p = r_temp % ghost_n(ths, t);
+      r_temp /= ghost_n(ths, t);
+      src += ((p - ghost_shift(ths, t) + ths->n[t]) % ths->n[t]) * stride;
+      stride *= ths->n[t];
     }
 
-      return;
-  } /* if(PRE_PSI) */
-
-  if(ths->flags & PRE_FG_PSI)
-  {
-    R fg_exp_l[2*(2*m+2)];
+    ghost_line_fill(gg + r * ng, g + src, ths->n[d - 1], ng,
+      ghost_shift(ths, d - 1));
+  }
+}
 
-    nfft_2d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
-    nfft_2d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
+/** Folds the grid gg with ghost cells back onto the periodic grid g. Every
+ *  line of g gathers the at most 3^(d-1) lines of gg that map onto it. */
+static void ghost_fold(const X(plan) *ths, const C *gg, C *g)
+{
+  const INT d = ths->d, n = ths->n[d - 1], ng = ghost_n(ths, d - 1);
+  const INT lines = ths->n_total / n;
+  INT r;
 
 #ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
+  #pragma omp parallel for default(shared) private(r)
 #endif
-    for (k = 0; k < M; k++)
+  for (r = 0; r < lines; r++)
+  {
+    INT p_t[3 * d], n_p[d], lj[d], t, r_temp = r, combos = 1, c;
+
+    /* rows of gg in dimension t that map onto row r_t of g */
+    for (t = d - 2; t >= 0; t--)
     {
-      R psij_const[2*(2*m+2)];
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      INT l;
-      R fg_psij0 = ths->psi[2*j*2];
-      R fg_psij1 = ths->psi[2*j*2+1];
-      R fg_psij2 = K(1.0);
+      const INT r_t = r_temp % ths->n[t];
+      INT k;
 
-      psij_const[0] = fg_psij0;
-      for (l = 1; l <= 2*m+1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
-      }
+      r_temp /= ths->n[t];
+      n_p[t] = 0;
 
-      fg_psij0 = ths->psi[2*(j*2+1)];
-      fg_psij1 = ths->psi[2*(j*2+1)+1];
-      fg_psij2 = K(1.0);
-      psij_const[2*m+2] = fg_psij0;
-      for (l = 1; l <= 2*m+1; l++)
+      for (k = -1; k <= 1; k++)
       {
-        fg_psij2 *= fg_psij1;
-        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
+        const INT p = r_t + ghost_shift(ths, t) + k * ths->n[t];
+
+        if (p >= 0 && p < ghost_n(ths, t))
+          p_t[3 * t + n_p[t]++] = p;
       }
 
-      nfft_trafo_2d_compute(ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+      lj[t] = 0;
+      combos *= n_p[t];
     }
 
-    return;
-  } /* if(PRE_FG_PSI) */
+    memset(g + r * n, 0, (size_t)(n) * sizeof(C));
 
-  if(ths->flags & FG_PSI)
-  {
-    R fg_exp_l[2*(2*m+2)];
+    for (c = 0; c < combos; c++)
+    {
+      INT row = 0;
 
-    nfft_2d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
-    nfft_2d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
+      for (t = 0; t < d - 1; t++)
+        row = row * ghost_n(ths, t) + p_t[3 * t + lj[t]];
 
-    sort(ths);
+      ghost_line_fold(g + r * n, gg + row * ng, n, ng, ghost_shift(ths, d - 1));
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      INT u, o, l;
-      R fg_psij0, fg_psij1, fg_psij2;
-      R psij_const[2*(2*m+2)];
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      for (t = d - 2; (t > 0) && (lj[t] == n_p[t] - 1); t--)
+        lj[t] = 0;
 
-      uo(ths, j, &u, &o, (INT)0);
-      fg_psij0 = (PHI(ths->n[0], ths->x[2*j] - ((R)u) / (R)(n0),0));
-      fg_psij1 = EXP(K(2.0) * ((R)(n0) * (ths->x[2*j]) - (R)(u)) / ths->b[0]);
-      fg_psij2 = K(1.0);
-      psij_const[0] = fg_psij0;
-      for (l = 1; l <= 2*m+1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
-      }
+      if (t >= 0)
+        lj[t]++;
+    }
+  }
+}
 
-      uo(ths,j,&u,&o, (INT)1);
-      fg_psij0 = (PHI(ths->n[1], ths->x[2*j+1] - ((R)u) / (R)(n1),1));
-      fg_psij1 = EXP(K(2.0) * ((R)(n1) * (ths->x[2*j+1]) - (R)(u)) / ths->b[1]);
-      fg_psij2 = K(1.0);
-      psij_const[2*m+2] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
-      }
+/**
+ * Lines of the window of node j in the grid with ghost cells, the window is
+ * traversed as lprod/w lines of w = 2m+2 contiguous grid points each. Line l
+ * starts at line_off[l] and carries the product line_psi[l] of the window
+ * values of the outer dimensions, the window values along the line are
+ * psi_t[(d-1)*w+l]. For PRE_FULL_PSI, psij holds all window values instead.
+ */
+static void ghost_node_lines(const X(plan) *ths, const INT j, const INT lprod,
+  R *psi_t, R *psij, INT *line_off, R *line_psi)
+{
+  const INT d = ths->d, w = 2 * ths->m + 2;
+  INT lj[d], off[d], stride[d], t, l_L, s = 0;
+  R phi_prod[d];
 
-      nfft_trafo_2d_compute(ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
-    }
+  for (t = d - 1, stride[d - 1] = 1; t > 0; t--)
+    stride[t - 1] = stride[t] * ghost_n(ths, t);
 
-    return;
-  } /* if(FG_PSI) */
+  off[0] = 0;
 
-  if(ths->flags & PRE_LIN_PSI)
+  for (t = 0; t < d; t++)
   {
-    const INT K = ths->K, ip_s = K / (m + 2);
+    INT u, o;
 
-    sort(ths);
+    uo(ths, j, &u, &o, t);
+    off[0] += (u + ghost_shift(ths, t)) * stride[t];
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      INT u, o, l;
-      R ip_y, ip_w;
-      INT ip_u;
-      R psij_const[2*(2*m+2)];
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+    if (ths->flags & PRE_FULL_PSI)
+      for (l_L = 0; l_L < w; l_L++)
+        psi_t[t * w + l_L] = K(1.0);
+    else if (ths->flags & PRE_PSI)
+      psi_load(ths, (j * d + t) * w, w, psi_t + t * w);
+    else
+      window_taps(ths, ths->x[j * d + t], u, t, psi_t + t * w);
 
-      uo(ths,j,&u,&o,(INT)0);
-      ip_y = FABS((R)(n0) * ths->x[2*j] - (R)(u)) * ((R)ip_s);
-      ip_u = (INT)LRINT(FLOOR(ip_y));
-      ip_w = ip_y - (R)(ip_u);
-      for (l = 0; l < 2*m+2; l++)
-        psij_const[l] = ths->psi[ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) + ths->psi[ABS(ip_u-l*ip_s+1)]*(ip_w);
+    lj[t] = 0;
+  }
 
-      uo(ths,j,&u,&o,(INT)1);
-      ip_y = FABS((R)(n1) * ths->x[2*j+1] - (R)(u)) * ((R)ip_s);
-      ip_u = (INT)(LRINT(FLOOR(ip_y)));
-      ip_w = ip_y - (R)(ip_u);
-      for (l = 0; l < 2*m+2; l++)
-        psij_const[2*m+2+l] = ths->psi[(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) + ths->psi[(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w);
+  if (ths->flags & PRE_FULL_PSI)
+    psi_load(ths, j * lprod, lprod, psij);
+
+  phi_prod[0] = K(1.0);
 
-      nfft_trafo_2d_compute(ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+  for (l_L = 0; l_L < lprod / w; l_L++)
+  {
+    for (t = s; t < d - 1; t++)
+    {
+      phi_prod[t + 1] = phi_prod[t] * psi_t[t * w + lj[t]];
+      off[t + 1] = off[t] + lj[t] * stride[t];
     }
-      return;
-  } /* if(PRE_LIN_PSI) */
 
-  /* no precomputed psi at all */
+    line_off[l_L] = off[d - 1];
+    line_psi[l_L] = phi_prod[d - 1];
 
-  sort(ths);
+    for (s = d - 2; (s > 0) && (lj[s] == w - 1); s--)
+      lj[s] = 0;
+
+    if (s >= 0)
+      lj[s]++;
+    else
+      s = 0;
+  }
+}
+
+/**
+ * B-step on the grid with ghost cells for all howmany vectors. The grid is
+ * copied periodically to g_ghost in one pass before the interpolation, such
+ * that every window is a set of contiguous lines without wrap around.
+ */
+static void B_ghost_A(X(plan) *ths)
+{
+  const INT d = ths->d, w = 2 * ths->m + 2, ng_total = ghost_total(ths);
+  INT t, k, lprod;
+
+  for (t = 0, lprod = 1; t < d; t++)
+    lprod *= w;
+
+  for (k = 0; k < ths->howmany; k++)
+    ghost_fill(ths, ths->g + k * ths->n_total, ths->g_ghost + k * ng_total);
 
 #ifdef _OPENMP
-  #pragma omp parallel for default(shared) private(k)
+  #pragma omp parallel default(shared)
 #endif
-  for (k = 0; k < M; k++)
   {
-    R psij_const[2*(2*m+2)];
-    INT u, o, l;
-    INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+    R *psij = (ths->flags & PRE_FULL_PSI)
+      ? (R*) Y(malloc)((size_t)(lprod) * sizeof(R)) : NULL;
+    INT *line_off = (INT*) Y(malloc)((size_t)(lprod / w) * sizeof(INT));
+    R *line_psi = (R*) Y(malloc)((size_t)(lprod / w) * sizeof(R));
+    R psi_t[d * w];
+    INT jj;
 
-    uo(ths,j,&u,&o,(INT)0);
-    for (l = 0; l <= 2*m+1; l++)
-      psij_const[l]=(PHI(ths->n[0], ths->x[2*j] - ((R)((u+l))) / (R)(n0),0));
+#ifdef _OPENMP
+    #pragma omp for
+#endif
+    for (jj = 0; jj < ths->M_total; jj++)
+    {
+      const INT j = B_many_node(ths, jj);
+      const R *psi_last = psi_t + (d - 1) * w;
+      INT k2, l_L, l;
 
-    uo(ths,j,&u,&o,(INT)1);
-    for (l = 0; l <= 2*m+1; l++)
-      psij_const[2*m+2+l] = (PHI(ths->n[1], ths->x[2*j+1] - ((R)((u+l)))/(R)(n1),1));
+      ghost_node_lines(ths, j, lprod, psi_t, psij, line_off, line_psi);
 
-    nfft_trafo_2d_compute(ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
-  }
-}
+      for (k2 = 0; k2 < ths->howmany; k2++)
+      {
+        const C *gg = ths->g_ghost + k2 * ng_total;
+        C fj = K(0.0);
 
-#define MACRO_adjoint_2d_B_OMP_BLOCKWISE_COMPUTE_PRE_PSI \
-            nfft_adjoint_2d_compute_omp_blockwise(ths->f[j], g, \
-                ths->psi+j*2*(2*m+2), ths->psi+(j*2+1)*(2*m+2), \
-                ths->x+2*j, ths->x+2*j+1, n0, n1, m, my_u0, my_o0);
+        for (l_L = 0; l_L < lprod / w; l_L++)
+        {
+          const C *g_line = gg + line_off[l_L];
+          C line = K(0.0);
 
-#define MACRO_adjoint_2d_B_OMP_BLOCKWISE_COMPUTE_PRE_FG_PSI \
-{ \
-            R psij_const[2*(2*m+2)]; \
-            INT l; \
-            R fg_psij0 = ths->psi[2*j*2]; \
-            R fg_psij1 = ths->psi[2*j*2+1]; \
-            R fg_psij2 = K(1.0); \
- \
-            psij_const[0] = fg_psij0; \
-            for(l=1; l<=2*m+1; l++) \
-            { \
-              fg_psij2 *= fg_psij1; \
-              psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l]; \
-            } \
- \
-            fg_psij0 = ths->psi[2*(j*2+1)]; \
-            fg_psij1 = ths->psi[2*(j*2+1)+1]; \
-            fg_psij2 = K(1.0); \
-            psij_const[2*m+2] = fg_psij0; \
-            for(l=1; l<=2*m+1; l++) \
-            { \
-              fg_psij2 *= fg_psij1; \
-              psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l]; \
-            } \
- \
-            nfft_adjoint_2d_compute_omp_blockwise(ths->f[j], g, \
-                psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, \
-                n0, n1, m, my_u0, my_o0); \
-}
+          if (psij)
+          {
+            const R *psij_line = psij + l_L * w;
 
-#define MACRO_adjoint_2d_B_OMP_BLOCKWISE_COMPUTE_FG_PSI \
-{ \
-            R psij_const[2*(2*m+2)]; \
-            R fg_psij0, fg_psij1, fg_psij2; \
-            INT u, o, l; \
- \
-            uo(ths,j,&u,&o,(INT)0); \
-            fg_psij0 = (PHI(ths->n[0],ths->x[2*j]-((R)u)/((R)n0),0)); \
-            fg_psij1 = EXP(K(2.0)*(((R)n0)*(ths->x[2*j]) - (R)u)/ths->b[0]); \
-            fg_psij2 = K(1.0); \
-            psij_const[0] = fg_psij0; \
-            for(l=1; l<=2*m+1; l++) \
-            { \
-              fg_psij2 *= fg_psij1; \
-              psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l]; \
-            } \
- \
-            uo(ths,j,&u,&o,(INT)1); \
-            fg_psij0 = (PHI(ths->n[1],ths->x[2*j+1]-((R)u)/((R)n1),1)); \
-            fg_psij1 = EXP(K(2.0)*(((R)n1)*(ths->x[2*j+1]) - (R)u)/ths->b[1]); \
-            fg_psij2 = K(1.0); \
-            psij_const[2*m+2] = fg_psij0; \
-            for(l=1; l<=2*m+1; l++) \
-            { \
-              fg_psij2 *= fg_psij1; \
-              psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l]; \
-            } \
- \
-            nfft_adjoint_2d_compute_omp_blockwise(ths->f[j], g, \
-                psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, \
-                n0, n1, m, my_u0, my_o0); \
-}
+            for (l = 0; l < w; l++)
+              line += psij_line[l] * g_line[l];
 
-#define MACRO_adjoint_2d_B_OMP_BLOCKWISE_COMPUTE_PRE_LIN_PSI \
-{ \
-            R psij_const[2*(2*m+2)]; \
-            INT u, o, l; \
-            INT ip_u; \
-            R ip_y, ip_w; \
- \
-            uo(ths,j,&u,&o,(INT)0); \
-            ip_y = FABS(((R)n0)*(ths->x[2*j]) - (R)u)*((R)ip_s); \
-            ip_u = LRINT(FLOOR(ip_y)); \
-            ip_w = ip_y-ip_u; \
-            for(l=0; l < 2*m+2; l++) \
-              psij_const[l] = ths->psi[ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) + \
-                ths->psi[ABS(ip_u-l*ip_s+1)]*(ip_w); \
- \
-            uo(ths,j,&u,&o,(INT)1); \
-            ip_y = FABS(((R)n1)*(ths->x[2*j+1]) - (R)u)*((R)ip_s); \
-            ip_u = LRINT(FLOOR(ip_y)); \
-            ip_w = ip_y-ip_u; \
-            for(l=0; l < 2*m+2; l++) \
-              psij_const[2*m+2+l] = ths->psi[(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) + \
-                ths->psi[(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w); \
- \
-            nfft_adjoint_2d_compute_omp_blockwise(ths->f[j], g, \
-                psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, \
-                n0, n1, m, my_u0, my_o0); \
-}
+            fj += line;
+          }
+          else
+          {
+            for (l = 0; l < w; l++)
+              line += psi_last[l] * g_line[l];
 
-#define MACRO_adjoint_2d_B_OMP_BLOCKWISE_COMPUTE_NO_PSI \
-{ \
-            R psij_const[2*(2*m+2)]; \
-            INT u, o, l; \
- \
-            uo(ths,j,&u,&o,(INT)0); \
-            for(l=0;l<=2*m+1;l++) \
-              psij_const[l]=(PHI(ths->n[0],ths->x[2*j]-((R)((u+l)))/((R)n0),0)); \
- \
-            uo(ths,j,&u,&o,(INT)1); \
-            for(l=0;l<=2*m+1;l++) \
-              psij_const[2*m+2+l]=(PHI(ths->n[1],ths->x[2*j+1]-((R)((u+l)))/((R)n1),1)); \
- \
-            nfft_adjoint_2d_compute_omp_blockwise(ths->f[j], g, \
-                psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, \
-                n0, n1, m, my_u0, my_o0); \
-}
+            fj += line_psi[l_L] * line;
+          }
+        }
 
-#define MACRO_adjoint_2d_B_OMP_BLOCKWISE(whichone) \
-{ \
-    if (ths->flags & NFFT_OMP_BLOCKWISE_ADJOINT) \
-    { \
-      _Pragma("omp parallel private(k)") \
-      { \
-        INT my_u0, my_o0, min_u_a, max_u_a, min_u_b, max_u_b; \
-        INT *ar_x = ths->index_x; \
- \
-        nfft_adjoint_B_omp_blockwise_init(&my_u0, &my_o0, &min_u_a, &max_u_a, \
-            &min_u_b, &max_u_b, 2, ths->n, m); \
- \
-        if (min_u_a != -1) \
-        { \
-          k = index_x_binary_search(ar_x, M, min_u_a); \
- \
-          MACRO_adjoint_nd_B_OMP_BLOCKWISE_ASSERT_A \
- \
-          while (k < M) \
-          { \
-            INT u_prod = ar_x[2*k]; \
-            INT j = ar_x[2*k+1]; \
- \
-            if (u_prod < min_u_a || u_prod > max_u_a) \
-              break; \
- \
-            MACRO_adjoint_2d_B_OMP_BLOCKWISE_COMPUTE_ ##whichone \
- \
-            k++; \
-          } \
-        } \
- \
-        if (min_u_b != -1) \
-        { \
-          INT k = index_x_binary_search(ar_x, M, min_u_b); \
- \
-          MACRO_adjoint_nd_B_OMP_BLOCKWISE_ASSERT_B \
- \
-          while (k < M) \
-          { \
-            INT u_prod = ar_x[2*k]; \
-            INT j = ar_x[2*k+1]; \
- \
-            if (u_prod < min_u_b || u_prod > max_u_b) \
-              break; \
- \
-            MACRO_adjoint_2d_B_OMP_BLOCKWISE_COMPUTE_ ##whichone \
- \
-            k++; \
-          } \
-        } \
-      } /* omp parallel */ \
-      return; \
-    } /* if(NFFT_OMP_BLOCKWISE_ADJOINT) */ \
-}
+        ths->f[k2 * ths->M_total + j] = fj;
+      }
+    }
 
+    Y(free)(line_psi);
+    Y(free)(line_off);
+    Y(free)(psij);
+  }
+}
 
-static void nfft_adjoint_2d_B(X(plan) *ths)
+/** Adjoint B-step on the grid with ghost cells, the spread values are folded
+ *  back onto the periodic grid in one pass afterwards. With OpenMP, every
+ *  thread spreads into its own slab of the first dimension of g_ghost, as for
+ *  NFFT_OMP_BLOCKWISE_ADJOINT, and skips the nodes whose window misses it. */
+static void B_ghost_T(X(plan) *ths)
 {
-  const INT n0 = ths->n[0];
-  const INT n1 = ths->n[1];
-  const INT M = ths->M_total;
-  const INT m = ths->m;
-  C* g = (C*) ths->g;
-  INT k;
-
-  memset(g, 0, (size_t)(ths->n_total) * sizeof(C));
+  const INT d = ths->d, w = 2 * ths->m + 2, ng_total = ghost_total(ths);
+  const INT ng0 = ghost_n(ths, 0), stride0 = ng_total / ng0;
+  INT t, k, lprod;
 
-  if(ths->flags & PRE_FULL_PSI)
-  {
-    nfft_adjoint_B_compute_full_psi(g, ths->psi_index_g, ths->psi, ths->f, M,
-        (INT)2, ths->n, m, ths->flags, ths->index_x);
-    return;
-  } /* if(PRE_FULL_PSI) */
+  for (t = 0, lprod = 1; t < d; t++)
+    lprod *= w;
 
-  if(ths->flags & PRE_PSI)
-  {
-#ifdef _OPENMP
-    MACRO_adjoint_2d_B_OMP_BLOCKWISE(PRE_PSI)
-#endif
+  memset(ths->g_ghost, 0, (size_t)(ng_total * ths->howmany) * sizeof(C));
 
 #ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
+  #pragma omp parallel default(shared)
 #endif
-    for (k = 0; k < M; k++)
-    {
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+  {
 #ifdef _OPENMP
-      nfft_adjoint_2d_compute_omp_atomic(ths->f[j], g, ths->psi+j*2*(2*m+2), ths->psi+(j*2+1)*(2*m+2), ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+    const INT nthreads = omp_get_num_threads(), tid = omp_get_thread_num();
 #else
-      nfft_adjoint_2d_compute_serial(ths->f+j, g, ths->psi+j*2*(2*m+2), ths->psi+(j*2+1)*(2*m+2), ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+    const INT nthreads = 1, tid = 0;
 #endif
-    }
-    return;
-  } /* if(PRE_PSI) */
+    const INT r0 = (ng0 * tid) / nthreads, r1 = (ng0 * (tid + 1)) / nthreads;
+    R *psij = (ths->flags & PRE_FULL_PSI)
+      ? (R*) Y(malloc)((size_t)(lprod) * sizeof(R)) : NULL;
+    INT *line_off = (INT*) Y(malloc)((size_t)(lprod / w) * sizeof(INT));
+    R *line_psi = (R*) Y(malloc)((size_t)(lprod / w) * sizeof(R));
+    R psi_t[d * w];
+    INT jj;
 
-  if(ths->flags & PRE_FG_PSI)
-  {
-    R fg_exp_l[2*(2*m+2)];
+    for (jj = 0; jj < ths->M_total; jj++)
+    {
+      const INT j = B_many_node(ths, jj);
+      const R *psi_last = psi_t + (d - 1) * w;
+      INT k2, l_L, l, u, o;
 
-    nfft_2d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
-    nfft_2d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
+      uo(ths, j, &u, &o, 0);
+      u += ghost_shift(ths, 0);
 
-#ifdef _OPENMP
-    MACRO_adjoint_2d_B_OMP_BLOCKWISE(PRE_FG_PSI)
-#endif
+      if (u + w <= r0 || u >= r1)
+        continue;
 
+      ghost_node_lines(ths, j, lprod, psi_t, psij, line_off, line_psi);
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      R psij_const[2*(2*m+2)];
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      INT l;
-      R fg_psij0 = ths->psi[2*j*2];
-      R fg_psij1 = ths->psi[2*j*2+1];
-      R fg_psij2 = K(1.0);
-
-      psij_const[0] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
+      for (k2 = 0; k2 < ths->howmany; k2++)
       {
-        fg_psij2 *= fg_psij1;
-        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
-      }
+        C *gg = ths->g_ghost + k2 * ng_total;
+        const C fj = ths->f[k2 * ths->M_total + j];
 
-      fg_psij0 = ths->psi[2*(j*2+1)];
-      fg_psij1 = ths->psi[2*(j*2+1)+1];
-      fg_psij2 = K(1.0);
-      psij_const[2*m+2] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
-      }
+        for (l_L = 0; l_L < lprod / w; l_L++)
+        {
+          C *g_line = gg + line_off[l_L];
+          const R *psi_line = psij ? psij + l_L * w : psi_last;
+          const C f_line = psij ? fj : line_psi[l_L] * fj;
+          INT l_lo = 0, l_hi = w;
+
+          /* the part of the line inside the slab, for d = 1 the line runs
+           * along the first dimension itself */
+          if (nthreads > 1)
+          {
+            const INT p0 = line_off[l_L] / stride0;
 
-#ifdef _OPENMP
-      nfft_adjoint_2d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
-#else
-      nfft_adjoint_2d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
-#endif
+            if (d == 1)
+            {
+              l_lo = MAX(0, r0 - p0);
+              l_hi = MIN(w, r1 - p0);
+            }
+            else if (p0 < r0 || p0 >= r1)
+              continue;
+          }
+
+          for (l = l_lo; l < l_hi; l++)
+            g_line[l] += psi_line[l] * f_line;
+        }
+      }
     }
 
+    Y(free)(line_psi);
+    Y(free)(line_off);
+    Y(free)(psij);
+  }
+
+  for (k = 0; k < ths->howmany; k++)
+    ghost_fold(ths, ths->g_ghost + k * ng_total, ths->g + k * ths->n_total);
+}
+
+/** B-step for all howmany vectors, each window value is loaded once per node
+ *  and applied to every vector. */
+static void B_many_A(X(plan) *ths)
+{
+  INT t, lprod;
+
+  if (ths->flags & NFFT_GHOST_CELLS)
+  {
+    B_ghost_A(ths);
     return;
-  } /* if(PRE_FG_PSI) */
+  }
 
-  if(ths->flags & FG_PSI)
+  if (ths->b_kernels)
   {
-    R fg_exp_l[2*(2*m+2)];
+    B_fixed_A(ths);
+    return;
+  }
 
-    nfft_2d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
-    nfft_2d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
+  if (psi_compact(ths))
+  {
+    B_compact_A(ths);
+    return;
+  }
 
-    sort(ths);
+  for (t = 0, lprod = 1; t < ths->d; t++)
+    lprod *= 2 * ths->m + 2;
+
+  memset(ths->f, 0, (size_t)(ths->M_total * ths->howmany) * sizeof(C));
 
 #ifdef _OPENMP
-    MACRO_adjoint_2d_B_OMP_BLOCKWISE(FG_PSI)
+  #pragma omp parallel default(shared)
 #endif
+  {
+    R *psij = (R*) Y(malloc)((size_t)(lprod) * sizeof(R));
+    INT *idx = (INT*) Y(malloc)((size_t)(lprod) * sizeof(INT));
+    INT jj;
 
 #ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
+    #pragma omp for
 #endif
-    for (k = 0; k < M; k++)
+    for (jj = 0; jj < ths->M_total; jj++)
     {
-      INT u, o, l;
-      R fg_psij0, fg_psij1, fg_psij2;
-      R psij_const[2*(2*m+2)];
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      const INT j = B_many_node(ths, jj);
+      INT k, l;
 
-      uo(ths,j,&u,&o,(INT)0);
-      fg_psij0 = (PHI(ths->n[0], ths->x[2*j] - ((R)u)/(R)(n0),0));
-      fg_psij1 = EXP(K(2.0) * ((R)(n0) * (ths->x[2*j]) - (R)(u)) / ths->b[0]);
-      fg_psij2 = K(1.0);
-      psij_const[0] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
+      B_many_stencil(ths, j, lprod, psij, idx);
+
+      for (k = 0; k < ths->howmany; k++)
       {
-        fg_psij2 *= fg_psij1;
-        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
+        const C *g = ths->g + k * ths->n_total;
+        C fj = K(0.0);
+
+        for (l = 0; l < lprod; l++)
+          fj += psij[l] * g[idx[l]];
+
+        ths->f[k * ths->M_total + j] = fj;
       }
+    }
 
-      uo(ths,j,&u,&o,(INT)1);
-      fg_psij0 = (PHI(ths->n[1], ths->x[2*j+1] - ((R)u) / (R)(n1),1));
-      fg_psij1 = EXP(K(2.0) * ((R)(n1) * (ths->x[2*j+1]) - (R)(u)) / ths->b[1]);
-      fg_psij2 = K(1.0);
-      psij_const[2*m+2] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
+    Y(free)(idx);
+    Y(free)(psij);
+  }
+}
+
+/** Adjoint B-step for all howmany vectors. With OpenMP, every thread spreads
+ *  into its own subset of the vectors. */
+static void B_many_T(X(plan) *ths)
+{
+  INT t, lprod;
+
+  if (ths->flags & NFFT_GHOST_CELLS)
+  {
+    B_ghost_T(ths);
+    return;
+  }
+
+  if (ths->b_kernels)
+  {
+#ifdef _OPENMP
+    if (ths->howmany >= Y(get_num_threads)())
+    {
+      /* every thread spreads into its own subset of the vectors */
+      #pragma omp parallel default(shared)
       {
-        fg_psij2 *= fg_psij1;
-        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
+        const INT nthreads = omp_get_num_threads(), tid = omp_get_thread_num();
+        B_fixed_T(ths, (ths->howmany * tid) / nthreads,
+          (ths->howmany * (tid + 1)) / nthreads);
       }
+    }
+    else
+    {
+      INT k;
 
-#ifdef _OPENMP
-      nfft_adjoint_2d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+      for (k = 0; k < ths->howmany; k++)
+        B_fixed_blockwise_T(ths, k);
+    }
 #else
-      nfft_adjoint_2d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+    B_fixed_T(ths, 0, ths->howmany);
 #endif
-    }
+    return;
+  }
 
+  if (psi_compact(ths))
+  {
+    B_compact_T(ths);
     return;
-  } /* if(FG_PSI) */
+  }
 
-  if(ths->flags & PRE_LIN_PSI)
+#ifdef _OPENMP
+  if (ths->howmany < Y(get_num_threads)())
   {
-    const INT K = ths->K;
-    const INT ip_s = K / (m + 2);
+    /* too few vectors to keep all threads busy, use the single vector
+     * B-step and its parallelisation */
+    C *f = ths->f, *g = ths->g;
+    INT k;
 
-    sort(ths);
+    for (k = 0; k < ths->howmany; k++)
+    {
+      ths->f = f + k * ths->M_total;
+      ths->g = g + k * ths->n_total;
+      B_T(ths);
+    }
+
+    ths->f = f;
+    ths->g = g;
+    return;
+  }
+#endif
+
+  for (t = 0, lprod = 1; t < ths->d; t++)
+    lprod *= 2 * ths->m + 2;
+
+  memset(ths->g, 0, (size_t)(ths->n_total * ths->howmany) * sizeof(C));
 
 #ifdef _OPENMP
-    MACRO_adjoint_2d_B_OMP_BLOCKWISE(PRE_LIN_PSI)
+  #pragma omp parallel default(shared)
 #endif
+  {
+    R *psij = (R*) Y(malloc)((size_t)(lprod) * sizeof(R));
+    INT *idx = (INT*) Y(malloc)((size_t)(lprod) * sizeof(INT));
+    INT jj, k_lo = 0, k_hi = ths->howmany;
 
 #ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
+    {
+      const INT nthreads = omp_get_num_threads(), tid = omp_get_thread_num();
+      k_lo = (ths->howmany * tid) / nthreads;
+      k_hi = (ths->howmany * (tid + 1)) / nthreads;
+    }
 #endif
-    for (k = 0; k < M; k++)
+
+    for (jj = 0; jj < ths->M_total; jj++)
     {
-      INT u,o,l;
-      INT ip_u;
-      R ip_y, ip_w;
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      R psij_const[2*(2*m+2)];
+      const INT j = B_many_node(ths, jj);
+      INT k, l;
 
-      uo(ths,j,&u,&o,(INT)0);
-      ip_y = FABS((R)(n0) * (ths->x[2*j]) - (R)(u)) * ((R)ip_s);
-      ip_u = (INT)(LRINT(FLOOR(ip_y)));
-      ip_w = ip_y - (R)(ip_u);
-      for(l=0; l < 2*m+2; l++)
-        psij_const[l] = ths->psi[ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
-          ths->psi[ABS(ip_u-l*ip_s+1)]*(ip_w);
+      B_many_stencil(ths, j, lprod, psij, idx);
 
-      uo(ths,j,&u,&o,(INT)1);
-      ip_y = FABS((R)(n1) * (ths->x[2*j+1]) - (R)(u)) * ((R)ip_s);
-      ip_u = (INT)(LRINT(FLOOR(ip_y)));
-      ip_w = ip_y - (R)(ip_u);
-      for(l=0; l < 2*m+2; l++)
-        psij_const[2*m+2+l] = ths->psi[(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
-          ths->psi[(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w);
+      for (k = k_lo; k < k_hi; k++)
+      {
+        C *g = ths->g + k * ths->n_total;
+        const C fj = ths->f[k * ths->M_total + j];
 
-#ifdef _OPENMP
-      nfft_adjoint_2d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
-#else
-      nfft_adjoint_2d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
-#endif
+        for (l = 0; l < lprod; l++)
+          g[idx[l]] += psij[l] * fj;
+      }
+    }
+
+    Y(free)(idx);
+    Y(free)(psij);
   }
-      return;
-    } /* if(PRE_LIN_PSI) */
+}
 
-  /* no precomputed psi at all */
-  sort(ths);
+/**
+ * Row-column FFT along dimension t for flag NFFT_PRUNED_FFT. Only the lines
+ * whose indices in the dimensions before t lie in the support
+ * [0,N_j/2) u [n_j-N_j/2,n_j) of g_hat are transformed. Each such
+ * dimension is described to FFTW as two loops, one over both blocks and
+ * one inside a block.
+ */
+static FFTW(plan) pruned_fft_plan(X(plan) *ths, const INT t, C *in, C *out,
+  const int sign)
+{
+  FFTW(iodim64) dim, loop[2 * ths->d];
+  INT j, stride = 1, rank = 0;
 
-#ifdef _OPENMP
-  MACRO_adjoint_2d_B_OMP_BLOCKWISE(NO_PSI)
-#endif
+  for (j = ths->d - 1; j >= 0; stride *= ths->n[j--])
+  {
+    if (j == t)
+    {
+      dim.n = ths->n[j];
+      dim.is = dim.os = stride;
+    }
+    else if (j < t)
+    {
+      const INT h = (ths->N[j] + 1) / 2;
+      loop[rank].n = 2;
+      loop[rank].is = loop[rank].os = (ths->n[j] - h) * stride;
+      loop[rank + 1].n = h;
+      loop[rank + 1].is = loop[rank + 1].os = stride;
+      rank += 2;
+    }
+    else
+    {
+      loop[rank].n = ths->n[j];
+      loop[rank].is = loop[rank].os = stride;
+      rank++;
+    }
+  }
 
-#ifdef _OPENMP
-  #pragma omp parallel for default(shared) private(k)
-#endif
-  for (k = 0; k < M; k++)
+  if (ths->howmany > 1)
   {
-    INT u,o,l;
-    R psij_const[2*(2*m+2)];
-    INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+    loop[rank].n = ths->howmany;
+    loop[rank].is = loop[rank].os = ths->n_total;
+    rank++;
+  }
 
-    uo(ths,j,&u,&o,(INT)0);
-    for(l=0;l<=2*m+1;l++)
-      psij_const[l]=(PHI(ths->n[0], ths->x[2*j] - ((R)((u+l))) / (R)(n0),0));
+  return FFTW(plan_guru64_dft)(1, &dim, (int)rank, loop, in, out, sign,
+    ths->fftw_flags);
+}
 
-    uo(ths,j,&u,&o,(INT)1);
-    for(l=0;l<=2*m+1;l++)
-      psij_const[2*m+2+l]=(PHI(ths->n[1], ths->x[2*j+1] - ((R)((u+l))) / (R)(n1),1));
+/** Plans for flag NFFT_PRUNED_FFT. The forward FFT transforms the last
+ *  dimension first, the backward FFT the first dimension first, so that
+ *  the zero padding of g_hat is skipped in either direction. */
+static void pruned_fft_init(X(plan) *ths)
+{
+  INT t;
 
-#ifdef _OPENMP
-    nfft_adjoint_2d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
-#else
-    nfft_adjoint_2d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
-#endif
+  ths->pruned_plan1 = (FFTW(plan)*) Y(malloc)((size_t)(ths->d) * sizeof(FFTW(plan)));
+  ths->pruned_plan2 = (FFTW(plan)*) Y(malloc)((size_t)(ths->d) * sizeof(FFTW(plan)));
+
+  for (t = 0; t < ths->d; t++)
+  {
+    ths->pruned_plan1[t] = pruned_fft_plan(ths, t, ths->g1,
+      t == 0 ? ths->g2 : ths->g1, FFTW_FORWARD);
+    ths->pruned_plan2[t] = pruned_fft_plan(ths, t, t == 0 ? ths->g2 : ths->g1,
+      ths->g1, FFTW_BACKWARD);
   }
 }
 
-
-void X(trafo_2d)(X(plan) *ths)
+static void pruned_fft_finalize(X(plan) *ths)
 {
-  if((ths->N[0] <= ths->m) || (ths->N[1] <= ths->m) || (ths->n[0] <= 2*ths->m+2) || (ths->n[1] <= 2*ths->m+2))
+  INT t;
+
+  for (t = 0; t < ths->d; t++)
   {
-    X(trafo_direct)(ths);
-    return;
+    FFTW(destroy_plan)(ths->pruned_plan1[t]);
+    FFTW(destroy_plan)(ths->pruned_plan2[t]);
   }
-  
-  INT k0,k1,n0,n1,N0,N1;
-  C *g_hat,*f_hat;
-  R *c_phi_inv01, *c_phi_inv02, *c_phi_inv11, *c_phi_inv12;
-  R ck01, ck02, ck11, ck12;
-  C *g_hat11,*f_hat11,*g_hat21,*f_hat21,*g_hat12,*f_hat12,*g_hat22,*f_hat22;
 
-  ths->g_hat=ths->g1;
-  ths->g=ths->g2;
+  Y(free)(ths->pruned_plan1);
+  Y(free)(ths->pruned_plan2);
+}
 
-  N0=ths->N[0];
-  N1=ths->N[1];
-  n0=ths->n[0];
-  n1=ths->n[1];
+/** Forward FFT from g1 to g2. The new-array execute functions of FFTW are
+ *  used, so that the grids may be replaced by a workspace, see
+ *  nfft_trafo_execute. */
+static void fft_forward(X(plan) *ths)
+{
+  if (ths->flags & NFFT_PRUNED_FFT)
+  {
+    INT t;
 
-  f_hat=(C*)ths->f_hat;
-  g_hat=(C*)ths->g_hat;
+    for (t = ths->d - 1; t >= 0; t--)
+      FFTW(execute_dft)(ths->pruned_plan1[t], ths->g1, t == 0 ? ths->g2 : ths->g1);
+  }
+  else
+    FFTW(execute_dft)(ths->my_fftw_plan1, ths->g1, ths->g2);
 
-  TIC(0)
-#ifdef _OPENMP
-  #pragma omp parallel for default(shared) private(k0)
-  for (k0 = 0; k0 < ths->n_total; k0++)
-    ths->g_hat[k0] = 0.0;
-#else
-  memset(ths->g_hat, 0, (size_t)(ths->n_total) * sizeof(C));
-#endif
-  if(ths->flags & PRE_PHI_HUT)
-    {
-      c_phi_inv01=ths->c_phi_inv[0];
-      c_phi_inv02=&ths->c_phi_inv[0][N0/2];
+  /* the D-step left g1 zero outside the coefficients, which an out-of-place
+   * FFT with FFTW_PRESERVE_INPUT keeps for the next one */
+  ths->g_hat_zero_padded = (ths->flags & FFT_OUT_OF_PLACE)
+    && (ths->fftw_flags & FFTW_PRESERVE_INPUT)
+    && !(ths->flags & (NFFT_PRUNED_FFT | NFFT_SHARED_GRID));
+}
 
-#ifdef _OPENMP
-      #pragma omp parallel for default(shared) private(k0,k1,ck01,ck02,c_phi_inv11,c_phi_inv12,g_hat11,f_hat11,g_hat21,f_hat21,g_hat12,f_hat12,g_hat22,f_hat22,ck11,ck12)
-#endif
-      for(k0=0;k0<N0/2;k0++)
-      {
-        ck01=c_phi_inv01[k0];
-        ck02=c_phi_inv02[k0];
+/** Backward FFT from g2 to g1. */
+static void fft_backward(X(plan) *ths)
+{
+  if (ths->flags & NFFT_PRUNED_FFT)
+  {
+    INT t;
 
-        c_phi_inv11=ths->c_phi_inv[1];
-        c_phi_inv12=&ths->c_phi_inv[1][N1/2];
+    for (t = 0; t < ths->d; t++)
+      FFTW(execute_dft)(ths->pruned_plan2[t], t == 0 ? ths->g2 : ths->g1, ths->g1);
+  }
+  else
+    FFTW(execute_dft)(ths->my_fftw_plan2, ths->g2, ths->g1);
 
-        g_hat11=g_hat + (n0-(N0/2)+k0)*n1+n1-(N1/2);
-        f_hat11=f_hat + k0*N1;
-        g_hat21=g_hat + k0*n1+n1-(N1/2);
-        f_hat21=f_hat + ((N0/2)+k0)*N1;
-        g_hat12=g_hat + (n0-(N0/2)+k0)*n1;
-        f_hat12=f_hat + k0*N1+(N1/2);
-        g_hat22=g_hat + k0*n1;
-        f_hat22=f_hat + ((N0/2)+k0)*N1+(N1/2);
+  ths->g_hat_zero_padded = 0;
+}
 
-        for(k1=0;k1<N1/2;k1++)
-        {
-          ck11=c_phi_inv11[k1];
-          ck12=c_phi_inv12[k1];
+/* ## real-valued version, flag NFFT_REAL  ################################## */
 
-          g_hat11[k1] = f_hat11[k1] * ck01 * ck11;
-          g_hat21[k1] = f_hat21[k1] * ck02 * ck11;
-          g_hat12[k1] = f_hat12[k1] * ck01 * ck12;
-          g_hat22[k1] = f_hat22[k1] * ck02 * ck12;
-        }
-      }
-    }
-  else
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k0,k1,ck01,ck02,ck11,ck12)
-#endif
-    for(k0=0;k0<N0/2;k0++)
-      {
-  ck01=K(1.0)/(PHI_HUT(ths->n[0],k0-N0/2,0));
-  ck02=K(1.0)/(PHI_HUT(ths->n[0],k0,0));
-  for(k1=0;k1<N1/2;k1++)
-    {
-      ck11=K(1.0)/(PHI_HUT(ths->n[1],k1-N1/2,1));
-      ck12=K(1.0)/(PHI_HUT(ths->n[1],k1,1));
-      g_hat[(n0-N0/2+k0)*n1+n1-N1/2+k1] = f_hat[k0*N1+k1]             * ck01 * ck11;
-      g_hat[k0*n1+n1-N1/2+k1]           = f_hat[(N0/2+k0)*N1+k1]      * ck02 * ck11;
-      g_hat[(n0-N0/2+k0)*n1+k1]         = f_hat[k0*N1+N1/2+k1]        * ck01 * ck12;
-      g_hat[k0*n1+k1]                   = f_hat[(N0/2+k0)*N1+N1/2+k1] * ck02 * ck12;
-    }
-      }
+/** Number of coefficients stored in f_hat for flag NFFT_REAL. */
+static inline INT real_N_hat(const X(plan) *ths)
+{
+  return ths->N_total / ths->N[ths->d - 1] * (ths->N[ths->d - 1] / 2);
+}
 
-  TOC(0)
+/** Size of the half-complex oversampled grid g_hat for flag NFFT_REAL. */
+static inline INT real_n_hat(const X(plan) *ths)
+{
+  return ths->n_total / ths->n[ths->d - 1] * (ths->n[ths->d - 1] / 2 + 1);
+}
 
-  TIC_FFTW(1)
-  FFTW(execute)(ths->my_fftw_plan1);
-  TOC_FFTW(1);
+/**
+ * Frequency k, plain index in g_hat and deconvolution factor of the stored
+ * coefficient k_L for flag NFFT_REAL. The last component of k runs over
+ * 0,...,N_{d-1}/2-1, all others over -N_t/2,...,N_t/2-1.
+ */
+static void real_coefficient(const X(plan) *ths, const INT k_L, INT *k,
+  INT *k_plain, R *c_phi_inv_k)
+{
+  INT t, k_temp = k_L, n_t;
 
-  TIC(2);
-  nfft_trafo_2d_B(ths);
-  TOC(2);
+  for (t = ths->d - 1; t >= 0; t--)
+  {
+    const INT N_t = (t == ths->d - 1) ? ths->N[t] / 2 : ths->N[t];
+    k[t] = k_temp % N_t - ((t == ths->d - 1) ? 0 : ths->N[t] / 2);
+    k_temp /= N_t;
+  }
+
+  *k_plain = 0;
+  *c_phi_inv_k = K(1.0);
+
+  for (t = 0; t < ths->d; t++)
+  {
+    n_t = (t == ths->d - 1) ? ths->n[t] / 2 + 1 : ths->n[t];
+    *k_plain = *k_plain * n_t + (k[t] + ths->n[t]) % ths->n[t];
+
+    if (ths->flags & PRE_PHI_HUT)
+      *c_phi_inv_k *= ths->c_phi_inv[t][k[t] + ths->N[t] / 2];
+    else
+      *c_phi_inv_k /= PHI_HUT(ths->n[t], k[t], t);
+  }
 }
 
-void X(adjoint_2d)(X(plan) *ths)
+/** D-step for flag NFFT_REAL. The complex conjugate turns the backward
+ *  c2r FFT of FFTW into the forward transform of the nfft. */
+static void D_real_A(X(plan) *ths)
 {
-  if((ths->N[0] <= ths->m) || (ths->N[1] <= ths->m) || (ths->n[0] <= 2*ths->m+2) || (ths->n[1] <= 2*ths->m+2))
+  INT k_L;
+
+  memset(ths->g_hat, 0, (size_t)(real_n_hat(ths)) * sizeof(C));
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) private(k_L)
+#endif
+  for (k_L = 0; k_L < real_N_hat(ths); k_L++)
   {
-    X(adjoint_direct)(ths);
-    return;
+    INT k[ths->d], k_plain;
+    R c_phi_inv_k;
+
+    real_coefficient(ths, k_L, k, &k_plain, &c_phi_inv_k);
+    ths->g_hat[k_plain] = CONJ(ths->f_hat[k_L]) * c_phi_inv_k;
   }
-  
-  INT k0,k1,n0,n1,N0,N1;
-  C *g_hat,*f_hat;
-  R *c_phi_inv01, *c_phi_inv02, *c_phi_inv11, *c_phi_inv12;
-  R ck01, ck02, ck11, ck12;
-  C *g_hat11,*f_hat11,*g_hat21,*f_hat21,*g_hat12,*f_hat12,*g_hat22,*f_hat22;
+}
 
-  ths->g_hat=ths->g1;
-  ths->g=ths->g2;
+static void D_real_T(X(plan) *ths)
+{
+  INT k_L;
 
-  N0=ths->N[0];
-  N1=ths->N[1];
-  n0=ths->n[0];
-  n1=ths->n[1];
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) private(k_L)
+#endif
+  for (k_L = 0; k_L < real_N_hat(ths); k_L++)
+  {
+    INT k[ths->d], k_plain;
+    R c_phi_inv_k;
 
-  f_hat=(C*)ths->f_hat;
-  g_hat=(C*)ths->g_hat;
+    real_coefficient(ths, k_L, k, &k_plain, &c_phi_inv_k);
+    ths->f_hat[k_L] = CONJ(ths->g_hat[k_plain]) * c_phi_inv_k;
+  }
+}
 
-  TIC(2);
-  nfft_adjoint_2d_B(ths);
-  TOC(2);
+/**
+ * B-step for flag NFFT_REAL on the real grid g. The tensor product window is
+ * traversed over the first d-1 dimensions, the last one is the inner loop
+ * over a contiguous line of g.
+ */
+static void B_real_A(X(plan) *ths)
+{
+  const R *g = (const R*) ths->g;
+  const INT d = ths->d, w = 2 * ths->m + 2;
+  INT t, jj, lprod;
 
-  TIC_FFTW(1)
-  FFTW(execute)(ths->my_fftw_plan2);
-  TOC_FFTW(1);
+  for (t = 0, lprod = 1; t < d; t++)
+    lprod *= w;
 
-  TIC(0)
-  if(ths->flags & PRE_PHI_HUT)
+#ifdef _OPENMP
+  #pragma omp parallel default(shared)
+#endif
+  {
+    R *psij_c = NULL;
+    INT *idx_c = NULL;
+
+    if ((ths->flags & PRE_FULL_PSI) && psi_compact(ths))
     {
-      c_phi_inv01=ths->c_phi_inv[0];
-      c_phi_inv02=&ths->c_phi_inv[0][N0/2];
+      psij_c = (R*) Y(malloc)((size_t)(lprod) * sizeof(R));
+      idx_c = (INT*) Y(malloc)((size_t)(lprod) * sizeof(INT));
+    }
 
 #ifdef _OPENMP
-      #pragma omp parallel for default(shared) private(k0,k1,ck01,ck02,c_phi_inv11,c_phi_inv12,g_hat11,f_hat11,g_hat21,f_hat21,g_hat12,f_hat12,g_hat22,f_hat22,ck11,ck12)
+    #pragma omp for
 #endif
-      for(k0=0;k0<N0/2;k0++)
+    for (jj = 0; jj < ths->M_total; jj++)
+    {
+      const INT j = B_many_node(ths, jj);
+      R fj = K(0.0);
+
+      if (psij_c)
       {
-        ck01=c_phi_inv01[k0];
-        ck02=c_phi_inv02[k0];
+        INT l;
 
-        c_phi_inv11=ths->c_phi_inv[1];
-        c_phi_inv12=&ths->c_phi_inv[1][N1/2];
+        B_many_stencil(ths, j, lprod, psij_c, idx_c);
 
-        g_hat11=g_hat + (n0-(N0/2)+k0)*n1+n1-(N1/2);
-        f_hat11=f_hat + k0*N1;
-        g_hat21=g_hat + k0*n1+n1-(N1/2);
-        f_hat21=f_hat + ((N0/2)+k0)*N1;
-        g_hat12=g_hat + (n0-(N0/2)+k0)*n1;
-        f_hat12=f_hat + k0*N1+(N1/2);
-        g_hat22=g_hat + k0*n1;
-        f_hat22=f_hat + ((N0/2)+k0)*N1+(N1/2);
+        for (l = 0; l < lprod; l++)
+          fj += psij_c[l] * g[idx_c[l]];
+      }
+      else if (ths->flags & PRE_FULL_PSI)
+      {
+        const R *psij = ths->psi + j * lprod;
+        const INT *idx = ths->psi_index_g + j * lprod;
+        INT l;
 
-        for(k1=0;k1<N1/2;k1++)
+        for (l = 0; l < lprod; l++)
+          fj += psij[l] * g[idx[l]];
+      }
+      else
+      {
+        R psi_t[d * w], phi_prod[d], acc[w];
+        INT l_t[d * w], lj[d], ll_plain[d], l_L, l, t2, s = 0;
+        const R *psi_last = psi_t + (d - 1) * w;
+        const INT *l_last = l_t + (d - 1) * w;
+
+        real_node_taps(ths, j, psi_t, l_t);
+
+        for (t2 = 0; t2 < d; t2++)
+          lj[t2] = 0;
+
+        for (l = 0; l < w; l++)
+          acc[l] = K(0.0);
+
+        phi_prod[0] = K(1.0);
+        ll_plain[0] = 0;
+
+        /* the lines are summed elementwise, the window of the last dimension
+         * is applied once per node, this avoids a reduction per line */
+        for (l_L = 0; l_L < lprod / w; l_L++)
         {
-          ck11=c_phi_inv11[k1];
-          ck12=c_phi_inv12[k1];
+          for (t2 = s; t2 < d - 1; t2++)
+          {
+            phi_prod[t2 + 1] = phi_prod[t2] * psi_t[t2 * w + lj[t2]];
+            ll_plain[t2 + 1] = (ll_plain[t2] + l_t[t2 * w + lj[t2]]) * ths->n[t2 + 1];
+          }
 
-          f_hat11[k1] = g_hat11[k1] * ck01 * ck11;
-          f_hat21[k1] = g_hat21[k1] * ck02 * ck11;
-          f_hat12[k1] = g_hat12[k1] * ck01 * ck12;
-          f_hat22[k1] = g_hat22[k1] * ck02 * ck12;
+          if (l_last[0] < l_last[w - 1])
+          {
+            const R *g_line = g + ll_plain[d - 1] + l_last[0];
+
+            for (l = 0; l < w; l++)
+              acc[l] += phi_prod[d - 1] * g_line[l];
+          }
+          else
+            for (l = 0; l < w; l++)
+              acc[l] += phi_prod[d - 1] * g[ll_plain[d - 1] + l_last[l]];
+
+          for (s = d - 2; (s > 0) && (lj[s] == w - 1); s--)
+            lj[s] = 0;
+
+          if (s >= 0)
+            lj[s]++;
+          else
+            s = 0;
         }
+
+        for (l = 0; l < w; l++)
+          fj += psi_last[l] * acc[l];
       }
+
+      ths->f_real[j] = fj;
     }
-  else
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k0,k1,ck01,ck02,ck11,ck12)
-#endif
-    for(k0=0;k0<N0/2;k0++)
-      {
-  ck01=K(1.0)/(PHI_HUT(ths->n[0],k0-N0/2,0));
-  ck02=K(1.0)/(PHI_HUT(ths->n[0],k0,0));
-  for(k1=0;k1<N1/2;k1++)
+
+    Y(free)(idx_c);
+    Y(free)(psij_c);
+  }
+}
+
+/**
+ * Adjoint B-step of node j for flag NFFT_REAL into the points of the real
+ * grid g whose first index lies in u0,...,o0. psij_c and idx_c hold the
+ * stencil for PRE_FULL_PSI stored compactly.
+ */
+static void B_real_node_T(const X(plan) *ths, const INT j, R *g, const R fj,
+  const INT u0, const INT o0, R *psij_c, INT *idx_c)
+{
+  const INT d = ths->d, w = 2 * ths->m + 2;
+  const INT n_rest = ths->n_total / ths->n[0];
+  INT t, l, lprod;
+
+  for (t = 0, lprod = 1; t < d; t++)
+    lprod *= w;
+
+  if (ths->flags & PRE_FULL_PSI)
+  {
+    const R *psij = ths->psi + j * lprod;
+    const INT *idx = ths->psi_index_g + j * lprod;
+    INT l0;
+
+    if (psij_c)
     {
-      ck11=K(1.0)/(PHI_HUT(ths->n[1],k1-N1/2,1));
-      ck12=K(1.0)/(PHI_HUT(ths->n[1],k1,1));
-      f_hat[k0*N1+k1]             = g_hat[(n0-N0/2+k0)*n1+n1-N1/2+k1] * ck01 * ck11;
-      f_hat[(N0/2+k0)*N1+k1]      = g_hat[k0*n1+n1-N1/2+k1]           * ck02 * ck11;
-      f_hat[k0*N1+N1/2+k1]        = g_hat[(n0-N0/2+k0)*n1+k1]         * ck01 * ck12;
-      f_hat[(N0/2+k0)*N1+N1/2+k1] = g_hat[k0*n1+k1]                   * ck02 * ck12;
+      B_many_stencil(ths, j, lprod, psij_c, idx_c);
+      psij = psij_c;
+      idx = idx_c;
     }
-      }
-  TOC(0)
-}
 
-/* ################################################ SPECIFIC VERSIONS FOR d=3 */
+    /* the stencil runs through the first dimension in blocks of lprod/w */
+    for (l0 = 0; l0 < lprod; l0 += lprod / w)
+    {
+      const INT i0 = idx[l0] / n_rest;
 
-static void nfft_3d_init_fg_exp_l(R *fg_exp_l, const INT m, const R b)
-{
-  INT l;
-  R fg_exp_b0, fg_exp_b1, fg_exp_b2, fg_exp_b0_sq;
+      if (i0 < u0 || i0 > o0)
+        continue;
 
-  fg_exp_b0 = EXP(-K(1.0) / b);
-  fg_exp_b0_sq = fg_exp_b0*fg_exp_b0;
-  fg_exp_b1 = K(1.0);
-  fg_exp_b2 = K(1.0);
-  fg_exp_l[0] = K(1.0);
-  for(l=1; l <= 2*m+1; l++)
+      for (l = l0; l < l0 + lprod / w; l++)
+        g[idx[l]] += psij[l] * fj;
+    }
+  }
+  else
+  {
+    R psi_t[d * w], phi_prod[d];
+    INT l_t[d * w], lj[d], ll_plain[d], l_L, t2, s = 0;
+    const R *psi_last = psi_t + (d - 1) * w;
+    const INT *l_last = l_t + (d - 1) * w;
+
+    real_node_taps(ths, j, psi_t, l_t);
+
+    for (t2 = 0; t2 < d; t2++)
+      lj[t2] = 0;
+
+    phi_prod[0] = fj;
+    ll_plain[0] = 0;
+
+    for (l_L = 0; l_L < lprod / w; l_L++)
     {
-      fg_exp_b2 = fg_exp_b1*fg_exp_b0;
-      fg_exp_b1 *= fg_exp_b0_sq;
-      fg_exp_l[l] = fg_exp_l[l-1]*fg_exp_b2;
+      for (t2 = s; t2 < d - 1; t2++)
+      {
+        phi_prod[t2 + 1] = phi_prod[t2] * psi_t[t2 * w + lj[t2]];
+        ll_plain[t2 + 1] = (ll_plain[t2] + l_t[t2 * w + lj[t2]]) * ths->n[t2 + 1];
+      }
+
+      if (d == 1)
+      {
+        for (l = 0; l < w; l++)
+          if (l_last[l] >= u0 && l_last[l] <= o0)
+            g[l_last[l]] += phi_prod[0] * psi_last[l];
+      }
+      else if (l_t[lj[0]] < u0 || l_t[lj[0]] > o0)
+        ;
+      else if (l_last[0] < l_last[w - 1])
+      {
+        R *g_line = g + ll_plain[d - 1] + l_last[0];
+
+        for (l = 0; l < w; l++)
+          g_line[l] += phi_prod[d - 1] * psi_last[l];
+      }
+      else
+        for (l = 0; l < w; l++)
+          g[ll_plain[d - 1] + l_last[l]] += phi_prod[d - 1] * psi_last[l];
+
+      for (s = d - 2; (s > 0) && (lj[s] == w - 1); s--)
+        lj[s] = 0;
+
+      if (s >= 0)
+        lj[s]++;
+      else
+        s = 0;
     }
+  }
 }
 
-static void nfft_trafo_3d_compute(C *fj, const C *g, const R *psij_const0,
-    const R *psij_const1, const R *psij_const2, const R *xj0, const R *xj1,
-    const R *xj2, const INT n0, const INT n1, const INT n2, const INT m)
+/**
+ * Adjoint B-step for flag NFFT_REAL. With OpenMP, it is parallelised like
+ * NFFT_OMP_BLOCKWISE_ADJOINT: every thread owns a block of the first
+ * dimension of g and spreads the parts of the windows that fall into it,
+ * without atomics. init_help sets NFFT_SORT_NODES for NFFT_REAL with OpenMP,
+ * so every thread finds the nodes that reach its block by binary search and
+ * visits only these.
+ */
+static void B_real_T(X(plan) *ths)
 {
-  INT u0, o0, l0, u1, o1, l1, u2, o2, l2;
-  const C *gj;
-  const R *psij0, *psij1, *psij2;
+  R *g = (R*) ths->g;
+  const INT d = ths->d, w = 2 * ths->m + 2;
+  INT t, lprod;
 
-  psij0 = psij_const0;
-  psij1 = psij_const1;
-  psij2 = psij_const2;
+  for (t = 0, lprod = 1; t < d; t++)
+    lprod *= w;
 
-  uo2(&u0, &o0, *xj0, n0, m);
-  uo2(&u1, &o1, *xj1, n1, m);
-  uo2(&u2, &o2, *xj2, n2, m);
+  memset(g, 0, (size_t)(ths->n_total) * sizeof(R));
 
-  *fj = 0;
+#ifdef _OPENMP
+  #pragma omp parallel default(shared)
+#endif
+  {
+    R *psij_c = NULL;
+    INT *idx_c = NULL;
+    INT jj;
 
-  if (u0 < o0)
-    if (u1 < o1)
-      if (u2 < o2)
-        for (l0 = 0; l0 <= 2 * m + 1; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-        }
-      else
-        /* asserts (u2>o2)*/
-        for (l0 = 0; l0 <= 2 * m + 1; l0++, psij0++)
+    if ((ths->flags & PRE_FULL_PSI) && psi_compact(ths))
+    {
+      psij_c = (R*) Y(malloc)((size_t)(lprod) * sizeof(R));
+      idx_c = (INT*) Y(malloc)((size_t)(lprod) * sizeof(INT));
+    }
+
+#ifdef _OPENMP
+    {
+      INT my_u0, my_o0, min_u[2], max_u[2], r;
+      const INT *ar_x = ths->index_x;
+
+      nfft_adjoint_B_omp_blockwise_init(&my_u0, &my_o0, &min_u[0], &max_u[0],
+        &min_u[1], &max_u[1], d, ths->n, ths->m);
+
+      /* NFFT_SORT_NODES is set for NFFT_REAL by init_help */
+      if (my_u0 != -1)
+      {
+        for (r = 0; r < 2; r++)
         {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
+          if (min_u[r] == -1)
+            continue;
+
+          for (jj = index_x_binary_search(ar_x, ths->M_total, min_u[r]);
+            jj < ths->M_total; jj++)
           {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-        }
-    else /* asserts (u1>o1)*/
-      if (u2 < o2)
-        for (l0 = 0; l0 <= 2 * m + 1; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-          for (l1 = 0; l1 <= o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-        }
-      else/* asserts (u2>o2) */
-      {
-        for (l0 = 0; l0 <= 2 * m + 1; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-          for (l1 = 0; l1 <= o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-            gj = g + ((u0 + l0) * n1 + l1) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+            const INT j = ar_x[2 * jj + 1];
+
+            if (ar_x[2 * jj] < min_u[r] || ar_x[2 * jj] > max_u[r])
+              break;
+
+            B_real_node_T(ths, j, g, ths->f_real[j], my_u0, my_o0, psij_c,
+              idx_c);
           }
         }
       }
-  else /* asserts (u0>o0) */
-    if (u1 < o1)
-      if (u2 < o2)
-      {
-        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-        }
+    }
+#else
+    for (jj = 0; jj < ths->M_total; jj++)
+    {
+      const INT j = B_many_node(ths, jj);
 
-        for (l0 = 0; l0 <= o0; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-        }
-      } else/* asserts (u2>o2) */
-      {
-        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-        }
+      B_real_node_T(ths, j, g, ths->f_real[j], 0, ths->n[0] - 1, psij_c,
+        idx_c);
+    }
+#endif
 
-        for (l0 = 0; l0 <= o0; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-            gj = g + (l0 * n1 + (u1 + l1)) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-        }
-      }
-    else /* asserts (u1>o1) */
-      if (u2 < o2)
-      {
-        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-          for (l1 = 0; l1 <= o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-        }
-        for (l0 = 0; l0 <= o0; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-          for (l1 = 0; l1 <= o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + (l0 * n1 + l1) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-        }
-      } else/* asserts (u2>o2) */
-      {
-        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-          for (l1 = 0; l1 <= o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-            gj = g + ((u0 + l0) * n1 + l1) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-        }
+    Y(free)(idx_c);
+    Y(free)(psij_c);
+  }
+}
 
-        for (l0 = 0; l0 <= o0; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-            gj = g + (l0 * n1 + (u1 + l1)) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-          for (l1 = 0; l1 <= o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + (l0 * n1 + l1) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-            gj = g + (l0 * n1 + l1) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
-          }
-        }
-      }
+static void trafo_real(X(plan) *ths)
+{
+  ths->g_hat = ths->g1;
+  ths->g = ths->g2;
+
+  TIC(0)
+  D_real_A(ths);
+  TOC(0)
+
+  TIC_FFTW(1)
+  FFTW(execute_dft_c2r)(ths->my_fftw_plan1, ths->g1, (R*)ths->g2);
+  TOC_FFTW(1)
+
+  TIC(2)
+  B_real_A(ths);
+  TOC(2)
 }
 
-#ifdef _OPENMP
-/** 
- * Adjoint NFFT for three-dimensional case updating only a specified range of
- * vector g.
- *
- * \arg f input coefficient f[j]
- * \arg g output vector g
- * \arg psij_const0 vector of window function values first component
- * \arg psij_const1 vector of window function values second component
- * \arg psij_const2 vector of window function values third component
- * \arg xj0 node x[3*j]
- * \arg xj1 node x[3*j+1]
- * \arg xj2 node x[3*j+2]
- * \arg n0 FFTW length (number oversampled Fourier coefficients) first comp.
- * \arg n1 FFTW length (number oversampled Fourier coefficients) second comp.
- * \arg n2 FFTW length (number oversampled Fourier coefficients) third comp.
- * \arg m window length
- * \arg my_u0 lowest index (first component) the current thread writes to
- * \arg my_o0 highest index (second component) the current thread writes to
- *
- * \author Toni Volkmer
- */
-static void nfft_adjoint_3d_compute_omp_blockwise(const C f, C *g,
-    const R *psij_const0, const R *psij_const1, const R *psij_const2,
-    const R *xj0, const R *xj1, const R *xj2,
-    const INT n0, const INT n1, const INT n2, const INT m,
-    const INT my_u0, const INT my_o0)
+static void adjoint_real(X(plan) *ths)
 {
-  INT ar_u0,ar_o0,l0,u1,o1,l1,u2,o2,l2;
+  ths->g_hat = ths->g1;
+  ths->g = ths->g2;
 
-  INT index_temp1[2*m+2];
-  INT index_temp2[2*m+2];
+  TIC(2)
+  B_real_T(ths);
+  TOC(2)
 
-  uo2(&ar_u0,&ar_o0,*xj0, n0, m);
-  uo2(&u1,&o1,*xj1, n1, m);
-  uo2(&u2,&o2,*xj2, n2, m);
+  TIC_FFTW(1)
+  FFTW(execute_dft_r2c)(ths->my_fftw_plan2, (R*)ths->g2, ths->g1);
+  TOC_FFTW(1)
 
-  for (l1=0; l1<=2*m+1; l1++)
-    index_temp1[l1] = (u1+l1)%n1;
+  TIC(0)
+  D_real_T(ths);
+  TOC(0)
+}
 
-  for (l2=0; l2<=2*m+1; l2++)
-    index_temp2[l2] = (u2+l2)%n2;
+/** nfft_trafo for howmany > 1: D-step per vector, one batched FFT, and a
+ *  shared B-step. */
+static void trafo_many(X(plan) *ths)
+{
+  C *f_hat = ths->f_hat;
+  INT k;
 
-  if(ar_u0<ar_o0)
+  for (k = 0; k < ths->howmany; k++)
   {
-    INT u0 = MAX(my_u0,ar_u0);
-    INT o0 = MIN(my_o0,ar_o0);
-    INT offset_psij = u0-ar_u0;
-#ifdef OMP_ASSERT
-    assert(offset_psij >= 0);
-    assert(o0-u0 <= 2*m+1);
-    assert(offset_psij+o0-u0 <= 2*m+1);
-#endif
+    ths->f_hat = f_hat + k * ths->N_total;
+    ths->g_hat = ths->g1 + k * ths->n_total;
+    D_A(ths);
+  }
 
-    for (l0 = 0; l0 <= o0-u0; l0++)
-    {
-      const INT i0 = (u0+l0) * n1;
-      const C val0 = psij_const0[offset_psij+l0];
+  ths->f_hat = f_hat;
+  ths->g_hat = ths->g1;
+  ths->g = ths->g2;
 
-      for(l1=0; l1<=2*m+1; l1++)
-      {
-        const INT i1 = (i0 + index_temp1[l1]) * n2;
-        const C val1 = psij_const1[l1];
+  TIC_FFTW(1)
+  fft_forward(ths);
+  TOC_FFTW(1)
 
-        for(l2=0; l2<=2*m+1; l2++)
-          g[i1 + index_temp2[l2]] += val0 * val1 * psij_const2[l2] * f;
-      }
-    }
-  }
-  else
+  TIC(2)
+  B_many_A(ths);
+  TOC(2)
+}
+
+/** nfft_adjoint for howmany > 1. */
+static void adjoint_many(X(plan) *ths)
+{
+  C *f_hat = ths->f_hat;
+  INT k;
+
+  ths->g_hat = ths->g1;
+  ths->g = ths->g2;
+
+  TIC(2)
+  B_many_T(ths);
+  TOC(2)
+
+  TIC_FFTW(1)
+  fft_backward(ths);
+  TOC_FFTW(1)
+
+  for (k = 0; k < ths->howmany; k++)
   {
-    INT u0 = MAX(my_u0,ar_u0);
-    INT o0 = my_o0;
-    INT offset_psij = u0-ar_u0;
-#ifdef OMP_ASSERT
-    assert(offset_psij >= 0);
-    assert(o0-u0 <= 2*m+1);
-    assert(offset_psij+o0-u0 <= 2*m+1);
+    ths->f_hat = f_hat + k * ths->N_total;
+    ths->g_hat = ths->g1 + k * ths->n_total;
+    D_T(ths);
+  }
+
+  ths->f_hat = f_hat;
+  ths->g_hat = ths->g1;
+}
+
+/* ## SIMD kernels for the B-step of the d=1,2,3 trafos  ##################### */
+
+#if defined(HAVE_ATTRIBUTE_TARGET) && !defined(NFFT_LDOUBLE)
+#define NFFT_SIMD
 #endif
 
-    for (l0 = 0; l0 <= o0-u0; l0++)
-    {
-      INT i0 = (u0+l0) * n1;
-      const C val0 = psij_const0[offset_psij+l0];
+#ifdef NFFT_SIMD
+/**
+ * Kernels for nodes whose stencil does not wrap around in the last dimension.
+ * The window values of the last dimension are passed duplicated for real and
+ * imaginary part (psid), so that every row of the stencil is one contiguous
+ * run of 2*(2m+2) reals in g. Real and imaginary parts are accumulated
+ * separately in vector registers, the window values of the leading dimensions
+ * are fused into one scalar factor per row. Rows wrap around in the leading
+ * dimensions only, which costs one branch per row.
+ *
+ * The kernels are instantiated for several instruction sets, every plan
+ * selects the widest one the CPU supports, see nfft_set_simd.
+ */
+#define MACRO_SIMD_KERNELS(isa, attr, bytes) \
+typedef R simd_ ## isa ## _t __attribute__((vector_size(bytes))); \
+\
+static inline attr void simd_row_ ## isa(simd_ ## isa ## _t *acc, R *tail, \
+  const R *psid, const R *g, const R s, const INT len2) \
+{ \
+  const INT vlen = (INT)((bytes) / sizeof(R)); \
+  INT i; \
+\
+  for (i = 0; i + vlen <= len2; i += vlen) \
+  { \
+    simd_ ## isa ## _t p, v; \
+    memcpy(&p, psid + i, bytes); \
+    memcpy(&v, g + i, bytes); \
+    *acc += (s * p) * v; \
+  } \
+\
+  for (; i < len2; i++) \
+    tail[i & 1] += s * psid[i] * g[i]; \
+} \
+\
+static inline attr void simd_reduce_ ## isa(C *fj, const simd_ ## isa ## _t acc, \
+  const R *tail) \
+{ \
+  R re = tail[0], im = tail[1]; \
+  INT i; \
+\
+  for (i = 0; i < (INT)((bytes) / sizeof(R)); i += 2) \
+  { \
+    re += acc[i]; \
+    im += acc[i + 1]; \
+  } \
+\
+  *fj = re + II * im; \
+} \
+\
+static attr void trafo_1d_kernel_ ## isa(C *fj, const R *psid, const C *g, \
+  const INT w) \
+{ \
+  simd_ ## isa ## _t acc = {0}; \
+  R tail[2] = {K(0.0), K(0.0)}; \
+\
+  simd_row_ ## isa(&acc, tail, psid, (const R*)g, K(1.0), 2 * w); \
+  simd_reduce_ ## isa(fj, acc, tail); \
+} \
+\
+static attr void trafo_2d_kernel_ ## isa(C *fj, const R *psij0, \
+  const R *psid1, const C *g, const INT u0, const INT u1, const INT n0, \
+  const INT n1, const INT w) \
+{ \
+  simd_ ## isa ## _t acc = {0}; \
+  R tail[2] = {K(0.0), K(0.0)}; \
+  INT l0, r0; \
+\
+  for (l0 = 0, r0 = u0; l0 < w; l0++, r0++) \
+  { \
+    if (r0 == n0) \
+      r0 = 0; \
+    simd_row_ ## isa(&acc, tail, psid1, (const R*)(g + r0 * n1 + u1), \
+      psij0[l0], 2 * w); \
+  } \
+\
+  simd_reduce_ ## isa(fj, acc, tail); \
+} \
+\
+static attr void trafo_3d_kernel_ ## isa(C *fj, const R *psij0, \
+  const R *psij1, const R *psid2, const C *g, const INT u0, const INT u1, \
+  const INT u2, const INT n0, const INT n1, const INT n2, const INT w) \
+{ \
+  simd_ ## isa ## _t acc = {0}; \
+  R tail[2] = {K(0.0), K(0.0)}; \
+  INT l0, l1, r0, r1; \
+\
+  for (l0 = 0, r0 = u0; l0 < w; l0++, r0++) \
+  { \
+    if (r0 == n0) \
+      r0 = 0; \
+    for (l1 = 0, r1 = u1; l1 < w; l1++, r1++) \
+    { \
+      if (r1 == n1) \
+        r1 = 0; \
+      simd_row_ ## isa(&acc, tail, psid2, \
+        (const R*)(g + (r0 * n1 + r1) * n2 + u2), psij0[l0] * psij1[l1], 2 * w); \
+    } \
+  } \
+\
+  simd_reduce_ ## isa(fj, acc, tail); \
+}
 
-      for(l1=0; l1<=2*m+1; l1++)
-      {
-        const INT i1 = (i0 + index_temp1[l1]) * n2;
-        const C val1 = psij_const1[l1];
+MACRO_SIMD_KERNELS(generic, , 16)
+#if defined(__x86_64__) || defined(__i386__)
+MACRO_SIMD_KERNELS(avx2, __attribute__((target("avx2,fma"))), 32)
+MACRO_SIMD_KERNELS(avx512, __attribute__((target("avx512f"))), 64)
+#endif
 
-        for(l2=0; l2<=2*m+1; l2++)
-          g[i1 + index_temp2[l2]] += val0 * val1 * psij_const2[l2] * f;
-      }
-    }
+typedef struct
+{
+  INT bytes;
+  void (*trafo_1d)(C *fj, const R *psid, const C *g, const INT w);
+  void (*trafo_2d)(C *fj, const R *psij0, const R *psid1, const C *g,
+    const INT u0, const INT u1, const INT n0, const INT n1, const INT w);
+  void (*trafo_3d)(C *fj, const R *psij0, const R *psij1, const R *psid2,
+    const C *g, const INT u0, const INT u1, const INT u2, const INT n0,
+    const INT n1, const INT n2, const INT w);
+} simd_kernels;
+
+#define SIMD_KERNELS(isa, bytes) \
+  {bytes, trafo_1d_kernel_ ## isa, trafo_2d_kernel_ ## isa, \
+    trafo_3d_kernel_ ## isa}
+
+static const simd_kernels simd_generic = SIMD_KERNELS(generic, 16);
+#if defined(__x86_64__) || defined(__i386__)
+static const simd_kernels simd_avx2 = SIMD_KERNELS(avx2, 32);
+static const simd_kernels simd_avx512 = SIMD_KERNELS(avx512, 64);
+
+/** Kernels for rows that fill whole vectors of the widest instruction set
+ *  (wide) and for all other rows (narrow), which would otherwise spend much
+ *  of their time in the scalar tail, indexed by ths->simd. */
+static const simd_kernels *const simd_wide[] = {&simd_generic, &simd_avx2,
+  &simd_avx512};
+static const simd_kernels *const simd_narrow[] = {&simd_generic, &simd_avx2,
+  &simd_avx2};
+#else
+static const simd_kernels *const simd_wide[] = {&simd_generic};
+static const simd_kernels *const simd_narrow[] = {&simd_generic};
+#endif
 
-    u0 = my_u0;
-    o0 = MIN(my_o0,ar_o0);
-    offset_psij += my_u0-ar_u0+n0;
+/** The widest instruction set up to level that the CPU supports. */
+static unsigned simd_supported(const unsigned level)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  const int avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
 
-#ifdef OMP_ASSERT
-    if (u0<=o0)
-    {
-      assert(o0-u0 <= 2*m+1);
-      assert(offset_psij+o0-u0 <= 2*m+1);
-    }
+  if (level >= NFFT_SIMD_AVX512 && avx2 && __builtin_cpu_supports("avx512f"))
+    return NFFT_SIMD_AVX512;
+
+  if (level >= NFFT_SIMD_AVX2 && avx2)
+    return NFFT_SIMD_AVX2;
+#else
+  UNUSED(level);
 #endif
-    for (l0 = 0; l0 <= o0-u0; l0++)
-    {
-      INT i0 = (u0+l0) * n1;
-      const C val0 = psij_const0[offset_psij+l0];
+  return NFFT_SIMD_GENERIC;
+}
 
-      for(l1=0; l1<=2*m+1; l1++)
-      {
-        const INT i1 = (i0 + index_temp1[l1]) * n2;
-        const C val1 = psij_const1[l1];
+/** Returns the kernels of the plan for rows of w complex values. */
+static inline const simd_kernels *simd_select(const X(plan) *ths, const INT w)
+{
+  return (2 * w * (INT)sizeof(R)) % simd_wide[ths->simd]->bytes == 0
+    ? simd_wide[ths->simd] : simd_narrow[ths->simd];
+}
 
-        for(l2=0; l2<=2*m+1; l2++)
-          g[i1 + index_temp2[l2]] += val0 * val1 * psij_const2[l2] * f;
-      }
-    }
-  }
+/** Duplicates the 2m+2 window values for real and imaginary part. */
+static inline void simd_dup(R *psid, const R *psij, const INT w)
+{
+  INT l;
+
+  for (l = 0; l < w; l++)
+    psid[2 * l] = psid[2 * l + 1] = psij[l];
 }
 #endif
 
-#ifdef _OPENMP
-/* adjoint NFFT three-dimensional case with OpenMP atomic operations */
-static void nfft_adjoint_3d_compute_omp_atomic(const C f, C *g,
-    const R *psij_const0, const R *psij_const1, const R *psij_const2,
-    const R *xj0, const R *xj1, const R *xj2,
-    const INT n0, const INT n1, const INT n2, const INT m)
+/* ## specialized version for d=1  ########################################### */
+
+static void nfft_1d_init_fg_exp_l(R *fg_exp_l, const INT m, const R b)
 {
-  INT u0,o0,l0,u1,o1,l1,u2,o2,l2;
+  const INT tmp2 = 2*m+2;
+  INT l;
+  R fg_exp_b0, fg_exp_b1, fg_exp_b2, fg_exp_b0_sq;
 
-  INT index_temp0[2*m+2];
-  INT index_temp1[2*m+2];
-  INT index_temp2[2*m+2];
+  fg_exp_b0 = EXP(K(-1.0)/b);
+  fg_exp_b0_sq = fg_exp_b0*fg_exp_b0;
+  fg_exp_b1 = fg_exp_b2 =fg_exp_l[0] = K(1.0);
 
-  uo2(&u0,&o0,*xj0, n0, m);
-  uo2(&u1,&o1,*xj1, n1, m);
-  uo2(&u2,&o2,*xj2, n2, m);
+  for (l = 1; l < tmp2; l++)
+  {
+    fg_exp_b2 = fg_exp_b1*fg_exp_b0;
+    fg_exp_b1 *= fg_exp_b0_sq;
+    fg_exp_l[l] = fg_exp_l[l-1]*fg_exp_b2;
+  }
+}
 
-  for (l0=0; l0<=2*m+1; l0++)
-    index_temp0[l0] = (u0+l0)%n0;
 
-  for (l1=0; l1<=2*m+1; l1++)
-    index_temp1[l1] = (u1+l1)%n1;
+static void nfft_trafo_1d_compute(const X(plan) *ths, C *fj, const C *g,
+  const R *psij_const, const R *xj, const INT n, const INT m)
+{
+  INT u, o, l;
+  const C *gj;
+  const R *psij;
+  psij = psij_const;
 
-  for (l2=0; l2<=2*m+1; l2++)
-    index_temp2[l2] = (u2+l2)%n2;
+  uo2(&u, &o, *xj, n, m);
 
-  for(l0=0; l0<=2*m+1; l0++)
+#ifdef NFFT_SIMD
+  if (u < o)
   {
-    for(l1=0; l1<=2*m+1; l1++)
-    {
-      for(l2=0; l2<=2*m+1; l2++)
-      {
-        INT i = (index_temp0[l0] * n1 + index_temp1[l1]) * n2 + index_temp2[l2];
-        C *lhs = g+i;
-        R *lhs_real = (R*)lhs;
-        C val = psij_const0[l0] * psij_const1[l1] * psij_const2[l2] * f;
+    R psid[2 * (2 * m + 2)];
+    simd_dup(psid, psij_const, 2 * m + 2);
+    simd_select(ths, 2 * m + 2)->trafo_1d(fj, psid, g + u, 2 * m + 2);
+    return;
+  }
+#else
+  UNUSED(ths);
+#endif
 
-#pragma omp atomic
-        lhs_real[0] += CREAL(val);
+  if (u < o)
+  {
+    for (l = 1, gj = g + u, (*fj) = (*psij++) * (*gj++); l <= 2*m+1; l++)
+      (*fj) += (*psij++) * (*gj++);
+  }
+  else
+  {
+    for (l = 1, gj = g + u, (*fj) = (*psij++) * (*gj++); l < 2*m+1 - o; l++)
+      (*fj) += (*psij++) * (*gj++);
+    for (l = 0, gj = g; l <= o; l++)
+      (*fj) += (*psij++) * (*gj++);
+  }
+}
 
-#pragma omp atomic
-        lhs_real[1] += CIMAG(val);
-      }
-    }
+#ifndef _OPENMP
+static void nfft_adjoint_1d_compute_serial(const C *fj, C *g,
+    const R *psij_const, const R *xj, const INT n, const INT m)
+{
+  INT u,o,l;
+  C *gj;
+  const R *psij;
+  psij = psij_const;
+
+  uo2(&u,&o,*xj, n, m);
+
+  if (u < o)
+  {
+    for (l = 0, gj = g+u; l <= 2*m+1; l++)
+      (*gj++) += (*psij++) * (*fj);
+  }
+  else
+  {
+    for (l = 0, gj = g+u; l < 2*m+1-o; l++)
+      (*gj++) += (*psij++) * (*fj);
+    for (l = 0, gj = g; l <= o; l++)
+      (*gj++) += (*psij++) * (*fj);
   }
 }
 #endif
 
-#ifndef _OPENMP
-static void nfft_adjoint_3d_compute_serial(const C *fj, C *g,
-    const R *psij_const0, const R *psij_const1, const R *psij_const2, const R *xj0,
-    const R *xj1, const R *xj2, const INT n0, const INT n1, const INT n2,
-    const INT m)
+#ifdef _OPENMP
+/* adjoint NFFT one-dimensional case with OpenMP atomic operations */
+static void nfft_adjoint_1d_compute_omp_atomic(const C f, C *g,
+    const R *psij_const, const R *xj, const INT n, const INT m)
 {
-  INT u0, o0, l0, u1, o1, l1, u2, o2, l2;
+  INT u,o,l;
   C *gj;
-  const R *psij0, *psij1, *psij2;
+  INT index_temp[2*m+2];
 
-  psij0 = psij_const0;
-  psij1 = psij_const1;
-  psij2 = psij_const2;
+  uo2(&u,&o,*xj, n, m);
 
-  uo2(&u0, &o0, *xj0, n0, m);
-  uo2(&u1, &o1, *xj1, n1, m);
-  uo2(&u2, &o2, *xj2, n2, m);
+  for (l=0; l<=2*m+1; l++)
+    index_temp[l] = (l+u)%n;
 
-  if (u0 < o0)
-    if (u1 < o1)
-      if (u2 < o2)
-        for (l0 = 0; l0 <= 2 * m + 1; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+  for (l = 0, gj = g+u; l <= 2*m+1; l++)
+  {
+    INT i = index_temp[l];
+    C *lhs = g+i;
+    R *lhs_real = (R*)lhs;
+    C val = psij_const[l] * f;
+    #pragma omp atomic
+    lhs_real[0] += CREAL(val);
+
+    #pragma omp atomic
+    lhs_real[1] += CIMAG(val);
+  }
+}
+#endif
+
+#ifdef _OPENMP
+/**
+ * Adjoint NFFT for one-dimensional case updating only a specified range of
+ * vector g.
+ *
+ * \arg f input coefficient f[j]
+ * \arg g output vector g
+ * \arg psij_const vector of window function values
+ * \arg xj node x[j]
+ * \arg n FFTW length (number oversampled Fourier coefficients)
+ * \arg m window length
+ * \arg my_u0 lowest index the current thread writes to in g
+ * \arg my_o0 highest index the current thread writes to in g
+ *
+ * \author Toni Volkmer
+ */
+static void nfft_adjoint_1d_compute_omp_blockwise(const C f, C *g,
+    const R *psij_const, const R *xj, const INT n, const INT m,
+    const INT my_u0, const INT my_o0)
+{
+  INT ar_u,ar_o,l;
+
+  uo2(&ar_u,&ar_o,*xj, n, m);
+
+  if (ar_u < ar_o)
+  {
+    INT u = MAX(my_u0,ar_u);
+    INT o = MIN(my_o0,ar_o);
+    INT offset_psij = u-ar_u;
+#ifdef OMP_ASSERT
+    assert(offset_psij >= 0);
+    assert(o-u <= 2*m+1);
+    assert(offset_psij+o-u <= 2*m+1);
+#endif
+
+    for (l = 0; l <= o-u; l++)
+      g[u+l] += psij_const[offset_psij+l] * f;
+  }
+  else
+  {
+    INT u = MAX(my_u0,ar_u);
+    INT o = my_o0;
+    INT offset_psij = u-ar_u;
+#ifdef OMP_ASSERT
+    assert(offset_psij >= 0);
+    assert(o-u <= 2*m+1);
+    assert(offset_psij+o-u <= 2*m+1);
+#endif
+
+    for (l = 0; l <= o-u; l++)
+      g[u+l] += psij_const[offset_psij+l] * f;
+
+    u = my_u0;
+    o = MIN(my_o0,ar_o);
+    offset_psij += my_u0-ar_u+n;
+
+#ifdef OMP_ASSERT
+    if (u <= o)
+    {
+      assert(o-u <= 2*m+1);
+      if (offset_psij+o-u > 2*m+1)
+      {
+        fprintf(stderr, "ERR: %d %d %d %d %d %d %d\n", ar_u, ar_o, my_u0, my_o0, u, o, offset_psij);
+      }
+      assert(offset_psij+o-u <= 2*m+1);
+    }
+#endif
+    for (l = 0; l <= o-u; l++)
+      g[u+l] += psij_const[offset_psij+l] * f;
+  }
+}
+#endif
+
+static void nfft_trafo_1d_B(X(plan) *ths)
+{
+  const INT n = ths->n[0], M = ths->M_total, m = ths->m, m2p2 = 2*m+2;
+  const C *g = (C*)ths->g;
+
+  if (ths->flags & PRE_FULL_PSI)
+  {
+    INT k;
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT l;
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      ths->f[j] = K(0.0);
+      for (l = 0; l < m2p2; l++)
+        ths->f[j] += ths->psi[j*m2p2+l] * g[ths->psi_index_g[j*m2p2+l]];
+    }
+    return;
+  } /* if(PRE_FULL_PSI) */
+
+  if (ths->flags & PRE_PSI)
+  {
+    INT k;
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      nfft_trafo_1d_compute(ths, &ths->f[j], g, ths->psi + j * (2 * m + 2),
+        &ths->x[j], n, m);
+    }
+    return;
+  } /* if(PRE_PSI) */
+
+  if (ths->flags & PRE_FG_PSI)
+  {
+    INT k;
+    R fg_exp_l[m2p2];
+
+    nfft_1d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      const R fg_psij0 = ths->psi[2 * j], fg_psij1 = ths->psi[2 * j + 1];
+      R fg_psij2 = K(1.0);
+      R psij_const[m2p2];
+      INT l;
+
+      psij_const[0] = fg_psij0;
+
+      for (l = 1; l < m2p2; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[l] = fg_psij0 * fg_psij2 * fg_exp_l[l];
+      }
+
+      nfft_trafo_1d_compute(ths, &ths->f[j], g, psij_const, &ths->x[j], n, m);
+    }
+
+    return;
+  } /* if(PRE_FG_PSI) */
+
+  if (ths->flags & FG_PSI)
+  {
+    INT k;
+    R fg_exp_l[m2p2];
+
+    nfft_1d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      INT u, o, l;
+      R fg_psij0, fg_psij1, fg_psij2;
+      R psij_const[m2p2];
+
+      uo(ths, (INT)j, &u, &o, (INT)0);
+      fg_psij0 = (PHI(ths->n[0], ths->x[j] - ((R)(u))/(R)(n), 0));
+      fg_psij1 = EXP(K(2.0) * ((R)(n) * ths->x[j] - (R)(u)) / ths->b[0]);
+      fg_psij2  = K(1.0);
+
+      psij_const[0] = fg_psij0;
+
+      for (l = 1; l < m2p2; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[l] = fg_psij0 * fg_psij2 * fg_exp_l[l];
+      }
+
+      nfft_trafo_1d_compute(ths, &ths->f[j], g, psij_const, &ths->x[j], n, m);
+    }
+    return;
+  } /* if(FG_PSI) */
+
+  if (ths->flags & PRE_LIN_PSI)
+  {
+    const INT K = ths->K, ip_s = K / (m + 2);
+    INT k;
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT u, o, l;
+      R ip_y, ip_w;
+      INT ip_u;
+      R psij_const[m2p2];
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+
+      uo(ths, (INT)j, &u, &o, (INT)0);
+
+      ip_y = FABS((R)(n) * ths->x[j] - (R)(u)) * ((R)ip_s);
+      ip_u = (INT)(LRINT(FLOOR(ip_y)));
+      ip_w = ip_y - (R)(ip_u);
+
+      for (l = 0; l < m2p2; l++)
+        psij_const[l] = ths->psi[ABS(ip_u-l*ip_s)] * (K(1.0) - ip_w)
+          + ths->psi[ABS(ip_u-l*ip_s+1)] * (ip_w);
+
+      nfft_trafo_1d_compute(ths, &ths->f[j], g, psij_const, &ths->x[j], n, m);
+    }
+    return;
+  } /* if(PRE_LIN_PSI) */
+  else
+  {
+    /* no precomputed psi at all */
+    INT k;
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      R psij_const[m2p2];
+      INT u, o;
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+
+      uo(ths, (INT)j, &u, &o, (INT)0);
+
+      window_taps(ths, ths->x[j], u, 0, psij_const);
+
+      nfft_trafo_1d_compute(ths, &ths->f[j], g, psij_const, &ths->x[j], n, m);
+    }
+  }
+}
+
+
+#define MACRO_adjoint_1d_B_OMP_BLOCKWISE_COMPUTE_PRE_PSI \
+{ \
+            nfft_adjoint_1d_compute_omp_blockwise(ths->f[j], g, \
+                ths->psi + j * (2 * m + 2), ths->x + j, n, m, my_u0, my_o0); \
+}
+
+#define MACRO_adjoint_1d_B_OMP_BLOCKWISE_COMPUTE_PRE_FG_PSI \
+{ \
+            R psij_const[2 * m + 2]; \
+            INT l; \
+            R fg_psij0 = ths->psi[2 * j]; \
+            R fg_psij1 = ths->psi[2 * j + 1]; \
+            R fg_psij2 = K(1.0); \
+ \
+            psij_const[0] = fg_psij0; \
+            for (l = 1; l <= 2 * m + 1; l++) \
+            { \
+              fg_psij2 *= fg_psij1; \
+              psij_const[l] = fg_psij0 * fg_psij2 * fg_exp_l[l]; \
+            } \
+ \
+            nfft_adjoint_1d_compute_omp_blockwise(ths->f[j], g, psij_const, \
+                ths->x + j, n, m, my_u0, my_o0); \
+}
+
+#define MACRO_adjoint_1d_B_OMP_BLOCKWISE_COMPUTE_FG_PSI \
+{ \
+            R psij_const[2 * m + 2]; \
+            R fg_psij0, fg_psij1, fg_psij2; \
+            INT u, o, l; \
+ \
+            uo(ths, j, &u, &o, (INT)0); \
+            fg_psij0 = (PHI(ths->n[0],ths->x[j]-((R)u)/((R)n),0)); \
+            fg_psij1 = EXP(K(2.0) * (((R)n) * (ths->x[j]) - (R)u) / ths->b[0]); \
+            fg_psij2 = K(1.0); \
+            psij_const[0] = fg_psij0; \
+            for (l = 1; l <= 2 * m + 1; l++) \
+            { \
+              fg_psij2 *= fg_psij1; \
+              psij_const[l] = fg_psij0 * fg_psij2 * fg_exp_l[l]; \
+            } \
+ \
+            nfft_adjoint_1d_compute_omp_blockwise(ths->f[j], g, psij_const, \
+                ths->x + j, n, m, my_u0, my_o0); \
+}
+
+#define MACRO_adjoint_1d_B_OMP_BLOCKWISE_COMPUTE_PRE_LIN_PSI \
+{ \
+            R psij_const[2 * m + 2]; \
+            INT ip_u; \
+            R ip_y, ip_w; \
+            INT u, o, l; \
+ \
+            uo(ths, j, &u, &o, (INT)0); \
+ \
+            ip_y = FABS(((R)n) * ths->x[j] - (R)u) * ((R)ip_s); \
+            ip_u = LRINT(FLOOR(ip_y)); \
+            ip_w = ip_y - ip_u; \
+            for (l = 0; l < 2 * m + 2; l++) \
+              psij_const[l] \
+                  = ths->psi[ABS(ip_u-l*ip_s)] * (K(1.0) - ip_w) \
+                      + ths->psi[ABS(ip_u-l*ip_s+1)] * (ip_w); \
+ \
+            nfft_adjoint_1d_compute_omp_blockwise(ths->f[j], g, psij_const, \
+                ths->x + j, n, m, my_u0, my_o0); \
+}
+
+#define MACRO_adjoint_1d_B_OMP_BLOCKWISE_COMPUTE_NO_PSI \
+{ \
+            R psij_const[2 * m + 2]; \
+            INT u, o; \
+ \
+            uo(ths, j, &u, &o, (INT)0); \
+ \
+            window_taps(ths, ths->x[j], u, 0, psij_const); \
+ \
+            nfft_adjoint_1d_compute_omp_blockwise(ths->f[j], g, psij_const, \
+                ths->x + j, n, m, my_u0, my_o0); \
+}
+
+#define MACRO_adjoint_1d_B_OMP_BLOCKWISE(whichone) \
+{ \
+    if (ths->flags & NFFT_OMP_BLOCKWISE_ADJOINT) \
+    { \
+      _Pragma("omp parallel private(k)") \
+      { \
+        INT my_u0, my_o0, min_u_a, max_u_a, min_u_b, max_u_b; \
+        INT *ar_x = ths->index_x; \
+ \
+        nfft_adjoint_B_omp_blockwise_init(&my_u0, &my_o0, &min_u_a, &max_u_a, \
+        		                          &min_u_b, &max_u_b, 1, &n, m); \
+ \
+        if (min_u_a != -1) \
+        { \
+          k = index_x_binary_search(ar_x, M, min_u_a); \
+ \
+          MACRO_adjoint_nd_B_OMP_BLOCKWISE_ASSERT_A \
+ \
+          while (k < M) \
+          { \
+            INT u_prod = ar_x[2*k]; \
+            INT j = ar_x[2*k+1]; \
+ \
+            if (u_prod < min_u_a || u_prod > max_u_a) \
+              break; \
+ \
+            MACRO_adjoint_1d_B_OMP_BLOCKWISE_COMPUTE_ ##whichone \
+ \
+            k++; \
+          } \
+        } \
+ \
+        if (min_u_b != -1) \
+        { \
+          k = index_x_binary_search(ar_x, M, min_u_b); \
+ \
+          MACRO_adjoint_nd_B_OMP_BLOCKWISE_ASSERT_B \
+ \
+          while (k < M) \
+          { \
+            INT u_prod = ar_x[2*k]; \
+            INT j = ar_x[2*k+1]; \
+ \
+            if (u_prod < min_u_b || u_prod > max_u_b) \
+              break; \
+ \
+            MACRO_adjoint_1d_B_OMP_BLOCKWISE_COMPUTE_ ##whichone \
+ \
+            k++; \
+          } \
+        } \
+      } /* omp parallel */ \
+      return; \
+    } /* if(NFFT_OMP_BLOCKWISE_ADJOINT) */ \
+}
+
+static void nfft_adjoint_1d_B(X(plan) *ths)
+{
+  const INT n = ths->n[0], M = ths->M_total, m = ths->m;
+  INT k;
+  C *g = (C*)ths->g;
+
+  memset(g, 0, (size_t)(ths->n_total) * sizeof(C));
+
+  if (ths->flags & PRE_FULL_PSI)
+  {
+    nfft_adjoint_B_compute_full_psi(g, ths->psi_index_g, ths->psi, ths->f, M,
+        (INT)1, ths->n, m, ths->flags, ths->index_x);
+    return;
+  } /* if(PRE_FULL_PSI) */
+
+  if (ths->flags & PRE_PSI)
+  {
+#ifdef _OPENMP
+    MACRO_adjoint_1d_B_OMP_BLOCKWISE(PRE_PSI)
+#endif
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+#ifdef _OPENMP
+      nfft_adjoint_1d_compute_omp_atomic(ths->f[j], g, ths->psi + j * (2 * m + 2), ths->x + j, n, m);
+#else
+      nfft_adjoint_1d_compute_serial(ths->f + j, g, ths->psi + j * (2 * m + 2), ths->x + j, n, m);
+#endif
+    }
+
+    return;
+  } /* if(PRE_PSI) */
+
+  if (ths->flags & PRE_FG_PSI)
+  {
+    R fg_exp_l[2 * m + 2];
+
+    nfft_1d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+
+#ifdef _OPENMP
+    MACRO_adjoint_1d_B_OMP_BLOCKWISE(PRE_FG_PSI)
+#endif
+
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      R psij_const[2 * m + 2];
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      INT l;
+      R fg_psij0 = ths->psi[2 * j];
+      R fg_psij1 = ths->psi[2 * j + 1];
+      R fg_psij2 = K(1.0);
+
+      psij_const[0] = fg_psij0;
+      for (l = 1; l <= 2 * m + 1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[l] = fg_psij0 * fg_psij2 * fg_exp_l[l];
+      }
+
+#ifdef _OPENMP
+      nfft_adjoint_1d_compute_omp_atomic(ths->f[j], g, psij_const, ths->x + j, n, m);
+#else
+      nfft_adjoint_1d_compute_serial(ths->f + j, g, psij_const, ths->x + j, n, m);
+#endif
+    }
+
+    return;
+  } /* if(PRE_FG_PSI) */
+
+  if (ths->flags & FG_PSI)
+  {
+    R fg_exp_l[2 * m + 2];
+
+    nfft_1d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+
+#ifdef _OPENMP
+    MACRO_adjoint_1d_B_OMP_BLOCKWISE(FG_PSI)
+#endif
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT u,o,l;
+      R psij_const[2 * m + 2];
+      R fg_psij0, fg_psij1, fg_psij2;
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+
+      uo(ths, j, &u, &o, (INT)0);
+      fg_psij0 = (PHI(ths->n[0], ths->x[j] - ((R)u) / (R)(n),0));
+      fg_psij1 = EXP(K(2.0) * ((R)(n) * (ths->x[j]) - (R)(u)) / ths->b[0]);
+      fg_psij2 = K(1.0);
+      psij_const[0] = fg_psij0;
+      for (l = 1; l <= 2 * m + 1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[l] = fg_psij0 * fg_psij2 * fg_exp_l[l];
+      }
+
+#ifdef _OPENMP
+      nfft_adjoint_1d_compute_omp_atomic(ths->f[j], g, psij_const, ths->x + j, n, m);
+#else
+      nfft_adjoint_1d_compute_serial(ths->f + j, g, psij_const, ths->x + j, n, m);
+#endif
+    }
+
+    return;
+  } /* if(FG_PSI) */
+
+  if (ths->flags & PRE_LIN_PSI)
+  {
+    const INT K = ths->K;
+    const INT ip_s = K / (m + 2);
+
+#ifdef _OPENMP
+    MACRO_adjoint_1d_B_OMP_BLOCKWISE(PRE_LIN_PSI)
+#endif
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT u,o,l;
+      INT ip_u;
+      R ip_y, ip_w;
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      R psij_const[2 * m + 2];
+
+      uo(ths, j, &u, &o, (INT)0);
+
+      ip_y = FABS((R)(n) * ths->x[j] - (R)(u)) * ((R)ip_s);
+      ip_u = (INT)(LRINT(FLOOR(ip_y)));
+      ip_w = ip_y - (R)(ip_u);
+      for (l = 0; l < 2 * m + 2; l++)
+        psij_const[l]
+            = ths->psi[ABS(ip_u-l*ip_s)] * (K(1.0) - ip_w)
+                + ths->psi[ABS(ip_u-l*ip_s+1)] * (ip_w);
+
+#ifdef _OPENMP
+      nfft_adjoint_1d_compute_omp_atomic(ths->f[j], g, psij_const, ths->x + j, n, m);
+#else
+      nfft_adjoint_1d_compute_serial(ths->f + j, g, psij_const, ths->x + j, n, m);
+#endif
+    }
+    return;
+  } /* if(PRE_LIN_PSI) */
+
+  /* no precomputed psi at all */
+#ifdef _OPENMP
+  MACRO_adjoint_1d_B_OMP_BLOCKWISE(NO_PSI)
+#endif
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) private(k)
+#endif
+  for (k = 0; k < M; k++)
+  {
+    INT u,o;
+    R psij_const[2 * m + 2];
+    INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+
+    uo(ths, j, &u, &o, (INT)0);
+
+    window_taps(ths, ths->x[j], u, 0, psij_const);
+
+#ifdef _OPENMP
+    nfft_adjoint_1d_compute_omp_atomic(ths->f[j], g, psij_const, ths->x + j, n, m);
+#else
+    nfft_adjoint_1d_compute_serial(ths->f + j, g, psij_const, ths->x + j, n, m);
+#endif
+  }
+}
+
+static void trafo_1d(X(plan) *ths)
+{
+  sort_once(ths);
+
+  if((ths->N[0] <= ths->m) || (ths->n[0] <= 2*ths->m+2))
+  {
+    trafo_direct(ths);
+    return;
+  }
+  
+  const INT N = ths->N[0], N2 = N/2, n = ths->n[0];
+  C *f_hat1 = (C*)&ths->f_hat[f_hat_half(ths, 0, 0)];
+  C *f_hat2 = (C*)&ths->f_hat[f_hat_half(ths, 0, 1)];
+
+  ths->g_hat = ths->g1;
+  ths->g = ths->g2;
+
+  {
+    C *g_hat1 = (C*)&ths->g_hat[n-N/2], *g_hat2 = (C*)ths->g_hat;
+    R *c_phi_inv1, *c_phi_inv2;
+
+    TIC(0)
+    g_hat_clear(ths);
+    if(ths->flags & PRE_PHI_HUT)
+    {
+      INT k;
+      c_phi_inv1 = ths->c_phi_inv[0];
+      c_phi_inv2 = &ths->c_phi_inv[0][N2];
+
+#ifdef _OPENMP
+      #pragma omp parallel for default(shared) private(k)
+#endif
+      for (k = 0; k < N2; k++)
+      {
+        g_hat1[k] = f_hat1[k] * c_phi_inv1[k];
+        g_hat2[k] = f_hat2[k] * c_phi_inv2[k];
+      }
+    }
+    else
+    {
+      INT k;
+#ifdef _OPENMP
+      #pragma omp parallel for default(shared) private(k)
+#endif
+      for (k = 0; k < N2; k++)
+      {
+        g_hat1[k] = f_hat1[k] / (PHI_HUT(ths->n[0],k-N2,0));
+        g_hat2[k] = f_hat2[k] / (PHI_HUT(ths->n[0],k,0));
+      }
+    }
+    TOC(0)
+
+    TIC_FFTW(1)
+    fft_forward(ths);
+    TOC_FFTW(1);
+
+    TIC(2);
+    nfft_trafo_1d_B(ths);
+    TOC(2);
+  }
+}
+
+static void adjoint_1d(X(plan) *ths)
+{
+  sort_once(ths);
+
+  if((ths->N[0] <= ths->m) || (ths->n[0] <= 2*ths->m+2))
+  {
+    adjoint_direct(ths);
+    return;
+  }
+  
+  INT n,N;
+  C *g_hat1,*g_hat2,*f_hat1,*f_hat2;
+  R *c_phi_inv1, *c_phi_inv2;
+
+  N=ths->N[0];
+  n=ths->n[0];
+
+  ths->g_hat=ths->g1;
+  ths->g=ths->g2;
+
+  f_hat1=(C*)&ths->f_hat[f_hat_half(ths, 0, 0)];
+  f_hat2=(C*)&ths->f_hat[f_hat_half(ths, 0, 1)];
+  g_hat1=(C*)&ths->g_hat[n-N/2];
+  g_hat2=(C*)ths->g_hat;
+
+  TIC(2)
+  nfft_adjoint_1d_B(ths);
+  TOC(2)
+
+  TIC_FFTW(1)
+  fft_backward(ths);
+  TOC_FFTW(1);
+
+  TIC(0)
+  if(ths->flags & PRE_PHI_HUT)
+  {
+    INT k;
+    c_phi_inv1=ths->c_phi_inv[0];
+    c_phi_inv2=&ths->c_phi_inv[0][N/2];
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < N/2; k++)
+    {
+      f_hat1[k] = g_hat1[k] * c_phi_inv1[k];
+      f_hat2[k] = g_hat2[k] * c_phi_inv2[k];
+    }
+  }
+  else
+  {
+    INT k;
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < N/2; k++)
+    {
+      f_hat1[k] = g_hat1[k] / (PHI_HUT(ths->n[0],k-N/2,0));
+      f_hat2[k] = g_hat2[k] / (PHI_HUT(ths->n[0],k,0));
+    }
+  }
+  TOC(0)
+}
+
+
+/* ################################################ SPECIFIC VERSIONS FOR d=2 */
+
+static void nfft_2d_init_fg_exp_l(R *fg_exp_l, const INT m, const R b)
+{
+  INT l;
+  R fg_exp_b0, fg_exp_b1, fg_exp_b2, fg_exp_b0_sq;
+
+  fg_exp_b0 = EXP(K(-1.0)/b);
+  fg_exp_b0_sq = fg_exp_b0*fg_exp_b0;
+  fg_exp_b1 = K(1.0);
+  fg_exp_b2 = K(1.0);
+  fg_exp_l[0] = K(1.0);
+  for(l=1; l <= 2*m+1; l++)
+    {
+      fg_exp_b2 = fg_exp_b1*fg_exp_b0;
+      fg_exp_b1 *= fg_exp_b0_sq;
+      fg_exp_l[l] = fg_exp_l[l-1]*fg_exp_b2;
+    }
+}
+
+static void nfft_trafo_2d_compute(const X(plan) *ths, C *fj, const C *g,
+    const R *psij_const0, const R *psij_const1, const R *xj0, const R *xj1,
+    const INT n0, const INT n1, const INT m)
+{
+  INT u0,o0,l0,u1,o1,l1;
+  const C *gj;
+  const R *psij0,*psij1;
+
+  psij0=psij_const0;
+  psij1=psij_const1;
+
+  uo2(&u0,&o0,*xj0, n0, m);
+  uo2(&u1,&o1,*xj1, n1, m);
+
+#ifdef NFFT_SIMD
+  if (u1 < o1)
+  {
+    R psid1[2 * (2 * m + 2)];
+    simd_dup(psid1, psij_const1, 2 * m + 2);
+    simd_select(ths, 2 * m + 2)->trafo_2d(fj, psij_const0, psid1, g, u0, u1, n0, n1, 2 * m + 2);
+    return;
+  }
+#else
+  UNUSED(ths);
+#endif
+
+  *fj=0;
+
+  if (u0 < o0)
+      if(u1 < o1)
+    for(l0=0; l0<=2*m+1; l0++,psij0++)
+    {
+        psij1=psij_const1;
+        gj=g+(u0+l0)*n1+u1;
+        for(l1=0; l1<=2*m+1; l1++)
+      (*fj) += (*psij0) * (*psij1++) * (*gj++);
+    }
+      else
+    for(l0=0; l0<=2*m+1; l0++,psij0++)
+    {
+        psij1=psij_const1;
+        gj=g+(u0+l0)*n1+u1;
+        for(l1=0; l1<2*m+1-o1; l1++)
+      (*fj) += (*psij0) * (*psij1++) * (*gj++);
+        gj=g+(u0+l0)*n1;
+        for(l1=0; l1<=o1; l1++)
+      (*fj) += (*psij0) * (*psij1++) * (*gj++);
+    }
+  else
+      if(u1<o1)
+      {
+    for(l0=0; l0<2*m+1-o0; l0++,psij0++)
+    {
+        psij1=psij_const1;
+        gj=g+(u0+l0)*n1+u1;
+        for(l1=0; l1<=2*m+1; l1++)
+      (*fj) += (*psij0) * (*psij1++) * (*gj++);
+    }
+    for(l0=0; l0<=o0; l0++,psij0++)
+    {
+        psij1=psij_const1;
+        gj=g+l0*n1+u1;
+        for(l1=0; l1<=2*m+1; l1++)
+      (*fj) += (*psij0) * (*psij1++) * (*gj++);
+    }
+      }
+      else
+      {
+    for(l0=0; l0<2*m+1-o0; l0++,psij0++)
+    {
+        psij1=psij_const1;
+        gj=g+(u0+l0)*n1+u1;
+        for(l1=0; l1<2*m+1-o1; l1++)
+      (*fj) += (*psij0) * (*psij1++) * (*gj++);
+        gj=g+(u0+l0)*n1;
+        for(l1=0; l1<=o1; l1++)
+      (*fj) += (*psij0) * (*psij1++) * (*gj++);
+    }
+    for(l0=0; l0<=o0; l0++,psij0++)
+    {
+        psij1=psij_const1;
+        gj=g+l0*n1+u1;
+        for(l1=0; l1<2*m+1-o1; l1++)
+      (*fj) += (*psij0) * (*psij1++) * (*gj++);
+        gj=g+l0*n1;
+        for(l1=0; l1<=o1; l1++)
+      (*fj) += (*psij0) * (*psij1++) * (*gj++);
+    }
+      }
+}
+
+#ifdef _OPENMP
+/* adjoint NFFT two-dimensional case with OpenMP atomic operations */
+static void nfft_adjoint_2d_compute_omp_atomic(const C f, C *g,
+            const R *psij_const0, const R *psij_const1, const R *xj0,
+            const R *xj1, const INT n0, const INT n1, const INT m)
+{
+  INT u0,o0,l0,u1,o1,l1;
+
+  INT index_temp0[2*m+2];
+  INT index_temp1[2*m+2];
+
+  uo2(&u0,&o0,*xj0, n0, m);
+  uo2(&u1,&o1,*xj1, n1, m);
+
+  for (l0=0; l0<=2*m+1; l0++)
+    index_temp0[l0] = (u0+l0)%n0;
+
+  for (l1=0; l1<=2*m+1; l1++)
+    index_temp1[l1] = (u1+l1)%n1;
+
+  for(l0=0; l0<=2*m+1; l0++)
+  {
+    for(l1=0; l1<=2*m+1; l1++)
+    {
+      INT i = index_temp0[l0] * n1 + index_temp1[l1];
+      C *lhs = g+i;
+      R *lhs_real = (R*)lhs;
+      C val = psij_const0[l0] * psij_const1[l1] * f;
+
+      #pragma omp atomic
+      lhs_real[0] += CREAL(val);
+
+      #pragma omp atomic
+      lhs_real[1] += CIMAG(val);
+    }
+  }
+}
+#endif
+
+#ifdef _OPENMP
+/** 
+ * Adjoint NFFT for two-dimensional case updating only a specified range of
+ * vector g.
+ *
+ * \arg f input coefficient f[j]
+ * \arg g output vector g
+ * \arg psij_const0 vector of window function values first component
+ * \arg psij_const1 vector of window function values second component
+ * \arg xj0 node x[2*j]
+ * \arg xj1 node x[2*j+1]
+ * \arg n0 FFTW length (number oversampled Fourier coefficients) first comp.
+ * \arg n1 FFTW length (number oversampled Fourier coefficients) second comp.
+ * \arg m window length
+ * \arg my_u0 lowest index (first component) the current thread writes to
+ * \arg my_o0 highest index (second component) the current thread writes to
+ *
+ * \author Toni Volkmer
+ */
+static void nfft_adjoint_2d_compute_omp_blockwise(const C f, C *g,
+            const R *psij_const0, const R *psij_const1, const R *xj0,
+            const R *xj1, const INT n0, const INT n1, const INT m,
+            const INT my_u0, const INT my_o0)
+{
+  INT ar_u0,ar_o0,l0,u1,o1,l1;
+  INT index_temp1[2*m+2];
+
+  uo2(&ar_u0,&ar_o0,*xj0, n0, m);
+  uo2(&u1,&o1,*xj1, n1, m);
+
+  for (l1 = 0; l1 <= 2*m+1; l1++)
+    index_temp1[l1] = (u1+l1)%n1;
+
+  if(ar_u0 < ar_o0)
+  {
+    INT u0 = MAX(my_u0,ar_u0);
+    INT o0 = MIN(my_o0,ar_o0);
+    INT offset_psij = u0-ar_u0;
+#ifdef OMP_ASSERT
+    assert(offset_psij >= 0);
+    assert(o0-u0 <= 2*m+1);
+    assert(offset_psij+o0-u0 <= 2*m+1);
+#endif
+
+    for (l0 = 0; l0 <= o0-u0; l0++)
+    {
+      INT i0 = (u0+l0) * n1;
+      const C val0 = psij_const0[offset_psij+l0];
+
+      for(l1=0; l1<=2*m+1; l1++)
+        g[i0 + index_temp1[l1]] += val0 * psij_const1[l1] * f;
+    }
+  }
+  else
+  {
+    INT u0 = MAX(my_u0,ar_u0);
+    INT o0 = my_o0;
+    INT offset_psij = u0-ar_u0;
+#ifdef OMP_ASSERT
+    assert(offset_psij >= 0);
+    assert(o0-u0 <= 2*m+1);
+    assert(offset_psij+o0-u0 <= 2*m+1);
+#endif
+
+    for (l0 = 0; l0 <= o0-u0; l0++)
+    {
+      INT i0 = (u0+l0) * n1;
+      const C val0 = psij_const0[offset_psij+l0];
+
+      for(l1=0; l1<=2*m+1; l1++)
+        g[i0 + index_temp1[l1]] += val0 * psij_const1[l1] * f;
+    }
+
+    u0 = my_u0;
+    o0 = MIN(my_o0,ar_o0);
+    offset_psij += my_u0-ar_u0+n0;
+
+#ifdef OMP_ASSERT
+    if (u0<=o0)
+    {
+      assert(o0-u0 <= 2*m+1);
+      assert(offset_psij+o0-u0 <= 2*m+1);
+    }
+#endif
+
+    for (l0 = 0; l0 <= o0-u0; l0++)
+    {
+      INT i0 = (u0+l0) * n1;
+      const C val0 = psij_const0[offset_psij+l0];
+
+      for(l1=0; l1<=2*m+1; l1++)
+        g[i0 + index_temp1[l1]] += val0 * psij_const1[l1] * f;
+    }
+  }
+}
+#endif
+
+#ifndef _OPENMP
+static void nfft_adjoint_2d_compute_serial(const C *fj, C *g,
+            const R *psij_const0, const R *psij_const1, const R *xj0,
+            const R *xj1, const INT n0, const INT n1, const INT m)
+{
+  INT u0,o0,l0,u1,o1,l1;
+  C *gj;
+  const R *psij0,*psij1;
+
+  psij0=psij_const0;
+  psij1=psij_const1;
+
+  uo2(&u0,&o0,*xj0, n0, m);
+  uo2(&u1,&o1,*xj1, n1, m);
+
+  if(u0<o0)
+      if(u1<o1)
+    for(l0=0; l0<=2*m+1; l0++,psij0++)
+    {
+        psij1=psij_const1;
+        gj=g+(u0+l0)*n1+u1;
+        for(l1=0; l1<=2*m+1; l1++)
+    (*gj++) += (*psij0) * (*psij1++) * (*fj);
+    }
+      else
+    for(l0=0; l0<=2*m+1; l0++,psij0++)
+    {
+        psij1=psij_const1;
+        gj=g+(u0+l0)*n1+u1;
+        for(l1=0; l1<2*m+1-o1; l1++)
+      (*gj++) += (*psij0) * (*psij1++) * (*fj);
+        gj=g+(u0+l0)*n1;
+        for(l1=0; l1<=o1; l1++)
+      (*gj++) += (*psij0) * (*psij1++) * (*fj);
+    }
+  else
+      if(u1<o1)
+      {
+    for(l0=0; l0<2*m+1-o0; l0++,psij0++)
+    {
+        psij1=psij_const1;
+        gj=g+(u0+l0)*n1+u1;
+        for(l1=0; l1<=2*m+1; l1++)
+      (*gj++) += (*psij0) * (*psij1++) * (*fj);
+    }
+    for(l0=0; l0<=o0; l0++,psij0++)
+    {
+        psij1=psij_const1;
+        gj=g+l0*n1+u1;
+        for(l1=0; l1<=2*m+1; l1++)
+      (*gj++) += (*psij0) * (*psij1++) * (*fj);
+    }
+      }
+      else
+      {
+    for(l0=0; l0<2*m+1-o0; l0++,psij0++)
+    {
+        psij1=psij_const1;
+        gj=g+(u0+l0)*n1+u1;
+        for(l1=0; l1<2*m+1-o1; l1++)
+      (*gj++) += (*psij0) * (*psij1++) * (*fj);
+        gj=g+(u0+l0)*n1;
+        for(l1=0; l1<=o1; l1++)
+      (*gj++) += (*psij0) * (*psij1++) * (*fj);
+    }
+    for(l0=0; l0<=o0; l0++,psij0++)
+    {
+        psij1=psij_const1;
+        gj=g+l0*n1+u1;
+        for(l1=0; l1<2*m+1-o1; l1++)
+      (*gj++) += (*psij0) * (*psij1++) * (*fj);
+        gj=g+l0*n1;
+        for(l1=0; l1<=o1; l1++)
+      (*gj++) += (*psij0) * (*psij1++) * (*fj);
+    }
+      }
+}
+#endif
+
+static void nfft_trafo_2d_B(X(plan) *ths)
+{
+  const C *g = (C*)ths->g;
+  const INT n0 = ths->n[0];
+  const INT n1 = ths->n[1];
+  const INT M = ths->M_total;
+  const INT m = ths->m;
+
+  INT k;
+
+  if(ths->flags & PRE_FULL_PSI)
+  {
+    const INT lprod = (2*m+2) * (2*m+2);
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT l;
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      ths->f[j] = K(0.0);
+      for (l = 0; l < lprod; l++)
+        ths->f[j] += ths->psi[j*lprod+l] * g[ths->psi_index_g[j*lprod+l]];
+    }
+    return;
+  } /* if(PRE_FULL_PSI) */
+
+  if(ths->flags & PRE_PSI)
+  {
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      nfft_trafo_2d_compute(ths, ths->f+j, g, ths->psi+j*2*(2*m+2), ths->psi+(j*2+1)*(2*m+2), ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+    }
+
+      return;
+  } /* if(PRE_PSI) */
+
+  if(ths->flags & PRE_FG_PSI)
+  {
+    R fg_exp_l[2*(2*m+2)];
+
+    nfft_2d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+    nfft_2d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      R psij_const[2*(2*m+2)];
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      INT l;
+      R fg_psij0 = ths->psi[2*j*2];
+      R fg_psij1 = ths->psi[2*j*2+1];
+      R fg_psij2 = K(1.0);
+
+      psij_const[0] = fg_psij0;
+      for (l = 1; l <= 2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
+      }
+
+      fg_psij0 = ths->psi[2*(j*2+1)];
+      fg_psij1 = ths->psi[2*(j*2+1)+1];
+      fg_psij2 = K(1.0);
+      psij_const[2*m+2] = fg_psij0;
+      for (l = 1; l <= 2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
+      }
+
+      nfft_trafo_2d_compute(ths, ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+    }
+
+    return;
+  } /* if(PRE_FG_PSI) */
+
+  if(ths->flags & FG_PSI)
+  {
+    R fg_exp_l[2*(2*m+2)];
+
+    nfft_2d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+    nfft_2d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT u, o, l;
+      R fg_psij0, fg_psij1, fg_psij2;
+      R psij_const[2*(2*m+2)];
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+
+      uo(ths, j, &u, &o, (INT)0);
+      fg_psij0 = (PHI(ths->n[0], ths->x[2*j] - ((R)u) / (R)(n0),0));
+      fg_psij1 = EXP(K(2.0) * ((R)(n0) * (ths->x[2*j]) - (R)(u)) / ths->b[0]);
+      fg_psij2 = K(1.0);
+      psij_const[0] = fg_psij0;
+      for (l = 1; l <= 2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
+      }
+
+      uo(ths,j,&u,&o, (INT)1);
+      fg_psij0 = (PHI(ths->n[1], ths->x[2*j+1] - ((R)u) / (R)(n1),1));
+      fg_psij1 = EXP(K(2.0) * ((R)(n1) * (ths->x[2*j+1]) - (R)(u)) / ths->b[1]);
+      fg_psij2 = K(1.0);
+      psij_const[2*m+2] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
+      }
+
+      nfft_trafo_2d_compute(ths, ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+    }
+
+    return;
+  } /* if(FG_PSI) */
+
+  if(ths->flags & PRE_LIN_PSI)
+  {
+    const INT K = ths->K, ip_s = K / (m + 2);
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT u, o, l;
+      R ip_y, ip_w;
+      INT ip_u;
+      R psij_const[2*(2*m+2)];
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+
+      uo(ths,j,&u,&o,(INT)0);
+      ip_y = FABS((R)(n0) * ths->x[2*j] - (R)(u)) * ((R)ip_s);
+      ip_u = (INT)LRINT(FLOOR(ip_y));
+      ip_w = ip_y - (R)(ip_u);
+      for (l = 0; l < 2*m+2; l++)
+        psij_const[l] = ths->psi[ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) + ths->psi[ABS(ip_u-l*ip_s+1)]*(ip_w);
+
+      uo(ths,j,&u,&o,(INT)1);
+      ip_y = FABS((R)(n1) * ths->x[2*j+1] - (R)(u)) * ((R)ip_s);
+      ip_u = (INT)(LRINT(FLOOR(ip_y)));
+      ip_w = ip_y - (R)(ip_u);
+      for (l = 0; l < 2*m+2; l++)
+        psij_const[2*m+2+l] = ths->psi[(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) + ths->psi[(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w);
+
+      nfft_trafo_2d_compute(ths, ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+    }
+      return;
+  } /* if(PRE_LIN_PSI) */
+
+  /* no precomputed psi at all */
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) private(k)
+#endif
+  for (k = 0; k < M; k++)
+  {
+    R psij_const[2*(2*m+2)];
+    INT u, o;
+    INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+
+    uo(ths,j,&u,&o,(INT)0);
+    window_taps(ths, ths->x[2*j], u, 0, psij_const);
+
+    uo(ths,j,&u,&o,(INT)1);
+    window_taps(ths, ths->x[2*j+1], u, 1, psij_const + 2*m+2);
+
+    nfft_trafo_2d_compute(ths, ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+  }
+}
+
+#define MACRO_adjoint_2d_B_OMP_BLOCKWISE_COMPUTE_PRE_PSI \
+            nfft_adjoint_2d_compute_omp_blockwise(ths->f[j], g, \
+                ths->psi+j*2*(2*m+2), ths->psi+(j*2+1)*(2*m+2), \
+                ths->x+2*j, ths->x+2*j+1, n0, n1, m, my_u0, my_o0);
+
+#define MACRO_adjoint_2d_B_OMP_BLOCKWISE_COMPUTE_PRE_FG_PSI \
+{ \
+            R psij_const[2*(2*m+2)]; \
+            INT l; \
+            R fg_psij0 = ths->psi[2*j*2]; \
+            R fg_psij1 = ths->psi[2*j*2+1]; \
+            R fg_psij2 = K(1.0); \
+ \
+            psij_const[0] = fg_psij0; \
+            for(l=1; l<=2*m+1; l++) \
+            { \
+              fg_psij2 *= fg_psij1; \
+              psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l]; \
+            } \
+ \
+            fg_psij0 = ths->psi[2*(j*2+1)]; \
+            fg_psij1 = ths->psi[2*(j*2+1)+1]; \
+            fg_psij2 = K(1.0); \
+            psij_const[2*m+2] = fg_psij0; \
+            for(l=1; l<=2*m+1; l++) \
+            { \
+              fg_psij2 *= fg_psij1; \
+              psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l]; \
+            } \
+ \
+            nfft_adjoint_2d_compute_omp_blockwise(ths->f[j], g, \
+                psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, \
+                n0, n1, m, my_u0, my_o0); \
+}
+
+#define MACRO_adjoint_2d_B_OMP_BLOCKWISE_COMPUTE_FG_PSI \
+{ \
+            R psij_const[2*(2*m+2)]; \
+            R fg_psij0, fg_psij1, fg_psij2; \
+            INT u, o, l; \
+ \
+            uo(ths,j,&u,&o,(INT)0); \
+            fg_psij0 = (PHI(ths->n[0],ths->x[2*j]-((R)u)/((R)n0),0)); \
+            fg_psij1 = EXP(K(2.0)*(((R)n0)*(ths->x[2*j]) - (R)u)/ths->b[0]); \
+            fg_psij2 = K(1.0); \
+            psij_const[0] = fg_psij0; \
+            for(l=1; l<=2*m+1; l++) \
+            { \
+              fg_psij2 *= fg_psij1; \
+              psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l]; \
+            } \
+ \
+            uo(ths,j,&u,&o,(INT)1); \
+            fg_psij0 = (PHI(ths->n[1],ths->x[2*j+1]-((R)u)/((R)n1),1)); \
+            fg_psij1 = EXP(K(2.0)*(((R)n1)*(ths->x[2*j+1]) - (R)u)/ths->b[1]); \
+            fg_psij2 = K(1.0); \
+            psij_const[2*m+2] = fg_psij0; \
+            for(l=1; l<=2*m+1; l++) \
+            { \
+              fg_psij2 *= fg_psij1; \
+              psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l]; \
+            } \
+ \
+            nfft_adjoint_2d_compute_omp_blockwise(ths->f[j], g, \
+                psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, \
+                n0, n1, m, my_u0, my_o0); \
+}
+
+#define MACRO_adjoint_2d_B_OMP_BLOCKWISE_COMPUTE_PRE_LIN_PSI \
+{ \
+            R psij_const[2*(2*m+2)]; \
+            INT u, o, l; \
+            INT ip_u; \
+            R ip_y, ip_w; \
+ \
+            uo(ths,j,&u,&o,(INT)0); \
+            ip_y = FABS(((R)n0)*(ths->x[2*j]) - (R)u)*((R)ip_s); \
+            ip_u = LRINT(FLOOR(ip_y)); \
+            ip_w = ip_y-ip_u; \
+            for(l=0; l < 2*m+2; l++) \
+              psij_const[l] = ths->psi[ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) + \
+                ths->psi[ABS(ip_u-l*ip_s+1)]*(ip_w); \
+ \
+            uo(ths,j,&u,&o,(INT)1); \
+            ip_y = FABS(((R)n1)*(ths->x[2*j+1]) - (R)u)*((R)ip_s); \
+            ip_u = LRINT(FLOOR(ip_y)); \
+            ip_w = ip_y-ip_u; \
+            for(l=0; l < 2*m+2; l++) \
+              psij_const[2*m+2+l] = ths->psi[(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) + \
+                ths->psi[(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w); \
+ \
+            nfft_adjoint_2d_compute_omp_blockwise(ths->f[j], g, \
+                psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, \
+                n0, n1, m, my_u0, my_o0); \
+}
+
+#define MACRO_adjoint_2d_B_OMP_BLOCKWISE_COMPUTE_NO_PSI \
+{ \
+            R psij_const[2*(2*m+2)]; \
+            INT u, o; \
+ \
+            uo(ths,j,&u,&o,(INT)0); \
+            window_taps(ths, ths->x[2*j], u, 0, psij_const); \
+ \
+            uo(ths,j,&u,&o,(INT)1); \
+            window_taps(ths, ths->x[2*j+1], u, 1, psij_const + 2*m+2); \
+ \
+            nfft_adjoint_2d_compute_omp_blockwise(ths->f[j], g, \
+                psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, \
+                n0, n1, m, my_u0, my_o0); \
+}
+
+#define MACRO_adjoint_2d_B_OMP_BLOCKWISE(whichone) \
+{ \
+    if (ths->flags & NFFT_OMP_BLOCKWISE_ADJOINT) \
+    { \
+      _Pragma("omp parallel private(k)") \
+      { \
+        INT my_u0, my_o0, min_u_a, max_u_a, min_u_b, max_u_b; \
+        INT *ar_x = ths->index_x; \
+ \
+        nfft_adjoint_B_omp_blockwise_init(&my_u0, &my_o0, &min_u_a, &max_u_a, \
+            &min_u_b, &max_u_b, 2, ths->n, m); \
+ \
+        if (min_u_a != -1) \
+        { \
+          k = index_x_binary_search(ar_x, M, min_u_a); \
+ \
+          MACRO_adjoint_nd_B_OMP_BLOCKWISE_ASSERT_A \
+ \
+          while (k < M) \
+          { \
+            INT u_prod = ar_x[2*k]; \
+            INT j = ar_x[2*k+1]; \
+ \
+            if (u_prod < min_u_a || u_prod > max_u_a) \
+              break; \
+ \
+            MACRO_adjoint_2d_B_OMP_BLOCKWISE_COMPUTE_ ##whichone \
+ \
+            k++; \
+          } \
+        } \
+ \
+        if (min_u_b != -1) \
+        { \
+          INT k = index_x_binary_search(ar_x, M, min_u_b); \
+ \
+          MACRO_adjoint_nd_B_OMP_BLOCKWISE_ASSERT_B \
+ \
+          while (k < M) \
+          { \
+            INT u_prod = ar_x[2*k]; \
+            INT j = ar_x[2*k+1]; \
+ \
+            if (u_prod < min_u_b || u_prod > max_u_b) \
+              break; \
+ \
+            MACRO_adjoint_2d_B_OMP_BLOCKWISE_COMPUTE_ ##whichone \
+ \
+            k++; \
+          } \
+        } \
+      } /* omp parallel */ \
+      return; \
+    } /* if(NFFT_OMP_BLOCKWISE_ADJOINT) */ \
+}
+
+
+static void nfft_adjoint_2d_B(X(plan) *ths)
+{
+  const INT n0 = ths->n[0];
+  const INT n1 = ths->n[1];
+  const INT M = ths->M_total;
+  const INT m = ths->m;
+  C* g = (C*) ths->g;
+  INT k;
+
+  memset(g, 0, (size_t)(ths->n_total) * sizeof(C));
+
+  if(ths->flags & PRE_FULL_PSI)
+  {
+    nfft_adjoint_B_compute_full_psi(g, ths->psi_index_g, ths->psi, ths->f, M,
+        (INT)2, ths->n, m, ths->flags, ths->index_x);
+    return;
+  } /* if(PRE_FULL_PSI) */
+
+  if(ths->flags & PRE_PSI)
+  {
+#ifdef _OPENMP
+    MACRO_adjoint_2d_B_OMP_BLOCKWISE(PRE_PSI)
+#endif
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+#ifdef _OPENMP
+      nfft_adjoint_2d_compute_omp_atomic(ths->f[j], g, ths->psi+j*2*(2*m+2), ths->psi+(j*2+1)*(2*m+2), ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+#else
+      nfft_adjoint_2d_compute_serial(ths->f+j, g, ths->psi+j*2*(2*m+2), ths->psi+(j*2+1)*(2*m+2), ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+#endif
+    }
+    return;
+  } /* if(PRE_PSI) */
+
+  if(ths->flags & PRE_FG_PSI)
+  {
+    R fg_exp_l[2*(2*m+2)];
+
+    nfft_2d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+    nfft_2d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
+
+#ifdef _OPENMP
+    MACRO_adjoint_2d_B_OMP_BLOCKWISE(PRE_FG_PSI)
+#endif
+
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      R psij_const[2*(2*m+2)];
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      INT l;
+      R fg_psij0 = ths->psi[2*j*2];
+      R fg_psij1 = ths->psi[2*j*2+1];
+      R fg_psij2 = K(1.0);
+
+      psij_const[0] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
+      }
+
+      fg_psij0 = ths->psi[2*(j*2+1)];
+      fg_psij1 = ths->psi[2*(j*2+1)+1];
+      fg_psij2 = K(1.0);
+      psij_const[2*m+2] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
+      }
+
+#ifdef _OPENMP
+      nfft_adjoint_2d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+#else
+      nfft_adjoint_2d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+#endif
+    }
+
+    return;
+  } /* if(PRE_FG_PSI) */
+
+  if(ths->flags & FG_PSI)
+  {
+    R fg_exp_l[2*(2*m+2)];
+
+    nfft_2d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+    nfft_2d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
+
+#ifdef _OPENMP
+    MACRO_adjoint_2d_B_OMP_BLOCKWISE(FG_PSI)
+#endif
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT u, o, l;
+      R fg_psij0, fg_psij1, fg_psij2;
+      R psij_const[2*(2*m+2)];
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+
+      uo(ths,j,&u,&o,(INT)0);
+      fg_psij0 = (PHI(ths->n[0], ths->x[2*j] - ((R)u)/(R)(n0),0));
+      fg_psij1 = EXP(K(2.0) * ((R)(n0) * (ths->x[2*j]) - (R)(u)) / ths->b[0]);
+      fg_psij2 = K(1.0);
+      psij_const[0] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
+      }
+
+      uo(ths,j,&u,&o,(INT)1);
+      fg_psij0 = (PHI(ths->n[1], ths->x[2*j+1] - ((R)u) / (R)(n1),1));
+      fg_psij1 = EXP(K(2.0) * ((R)(n1) * (ths->x[2*j+1]) - (R)(u)) / ths->b[1]);
+      fg_psij2 = K(1.0);
+      psij_const[2*m+2] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
+      }
+
+#ifdef _OPENMP
+      nfft_adjoint_2d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+#else
+      nfft_adjoint_2d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+#endif
+    }
+
+    return;
+  } /* if(FG_PSI) */
+
+  if(ths->flags & PRE_LIN_PSI)
+  {
+    const INT K = ths->K;
+    const INT ip_s = K / (m + 2);
+
+#ifdef _OPENMP
+    MACRO_adjoint_2d_B_OMP_BLOCKWISE(PRE_LIN_PSI)
+#endif
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT u,o,l;
+      INT ip_u;
+      R ip_y, ip_w;
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      R psij_const[2*(2*m+2)];
+
+      uo(ths,j,&u,&o,(INT)0);
+      ip_y = FABS((R)(n0) * (ths->x[2*j]) - (R)(u)) * ((R)ip_s);
+      ip_u = (INT)(LRINT(FLOOR(ip_y)));
+      ip_w = ip_y - (R)(ip_u);
+      for(l=0; l < 2*m+2; l++)
+        psij_const[l] = ths->psi[ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
+          ths->psi[ABS(ip_u-l*ip_s+1)]*(ip_w);
+
+      uo(ths,j,&u,&o,(INT)1);
+      ip_y = FABS((R)(n1) * (ths->x[2*j+1]) - (R)(u)) * ((R)ip_s);
+      ip_u = (INT)(LRINT(FLOOR(ip_y)));
+      ip_w = ip_y - (R)(ip_u);
+      for(l=0; l < 2*m+2; l++)
+        psij_const[2*m+2+l] = ths->psi[(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
+          ths->psi[(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w);
+
+#ifdef _OPENMP
+      nfft_adjoint_2d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+#else
+      nfft_adjoint_2d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+#endif
+  }
+      return;
+    } /* if(PRE_LIN_PSI) */
+
+  /* no precomputed psi at all */
+#ifdef _OPENMP
+  MACRO_adjoint_2d_B_OMP_BLOCKWISE(NO_PSI)
+#endif
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) private(k)
+#endif
+  for (k = 0; k < M; k++)
+  {
+    INT u,o;
+    R psij_const[2*(2*m+2)];
+    INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+
+    uo(ths,j,&u,&o,(INT)0);
+    window_taps(ths, ths->x[2*j], u, 0, psij_const);
+
+    uo(ths,j,&u,&o,(INT)1);
+    window_taps(ths, ths->x[2*j+1], u, 1, psij_const + 2*m+2);
+
+#ifdef _OPENMP
+    nfft_adjoint_2d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+#else
+    nfft_adjoint_2d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, ths->x+2*j, ths->x+2*j+1, n0, n1, m);
+#endif
+  }
+}
+
+
+static void trafo_2d(X(plan) *ths)
+{
+  sort_once(ths);
+
+  if((ths->N[0] <= ths->m) || (ths->N[1] <= ths->m) || (ths->n[0] <= 2*ths->m+2) || (ths->n[1] <= 2*ths->m+2))
+  {
+    trafo_direct(ths);
+    return;
+  }
+  
+  INT k0,k1,n0,n1,N0,N1;
+  INT o01, o02, o11, o12; /* halves of f_hat */
+  C *g_hat,*f_hat;
+  R *c_phi_inv01, *c_phi_inv02, *c_phi_inv11, *c_phi_inv12;
+  R ck01, ck02, ck11, ck12;
+  C *g_hat11,*f_hat11,*g_hat21,*f_hat21,*g_hat12,*f_hat12,*g_hat22,*f_hat22;
+
+  ths->g_hat=ths->g1;
+  ths->g=ths->g2;
+
+  N0=ths->N[0];
+  N1=ths->N[1];
+  n0=ths->n[0];
+  n1=ths->n[1];
+
+  o01=f_hat_half(ths,0,0);
+  o02=f_hat_half(ths,0,1);
+  o11=f_hat_half(ths,1,0);
+  o12=f_hat_half(ths,1,1);
+
+  f_hat=(C*)ths->f_hat;
+  g_hat=(C*)ths->g_hat;
+
+  TIC(0)
+  g_hat_clear(ths);
+  if(ths->flags & PRE_PHI_HUT)
+    {
+      c_phi_inv01=ths->c_phi_inv[0];
+      c_phi_inv02=&ths->c_phi_inv[0][N0/2];
+
+#ifdef _OPENMP
+      #pragma omp parallel for default(shared) private(k0,k1,ck01,ck02,c_phi_inv11,c_phi_inv12,g_hat11,f_hat11,g_hat21,f_hat21,g_hat12,f_hat12,g_hat22,f_hat22,ck11,ck12)
+#endif
+      for(k0=0;k0<N0/2;k0++)
+      {
+        ck01=c_phi_inv01[k0];
+        ck02=c_phi_inv02[k0];
+
+        c_phi_inv11=ths->c_phi_inv[1];
+        c_phi_inv12=&ths->c_phi_inv[1][N1/2];
+
+        g_hat11=g_hat + (n0-(N0/2)+k0)*n1+n1-(N1/2);
+        f_hat11=f_hat + (o01+k0)*N1+o11;
+        g_hat21=g_hat + k0*n1+n1-(N1/2);
+        f_hat21=f_hat + (o02+k0)*N1+o11;
+        g_hat12=g_hat + (n0-(N0/2)+k0)*n1;
+        f_hat12=f_hat + (o01+k0)*N1+o12;
+        g_hat22=g_hat + k0*n1;
+        f_hat22=f_hat + (o02+k0)*N1+o12;
+
+        for(k1=0;k1<N1/2;k1++)
+        {
+          ck11=c_phi_inv11[k1];
+          ck12=c_phi_inv12[k1];
+
+          g_hat11[k1] = f_hat11[k1] * ck01 * ck11;
+          g_hat21[k1] = f_hat21[k1] * ck02 * ck11;
+          g_hat12[k1] = f_hat12[k1] * ck01 * ck12;
+          g_hat22[k1] = f_hat22[k1] * ck02 * ck12;
+        }
+      }
+    }
+  else
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k0,k1,ck01,ck02,ck11,ck12)
+#endif
+    for(k0=0;k0<N0/2;k0++)
+      {
+  ck01=K(1.0)/(PHI_HUT(ths->n[0],k0-N0/2,0));
+  ck02=K(1.0)/(PHI_HUT(ths->n[0],k0,0));
+  for(k1=0;k1<N1/2;k1++)
+    {
+      ck11=K(1.0)/(PHI_HUT(ths->n[1],k1-N1/2,1));
+      ck12=K(1.0)/(PHI_HUT(ths->n[1],k1,1));
+      g_hat[(n0-N0/2+k0)*n1+n1-N1/2+k1] = f_hat[(o01+k0)*N1+o11+k1]             * ck01 * ck11;
+      g_hat[k0*n1+n1-N1/2+k1]           = f_hat[(o02+k0)*N1+o11+k1]      * ck02 * ck11;
+      g_hat[(n0-N0/2+k0)*n1+k1]         = f_hat[(o01+k0)*N1+o12+k1]        * ck01 * ck12;
+      g_hat[k0*n1+k1]                   = f_hat[(o02+k0)*N1+o12+k1] * ck02 * ck12;
+    }
+      }
+
+  TOC(0)
+
+  TIC_FFTW(1)
+  fft_forward(ths);
+  TOC_FFTW(1);
+
+  TIC(2);
+  nfft_trafo_2d_B(ths);
+  TOC(2);
+}
+
+static void adjoint_2d(X(plan) *ths)
+{
+  sort_once(ths);
+
+  if((ths->N[0] <= ths->m) || (ths->N[1] <= ths->m) || (ths->n[0] <= 2*ths->m+2) || (ths->n[1] <= 2*ths->m+2))
+  {
+    adjoint_direct(ths);
+    return;
+  }
+  
+  INT k0,k1,n0,n1,N0,N1;
+  INT o01, o02, o11, o12; /* halves of f_hat */
+  C *g_hat,*f_hat;
+  R *c_phi_inv01, *c_phi_inv02, *c_phi_inv11, *c_phi_inv12;
+  R ck01, ck02, ck11, ck12;
+  C *g_hat11,*f_hat11,*g_hat21,*f_hat21,*g_hat12,*f_hat12,*g_hat22,*f_hat22;
+
+  ths->g_hat=ths->g1;
+  ths->g=ths->g2;
+
+  N0=ths->N[0];
+  N1=ths->N[1];
+  n0=ths->n[0];
+  n1=ths->n[1];
+
+  o01=f_hat_half(ths,0,0);
+  o02=f_hat_half(ths,0,1);
+  o11=f_hat_half(ths,1,0);
+  o12=f_hat_half(ths,1,1);
+
+  f_hat=(C*)ths->f_hat;
+  g_hat=(C*)ths->g_hat;
+
+  TIC(2);
+  nfft_adjoint_2d_B(ths);
+  TOC(2);
+
+  TIC_FFTW(1)
+  fft_backward(ths);
+  TOC_FFTW(1);
+
+  TIC(0)
+  if(ths->flags & PRE_PHI_HUT)
+    {
+      c_phi_inv01=ths->c_phi_inv[0];
+      c_phi_inv02=&ths->c_phi_inv[0][N0/2];
+
+#ifdef _OPENMP
+      #pragma omp parallel for default(shared) private(k0,k1,ck01,ck02,c_phi_inv11,c_phi_inv12,g_hat11,f_hat11,g_hat21,f_hat21,g_hat12,f_hat12,g_hat22,f_hat22,ck11,ck12)
+#endif
+      for(k0=0;k0<N0/2;k0++)
+      {
+        ck01=c_phi_inv01[k0];
+        ck02=c_phi_inv02[k0];
+
+        c_phi_inv11=ths->c_phi_inv[1];
+        c_phi_inv12=&ths->c_phi_inv[1][N1/2];
+
+        g_hat11=g_hat + (n0-(N0/2)+k0)*n1+n1-(N1/2);
+        f_hat11=f_hat + (o01+k0)*N1+o11;
+        g_hat21=g_hat + k0*n1+n1-(N1/2);
+        f_hat21=f_hat + (o02+k0)*N1+o11;
+        g_hat12=g_hat + (n0-(N0/2)+k0)*n1;
+        f_hat12=f_hat + (o01+k0)*N1+o12;
+        g_hat22=g_hat + k0*n1;
+        f_hat22=f_hat + (o02+k0)*N1+o12;
+
+        for(k1=0;k1<N1/2;k1++)
+        {
+          ck11=c_phi_inv11[k1];
+          ck12=c_phi_inv12[k1];
+
+          f_hat11[k1] = g_hat11[k1] * ck01 * ck11;
+          f_hat21[k1] = g_hat21[k1] * ck02 * ck11;
+          f_hat12[k1] = g_hat12[k1] * ck01 * ck12;
+          f_hat22[k1] = g_hat22[k1] * ck02 * ck12;
+        }
+      }
+    }
+  else
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k0,k1,ck01,ck02,ck11,ck12)
+#endif
+    for(k0=0;k0<N0/2;k0++)
+      {
+  ck01=K(1.0)/(PHI_HUT(ths->n[0],k0-N0/2,0));
+  ck02=K(1.0)/(PHI_HUT(ths->n[0],k0,0));
+  for(k1=0;k1<N1/2;k1++)
+    {
+      ck11=K(1.0)/(PHI_HUT(ths->n[1],k1-N1/2,1));
+      ck12=K(1.0)/(PHI_HUT(ths->n[1],k1,1));
+      f_hat[(o01+k0)*N1+o11+k1]             = g_hat[(n0-N0/2+k0)*n1+n1-N1/2+k1] * ck01 * ck11;
+      f_hat[(o02+k0)*N1+o11+k1]      = g_hat[k0*n1+n1-N1/2+k1]           * ck02 * ck11;
+      f_hat[(o01+k0)*N1+o12+k1]        = g_hat[(n0-N0/2+k0)*n1+k1]         * ck01 * ck12;
+      f_hat[(o02+k0)*N1+o12+k1] = g_hat[k0*n1+k1]                   * ck02 * ck12;
+    }
+      }
+  TOC(0)
+}
+
+/* ################################################ SPECIFIC VERSIONS FOR d=3 */
+
+static void nfft_3d_init_fg_exp_l(R *fg_exp_l, const INT m, const R b)
+{
+  INT l;
+  R fg_exp_b0, fg_exp_b1, fg_exp_b2, fg_exp_b0_sq;
+
+  fg_exp_b0 = EXP(-K(1.0) / b);
+  fg_exp_b0_sq = fg_exp_b0*fg_exp_b0;
+  fg_exp_b1 = K(1.0);
+  fg_exp_b2 = K(1.0);
+  fg_exp_l[0] = K(1.0);
+  for(l=1; l <= 2*m+1; l++)
+    {
+      fg_exp_b2 = fg_exp_b1*fg_exp_b0;
+      fg_exp_b1 *= fg_exp_b0_sq;
+      fg_exp_l[l] = fg_exp_l[l-1]*fg_exp_b2;
+    }
+}
+
+static void nfft_trafo_3d_compute(const X(plan) *ths, C *fj, const C *g,
+    const R *psij_const0, const R *psij_const1, const R *psij_const2,
+    const R *xj0, const R *xj1, const R *xj2, const INT n0, const INT n1,
+    const INT n2, const INT m)
+{
+  INT u0, o0, l0, u1, o1, l1, u2, o2, l2;
+  const C *gj;
+  const R *psij0, *psij1, *psij2;
+
+  psij0 = psij_const0;
+  psij1 = psij_const1;
+  psij2 = psij_const2;
+
+  uo2(&u0, &o0, *xj0, n0, m);
+  uo2(&u1, &o1, *xj1, n1, m);
+  uo2(&u2, &o2, *xj2, n2, m);
+
+#ifdef NFFT_SIMD
+  if (u2 < o2)
+  {
+    R psid2[2 * (2 * m + 2)];
+    simd_dup(psid2, psij_const2, 2 * m + 2);
+    simd_select(ths, 2 * m + 2)->trafo_3d(fj, psij_const0, psij_const1, psid2, g,
+      u0, u1, u2, n0, n1, n2, 2 * m + 2);
+    return;
+  }
+#else
+  UNUSED(ths);
+#endif
+
+  *fj = 0;
+
+  if (u0 < o0)
+    if (u1 < o1)
+      if (u2 < o2)
+        for (l0 = 0; l0 <= 2 * m + 1; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+        }
+      else
+        /* asserts (u2>o2)*/
+        for (l0 = 0; l0 <= 2 * m + 1; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+        }
+    else /* asserts (u1>o1)*/
+      if (u2 < o2)
+        for (l0 = 0; l0 <= 2 * m + 1; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+          for (l1 = 0; l1 <= o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+        }
+      else/* asserts (u2>o2) */
+      {
+        for (l0 = 0; l0 <= 2 * m + 1; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+          for (l1 = 0; l1 <= o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+            gj = g + ((u0 + l0) * n1 + l1) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+        }
+      }
+  else /* asserts (u0>o0) */
+    if (u1 < o1)
+      if (u2 < o2)
+      {
+        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+        }
+
+        for (l0 = 0; l0 <= o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+        }
+      } else/* asserts (u2>o2) */
+      {
+        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+        }
+
+        for (l0 = 0; l0 <= o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+            gj = g + (l0 * n1 + (u1 + l1)) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+        }
+      }
+    else /* asserts (u1>o1) */
+      if (u2 < o2)
+      {
+        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+          for (l1 = 0; l1 <= o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+        }
+        for (l0 = 0; l0 <= o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+          for (l1 = 0; l1 <= o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + (l0 * n1 + l1) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+        }
+      } else/* asserts (u2>o2) */
+      {
+        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+          for (l1 = 0; l1 <= o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+            gj = g + ((u0 + l0) * n1 + l1) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+        }
+
+        for (l0 = 0; l0 <= o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+            gj = g + (l0 * n1 + (u1 + l1)) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+          for (l1 = 0; l1 <= o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + (l0 * n1 + l1) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+            gj = g + (l0 * n1 + l1) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*fj) += (*psij0) * (*psij1) * (*psij2++) * (*gj++);
+          }
+        }
+      }
+}
+
+#ifdef _OPENMP
+/** 
+ * Adjoint NFFT for three-dimensional case updating only a specified range of
+ * vector g.
+ *
+ * \arg f input coefficient f[j]
+ * \arg g output vector g
+ * \arg psij_const0 vector of window function values first component
+ * \arg psij_const1 vector of window function values second component
+ * \arg psij_const2 vector of window function values third component
+ * \arg xj0 node x[3*j]
+ * \arg xj1 node x[3*j+1]
+ * \arg xj2 node x[3*j+2]
+ * \arg n0 FFTW length (number oversampled Fourier coefficients) first comp.
+ * \arg n1 FFTW length (number oversampled Fourier coefficients) second comp.
+ * \arg n2 FFTW length (number oversampled Fourier coefficients) third comp.
+ * \arg m window length
+ * \arg my_u0 lowest index (first component) the current thread writes to
+ * \arg my_o0 highest index (second component) the current thread writes to
+ *
+ * \author Toni Volkmer
+ */
+static void nfft_adjoint_3d_compute_omp_blockwise(const C f, C *g,
+    const R *psij_const0, const R *psij_const1, const R *psij_const2,
+    const R *xj0, const R *xj1, const R *xj2,
+    const INT n0, const INT n1, const INT n2, const INT m,
+    const INT my_u0, const INT my_o0)
+{
+  INT ar_u0,ar_o0,l0,u1,o1,l1,u2,o2,l2;
+
+  INT index_temp1[2*m+2];
+  INT index_temp2[2*m+2];
+
+  uo2(&ar_u0,&ar_o0,*xj0, n0, m);
+  uo2(&u1,&o1,*xj1, n1, m);
+  uo2(&u2,&o2,*xj2, n2, m);
+
+  for (l1=0; l1<=2*m+1; l1++)
+    index_temp1[l1] = (u1+l1)%n1;
+
+  for (l2=0; l2<=2*m+1; l2++)
+    index_temp2[l2] = (u2+l2)%n2;
+
+  if(ar_u0<ar_o0)
+  {
+    INT u0 = MAX(my_u0,ar_u0);
+    INT o0 = MIN(my_o0,ar_o0);
+    INT offset_psij = u0-ar_u0;
+#ifdef OMP_ASSERT
+    assert(offset_psij >= 0);
+    assert(o0-u0 <= 2*m+1);
+    assert(offset_psij+o0-u0 <= 2*m+1);
+#endif
+
+    for (l0 = 0; l0 <= o0-u0; l0++)
+    {
+      const INT i0 = (u0+l0) * n1;
+      const C val0 = psij_const0[offset_psij+l0];
+
+      for(l1=0; l1<=2*m+1; l1++)
+      {
+        const INT i1 = (i0 + index_temp1[l1]) * n2;
+        const C val1 = psij_const1[l1];
+
+        for(l2=0; l2<=2*m+1; l2++)
+          g[i1 + index_temp2[l2]] += val0 * val1 * psij_const2[l2] * f;
+      }
+    }
+  }
+  else
+  {
+    INT u0 = MAX(my_u0,ar_u0);
+    INT o0 = my_o0;
+    INT offset_psij = u0-ar_u0;
+#ifdef OMP_ASSERT
+    assert(offset_psij >= 0);
+    assert(o0-u0 <= 2*m+1);
+    assert(offset_psij+o0-u0 <= 2*m+1);
+#endif
+
+    for (l0 = 0; l0 <= o0-u0; l0++)
+    {
+      INT i0 = (u0+l0) * n1;
+      const C val0 = psij_const0[offset_psij+l0];
+
+      for(l1=0; l1<=2*m+1; l1++)
+      {
+        const INT i1 = (i0 + index_temp1[l1]) * n2;
+        const C val1 = psij_const1[l1];
+
+        for(l2=0; l2<=2*m+1; l2++)
+          g[i1 + index_temp2[l2]] += val0 * val1 * psij_const2[l2] * f;
+      }
+    }
+
+    u0 = my_u0;
+    o0 = MIN(my_o0,ar_o0);
+    offset_psij += my_u0-ar_u0+n0;
+
+#ifdef OMP_ASSERT
+    if (u0<=o0)
+    {
+      assert(o0-u0 <= 2*m+1);
+      assert(offset_psij+o0-u0 <= 2*m+1);
+    }
+#endif
+    for (l0 = 0; l0 <= o0-u0; l0++)
+    {
+      INT i0 = (u0+l0) * n1;
+      const C val0 = psij_const0[offset_psij+l0];
+
+      for(l1=0; l1<=2*m+1; l1++)
+      {
+        const INT i1 = (i0 + index_temp1[l1]) * n2;
+        const C val1 = psij_const1[l1];
+
+        for(l2=0; l2<=2*m+1; l2++)
+          g[i1 + index_temp2[l2]] += val0 * val1 * psij_const2[l2] * f;
+      }
+    }
+  }
+}
+#endif
+
+#ifdef _OPENMP
+/* adjoint NFFT three-dimensional case with OpenMP atomic operations */
+static void nfft_adjoint_3d_compute_omp_atomic(const C f, C *g,
+    const R *psij_const0, const R *psij_const1, const R *psij_const2,
+    const R *xj0, const R *xj1, const R *xj2,
+    const INT n0, const INT n1, const INT n2, const INT m)
+{
+  INT u0,o0,l0,u1,o1,l1,u2,o2,l2;
+
+  INT index_temp0[2*m+2];
+  INT index_temp1[2*m+2];
+  INT index_temp2[2*m+2];
+
+  uo2(&u0,&o0,*xj0, n0, m);
+  uo2(&u1,&o1,*xj1, n1, m);
+  uo2(&u2,&o2,*xj2, n2, m);
+
+  for (l0=0; l0<=2*m+1; l0++)
+    index_temp0[l0] = (u0+l0)%n0;
+
+  for (l1=0; l1<=2*m+1; l1++)
+    index_temp1[l1] = (u1+l1)%n1;
+
+  for (l2=0; l2<=2*m+1; l2++)
+    index_temp2[l2] = (u2+l2)%n2;
+
+  for(l0=0; l0<=2*m+1; l0++)
+  {
+    for(l1=0; l1<=2*m+1; l1++)
+    {
+      for(l2=0; l2<=2*m+1; l2++)
+      {
+        INT i = (index_temp0[l0] * n1 + index_temp1[l1]) * n2 + index_temp2[l2];
+        C *lhs = g+i;
+        R *lhs_real = (R*)lhs;
+        C val = psij_const0[l0] * psij_const1[l1] * psij_const2[l2] * f;
+
+#pragma omp atomic
+        lhs_real[0] += CREAL(val);
+
+#pragma omp atomic
+        lhs_real[1] += CIMAG(val);
+      }
+    }
+  }
+}
+#endif
+
+#ifndef _OPENMP
+static void nfft_adjoint_3d_compute_serial(const C *fj, C *g,
+    const R *psij_const0, const R *psij_const1, const R *psij_const2, const R *xj0,
+    const R *xj1, const R *xj2, const INT n0, const INT n1, const INT n2,
+    const INT m)
+{
+  INT u0, o0, l0, u1, o1, l1, u2, o2, l2;
+  C *gj;
+  const R *psij0, *psij1, *psij2;
+
+  psij0 = psij_const0;
+  psij1 = psij_const1;
+  psij2 = psij_const2;
+
+  uo2(&u0, &o0, *xj0, n0, m);
+  uo2(&u1, &o1, *xj1, n1, m);
+  uo2(&u2, &o2, *xj2, n2, m);
+
+  if (u0 < o0)
+    if (u1 < o1)
+      if (u2 < o2)
+        for (l0 = 0; l0 <= 2 * m + 1; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
           }
         }
       else
@@ -4484,1467 +7811,2991 @@ static void nfft_adjoint_3d_compute_serial(const C *fj, C *g,
               (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
           }
         }
-    else /* asserts (u1>o1)*/
-      if (u2 < o2)
-        for (l0 = 0; l0 <= 2 * m + 1; l0++, psij0++)
+    else /* asserts (u1>o1)*/
+      if (u2 < o2)
+        for (l0 = 0; l0 <= 2 * m + 1; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+          }
+          for (l1 = 0; l1 <= o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+          }
+        }
+      else/* asserts (u2>o2) */
+      {
+        for (l0 = 0; l0 <= 2 * m + 1; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+          }
+          for (l1 = 0; l1 <= o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+            gj = g + ((u0 + l0) * n1 + l1) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+          }
+        }
+      }
+  else /* asserts (u0>o0) */
+    if (u1 < o1)
+      if (u2 < o2)
+      {
+        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+          }
+        }
+
+        for (l0 = 0; l0 <= o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+          }
+        }
+      } else/* asserts (u2>o2) */
+      {
+        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+          }
+        }
+
+        for (l0 = 0; l0 <= o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+            gj = g + (l0 * n1 + (u1 + l1)) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+          }
+        }
+      }
+    else /* asserts (u1>o1) */
+      if (u2 < o2)
+      {
+        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+          }
+          for (l1 = 0; l1 <= o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+          }
+        }
+        for (l0 = 0; l0 <= o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+          }
+          for (l1 = 0; l1 <= o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + (l0 * n1 + l1) * n2 + u2;
+            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+          }
+        }
+      } else/* asserts (u2>o2) */
+      {
+        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
+        {
+          psij1 = psij_const1;
+          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+          }
+          for (l1 = 0; l1 <= o1; l1++, psij1++)
+          {
+            psij2 = psij_const2;
+            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+            gj = g + ((u0 + l0) * n1 + l1) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+          }
+        }
+
+        for (l0 = 0; l0 <= o0; l0++, psij0++)
         {
           psij1 = psij_const1;
           for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
           {
             psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+            gj = g + (l0 * n1 + (u1 + l1)) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
               (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
           }
           for (l1 = 0; l1 <= o1; l1++, psij1++)
           {
             psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
+            gj = g + (l0 * n1 + l1) * n2 + u2;
+            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
+              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
+            gj = g + (l0 * n1 + l1) * n2;
+            for (l2 = 0; l2 <= o2; l2++)
               (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
           }
         }
-      else/* asserts (u2>o2) */
+      }
+}
+#endif
+
+static void nfft_trafo_3d_B(X(plan) *ths)
+{
+  const INT n0 = ths->n[0];
+  const INT n1 = ths->n[1];
+  const INT n2 = ths->n[2];
+  const INT M = ths->M_total;
+  const INT m = ths->m;
+
+  const C* g = (C*) ths->g;
+
+  INT k;
+
+  if(ths->flags & PRE_FULL_PSI)
+  {
+    const INT lprod = (2*m+2) * (2*m+2) * (2*m+2);
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT l;
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      ths->f[j] = K(0.0);
+      for (l = 0; l < lprod; l++)
+        ths->f[j] += ths->psi[j*lprod+l] * g[ths->psi_index_g[j*lprod+l]];
+    }
+    return;
+  } /* if(PRE_FULL_PSI) */
+
+  if(ths->flags & PRE_PSI)
+  {
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      nfft_trafo_3d_compute(ths, ths->f+j, g, ths->psi+j*3*(2*m+2), ths->psi+(j*3+1)*(2*m+2), ths->psi+(j*3+2)*(2*m+2), ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+    }
+    return;
+  } /* if(PRE_PSI) */
+
+  if(ths->flags & PRE_FG_PSI)
+  {
+    R fg_exp_l[3*(2*m+2)];
+
+    nfft_3d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+    nfft_3d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
+    nfft_3d_init_fg_exp_l(fg_exp_l+2*(2*m+2), m, ths->b[2]);
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      INT l;
+      R psij_const[3*(2*m+2)];
+      R fg_psij0 = ths->psi[2*j*3];
+      R fg_psij1 = ths->psi[2*j*3+1];
+      R fg_psij2 = K(1.0);
+
+      psij_const[0] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
+      }
+
+      fg_psij0 = ths->psi[2*(j*3+1)];
+      fg_psij1 = ths->psi[2*(j*3+1)+1];
+      fg_psij2 = K(1.0);
+      psij_const[2*m+2] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
+      }
+
+      fg_psij0 = ths->psi[2*(j*3+2)];
+      fg_psij1 = ths->psi[2*(j*3+2)+1];
+      fg_psij2 = K(1.0);
+      psij_const[2*(2*m+2)] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[2*(2*m+2)+l] = fg_psij0*fg_psij2*fg_exp_l[2*(2*m+2)+l];
+      }
+
+      nfft_trafo_3d_compute(ths, ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+    }
+
+    return;
+  } /* if(PRE_FG_PSI) */
+
+  if(ths->flags & FG_PSI)
+  {
+    R fg_exp_l[3*(2*m+2)];
+
+    nfft_3d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+    nfft_3d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
+    nfft_3d_init_fg_exp_l(fg_exp_l+2*(2*m+2), m, ths->b[2]);
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      INT u, o, l;
+      R psij_const[3*(2*m+2)];
+      R fg_psij0, fg_psij1, fg_psij2;
+
+      uo(ths,j,&u,&o,(INT)0);
+      fg_psij0 = (PHI(ths->n[0], ths->x[3*j] - ((R)u) / (R)(n0),0));
+      fg_psij1 = EXP(K(2.0) * ((R)(n0) * (ths->x[3*j]) - (R)(u)) / ths->b[0]);
+      fg_psij2 = K(1.0);
+      psij_const[0] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
+      }
+
+      uo(ths,j,&u,&o,(INT)1);
+      fg_psij0 = (PHI(ths->n[1], ths->x[3*j+1] - ((R)u) / (R)(n1),1));
+      fg_psij1 = EXP(K(2.0) * ((R)(n1) * (ths->x[3*j+1]) - (R)(u)) / ths->b[1]);
+      fg_psij2 = K(1.0);
+      psij_const[2*m+2] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
+      }
+
+      uo(ths,j,&u,&o,(INT)2);
+      fg_psij0 = (PHI(ths->n[2], ths->x[3*j+2] - ((R)u) / (R)(n2),2));
+      fg_psij1 = EXP(K(2.0) * ((R)(n2) * (ths->x[3*j+2]) - (R)(u)) / ths->b[2]);
+      fg_psij2 = K(1.0);
+      psij_const[2*(2*m+2)] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[2*(2*m+2)+l] = fg_psij0*fg_psij2*fg_exp_l[2*(2*m+2)+l];
+      }
+
+      nfft_trafo_3d_compute(ths, ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+    }
+
+    return;
+  } /* if(FG_PSI) */
+
+  if(ths->flags & PRE_LIN_PSI)
+  {
+    const INT K = ths->K, ip_s = K / (m + 2);
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT u, o, l;
+      R ip_y, ip_w;
+      INT ip_u;
+      R psij_const[3*(2*m+2)];
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+
+      uo(ths,j,&u,&o,(INT)0);
+      ip_y = FABS((R)(n0) * ths->x[3*j+0] - (R)(u)) * ((R)ip_s);
+      ip_u = (INT)(LRINT(FLOOR(ip_y)));
+      ip_w = ip_y - (R)(ip_u);
+      for(l=0; l < 2*m+2; l++)
+        psij_const[l] = ths->psi[ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
+          ths->psi[ABS(ip_u-l*ip_s+1)]*(ip_w);
+
+      uo(ths,j,&u,&o,(INT)1);
+      ip_y = FABS((R)(n1) * ths->x[3*j+1] - (R)(u)) * ((R)ip_s);
+      ip_u = (INT)(LRINT(FLOOR(ip_y)));
+      ip_w = ip_y - (R)(ip_u);
+      for(l=0; l < 2*m+2; l++)
+        psij_const[2*m+2+l] = ths->psi[(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
+          ths->psi[(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w);
+
+      uo(ths,j,&u,&o,(INT)2);
+      ip_y = FABS((R)(n2) * ths->x[3*j+2] - (R)(u)) * ((R)ip_s);
+      ip_u = (INT)(LRINT(FLOOR(ip_y)));
+      ip_w = ip_y - (R)(ip_u);
+      for(l=0; l < 2*m+2; l++)
+        psij_const[2*(2*m+2)+l] = ths->psi[2*(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
+          ths->psi[2*(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w);
+
+      nfft_trafo_3d_compute(ths, ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+    }
+    return;
+  } /* if(PRE_LIN_PSI) */
+
+  /* no precomputed psi at all */
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) private(k)
+#endif
+  for (k = 0; k < M; k++)
+  {
+    R psij_const[3*(2*m+2)];
+    INT u, o;
+    INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+
+    uo(ths,j,&u,&o,(INT)0);
+    window_taps(ths, ths->x[3*j], u, 0, psij_const);
+
+    uo(ths,j,&u,&o,(INT)1);
+    window_taps(ths, ths->x[3*j+1], u, 1, psij_const + 2*m+2);
+
+    uo(ths,j,&u,&o,(INT)2);
+    window_taps(ths, ths->x[3*j+2], u, 2, psij_const + 2*(2*m+2));
+
+    nfft_trafo_3d_compute(ths, ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+  }
+}
+
+#define MACRO_adjoint_3d_B_OMP_BLOCKWISE_COMPUTE_PRE_PSI \
+            nfft_adjoint_3d_compute_omp_blockwise(ths->f[j], g, \
+                ths->psi+j*3*(2*m+2), \
+                ths->psi+(j*3+1)*(2*m+2), \
+                ths->psi+(j*3+2)*(2*m+2), \
+                ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, \
+                n0, n1, n2, m, my_u0, my_o0);
+
+#define MACRO_adjoint_3d_B_OMP_BLOCKWISE_COMPUTE_PRE_FG_PSI \
+{ \
+            INT l; \
+            R psij_const[3*(2*m+2)]; \
+            R fg_psij0 = ths->psi[2*j*3]; \
+            R fg_psij1 = ths->psi[2*j*3+1]; \
+            R fg_psij2 = K(1.0); \
+ \
+            psij_const[0] = fg_psij0; \
+            for(l=1; l<=2*m+1; l++) \
+            { \
+              fg_psij2 *= fg_psij1; \
+              psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l]; \
+            } \
+ \
+            fg_psij0 = ths->psi[2*(j*3+1)]; \
+            fg_psij1 = ths->psi[2*(j*3+1)+1]; \
+            fg_psij2 = K(1.0); \
+            psij_const[2*m+2] = fg_psij0; \
+            for(l=1; l<=2*m+1; l++) \
+            { \
+              fg_psij2 *= fg_psij1; \
+              psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l]; \
+            } \
+ \
+            fg_psij0 = ths->psi[2*(j*3+2)]; \
+            fg_psij1 = ths->psi[2*(j*3+2)+1]; \
+            fg_psij2 = K(1.0); \
+            psij_const[2*(2*m+2)] = fg_psij0; \
+            for(l=1; l<=2*m+1; l++) \
+            { \
+              fg_psij2 *= fg_psij1; \
+              psij_const[2*(2*m+2)+l] = fg_psij0*fg_psij2*fg_exp_l[2*(2*m+2)+l]; \
+            } \
+ \
+            nfft_adjoint_3d_compute_omp_blockwise(ths->f[j], g, \
+                psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, \
+                ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, \
+                n0, n1, n2, m, my_u0, my_o0); \
+}
+
+#define MACRO_adjoint_3d_B_OMP_BLOCKWISE_COMPUTE_FG_PSI \
+{ \
+            INT u, o, l; \
+            R psij_const[3*(2*m+2)]; \
+            R fg_psij0, fg_psij1, fg_psij2; \
+ \
+            uo(ths,j,&u,&o,(INT)0); \
+            fg_psij0 = (PHI(ths->n[0],ths->x[3*j]-((R)u)/((R)n0),0)); \
+            fg_psij1 = EXP(K(2.0)*(((R)n0)*(ths->x[3*j]) - (R)u)/ths->b[0]); \
+            fg_psij2 = K(1.0); \
+            psij_const[0] = fg_psij0; \
+            for(l=1; l<=2*m+1; l++) \
+            { \
+              fg_psij2 *= fg_psij1; \
+              psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l]; \
+            } \
+ \
+            uo(ths,j,&u,&o,(INT)1); \
+            fg_psij0 = (PHI(ths->n[1],ths->x[3*j+1]-((R)u)/((R)n1),1)); \
+            fg_psij1 = EXP(K(2.0)*(((R)n1)*(ths->x[3*j+1]) - (R)u)/ths->b[1]); \
+            fg_psij2 = K(1.0); \
+            psij_const[2*m+2] = fg_psij0; \
+            for(l=1; l<=2*m+1; l++) \
+            { \
+              fg_psij2 *= fg_psij1; \
+              psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l]; \
+            } \
+ \
+            uo(ths,j,&u,&o,(INT)2); \
+            fg_psij0 = (PHI(ths->n[2],ths->x[3*j+2]-((R)u)/((R)n2),2)); \
+            fg_psij1 = EXP(K(2.0)*(((R)n2)*(ths->x[3*j+2]) - (R)u)/ths->b[2]); \
+            fg_psij2 = K(1.0); \
+            psij_const[2*(2*m+2)] = fg_psij0; \
+            for(l=1; l<=2*m+1; l++) \
+            { \
+              fg_psij2 *= fg_psij1; \
+              psij_const[2*(2*m+2)+l] = fg_psij0*fg_psij2*fg_exp_l[2*(2*m+2)+l]; \
+            } \
+ \
+            nfft_adjoint_3d_compute_omp_blockwise(ths->f[j], g, \
+                psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, \
+                ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, \
+                n0, n1, n2, m, my_u0, my_o0); \
+}
+
+#define MACRO_adjoint_3d_B_OMP_BLOCKWISE_COMPUTE_PRE_LIN_PSI \
+{ \
+            INT u, o, l; \
+            R psij_const[3*(2*m+2)]; \
+            INT ip_u; \
+            R ip_y, ip_w; \
+ \
+            uo(ths,j,&u,&o,(INT)0); \
+            ip_y = FABS(((R)n0)*ths->x[3*j+0] - (R)u)*((R)ip_s); \
+            ip_u = LRINT(FLOOR(ip_y)); \
+            ip_w = ip_y-ip_u; \
+            for(l=0; l < 2*m+2; l++) \
+              psij_const[l] = ths->psi[ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) + \
+                ths->psi[ABS(ip_u-l*ip_s+1)]*(ip_w); \
+ \
+            uo(ths,j,&u,&o,(INT)1); \
+            ip_y = FABS(((R)n1)*ths->x[3*j+1] - (R)u)*((R)ip_s); \
+            ip_u = LRINT(FLOOR(ip_y)); \
+            ip_w = ip_y-ip_u; \
+            for(l=0; l < 2*m+2; l++) \
+              psij_const[2*m+2+l] = ths->psi[(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) + \
+                ths->psi[(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w); \
+ \
+            uo(ths,j,&u,&o,(INT)2); \
+            ip_y = FABS(((R)n2)*ths->x[3*j+2] - (R)u)*((R)ip_s); \
+            ip_u = LRINT(FLOOR(ip_y)); \
+            ip_w = ip_y-ip_u; \
+            for(l=0; l < 2*m+2; l++) \
+              psij_const[2*(2*m+2)+l] = ths->psi[2*(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) + \
+                ths->psi[2*(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w); \
+ \
+            nfft_adjoint_3d_compute_omp_blockwise(ths->f[j], g, \
+                psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, \
+                ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, \
+                n0, n1, n2, m, my_u0, my_o0); \
+}
+
+#define MACRO_adjoint_3d_B_OMP_BLOCKWISE_COMPUTE_NO_PSI \
+{ \
+            INT u, o; \
+            R psij_const[3*(2*m+2)]; \
+ \
+            uo(ths,j,&u,&o,(INT)0); \
+            window_taps(ths, ths->x[3*j], u, 0, psij_const); \
+ \
+            uo(ths,j,&u,&o,(INT)1); \
+            window_taps(ths, ths->x[3*j+1], u, 1, psij_const + 2*m+2); \
+ \
+            uo(ths,j,&u,&o,(INT)2); \
+            window_taps(ths, ths->x[3*j+2], u, 2, psij_const + 2*(2*m+2)); \
+ \
+            nfft_adjoint_3d_compute_omp_blockwise(ths->f[j], g, \
+                psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, \
+                ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, \
+                n0, n1, n2, m, my_u0, my_o0); \
+}
+
+#define MACRO_adjoint_3d_B_OMP_BLOCKWISE(whichone) \
+{ \
+    if (ths->flags & NFFT_OMP_BLOCKWISE_ADJOINT) \
+    { \
+      _Pragma("omp parallel private(k)") \
+      { \
+        INT my_u0, my_o0, min_u_a, max_u_a, min_u_b, max_u_b; \
+        INT *ar_x = ths->index_x; \
+ \
+        nfft_adjoint_B_omp_blockwise_init(&my_u0, &my_o0, &min_u_a, &max_u_a, \
+            &min_u_b, &max_u_b, 3, ths->n, m); \
+ \
+        if (min_u_a != -1) \
+        { \
+          k = index_x_binary_search(ar_x, M, min_u_a); \
+ \
+          MACRO_adjoint_nd_B_OMP_BLOCKWISE_ASSERT_A \
+ \
+          while (k < M) \
+          { \
+            INT u_prod = ar_x[2*k]; \
+            INT j = ar_x[2*k+1]; \
+ \
+            if (u_prod < min_u_a || u_prod > max_u_a) \
+              break; \
+ \
+            MACRO_adjoint_3d_B_OMP_BLOCKWISE_COMPUTE_ ##whichone \
+ \
+            k++; \
+          } \
+        } \
+ \
+        if (min_u_b != -1) \
+        { \
+          INT k = index_x_binary_search(ar_x, M, min_u_b); \
+ \
+          MACRO_adjoint_nd_B_OMP_BLOCKWISE_ASSERT_B \
+ \
+          while (k < M) \
+          { \
+            INT u_prod = ar_x[2*k]; \
+            INT j = ar_x[2*k+1]; \
+ \
+            if (u_prod < min_u_b || u_prod > max_u_b) \
+              break; \
+ \
+            MACRO_adjoint_3d_B_OMP_BLOCKWISE_COMPUTE_ ##whichone \
+ \
+            k++; \
+          } \
+        } \
+      } /* omp parallel */ \
+      return; \
+    } /* if(NFFT_OMP_BLOCKWISE_ADJOINT) */ \
+}
+
+static void nfft_adjoint_3d_B(X(plan) *ths)
+{
+  INT k;
+  const INT n0 = ths->n[0];
+  const INT n1 = ths->n[1];
+  const INT n2 = ths->n[2];
+  const INT M = ths->M_total;
+  const INT m = ths->m;
+
+  C* g = (C*) ths->g;
+
+  memset(g, 0, (size_t)(ths->n_total) * sizeof(C));
+
+  if(ths->flags & PRE_FULL_PSI)
+  {
+    nfft_adjoint_B_compute_full_psi(g, ths->psi_index_g, ths->psi, ths->f, M,
+        (INT)3, ths->n, m, ths->flags, ths->index_x);
+    return;
+  } /* if(PRE_FULL_PSI) */
+
+  if(ths->flags & PRE_PSI)
+  {
+#ifdef _OPENMP
+    MACRO_adjoint_3d_B_OMP_BLOCKWISE(PRE_PSI)
+#endif
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+#ifdef _OPENMP
+      nfft_adjoint_3d_compute_omp_atomic(ths->f[j], g, ths->psi+j*3*(2*m+2), ths->psi+(j*3+1)*(2*m+2), ths->psi+(j*3+2)*(2*m+2), ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+#else
+      nfft_adjoint_3d_compute_serial(ths->f+j, g, ths->psi+j*3*(2*m+2), ths->psi+(j*3+1)*(2*m+2), ths->psi+(j*3+2)*(2*m+2), ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+#endif
+    }
+    return;
+  } /* if(PRE_PSI) */
+
+  if(ths->flags & PRE_FG_PSI)
+  {
+    R fg_exp_l[3*(2*m+2)];
+
+    nfft_3d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+    nfft_3d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
+    nfft_3d_init_fg_exp_l(fg_exp_l+2*(2*m+2), m, ths->b[2]);
+
+#ifdef _OPENMP
+    MACRO_adjoint_3d_B_OMP_BLOCKWISE(PRE_FG_PSI)
+#endif
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      R psij_const[3*(2*m+2)];
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      INT l;
+      R fg_psij0 = ths->psi[2*j*3];
+      R fg_psij1 = ths->psi[2*j*3+1];
+      R fg_psij2 = K(1.0);
+
+      psij_const[0] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
+      }
+
+      fg_psij0 = ths->psi[2*(j*3+1)];
+      fg_psij1 = ths->psi[2*(j*3+1)+1];
+      fg_psij2 = K(1.0);
+      psij_const[2*m+2] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
+      }
+
+      fg_psij0 = ths->psi[2*(j*3+2)];
+      fg_psij1 = ths->psi[2*(j*3+2)+1];
+      fg_psij2 = K(1.0);
+      psij_const[2*(2*m+2)] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[2*(2*m+2)+l] = fg_psij0*fg_psij2*fg_exp_l[2*(2*m+2)+l];
+      }
+
+#ifdef _OPENMP
+      nfft_adjoint_3d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+#else
+      nfft_adjoint_3d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+#endif
+    }
+
+    return;
+  } /* if(PRE_FG_PSI) */
+
+  if(ths->flags & FG_PSI)
+  {
+    R fg_exp_l[3*(2*m+2)];
+
+    nfft_3d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
+    nfft_3d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
+    nfft_3d_init_fg_exp_l(fg_exp_l+2*(2*m+2), m, ths->b[2]);
+
+#ifdef _OPENMP
+    MACRO_adjoint_3d_B_OMP_BLOCKWISE(FG_PSI)
+#endif
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT u,o,l;
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      R psij_const[3*(2*m+2)];
+      R fg_psij0, fg_psij1, fg_psij2;
+
+      uo(ths,j,&u,&o,(INT)0);
+      fg_psij0 = (PHI(ths->n[0], ths->x[3*j] - ((R)u) / (R)(n0),0));
+      fg_psij1 = EXP(K(2.0) * ((R)(n0) * (ths->x[3*j]) - (R)(u))/ths->b[0]);
+      fg_psij2 = K(1.0);
+      psij_const[0] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
+      }
+
+      uo(ths,j,&u,&o,(INT)1);
+      fg_psij0 = (PHI(ths->n[1], ths->x[3*j+1] - ((R)u) / (R)(n1),1));
+      fg_psij1 = EXP(K(2.0) * ((R)(n1) * (ths->x[3*j+1]) - (R)(u))/ths->b[1]);
+      fg_psij2 = K(1.0);
+      psij_const[2*m+2] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
+      }
+
+      uo(ths,j,&u,&o,(INT)2);
+      fg_psij0 = (PHI(ths->n[2], ths->x[3*j+2] - ((R)u) / (R)(n2),2));
+      fg_psij1 = EXP(K(2.0) * ((R)(n2) * (ths->x[3*j+2]) - (R)(u))/ths->b[2]);
+      fg_psij2 = K(1.0);
+      psij_const[2*(2*m+2)] = fg_psij0;
+      for(l=1; l<=2*m+1; l++)
+      {
+        fg_psij2 *= fg_psij1;
+        psij_const[2*(2*m+2)+l] = fg_psij0*fg_psij2*fg_exp_l[2*(2*m+2)+l];
+      }
+
+#ifdef _OPENMP
+      nfft_adjoint_3d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+#else
+      nfft_adjoint_3d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+#endif
+    }
+
+    return;
+  } /* if(FG_PSI) */
+
+  if(ths->flags & PRE_LIN_PSI)
+  {
+    const INT K = ths->K;
+    const INT ip_s = K / (m + 2);
+
+#ifdef _OPENMP
+    MACRO_adjoint_3d_B_OMP_BLOCKWISE(PRE_LIN_PSI)
+#endif
+
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k)
+#endif
+    for (k = 0; k < M; k++)
+    {
+      INT u,o,l;
+      INT ip_u;
+      R ip_y, ip_w;
+      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      R psij_const[3*(2*m+2)];
+
+      uo(ths,j,&u,&o,(INT)0);
+      ip_y = FABS((R)(n0) * ths->x[3*j+0] - (R)(u)) * ((R)ip_s);
+      ip_u = (INT)(LRINT(FLOOR(ip_y)));
+      ip_w = ip_y - (R)(ip_u);
+      for(l=0; l < 2*m+2; l++)
+        psij_const[l] = ths->psi[ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
+          ths->psi[ABS(ip_u-l*ip_s+1)]*(ip_w);
+
+      uo(ths,j,&u,&o,(INT)1);
+      ip_y = FABS((R)(n1) * ths->x[3*j+1] - (R)(u)) * ((R)ip_s);
+      ip_u = (INT)(LRINT(FLOOR(ip_y)));
+      ip_w = ip_y - (R)(ip_u);
+      for(l=0; l < 2*m+2; l++)
+        psij_const[2*m+2+l] = ths->psi[(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
+          ths->psi[(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w);
+
+      uo(ths,j,&u,&o,(INT)2);
+      ip_y = FABS((R)(n2) * ths->x[3*j+2] - (R)(u))*((R)ip_s);
+      ip_u = (INT)(LRINT(FLOOR(ip_y)));
+      ip_w = ip_y - (R)(ip_u);
+      for(l=0; l < 2*m+2; l++)
+        psij_const[2*(2*m+2)+l] = ths->psi[2*(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
+          ths->psi[2*(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w);
+
+#ifdef _OPENMP
+      nfft_adjoint_3d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+#else
+      nfft_adjoint_3d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+#endif
+    }
+    return;
+  } /* if(PRE_LIN_PSI) */
+
+  /* no precomputed psi at all */
+#ifdef _OPENMP
+  MACRO_adjoint_3d_B_OMP_BLOCKWISE(NO_PSI)
+#endif
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) private(k)
+#endif
+  for (k = 0; k < M; k++)
+  {
+    INT u,o;
+    R psij_const[3*(2*m+2)];
+    INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+
+    uo(ths,j,&u,&o,(INT)0);
+    window_taps(ths, ths->x[3*j], u, 0, psij_const);
+
+    uo(ths,j,&u,&o,(INT)1);
+    window_taps(ths, ths->x[3*j+1], u, 1, psij_const + 2*m+2);
+
+    uo(ths,j,&u,&o,(INT)2);
+    window_taps(ths, ths->x[3*j+2], u, 2, psij_const + 2*(2*m+2));
+
+#ifdef _OPENMP
+    nfft_adjoint_3d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+#else
+    nfft_adjoint_3d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+#endif
+  }
+}
+
+
+static void trafo_3d(X(plan) *ths)
+{
+  sort_once(ths);
+
+  if((ths->N[0] <= ths->m) || (ths->N[1] <= ths->m) || (ths->N[2] <= ths->m) || (ths->n[0] <= 2*ths->m+2) || (ths->n[1] <= 2*ths->m+2) || (ths->n[2] <= 2*ths->m+2))
+  {
+    trafo_direct(ths);
+    return;
+  }
+  
+  INT k0,k1,k2,n0,n1,n2,N0,N1,N2;
+  INT o01, o02, o11, o12, o21, o22; /* halves of f_hat */
+  C *g_hat,*f_hat;
+  R *c_phi_inv01, *c_phi_inv02, *c_phi_inv11, *c_phi_inv12, *c_phi_inv21, *c_phi_inv22;
+  R ck01, ck02, ck11, ck12, ck21, ck22;
+  C *g_hat111,*f_hat111,*g_hat211,*f_hat211,*g_hat121,*f_hat121,*g_hat221,*f_hat221;
+  C *g_hat112,*f_hat112,*g_hat212,*f_hat212,*g_hat122,*f_hat122,*g_hat222,*f_hat222;
+
+  ths->g_hat=ths->g1;
+  ths->g=ths->g2;
+
+  N0=ths->N[0];
+  N1=ths->N[1];
+  N2=ths->N[2];
+  n0=ths->n[0];
+  n1=ths->n[1];
+  n2=ths->n[2];
+
+  o01=f_hat_half(ths,0,0);
+  o02=f_hat_half(ths,0,1);
+  o11=f_hat_half(ths,1,0);
+  o12=f_hat_half(ths,1,1);
+  o21=f_hat_half(ths,2,0);
+  o22=f_hat_half(ths,2,1);
+
+  f_hat=(C*)ths->f_hat;
+  g_hat=(C*)ths->g_hat;
+
+  TIC(0)
+  g_hat_clear(ths);
+
+  if(ths->flags & PRE_PHI_HUT)
+    {
+      c_phi_inv01=ths->c_phi_inv[0];
+      c_phi_inv02=&ths->c_phi_inv[0][N0/2];
+
+#ifdef _OPENMP
+      #pragma omp parallel for default(shared) private(k0,k1,k2,ck01,ck02,c_phi_inv11,c_phi_inv12,ck11,ck12,c_phi_inv21,c_phi_inv22,g_hat111,f_hat111,g_hat211,f_hat211,g_hat121,f_hat121,g_hat221,f_hat221,g_hat112,f_hat112,g_hat212,f_hat212,g_hat122,f_hat122,g_hat222,f_hat222,ck21,ck22)
+#endif
+      for(k0=0;k0<N0/2;k0++)
+  {
+    ck01=c_phi_inv01[k0];
+    ck02=c_phi_inv02[k0];
+    c_phi_inv11=ths->c_phi_inv[1];
+    c_phi_inv12=&ths->c_phi_inv[1][N1/2];
+
+    for(k1=0;k1<N1/2;k1++)
+      {
+        ck11=c_phi_inv11[k1];
+        ck12=c_phi_inv12[k1];
+        c_phi_inv21=ths->c_phi_inv[2];
+        c_phi_inv22=&ths->c_phi_inv[2][N2/2];
+
+        g_hat111=g_hat + ((n0-(N0/2)+k0)*n1+n1-(N1/2)+k1)*n2+n2-(N2/2);
+        f_hat111=f_hat + ((o01+k0)*N1+o11+k1)*N2+o21;
+        g_hat211=g_hat + (k0*n1+n1-(N1/2)+k1)*n2+n2-(N2/2);
+        f_hat211=f_hat + ((o02+k0)*N1+o11+k1)*N2+o21;
+        g_hat121=g_hat + ((n0-(N0/2)+k0)*n1+k1)*n2+n2-(N2/2);
+        f_hat121=f_hat + ((o01+k0)*N1+o12+k1)*N2+o21;
+        g_hat221=g_hat + (k0*n1+k1)*n2+n2-(N2/2);
+        f_hat221=f_hat + ((o02+k0)*N1+o12+k1)*N2+o21;
+
+        g_hat112=g_hat + ((n0-(N0/2)+k0)*n1+n1-(N1/2)+k1)*n2;
+        f_hat112=f_hat + ((o01+k0)*N1+o11+k1)*N2+o22;
+        g_hat212=g_hat + (k0*n1+n1-(N1/2)+k1)*n2;
+        f_hat212=f_hat + ((o02+k0)*N1+o11+k1)*N2+o22;
+        g_hat122=g_hat + ((n0-(N0/2)+k0)*n1+k1)*n2;
+        f_hat122=f_hat + ((o01+k0)*N1+o12+k1)*N2+o22;
+        g_hat222=g_hat + (k0*n1+k1)*n2;
+        f_hat222=f_hat + ((o02+k0)*N1+o12+k1)*N2+o22;
+
+        for(k2=0;k2<N2/2;k2++)
+    {
+      ck21=c_phi_inv21[k2];
+      ck22=c_phi_inv22[k2];
+
+      g_hat111[k2] = f_hat111[k2] * ck01 * ck11 * ck21;
+      g_hat211[k2] = f_hat211[k2] * ck02 * ck11 * ck21;
+      g_hat121[k2] = f_hat121[k2] * ck01 * ck12 * ck21;
+      g_hat221[k2] = f_hat221[k2] * ck02 * ck12 * ck21;
+
+      g_hat112[k2] = f_hat112[k2] * ck01 * ck11 * ck22;
+      g_hat212[k2] = f_hat212[k2] * ck02 * ck11 * ck22;
+      g_hat122[k2] = f_hat122[k2] * ck01 * ck12 * ck22;
+      g_hat222[k2] = f_hat222[k2] * ck02 * ck12 * ck22;
+    }
+      }
+  }
+    }
+  else
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k0,k1,k2,ck01,ck02,ck11,ck12,ck21,ck22)
+#endif
+    for(k0=0;k0<N0/2;k0++)
       {
-        for (l0 = 0; l0 <= 2 * m + 1; l0++, psij0++)
+  ck01=K(1.0)/(PHI_HUT(ths->n[0],k0-N0/2,0));
+  ck02=K(1.0)/(PHI_HUT(ths->n[0],k0,0));
+  for(k1=0;k1<N1/2;k1++)
+    {
+      ck11=K(1.0)/(PHI_HUT(ths->n[1],k1-N1/2,1));
+      ck12=K(1.0)/(PHI_HUT(ths->n[1],k1,1));
+
+      for(k2=0;k2<N2/2;k2++)
         {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-          }
-          for (l1 = 0; l1 <= o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-            gj = g + ((u0 + l0) * n1 + l1) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-          }
+    ck21=K(1.0)/(PHI_HUT(ths->n[2],k2-N2/2,2));
+    ck22=K(1.0)/(PHI_HUT(ths->n[2],k2,2));
+
+    g_hat[((n0-N0/2+k0)*n1+n1-N1/2+k1)*n2+n2-N2/2+k2] = f_hat[((o01+k0)*N1+o11+k1)*N2+o21+k2]                  * ck01 * ck11 * ck21;
+    g_hat[(k0*n1+n1-N1/2+k1)*n2+n2-N2/2+k2]           = f_hat[((o02+k0)*N1+o11+k1)*N2+o21+k2]           * ck02 * ck11 * ck21;
+    g_hat[((n0-N0/2+k0)*n1+k1)*n2+n2-N2/2+k2]         = f_hat[((o01+k0)*N1+o12+k1)*N2+o21+k2]             * ck01 * ck12 * ck21;
+    g_hat[(k0*n1+k1)*n2+n2-N2/2+k2]                   = f_hat[((o02+k0)*N1+o12+k1)*N2+o21+k2]      * ck02 * ck12 * ck21;
+
+    g_hat[((n0-N0/2+k0)*n1+n1-N1/2+k1)*n2+k2]         = f_hat[((o01+k0)*N1+o11+k1)*N2+o22+k2]             * ck01 * ck11 * ck22;
+    g_hat[(k0*n1+n1-N1/2+k1)*n2+k2]                   = f_hat[((o02+k0)*N1+o11+k1)*N2+o22+k2]      * ck02 * ck11 * ck22;
+    g_hat[((n0-N0/2+k0)*n1+k1)*n2+k2]                 = f_hat[((o01+k0)*N1+o12+k1)*N2+o22+k2]        * ck01 * ck12 * ck22;
+    g_hat[(k0*n1+k1)*n2+k2]                           = f_hat[((o02+k0)*N1+o12+k1)*N2+o22+k2] * ck02 * ck12 * ck22;
         }
+    }
       }
-  else /* asserts (u0>o0) */
-    if (u1 < o1)
-      if (u2 < o2)
+
+  TOC(0)
+
+  TIC_FFTW(1)
+  fft_forward(ths);
+  TOC_FFTW(1);
+
+  TIC(2);
+  nfft_trafo_3d_B(ths);
+  TOC(2);
+}
+
+static void adjoint_3d(X(plan) *ths)
+{
+  sort_once(ths);
+
+  if((ths->N[0] <= ths->m) || (ths->N[1] <= ths->m) || (ths->N[2] <= ths->m) || (ths->n[0] <= 2*ths->m+2) || (ths->n[1] <= 2*ths->m+2) || (ths->n[2] <= 2*ths->m+2))
+  {
+    adjoint_direct(ths);
+    return;
+  }
+  
+  INT k0,k1,k2,n0,n1,n2,N0,N1,N2;
+  INT o01, o02, o11, o12, o21, o22; /* halves of f_hat */
+  C *g_hat,*f_hat;
+  R *c_phi_inv01, *c_phi_inv02, *c_phi_inv11, *c_phi_inv12, *c_phi_inv21, *c_phi_inv22;
+  R ck01, ck02, ck11, ck12, ck21, ck22;
+  C *g_hat111,*f_hat111,*g_hat211,*f_hat211,*g_hat121,*f_hat121,*g_hat221,*f_hat221;
+  C *g_hat112,*f_hat112,*g_hat212,*f_hat212,*g_hat122,*f_hat122,*g_hat222,*f_hat222;
+
+  ths->g_hat=ths->g1;
+  ths->g=ths->g2;
+
+  N0=ths->N[0];
+  N1=ths->N[1];
+  N2=ths->N[2];
+  n0=ths->n[0];
+  n1=ths->n[1];
+  n2=ths->n[2];
+
+  o01=f_hat_half(ths,0,0);
+  o02=f_hat_half(ths,0,1);
+  o11=f_hat_half(ths,1,0);
+  o12=f_hat_half(ths,1,1);
+  o21=f_hat_half(ths,2,0);
+  o22=f_hat_half(ths,2,1);
+
+  f_hat=(C*)ths->f_hat;
+  g_hat=(C*)ths->g_hat;
+
+  TIC(2);
+  nfft_adjoint_3d_B(ths);
+  TOC(2);
+
+  TIC_FFTW(1)
+  fft_backward(ths);
+  TOC_FFTW(1);
+
+  TIC(0)
+  if(ths->flags & PRE_PHI_HUT)
+    {
+      c_phi_inv01=ths->c_phi_inv[0];
+      c_phi_inv02=&ths->c_phi_inv[0][N0/2];
+
+#ifdef _OPENMP
+      #pragma omp parallel for default(shared) private(k0,k1,k2,ck01,ck02,c_phi_inv11,c_phi_inv12,ck11,ck12,c_phi_inv21,c_phi_inv22,g_hat111,f_hat111,g_hat211,f_hat211,g_hat121,f_hat121,g_hat221,f_hat221,g_hat112,f_hat112,g_hat212,f_hat212,g_hat122,f_hat122,g_hat222,f_hat222,ck21,ck22)
+#endif
+      for(k0=0;k0<N0/2;k0++)
+  {
+    ck01=c_phi_inv01[k0];
+    ck02=c_phi_inv02[k0];
+    c_phi_inv11=ths->c_phi_inv[1];
+    c_phi_inv12=&ths->c_phi_inv[1][N1/2];
+
+    for(k1=0;k1<N1/2;k1++)
       {
-        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-          }
-        }
+        ck11=c_phi_inv11[k1];
+        ck12=c_phi_inv12[k1];
+        c_phi_inv21=ths->c_phi_inv[2];
+        c_phi_inv22=&ths->c_phi_inv[2][N2/2];
 
-        for (l0 = 0; l0 <= o0; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-          }
-        }
-      } else/* asserts (u2>o2) */
+        g_hat111=g_hat + ((n0-(N0/2)+k0)*n1+n1-(N1/2)+k1)*n2+n2-(N2/2);
+        f_hat111=f_hat + ((o01+k0)*N1+o11+k1)*N2+o21;
+        g_hat211=g_hat + (k0*n1+n1-(N1/2)+k1)*n2+n2-(N2/2);
+        f_hat211=f_hat + ((o02+k0)*N1+o11+k1)*N2+o21;
+        g_hat121=g_hat + ((n0-(N0/2)+k0)*n1+k1)*n2+n2-(N2/2);
+        f_hat121=f_hat + ((o01+k0)*N1+o12+k1)*N2+o21;
+        g_hat221=g_hat + (k0*n1+k1)*n2+n2-(N2/2);
+        f_hat221=f_hat + ((o02+k0)*N1+o12+k1)*N2+o21;
+
+        g_hat112=g_hat + ((n0-(N0/2)+k0)*n1+n1-(N1/2)+k1)*n2;
+        f_hat112=f_hat + ((o01+k0)*N1+o11+k1)*N2+o22;
+        g_hat212=g_hat + (k0*n1+n1-(N1/2)+k1)*n2;
+        f_hat212=f_hat + ((o02+k0)*N1+o11+k1)*N2+o22;
+        g_hat122=g_hat + ((n0-(N0/2)+k0)*n1+k1)*n2;
+        f_hat122=f_hat + ((o01+k0)*N1+o12+k1)*N2+o22;
+        g_hat222=g_hat + (k0*n1+k1)*n2;
+        f_hat222=f_hat + ((o02+k0)*N1+o12+k1)*N2+o22;
+
+        for(k2=0;k2<N2/2;k2++)
+    {
+      ck21=c_phi_inv21[k2];
+      ck22=c_phi_inv22[k2];
+
+      f_hat111[k2] = g_hat111[k2] * ck01 * ck11 * ck21;
+      f_hat211[k2] = g_hat211[k2] * ck02 * ck11 * ck21;
+      f_hat121[k2] = g_hat121[k2] * ck01 * ck12 * ck21;
+      f_hat221[k2] = g_hat221[k2] * ck02 * ck12 * ck21;
+
+      f_hat112[k2] = g_hat112[k2] * ck01 * ck11 * ck22;
+      f_hat212[k2] = g_hat212[k2] * ck02 * ck11 * ck22;
+      f_hat122[k2] = g_hat122[k2] * ck01 * ck12 * ck22;
+      f_hat222[k2] = g_hat222[k2] * ck02 * ck12 * ck22;
+    }
+      }
+  }
+    }
+  else
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(k0,k1,k2,ck01,ck02,ck11,ck12,ck21,ck22)
+#endif
+    for(k0=0;k0<N0/2;k0++)
       {
-        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
+  ck01=K(1.0)/(PHI_HUT(ths->n[0],k0-N0/2,0));
+  ck02=K(1.0)/(PHI_HUT(ths->n[0],k0,0));
+  for(k1=0;k1<N1/2;k1++)
+    {
+      ck11=K(1.0)/(PHI_HUT(ths->n[1],k1-N1/2,1));
+      ck12=K(1.0)/(PHI_HUT(ths->n[1],k1,1));
+
+      for(k2=0;k2<N2/2;k2++)
         {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-          }
+    ck21=K(1.0)/(PHI_HUT(ths->n[2],k2-N2/2,2));
+    ck22=K(1.0)/(PHI_HUT(ths->n[2],k2,2));
+
+    f_hat[((o01+k0)*N1+o11+k1)*N2+o21+k2]                  = g_hat[((n0-N0/2+k0)*n1+n1-N1/2+k1)*n2+n2-N2/2+k2] * ck01 * ck11 * ck21;
+    f_hat[((o02+k0)*N1+o11+k1)*N2+o21+k2]           = g_hat[(k0*n1+n1-N1/2+k1)*n2+n2-N2/2+k2]           * ck02 * ck11 * ck21;
+    f_hat[((o01+k0)*N1+o12+k1)*N2+o21+k2]             = g_hat[((n0-N0/2+k0)*n1+k1)*n2+n2-N2/2+k2]         * ck01 * ck12 * ck21;
+    f_hat[((o02+k0)*N1+o12+k1)*N2+o21+k2]      = g_hat[(k0*n1+k1)*n2+n2-N2/2+k2]                   * ck02 * ck12 * ck21;
+
+    f_hat[((o01+k0)*N1+o11+k1)*N2+o22+k2]             = g_hat[((n0-N0/2+k0)*n1+n1-N1/2+k1)*n2+k2]         * ck01 * ck11 * ck22;
+    f_hat[((o02+k0)*N1+o11+k1)*N2+o22+k2]      = g_hat[(k0*n1+n1-N1/2+k1)*n2+k2]                   * ck02 * ck11 * ck22;
+    f_hat[((o01+k0)*N1+o12+k1)*N2+o22+k2]        = g_hat[((n0-N0/2+k0)*n1+k1)*n2+k2]                 * ck01 * ck12 * ck22;
+    f_hat[((o02+k0)*N1+o12+k1)*N2+o22+k2] = g_hat[(k0*n1+k1)*n2+k2]                           * ck02 * ck12 * ck22;
         }
+    }
+      }
+
+  TOC(0)
+}
+
+/** Whether the degree N is too low for the fast transform, which then falls
+ *  back to the direct one. */
+static int direct_only(const X(plan) *ths)
+{
+  INT t;
+
+  for (t = 0; t < ths->d; t++)
+    if ((ths->N[t] <= ths->m) || (ths->n[t] <= 2 * ths->m + 2))
+      return 1;
+
+  return 0;
+}
+
+/* ## B-step on a grid of the caller ######################################## */
+
+/** f = B g with f in the order of the nodes, g in ths->g, by the B-steps of
+ *  nfft_trafo. */
+static void interp_nodes(X(plan) *ths)
+{
+  sort_once(ths);
+
+  if (ths->flags & NFFT_REAL)
+    B_real_A(ths);
+  else if (ths->howmany > 1 || psi_compact(ths) || (ths->flags & NFFT_GHOST_CELLS)
+    || B_fixed_single(ths, 0))
+    B_many_A(ths);
+  else
+    switch(ths->d)
+    {
+      case 1: nfft_trafo_1d_B(ths); break;
+      case 2: nfft_trafo_2d_B(ths); break;
+      case 3: nfft_trafo_3d_B(ths); break;
+      default: B_A(ths);
+    }
+}
+
+/** g = B^T f with f in the order of the nodes, g in ths->g, by the B-steps of
+ *  nfft_adjoint. */
+static void spread_nodes(X(plan) *ths)
+{
+  sort_once(ths);
+
+  if (ths->flags & NFFT_REAL)
+    B_real_T(ths);
+  else if (ths->howmany > 1 || psi_compact(ths) || (ths->flags & NFFT_GHOST_CELLS)
+    || B_fixed_single(ths, 1))
+    B_many_T(ths);
+  else
+    switch((ths->flags & NFFT_OMP_TILED_ADJOINT) ? 0 : ths->d)
+    {
+      case 1: nfft_adjoint_1d_B(ths); break;
+      case 2: nfft_adjoint_2d_B(ths); break;
+      case 3: nfft_adjoint_3d_B(ths); break;
+      default: B_T(ths);
+    }
+}
+
+static void interp(X(plan) *ths)
+{
+  if (permute_f(ths))
+  {
+    C *f = ths->f;
+    R *f_real = ths->f_real;
+
+    ths->f = ths->f_perm;
+    ths->f_real = (R*)ths->f_perm;
+    interp_nodes(ths);
+    ths->f = f;
+    ths->f_real = f_real;
+    f_from_node_order(ths);
+  }
+  else
+    interp_nodes(ths);
+}
+
+static void spread(X(plan) *ths)
+{
+  /* the grid of the caller may be g1 of the plan */
+  if (ths->g == ths->g1)
+    ths->g_hat_zero_padded = 0;
+
+  if (permute_f(ths))
+  {
+    C *f = ths->f;
+    R *f_real = ths->f_real;
+
+    f_to_node_order(ths);
+    ths->f = ths->f_perm;
+    ths->f_real = (R*)ths->f_perm;
+    spread_nodes(ths);
+    ths->f = f;
+    ths->f_real = f_real;
+  }
+  else
+    spread_nodes(ths);
+}
+
+/** The grid g2 a plan evaluates, that of its plan for a node set. */
+static const C *cached_grid(const X(plan) *ths)
+{
+  return ths->grid_plan ? ((const X(plan)*) ths->grid_plan)->g2 : ths->g2;
+}
+
+/** f = B g at the M nodes x from the grid of the last nfft_trafo, the window
+ *  is evaluated for each node. f holds howmany vectors of M values. */
+static void trafo_points(const X(plan) *ths, const INT M, const R *x, C *f)
+{
+  X(plan) p = *ths;
+  const C *g = cached_grid(ths);
+  INT t, lprod;
+
+  /* the plan holds non-const nodes, the points of the caller are copied */
+  p.x = (R*) Y(malloc)((size_t)(ths->d * M) * sizeof(R));
+  memcpy(p.x, x, (size_t)(ths->d * M) * sizeof(R));
+  p.M_total = M;
+  p.f = f;
+  p.f_real = (R*) f;
+  p.flags &= ~(PRE_ONE_PSI | PRE_POLY_PSI | FG_PSI | NFFT_SORT_NODES
+    | NFFT_REORDER_NODES);
+
+  if (direct_only(ths))
+  {
+    if (ths->grid_plan)
+      p.f_hat = ((const X(plan)*) ths->grid_plan)->f_hat;
+
+    trafo_direct_nodes(&p);
+    Y(free)(p.x);
+    return;
+  }
+
+  for (t = 0, lprod = 1; t < ths->d; t++)
+    lprod *= 2 * ths->m + 2;
+
+#ifdef _OPENMP
+  #pragma omp parallel default(shared)
+#endif
+  {
+    R *psij = (R*) Y(malloc)((size_t)(lprod) * sizeof(R));
+    INT *idx = (INT*) Y(malloc)((size_t)(lprod) * sizeof(INT));
+    INT j;
 
-        for (l0 = 0; l0 <= o0; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 <= 2 * m + 1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-            gj = g + (l0 * n1 + (u1 + l1)) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-          }
-        }
-      }
-    else /* asserts (u1>o1) */
-      if (u2 < o2)
+#ifdef _OPENMP
+    #pragma omp for
+#endif
+    for (j = 0; j < M; j++)
+    {
+      INT k, l;
+
+      B_many_stencil(&p, j, lprod, psij, idx);
+
+      if (p.flags & NFFT_REAL)
       {
-        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-          }
-          for (l1 = 0; l1 <= o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-          }
-        }
-        for (l0 = 0; l0 <= o0; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-          }
-          for (l1 = 0; l1 <= o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + (l0 * n1 + l1) * n2 + u2;
-            for (l2 = 0; l2 <= 2 * m + 1; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-          }
-        }
-      } else/* asserts (u2>o2) */
+        R fj = K(0.0);
+
+        for (l = 0; l < lprod; l++)
+          fj += psij[l] * ((const R*) g)[idx[l]];
+
+        p.f_real[j] = fj;
+      }
+      else
       {
-        for (l0 = 0; l0 < 2 * m + 1 - o0; l0++, psij0++)
+        for (k = 0; k < p.howmany; k++)
         {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-            gj = g + ((u0 + l0) * n1 + (u1 + l1)) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-          }
-          for (l1 = 0; l1 <= o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + ((u0 + l0) * n1 + l1) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-            gj = g + ((u0 + l0) * n1 + l1) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-          }
-        }
+          const C *gk = g + k * p.n_total;
+          C fj = K(0.0);
 
-        for (l0 = 0; l0 <= o0; l0++, psij0++)
-        {
-          psij1 = psij_const1;
-          for (l1 = 0; l1 < 2 * m + 1 - o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + (l0 * n1 + (u1 + l1)) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-            gj = g + (l0 * n1 + (u1 + l1)) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-          }
-          for (l1 = 0; l1 <= o1; l1++, psij1++)
-          {
-            psij2 = psij_const2;
-            gj = g + (l0 * n1 + l1) * n2 + u2;
-            for (l2 = 0; l2 < 2 * m + 1 - o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-            gj = g + (l0 * n1 + l1) * n2;
-            for (l2 = 0; l2 <= o2; l2++)
-              (*gj++) += (*psij0) * (*psij1) * (*psij2++) * (*fj);
-          }
+          for (l = 0; l < lprod; l++)
+            fj += psij[l] * gk[idx[l]];
+
+          f[k * M + j] = fj;
         }
       }
+    }
+
+    Y(free)(idx);
+    Y(free)(psij);
+  }
+
+  Y(free)(p.x);
+}
+
+/** f_hat and the grids of a node set, taken from its plan before each use
+ *  as the plan may have replaced them. */
+static void node_set_arrays(X(plan) *ths)
+{
+  const X(plan) *grid_plan = (const X(plan)*) ths->grid_plan;
+
+  ths->f_hat = grid_plan->f_hat;
+  ths->g1 = grid_plan->g1;
+  ths->g2 = grid_plan->g2;
+}
+
+/** nfft_trafo with f in the order of the nodes x. */
+static void trafo_nodes(X(plan) *ths)
+{
+  sort_once(ths);
+
+  if (direct_only(ths))
+  {
+    trafo_direct_nodes(ths);
+    return;
+  }
+
+  if (ths->grid_plan)
+  {
+    ths->g = ths->g2;
+    interp_nodes(ths);
+    return;
+  }
+
+  if (ths->flags & NFFT_REAL)
+  {
+    trafo_real(ths);
+    return;
+  }
+
+  if (ths->howmany > 1 || psi_compact(ths) || (ths->flags & NFFT_GHOST_CELLS)
+    || B_fixed_single(ths, 0))
+  {
+    trafo_many(ths);
+    return;
+  }
+  
+  switch(ths->d)
+  {
+    case 1: trafo_1d(ths); break;
+    case 2: trafo_2d(ths); break;
+    case 3: trafo_3d(ths); break;
+    default:
+    {
+      /* use ths->my_fftw_plan1 */
+      ths->g_hat = ths->g1;
+      ths->g = ths->g2;
+
+      /** form \f$ \hat g_k = \frac{\hat f_k}{c_k\left(\phi\right)} \text{ for }
+       *  k \in I_N \f$
+       */
+      TIC(0)
+      D_A(ths);
+      TOC(0)
+
+      /** compute by d-variate discrete Fourier transform
+       *  \f$ g_l = \sum_{k \in I_N} \hat g_k {\rm e}^{-2\pi {\rm i} \frac{kl}{n}}
+       *  \text{ for } l \in I_n \f$
+       */
+      TIC_FFTW(1)
+      fft_forward(ths);
+      TOC_FFTW(1)
+
+      /** set \f$ f_j =\sum_{l \in I_n,m(x_j)} g_l \psi\left(x_j-\frac{l}{n}\right)
+       *  \text{ for } j=0,\dots,M_total-1 \f$
+       */
+      TIC(2)
+      B_A(ths);
+      TOC(2)
+    }
+  }
+}
+
+/** nfft_adjoint with f in the order of the nodes x. */
+static void adjoint_nodes(X(plan) *ths)
+{
+  sort_once(ths);
+
+  if (direct_only(ths))
+  {
+    adjoint_direct_nodes(ths);
+    return;
+  }
+
+  if (ths->flags & NFFT_REAL)
+  {
+    adjoint_real(ths);
+    return;
+  }
+
+  if (ths->howmany > 1 || psi_compact(ths) || (ths->flags & NFFT_GHOST_CELLS)
+    || B_fixed_single(ths, 1))
+  {
+    adjoint_many(ths);
+    return;
+  }
+  
+  /* the tiled adjoint B-step is implemented in B_T for all d */
+  switch((ths->flags & NFFT_OMP_TILED_ADJOINT) ? 0 : ths->d)
+  {
+    case 1: adjoint_1d(ths); break;
+    case 2: adjoint_2d(ths); break;
+    case 3: adjoint_3d(ths); break;
+    default:
+    {
+      /* use ths->my_fftw_plan2 */
+      ths->g_hat=ths->g1;
+      ths->g=ths->g2;
+      
+      /** set \f$ g_l = \sum_{j=0}^{M_total-1} f_j \psi\left(x_j-\frac{l}{n}\right)
+       *  \text{ for } l \in I_n,m(x_j) \f$
+       */
+      TIC(2)
+      B_T(ths);
+      TOC(2)
+
+      /** compute by d-variate discrete Fourier transform
+       *  \f$ \hat g_k = \sum_{l \in I_n} g_l {\rm e}^{+2\pi {\rm i} \frac{kl}{n}}
+       *  \text{ for }  k \in I_N\f$
+       */
+      TIC_FFTW(1)
+      fft_backward(ths);
+      TOC_FFTW(1)
+
+      /** form \f$ \hat f_k = \frac{\hat g_k}{c_k\left(\phi\right)} \text{ for }
+       *  k \in I_N \f$
+       */
+      TIC(0)
+      D_T(ths);
+      TOC(0)
+    }
+  }
+}
+
+/** user routines
+ */
+static void trafo(X(plan) *ths)
+{
+  if (ths->grid_plan)
+    node_set_arrays(ths);
+
+  if (permute_f(ths))
+  {
+    C *f = ths->f;
+    R *f_real = ths->f_real;
+
+    ths->f = ths->f_perm;
+    ths->f_real = (R*)ths->f_perm;
+    trafo_nodes(ths);
+    ths->f = f;
+    ths->f_real = f_real;
+    f_from_node_order(ths);
+  }
+  else
+    trafo_nodes(ths);
+} /* nfft_trafo */
+
+static void adjoint(X(plan) *ths)
+{
+  /* a node set only evaluates the grid of its plan, the adjoint would
+   * overwrite the f_hat and grids it shares with that plan */
+  CK(!ths->grid_plan);
+
+  if (permute_f(ths))
+  {
+    C *f = ths->f;
+    R *f_real = ths->f_real;
+
+    f_to_node_order(ths);
+    ths->f = ths->f_perm;
+    ths->f_real = (R*)ths->f_perm;
+    adjoint_nodes(ths);
+    ths->f = f;
+    ths->f_real = f_real;
+  }
+  else
+    adjoint_nodes(ths);
+} /* nfft_adjoint */
+
+/* ## re-entrant execute with caller-owned arrays ############################ */
+
+/** Regions of the workspace are aligned like the arrays of Y(malloc), so
+ *  that the new-array execute functions of FFTW accept them. */
+#define WORKSPACE_ALIGN(size) (((size) + (size_t)63) & ~(size_t)63)
+
+/**
+ * Offsets in bytes of the regions of the workspace for nfft_trafo_execute,
+ * returns its total size. g1 is at offset 0.
+ */
+static size_t workspace_layout(const X(plan) *ths, size_t *g2, size_t *f_perm,
+  size_t *g_ghost)
+{
+  size_t size;
+
+  if (ths->flags & NFFT_REAL)
+  {
+    size = WORKSPACE_ALIGN((size_t)(real_n_hat(ths)) * sizeof(C));
+    *g2 = size;
+    size += WORKSPACE_ALIGN((size_t)(ths->n_total) * sizeof(R));
+  }
+  else
+  {
+    size = WORKSPACE_ALIGN((size_t)(ths->n_total * ths->howmany) * sizeof(C));
+    *g2 = (ths->flags & FFT_OUT_OF_PLACE) ? size : 0;
+    if (ths->flags & FFT_OUT_OF_PLACE)
+      size += WORKSPACE_ALIGN((size_t)(ths->n_total * ths->howmany) * sizeof(C));
+  }
+
+  *f_perm = size;
+  if (permute_f(ths))
+    size += WORKSPACE_ALIGN((size_t)(ths->M_total * ths->howmany) * sizeof(C));
+
+  *g_ghost = size;
+  if (ths->flags & NFFT_GHOST_CELLS)
+    size += WORKSPACE_ALIGN((size_t)(ghost_total(ths) * ths->howmany) * sizeof(C));
+
+  return size;
+}
+
+size_t X(workspace_size)(const X(plan) *ths)
+{
+  size_t g2, f_perm, g_ghost;
+  return workspace_layout(ths, &g2, &f_perm, &g_ghost);
+}
+
+/** Copy of the plan that works on f_hat, f and the workspace. Everything
+ *  written by a transform is redirected, the plan itself is only read; the
+ *  B-steps read index_x of the plan, which the precomputation sorted. */
+static void execute_plan(const X(plan) *ths, X(plan) *p, C *f_hat, C *f,
+  void *work)
+{
+  size_t g2, f_perm, g_ghost;
+  char *w = (char*) work;
+
+  workspace_layout(ths, &g2, &f_perm, &g_ghost);
+
+  /* the copies of the plan would sort the index_x they share */
+  CK(!(ths->flags & NFFT_SORT_NODES) || ths->index_x_sorted);
+
+  *p = *ths;
+  p->f_hat = f_hat;
+
+  if (ths->flags & NFFT_REAL)
+    p->f_real = (R*) f;
+  else
+    p->f = f;
+
+  p->g1 = (C*) w;
+  p->g2 = (C*) (w + g2);
+  p->g_hat_zero_padded = 0;
+
+  if (permute_f(ths))
+    p->f_perm = (C*) (w + f_perm);
+
+  if (ths->flags & NFFT_GHOST_CELLS)
+    p->g_ghost = (C*) (w + g_ghost);
 }
-#endif
 
-static void nfft_trafo_3d_B(X(plan) *ths)
+void X(trafo_execute)(const X(plan) *ths, C *f_hat, C *f, void *work)
 {
-  const INT n0 = ths->n[0];
-  const INT n1 = ths->n[1];
-  const INT n2 = ths->n[2];
-  const INT M = ths->M_total;
-  const INT m = ths->m;
+  X(plan) p;
 
-  const C* g = (C*) ths->g;
+  execute_plan(ths, &p, f_hat, f, work);
+  X(trafo)(&p);
+}
+
+void X(adjoint_execute)(const X(plan) *ths, C *f_hat, C *f, void *work)
+{
+  X(plan) p;
+
+  execute_plan(ths, &p, f_hat, f, work);
+  X(adjoint)(&p);
+}
 
+/* ## stages of the transforms and a pipelined batch ######################### */
+
+/* Plans with N[t] <= m or n[t] <= 2m+2, see direct_only, are computed
+ * directly by the B stage, from f_hat into f for the transform and from f into
+ * f_hat for the adjoint; their D and FFT stages do nothing. */
+
+/** D-step from f_hat into g1. */
+static void trafo_D(X(plan) *ths)
+{
+  C *f_hat = ths->f_hat;
   INT k;
 
-  if(ths->flags & PRE_FULL_PSI)
+  if (direct_only(ths))
+    return;
+
+  if (ths->flags & NFFT_REAL)
   {
-    const INT lprod = (2*m+2) * (2*m+2) * (2*m+2);
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      INT l;
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      ths->f[j] = K(0.0);
-      for (l = 0; l < lprod; l++)
-        ths->f[j] += ths->psi[j*lprod+l] * g[ths->psi_index_g[j*lprod+l]];
-    }
+    ths->g_hat = ths->g1;
+    D_real_A(ths);
     return;
-  } /* if(PRE_FULL_PSI) */
+  }
 
-  if(ths->flags & PRE_PSI)
+  for (k = 0; k < ths->howmany; k++)
   {
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      nfft_trafo_3d_compute(ths->f+j, g, ths->psi+j*3*(2*m+2), ths->psi+(j*3+1)*(2*m+2), ths->psi+(j*3+2)*(2*m+2), ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
-    }
+    ths->f_hat = f_hat + k * ths->N_total;
+    ths->g_hat = ths->g1 + k * ths->n_total;
+    D_A(ths);
+  }
+
+  ths->f_hat = f_hat;
+  ths->g_hat = ths->g1;
+}
+
+/** FFT from g1 into g2. */
+static void trafo_fft(X(plan) *ths)
+{
+  if (direct_only(ths))
     return;
-  } /* if(PRE_PSI) */
 
-  if(ths->flags & PRE_FG_PSI)
+  if (ths->flags & NFFT_REAL)
+    FFTW(execute_dft_c2r)(ths->my_fftw_plan1, ths->g1, (R*)ths->g2);
+  else
+    fft_forward(ths);
+}
+
+/** B-step from g2 into f. */
+static void trafo_B(X(plan) *ths)
+{
+  if (direct_only(ths))
   {
-    R fg_exp_l[3*(2*m+2)];
+    trafo_direct(ths);
+    return;
+  }
 
-    nfft_3d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
-    nfft_3d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
-    nfft_3d_init_fg_exp_l(fg_exp_l+2*(2*m+2), m, ths->b[2]);
+  ths->g = ths->g2;
+  interp(ths);
+}
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      INT l;
-      R psij_const[3*(2*m+2)];
-      R fg_psij0 = ths->psi[2*j*3];
-      R fg_psij1 = ths->psi[2*j*3+1];
-      R fg_psij2 = K(1.0);
+/** Adjoint B-step from f into g2. */
+static void adjoint_B(X(plan) *ths)
+{
+  CK(!ths->grid_plan);
 
-      psij_const[0] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
-      }
+  if (direct_only(ths))
+  {
+    adjoint_direct(ths);
+    return;
+  }
 
-      fg_psij0 = ths->psi[2*(j*3+1)];
-      fg_psij1 = ths->psi[2*(j*3+1)+1];
-      fg_psij2 = K(1.0);
-      psij_const[2*m+2] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
-      }
+  ths->g = ths->g2;
+  spread(ths);
+}
 
-      fg_psij0 = ths->psi[2*(j*3+2)];
-      fg_psij1 = ths->psi[2*(j*3+2)+1];
-      fg_psij2 = K(1.0);
-      psij_const[2*(2*m+2)] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[2*(2*m+2)+l] = fg_psij0*fg_psij2*fg_exp_l[2*(2*m+2)+l];
-      }
+/** FFT from g2 into g1. */
+static void adjoint_fft(X(plan) *ths)
+{
+  CK(!ths->grid_plan);
 
-      nfft_trafo_3d_compute(ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
-    }
+  if (direct_only(ths))
+    return;
+
+  if (ths->flags & NFFT_REAL)
+    FFTW(execute_dft_r2c)(ths->my_fftw_plan2, (R*)ths->g2, ths->g1);
+  else
+    fft_backward(ths);
+}
+
+/** Adjoint D-step from g1 into f_hat. */
+static void adjoint_D(X(plan) *ths)
+{
+  C *f_hat = ths->f_hat;
+  INT k;
 
+  CK(!ths->grid_plan);
+
+  if (direct_only(ths))
     return;
-  } /* if(PRE_FG_PSI) */
 
-  if(ths->flags & FG_PSI)
+  if (ths->flags & NFFT_REAL)
   {
-    R fg_exp_l[3*(2*m+2)];
+    ths->g_hat = ths->g1;
+    D_real_T(ths);
+    return;
+  }
 
-    nfft_3d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
-    nfft_3d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
-    nfft_3d_init_fg_exp_l(fg_exp_l+2*(2*m+2), m, ths->b[2]);
+  for (k = 0; k < ths->howmany; k++)
+  {
+    ths->f_hat = f_hat + k * ths->N_total;
+    ths->g_hat = ths->g1 + k * ths->n_total;
+    D_T(ths);
+  }
 
-    sort(ths);
+  ths->f_hat = f_hat;
+  ths->g_hat = ths->g1;
+}
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
+/** initialisation of direct transform
+ */
+static void precompute_phi_hut(X(plan) *ths)
+{
+  INT ks[ths->d]; /* index over all frequencies */
+  INT t; /* index over all dimensions */
+
+  ths->c_phi_inv = (R**) Y(malloc)((size_t)(ths->d) * sizeof(R*));
+
+  for (t = 0; t < ths->d; t++)
+  {
+    ths->c_phi_inv[t] = (R*)Y(malloc)((size_t)(ths->N[t]) * sizeof(R));
+
+    if (ths->window == NFFT_WINDOW_ES)
     {
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      INT u, o, l;
-      R psij_const[3*(2*m+2)];
-      R fg_psij0, fg_psij1, fg_psij2;
+      /* share the quadrature nodes over all frequencies */
+      const INT nq = ES_QUADRATURE_NODES(ths->m);
+      R *z = (R*) Y(malloc)((size_t)(2 * nq) * sizeof(R));
 
-      uo(ths,j,&u,&o,(INT)0);
-      fg_psij0 = (PHI(ths->n[0], ths->x[3*j] - ((R)u) / (R)(n0),0));
-      fg_psij1 = EXP(K(2.0) * ((R)(n0) * (ths->x[3*j]) - (R)(u)) / ths->b[0]);
-      fg_psij2 = K(1.0);
-      psij_const[0] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
-      }
+      es_quadrature(nq, z, z + nq);
 
-      uo(ths,j,&u,&o,(INT)1);
-      fg_psij0 = (PHI(ths->n[1], ths->x[3*j+1] - ((R)u) / (R)(n1),1));
-      fg_psij1 = EXP(K(2.0) * ((R)(n1) * (ths->x[3*j+1]) - (R)(u)) / ths->b[1]);
-      fg_psij2 = K(1.0);
-      psij_const[2*m+2] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
-      }
+      for (ks[t] = 0; ks[t] < ths->N[t]; ks[t]++)
+        ths->c_phi_inv[t][ks[t]] = K(1.0) / phi_hut_es_quadrature(ths,
+          ths->n[t], (R)(ks[t] - ths->N[t] / 2), t, nq, z, z + nq);
 
-      uo(ths,j,&u,&o,(INT)2);
-      fg_psij0 = (PHI(ths->n[2], ths->x[3*j+2] - ((R)u) / (R)(n2),2));
-      fg_psij1 = EXP(K(2.0) * ((R)(n2) * (ths->x[3*j+2]) - (R)(u)) / ths->b[2]);
-      fg_psij2 = K(1.0);
-      psij_const[2*(2*m+2)] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
+      Y(free)(z);
+    }
+    else
+    {
+      for (ks[t] = 0; ks[t] < ths->N[t]; ks[t]++)
       {
-        fg_psij2 *= fg_psij1;
-        psij_const[2*(2*m+2)+l] = fg_psij0*fg_psij2*fg_exp_l[2*(2*m+2)+l];
+        ths->c_phi_inv[t][ks[t]]= K(1.0) / (PHI_HUT(ths->n[t], ks[t] - ths->N[t] / 2,t));
       }
-
-      nfft_trafo_3d_compute(ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
     }
+  }
+} /* nfft_phi_hut */
 
-    return;
-  } /* if(FG_PSI) */
+/** create a lookup table, but NOT for each node
+ *  good idea K=2^xx
+ *  assumes an EVEN window function
+ */
+/** Precomputed window values of the single node j, psij and idx are
+ *  scratch arrays of length (2m+2)^d. */
+static void precompute_psi_node(X(plan) *ths, const INT j, R *psij, INT *idx)
+{
+  const INT w = 2 * ths->m + 2;
+  INT t, u, o;
 
-  if(ths->flags & PRE_LIN_PSI)
+  if (ths->flags & PRE_FG_PSI)
   {
-    const INT K = ths->K, ip_s = K / (m + 2);
+    for (t = 0; t < ths->d; t++)
+    {
+      uo(ths, j, &u, &o, t);
 
-    sort(ths);
+      ths->psi[2 * (j * ths->d + t)] =
+        PHI(ths->n[t], (ths->x[j * ths->d + t] - ((R)u) / (R)(ths->n[t])), t);
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      INT u, o, l;
-      R ip_y, ip_w;
-      INT ip_u;
-      R psij_const[3*(2*m+2)];
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      ths->psi[2 * (j * ths->d + t) + 1] =
+        EXP(K(2.0) * ((R)(ths->n[t]) * ths->x[j * ths->d + t] - (R)(u)) / ths->b[t]);
+    }
+  }
 
-      uo(ths,j,&u,&o,(INT)0);
-      ip_y = FABS((R)(n0) * ths->x[3*j+0] - (R)(u)) * ((R)ip_s);
-      ip_u = (INT)(LRINT(FLOOR(ip_y)));
-      ip_w = ip_y - (R)(ip_u);
-      for(l=0; l < 2*m+2; l++)
-        psij_const[l] = ths->psi[ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
-          ths->psi[ABS(ip_u-l*ip_s+1)]*(ip_w);
+  if (ths->flags & PRE_PSI)
+  {
+    for (t = 0; t < ths->d; t++)
+    {
+      uo(ths, j, &u, &o, t);
+      window_taps(ths, ths->x[j * ths->d + t], u, t, psij);
+      psi_store(ths, (j * ths->d + t) * w, w, psij);
+    }
+  }
 
-      uo(ths,j,&u,&o,(INT)1);
-      ip_y = FABS((R)(n1) * ths->x[3*j+1] - (R)(u)) * ((R)ip_s);
-      ip_u = (INT)(LRINT(FLOOR(ip_y)));
-      ip_w = ip_y - (R)(ip_u);
-      for(l=0; l < 2*m+2; l++)
-        psij_const[2*m+2+l] = ths->psi[(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
-          ths->psi[(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w);
+  if (ths->flags & PRE_FULL_PSI)
+  {
+    /* the stencil of B_many_stencil, evaluated instead of read */
+    X(plan) p = *ths;
+    INT lprod;
 
-      uo(ths,j,&u,&o,(INT)2);
-      ip_y = FABS((R)(n2) * ths->x[3*j+2] - (R)(u)) * ((R)ip_s);
-      ip_u = (INT)(LRINT(FLOOR(ip_y)));
-      ip_w = ip_y - (R)(ip_u);
-      for(l=0; l < 2*m+2; l++)
-        psij_const[2*(2*m+2)+l] = ths->psi[2*(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
-          ths->psi[2*(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w);
+    for (t = 0, lprod = 1; t < ths->d; t++)
+      lprod *= w;
 
-      nfft_trafo_3d_compute(ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
-    }
-    return;
-  } /* if(PRE_LIN_PSI) */
+    p.flags &= ~(PRE_PSI | PRE_FULL_PSI);
+    B_many_stencil(&p, j, lprod, psij, idx);
+    psi_store(ths, j * lprod, lprod, psij);
 
-  /* no precomputed psi at all */
+    if (ths->flags & NFFT_PSI_BASE_INDEX)
+      ths->psi_index_g[j] = psi_base_index(ths, j);
+    else
+      psi_index_store(ths, j * lprod, lprod, idx);
 
-  sort(ths);
+    ths->psi_index_f[j] = lprod;
+  }
+}
 
-#ifdef _OPENMP
-  #pragma omp parallel for default(shared) private(k)
-#endif
-  for (k = 0; k < M; k++)
-  {
-    R psij_const[3*(2*m+2)];
-    INT u, o, l;
-    INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+/** Precomputed window values of the nodes in the list nodes, or of all nodes
+ *  if nodes is NULL. */
+static void precompute_psi_nodes(X(plan) *ths, const INT *nodes,
+  const INT num_nodes)
+{
+  INT t, lprod;
 
-    uo(ths,j,&u,&o,(INT)0);
-    for(l=0;l<=2*m+1;l++)
-      psij_const[l]=(PHI(ths->n[0], ths->x[3*j] - ((R)((u+l))) / (R)(n0),0));
+  for (t = 0, lprod = 1; t < ths->d; t++)
+    lprod *= 2 * ths->m + 2;
 
-    uo(ths,j,&u,&o,(INT)1);
-    for(l=0;l<=2*m+1;l++)
-      psij_const[2*m+2+l]=(PHI(ths->n[1], ths->x[3*j+1] - ((R)((u+l))) / (R)(n1),1));
+#ifdef _OPENMP
+  #pragma omp parallel default(shared)
+#endif
+  {
+    R *psij = (R*) Y(malloc)((size_t)(lprod) * sizeof(R));
+    INT *idx = (INT*) Y(malloc)((size_t)(lprod) * sizeof(INT));
+    INT jj;
 
-    uo(ths,j,&u,&o,(INT)2);
-    for(l=0;l<=2*m+1;l++)
-      psij_const[2*(2*m+2)+l]=(PHI(ths->n[2], ths->x[3*j+2] - ((R)((u+l))) / (R)(n2),2));
+#ifdef _OPENMP
+    #pragma omp for
+#endif
+    for (jj = 0; jj < num_nodes; jj++)
+      precompute_psi_node(ths, nodes ? nodes[jj] : jj, psij, idx);
 
-    nfft_trafo_3d_compute(ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+    Y(free)(idx);
+    Y(free)(psij);
   }
 }
 
-#define MACRO_adjoint_3d_B_OMP_BLOCKWISE_COMPUTE_PRE_PSI \
-            nfft_adjoint_3d_compute_omp_blockwise(ths->f[j], g, \
-                ths->psi+j*3*(2*m+2), \
-                ths->psi+(j*3+1)*(2*m+2), \
-                ths->psi+(j*3+2)*(2*m+2), \
-                ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, \
-                n0, n1, n2, m, my_u0, my_o0);
+static void precompute_lin_psi(X(plan) *ths)
+{
+  INT t;                                /**< index over all dimensions       */
+  INT j;                                /**< index over all nodes            */
+  R step;                          /**< step size in [0,(m+2)/n]        */
 
-#define MACRO_adjoint_3d_B_OMP_BLOCKWISE_COMPUTE_PRE_FG_PSI \
-{ \
-            INT l; \
-            R psij_const[3*(2*m+2)]; \
-            R fg_psij0 = ths->psi[2*j*3]; \
-            R fg_psij1 = ths->psi[2*j*3+1]; \
-            R fg_psij2 = K(1.0); \
- \
-            psij_const[0] = fg_psij0; \
-            for(l=1; l<=2*m+1; l++) \
-            { \
-              fg_psij2 *= fg_psij1; \
-              psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l]; \
-            } \
- \
-            fg_psij0 = ths->psi[2*(j*3+1)]; \
-            fg_psij1 = ths->psi[2*(j*3+1)+1]; \
-            fg_psij2 = K(1.0); \
-            psij_const[2*m+2] = fg_psij0; \
-            for(l=1; l<=2*m+1; l++) \
-            { \
-              fg_psij2 *= fg_psij1; \
-              psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l]; \
-            } \
- \
-            fg_psij0 = ths->psi[2*(j*3+2)]; \
-            fg_psij1 = ths->psi[2*(j*3+2)+1]; \
-            fg_psij2 = K(1.0); \
-            psij_const[2*(2*m+2)] = fg_psij0; \
-            for(l=1; l<=2*m+1; l++) \
-            { \
-              fg_psij2 *= fg_psij1; \
-              psij_const[2*(2*m+2)+l] = fg_psij0*fg_psij2*fg_exp_l[2*(2*m+2)+l]; \
-            } \
- \
-            nfft_adjoint_3d_compute_omp_blockwise(ths->f[j], g, \
-                psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, \
-                ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, \
-                n0, n1, n2, m, my_u0, my_o0); \
-}
+  /* index_x for the B-steps, which do not sort the nodes */
+  sort(ths);
 
-#define MACRO_adjoint_3d_B_OMP_BLOCKWISE_COMPUTE_FG_PSI \
-{ \
-            INT u, o, l; \
-            R psij_const[3*(2*m+2)]; \
-            R fg_psij0, fg_psij1, fg_psij2; \
- \
-            uo(ths,j,&u,&o,(INT)0); \
-            fg_psij0 = (PHI(ths->n[0],ths->x[3*j]-((R)u)/((R)n0),0)); \
-            fg_psij1 = EXP(K(2.0)*(((R)n0)*(ths->x[3*j]) - (R)u)/ths->b[0]); \
-            fg_psij2 = K(1.0); \
-            psij_const[0] = fg_psij0; \
-            for(l=1; l<=2*m+1; l++) \
-            { \
-              fg_psij2 *= fg_psij1; \
-              psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l]; \
-            } \
- \
-            uo(ths,j,&u,&o,(INT)1); \
-            fg_psij0 = (PHI(ths->n[1],ths->x[3*j+1]-((R)u)/((R)n1),1)); \
-            fg_psij1 = EXP(K(2.0)*(((R)n1)*(ths->x[3*j+1]) - (R)u)/ths->b[1]); \
-            fg_psij2 = K(1.0); \
-            psij_const[2*m+2] = fg_psij0; \
-            for(l=1; l<=2*m+1; l++) \
-            { \
-              fg_psij2 *= fg_psij1; \
-              psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l]; \
-            } \
- \
-            uo(ths,j,&u,&o,(INT)2); \
-            fg_psij0 = (PHI(ths->n[2],ths->x[3*j+2]-((R)u)/((R)n2),2)); \
-            fg_psij1 = EXP(K(2.0)*(((R)n2)*(ths->x[3*j+2]) - (R)u)/ths->b[2]); \
-            fg_psij2 = K(1.0); \
-            psij_const[2*(2*m+2)] = fg_psij0; \
-            for(l=1; l<=2*m+1; l++) \
-            { \
-              fg_psij2 *= fg_psij1; \
-              psij_const[2*(2*m+2)+l] = fg_psij0*fg_psij2*fg_exp_l[2*(2*m+2)+l]; \
-            } \
- \
-            nfft_adjoint_3d_compute_omp_blockwise(ths->f[j], g, \
-                psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, \
-                ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, \
-                n0, n1, n2, m, my_u0, my_o0); \
+  for (t=0; t<ths->d; t++)
+    {
+      step = ((R)(ths->m+2)) / ((R)(ths->K * ths->n[t]));
+      for(j = 0;j <= ths->K; j++)
+  {
+    ths->psi[(ths->K+1)*t + j] = PHI(ths->n[t], (R)(j) * step,t);
+  } /* for(j) */
+    } /* for(t) */
 }
 
-#define MACRO_adjoint_3d_B_OMP_BLOCKWISE_COMPUTE_PRE_LIN_PSI \
-{ \
-            INT u, o, l; \
-            R psij_const[3*(2*m+2)]; \
-            INT ip_u; \
-            R ip_y, ip_w; \
- \
-            uo(ths,j,&u,&o,(INT)0); \
-            ip_y = FABS(((R)n0)*ths->x[3*j+0] - (R)u)*((R)ip_s); \
-            ip_u = LRINT(FLOOR(ip_y)); \
-            ip_w = ip_y-ip_u; \
-            for(l=0; l < 2*m+2; l++) \
-              psij_const[l] = ths->psi[ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) + \
-                ths->psi[ABS(ip_u-l*ip_s+1)]*(ip_w); \
- \
-            uo(ths,j,&u,&o,(INT)1); \
-            ip_y = FABS(((R)n1)*ths->x[3*j+1] - (R)u)*((R)ip_s); \
-            ip_u = LRINT(FLOOR(ip_y)); \
-            ip_w = ip_y-ip_u; \
-            for(l=0; l < 2*m+2; l++) \
-              psij_const[2*m+2+l] = ths->psi[(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) + \
-                ths->psi[(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w); \
- \
-            uo(ths,j,&u,&o,(INT)2); \
-            ip_y = FABS(((R)n2)*ths->x[3*j+2] - (R)u)*((R)ip_s); \
-            ip_u = LRINT(FLOOR(ip_y)); \
-            ip_w = ip_y-ip_u; \
-            for(l=0; l < 2*m+2; l++) \
-              psij_const[2*(2*m+2)+l] = ths->psi[2*(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) + \
-                ths->psi[2*(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w); \
- \
-            nfft_adjoint_3d_compute_omp_blockwise(ths->f[j], g, \
-                psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, \
-                ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, \
-                n0, n1, n2, m, my_u0, my_o0); \
-}
+static void precompute_fg_psi(X(plan) *ths)
+{
+  INT t;                                /**< index over all dimensions       */
+  INT u, o;                             /**< depends on x_j                  */
 
-#define MACRO_adjoint_3d_B_OMP_BLOCKWISE_COMPUTE_NO_PSI \
-{ \
-            INT u, o, l; \
-            R psij_const[3*(2*m+2)]; \
- \
-            uo(ths,j,&u,&o,(INT)0); \
-            for(l=0;l<=2*m+1;l++) \
-              psij_const[l]=(PHI(ths->n[0],ths->x[3*j]-((R)((u+l)))/((R) n0),0)); \
- \
-            uo(ths,j,&u,&o,(INT)1); \
-            for(l=0;l<=2*m+1;l++) \
-              psij_const[2*m+2+l]=(PHI(ths->n[1],ths->x[3*j+1]-((R)((u+l)))/((R) n1),1)); \
- \
-            uo(ths,j,&u,&o,(INT)2); \
-            for(l=0;l<=2*m+1;l++) \
-              psij_const[2*(2*m+2)+l]=(PHI(ths->n[2],ths->x[3*j+2]-((R)((u+l)))/((R) n2),2)); \
- \
-            nfft_adjoint_3d_compute_omp_blockwise(ths->f[j], g, \
-                psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, \
-                ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, \
-                n0, n1, n2, m, my_u0, my_o0); \
-}
+  sort(ths);
 
-#define MACRO_adjoint_3d_B_OMP_BLOCKWISE(whichone) \
-{ \
-    if (ths->flags & NFFT_OMP_BLOCKWISE_ADJOINT) \
-    { \
-      _Pragma("omp parallel private(k)") \
-      { \
-        INT my_u0, my_o0, min_u_a, max_u_a, min_u_b, max_u_b; \
-        INT *ar_x = ths->index_x; \
- \
-        nfft_adjoint_B_omp_blockwise_init(&my_u0, &my_o0, &min_u_a, &max_u_a, \
-            &min_u_b, &max_u_b, 3, ths->n, m); \
- \
-        if (min_u_a != -1) \
-        { \
-          k = index_x_binary_search(ar_x, M, min_u_a); \
- \
-          MACRO_adjoint_nd_B_OMP_BLOCKWISE_ASSERT_A \
- \
-          while (k < M) \
-          { \
-            INT u_prod = ar_x[2*k]; \
-            INT j = ar_x[2*k+1]; \
- \
-            if (u_prod < min_u_a || u_prod > max_u_a) \
-              break; \
- \
-            MACRO_adjoint_3d_B_OMP_BLOCKWISE_COMPUTE_ ##whichone \
- \
-            k++; \
-          } \
-        } \
- \
-        if (min_u_b != -1) \
-        { \
-          INT k = index_x_binary_search(ar_x, M, min_u_b); \
- \
-          MACRO_adjoint_nd_B_OMP_BLOCKWISE_ASSERT_B \
- \
-          while (k < M) \
-          { \
-            INT u_prod = ar_x[2*k]; \
-            INT j = ar_x[2*k+1]; \
- \
-            if (u_prod < min_u_b || u_prod > max_u_b) \
-              break; \
- \
-            MACRO_adjoint_3d_B_OMP_BLOCKWISE_COMPUTE_ ##whichone \
- \
-            k++; \
-          } \
-        } \
-      } /* omp parallel */ \
-      return; \
-    } /* if(NFFT_OMP_BLOCKWISE_ADJOINT) */ \
-}
+  for (t=0; t<ths->d; t++)
+  {
+    INT j;
+#ifdef _OPENMP
+    #pragma omp parallel for default(shared) private(j,u,o)
+#endif
+    for (j = 0; j < ths->M_total; j++)
+      {
+  uo(ths,j,&u,&o,t);
 
-static void nfft_adjoint_3d_B(X(plan) *ths)
-{
-  INT k;
-  const INT n0 = ths->n[0];
-  const INT n1 = ths->n[1];
-  const INT n2 = ths->n[2];
-  const INT M = ths->M_total;
-  const INT m = ths->m;
+        ths->psi[2*(j*ths->d+t)]=
+            (PHI(ths->n[t] ,(ths->x[j*ths->d+t] - ((R)u) / (R)(ths->n[t])),t));
 
-  C* g = (C*) ths->g;
+        ths->psi[2*(j*ths->d+t)+1]=
+            EXP(K(2.0) * ((R)(ths->n[t]) * ths->x[j*ths->d+t] - (R)(u)) / ths->b[t]);
+      } /* for(j) */
+  }
+  /* for(t) */
+} /* nfft_precompute_fg_psi */
 
-  memset(g, 0, (size_t)(ths->n_total) * sizeof(C));
+static void precompute_psi(X(plan) *ths)
+{
+  INT t; /* index over all dimensions */
+  INT l; /* index u<=l<=o */
+  INT lj; /* index 0<=lj<u+o+1 */
+  INT u, o; /* depends on x_j */
+
+  sort(ths);
 
-  if(ths->flags & PRE_FULL_PSI)
+  if (ths->flags & NFFT_PSI_FLOAT)
   {
-    nfft_adjoint_B_compute_full_psi(g, ths->psi_index_g, ths->psi, ths->f, M,
-        (INT)3, ths->n, m, ths->flags, ths->index_x);
+    precompute_psi_nodes(ths, NULL, ths->M_total);
     return;
-  } /* if(PRE_FULL_PSI) */
+  }
 
-  if(ths->flags & PRE_PSI)
+  for (t=0; t<ths->d; t++)
   {
+    INT j;
 #ifdef _OPENMP
-    MACRO_adjoint_3d_B_OMP_BLOCKWISE(PRE_PSI)
-#endif
-
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
+    #pragma omp parallel for default(shared) private(j,l,lj,u,o)
 #endif
-    for (k = 0; k < M; k++)
+    for (j = 0; j < ths->M_total; j++)
     {
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
+      uo(ths,j,&u,&o,t);
+
+      for(l = u, lj = 0; l <= o; l++, lj++)
+        ths->psi[(j * ths->d + t) * (2 * ths->m + 2) + lj] =
+            (PHI(ths->n[t], (ths->x[j*ths->d+t] - ((R)l) / (R)(ths->n[t])), t));
+    } /* for(j) */
+  }
+  /* for(t) */
+} /* nfft_precompute_psi */
+
 #ifdef _OPENMP
-      nfft_adjoint_3d_compute_omp_atomic(ths->f[j], g, ths->psi+j*3*(2*m+2), ths->psi+(j*3+1)*(2*m+2), ths->psi+(j*3+2)*(2*m+2), ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
-#else
-      nfft_adjoint_3d_compute_serial(ths->f+j, g, ths->psi+j*3*(2*m+2), ths->psi+(j*3+1)*(2*m+2), ths->psi+(j*3+2)*(2*m+2), ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
-#endif
-    }
-    return;
-  } /* if(PRE_PSI) */
+static void nfft_precompute_full_psi_omp(X(plan) *ths)
+{
+  INT j;                                /**< index over all nodes            */
+  INT lprod;                            /**< 'bandwidth' of matrix B         */
 
-  if(ths->flags & PRE_FG_PSI)
   {
-    R fg_exp_l[3*(2*m+2)];
+    INT t;
+    for(t=0,lprod = 1; t<ths->d; t++)
+        lprod *= 2*ths->m+2;
+  }
 
-    nfft_3d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
-    nfft_3d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
-    nfft_3d_init_fg_exp_l(fg_exp_l+2*(2*m+2), m, ths->b[2]);
+  #pragma omp parallel for default(shared) private(j)
+  for(j=0; j<ths->M_total; j++)
+    {
+      INT t,t2;                             /**< index over all dimensions       */
+      INT l_L;                              /**< plain index 0<=l_L<lprod        */
+      INT lj[ths->d];                       /**< multi index 0<=lj<u+o+1         */
+      INT ll_plain[ths->d+1];               /**< postfix plain index             */
 
-#ifdef _OPENMP
-    MACRO_adjoint_3d_B_OMP_BLOCKWISE(PRE_FG_PSI)
-#endif
+      INT u[ths->d], o[ths->d];             /**< depends on x_j                  */
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      R psij_const[3*(2*m+2)];
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      INT l;
-      R fg_psij0 = ths->psi[2*j*3];
-      R fg_psij1 = ths->psi[2*j*3+1];
-      R fg_psij2 = K(1.0);
+      R phi_prod[ths->d+1];
+      INT ix = j*lprod;
 
-      psij_const[0] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
-      }
+      phi_prod[0]=1;
+      ll_plain[0]=0;
 
-      fg_psij0 = ths->psi[2*(j*3+1)];
-      fg_psij1 = ths->psi[2*(j*3+1)+1];
-      fg_psij2 = K(1.0);
-      psij_const[2*m+2] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
-      }
+      MACRO_init_uo_l_lj_t;
 
-      fg_psij0 = ths->psi[2*(j*3+2)];
-      fg_psij1 = ths->psi[2*(j*3+2)+1];
-      fg_psij2 = K(1.0);
-      psij_const[2*(2*m+2)] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
+      for(l_L=0; l_L<lprod; l_L++, ix++)
       {
-        fg_psij2 *= fg_psij1;
-        psij_const[2*(2*m+2)+l] = fg_psij0*fg_psij2*fg_exp_l[2*(2*m+2)+l];
-      }
+        MACRO_update_phi_prod_ll_plain(without_PRE_PSI);
+
+        ths->psi_index_g[ix]=ll_plain[ths->d];
+        ths->psi[ix]=phi_prod[ths->d];
+
+        MACRO_count_uo_l_lj_t;
+      } /* for(l_L) */
+
+      ths->psi_index_f[j]=lprod;
+    } /* for(j) */
+}
+#endif
+
+static void precompute_full_psi(X(plan) *ths)
+{
+  if (psi_compact(ths))
+  {
+    sort(ths);
+    precompute_psi_nodes(ths, NULL, ths->M_total);
+    return;
+  }
 
 #ifdef _OPENMP
-      nfft_adjoint_3d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+  sort(ths);
+
+  nfft_precompute_full_psi_omp(ths);
 #else
-      nfft_adjoint_3d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
+  INT t, t2; /* index over all dimensions */
+  INT j; /* index over all nodes */
+  INT l_L; /* plain index 0 <= l_L < lprod */
+  INT lj[ths->d]; /* multi index 0<=lj<u+o+1 */
+  INT ll_plain[ths->d+1]; /* postfix plain index */
+  INT lprod; /* 'bandwidth' of matrix B */
+  INT u[ths->d], o[ths->d]; /* depends on x_j */
+
+  R phi_prod[ths->d+1];
+
+  INT ix, ix_old;
+
+  sort(ths);
+
+  phi_prod[0] = K(1.0);
+  ll_plain[0] = 0;
+
+  for (t = 0, lprod = 1; t < ths->d; t++)
+    lprod *= 2 * ths->m + 2;
+
+  for (j = 0, ix = 0, ix_old = 0; j < ths->M_total; j++)
+  {
+    MACRO_init_uo_l_lj_t;
+
+    for (l_L = 0; l_L < lprod; l_L++, ix++)
+    {
+      MACRO_update_phi_prod_ll_plain(without_PRE_PSI);
+
+      ths->psi_index_g[ix] = ll_plain[ths->d];
+      ths->psi[ix] = phi_prod[ths->d];
+
+      MACRO_count_uo_l_lj_t;
+    } /* for(l_L) */
+
+    ths->psi_index_f[j] = ix - ix_old;
+    ix_old = ix;
+  } /* for(j) */
 #endif
-    }
+}
 
-    return;
-  } /* if(PRE_FG_PSI) */
+/** Apply the memory policy of the plan to psi and psi_index_g, returns the
+ *  parts that took effect. */
+static unsigned psi_memory_policy(X(plan) *ths)
+{
+  const unsigned policy = ths->memory_policy & ~NFFT_MEMORY_HUGE_PAGES_EXPLICIT;
+  unsigned applied = 0;
+  INT t, lprod;
 
-  if(ths->flags & FG_PSI)
+  for (t = 0, lprod = 1; t < ths->d; t++)
+    lprod *= 2 * ths->m + 2;
+
+  if (ths->flags & PRE_PSI)
+    applied |= Y(memory_policy_apply)(ths->psi, (size_t)(ths->M_total * ths->d
+      * (2 * ths->m + 2)) * psi_size(ths), policy);
+
+  if (ths->flags & PRE_FG_PSI)
+    applied |= Y(memory_policy_apply)(ths->psi, (size_t)(ths->M_total * ths->d
+      * 2) * sizeof(R), policy);
+
+  if (ths->flags & PRE_FULL_PSI)
   {
-    R fg_exp_l[3*(2*m+2)];
+    applied |= Y(memory_policy_apply)(ths->psi, (size_t)(ths->M_total * lprod)
+      * psi_size(ths), policy);
+    applied |= Y(memory_policy_apply)(ths->psi_index_g, (size_t)(ths->M_total)
+      * psi_index_size(ths, lprod), policy);
+  }
 
-    nfft_3d_init_fg_exp_l(fg_exp_l, m, ths->b[0]);
-    nfft_3d_init_fg_exp_l(fg_exp_l+2*m+2, m, ths->b[1]);
-    nfft_3d_init_fg_exp_l(fg_exp_l+2*(2*m+2), m, ths->b[2]);
+  return applied;
+}
+
+/** Allocates psi and psi_index_g for M_total nodes anew, the new pages are
+ *  not written yet. */
+static void psi_malloc(X(plan) *ths)
+{
+  const INT M = ths->M_total;
+  INT t, lprod;
+
+  for (t = 0, lprod = 1; t < ths->d; t++)
+    lprod *= 2 * ths->m + 2;
+
+  ths->psi_current = 0;
+
+  if (ths->flags & (PRE_PSI | PRE_FG_PSI | PRE_FULL_PSI))
+  {
+    const INT num_psi = (ths->flags & PRE_FULL_PSI) ? M * lprod
+      : (ths->flags & PRE_PSI) ? M * ths->d * (2 * ths->m + 2) : M * ths->d * 2;
+
+    Y(free)(ths->psi);
+    ths->psi = (R*) Y(malloc)((size_t)(num_psi)
+      * ((ths->flags & PRE_FG_PSI) ? sizeof(R) : psi_size(ths)));
+  }
+
+  if (ths->flags & PRE_FULL_PSI)
+  {
+    Y(free)(ths->psi_index_g);
+    ths->psi_index_g = (INT*) Y(malloc)((size_t)(M) * psi_index_size(ths, lprod));
+  }
+}
 
+static void precompute_one_psi(X(plan) *ths)
+{
+  if(ths->flags & NFFT_REORDER_NODES)
+    reorder_nodes(ths);
+
+  /* index_x for the B-steps, which do not sort the nodes; the precomputations
+   * of psi sort them themselves */
+  if(!(ths->flags & PRE_ONE_PSI))
     sort(ths);
 
-#ifdef _OPENMP
-    MACRO_adjoint_3d_B_OMP_BLOCKWISE(FG_PSI)
-#endif
+  if(ths->flags & PRE_LIN_PSI)
+    precompute_lin_psi(ths);
+  if(ths->flags & PRE_FG_PSI)
+    precompute_fg_psi(ths);
+  if(ths->flags & PRE_PSI)
+    precompute_psi(ths);
+  if(ths->flags & PRE_FULL_PSI)
+    precompute_full_psi(ths);
+  precompute_tiles(ths);
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
-    {
-      INT u,o,l;
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      R psij_const[3*(2*m+2)];
-      R fg_psij0, fg_psij1, fg_psij2;
+  ths->psi_current = 1;
+}
 
-      uo(ths,j,&u,&o,(INT)0);
-      fg_psij0 = (PHI(ths->n[0], ths->x[3*j] - ((R)u) / (R)(n0),0));
-      fg_psij1 = EXP(K(2.0) * ((R)(n0) * (ths->x[3*j]) - (R)(u))/ths->b[0]);
-      fg_psij2 = K(1.0);
-      psij_const[0] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[l] = fg_psij0*fg_psij2*fg_exp_l[l];
-      }
+/** Reallocates the buffers of size proportional to M_total for M nodes. */
+static void resize_nodes(X(plan) *ths, const INT M)
+{
+  const INT howmany = (ths->flags & NFFT_REAL) ? 1 : ths->howmany;
 
-      uo(ths,j,&u,&o,(INT)1);
-      fg_psij0 = (PHI(ths->n[1], ths->x[3*j+1] - ((R)u) / (R)(n1),1));
-      fg_psij1 = EXP(K(2.0) * ((R)(n1) * (ths->x[3*j+1]) - (R)(u))/ths->b[1]);
-      fg_psij2 = K(1.0);
-      psij_const[2*m+2] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[2*m+2+l] = fg_psij0*fg_psij2*fg_exp_l[2*m+2+l];
-      }
+  ths->M_total = M;
 
-      uo(ths,j,&u,&o,(INT)2);
-      fg_psij0 = (PHI(ths->n[2], ths->x[3*j+2] - ((R)u) / (R)(n2),2));
-      fg_psij1 = EXP(K(2.0) * ((R)(n2) * (ths->x[3*j+2]) - (R)(u))/ths->b[2]);
-      fg_psij2 = K(1.0);
-      psij_const[2*(2*m+2)] = fg_psij0;
-      for(l=1; l<=2*m+1; l++)
-      {
-        fg_psij2 *= fg_psij1;
-        psij_const[2*(2*m+2)+l] = fg_psij0*fg_psij2*fg_exp_l[2*(2*m+2)+l];
-      }
+  if (ths->flags & MALLOC_X)
+  {
+    Y(free)(ths->x);
+    ths->x = (R*) Y(malloc)((size_t)(ths->d * M) * sizeof(R));
+  }
 
-#ifdef _OPENMP
-      nfft_adjoint_3d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
-#else
-      nfft_adjoint_3d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
-#endif
+  if (ths->flags & MALLOC_F)
+  {
+    if (ths->flags & NFFT_REAL)
+    {
+      Y(free)(ths->f_real);
+      ths->f_real = (R*) Y(malloc)((size_t)(M) * sizeof(R));
     }
+    else
+    {
+      Y(free)(ths->f);
+      ths->f = (C*) Y(malloc)((size_t)(M * howmany) * sizeof(C));
+    }
+  }
 
-    return;
-  } /* if(FG_PSI) */
+  /* fresh pages of psi, placed before the precomputation writes them */
+  psi_malloc(ths);
+  ths->psi_applied = psi_memory_policy(ths);
 
-  if(ths->flags & PRE_LIN_PSI)
+  if (ths->flags & PRE_FULL_PSI)
   {
-    const INT K = ths->K;
-    const INT ip_s = K / (m + 2);
+    Y(free)(ths->psi_index_f);
+    ths->psi_index_f = (INT*) Y(malloc)((size_t)(M) * sizeof(INT));
+  }
 
-    sort(ths);
+  if (ths->flags & NFFT_SORT_NODES)
+  {
+    Y(free)(ths->index_x);
+    ths->index_x = (INT*) Y(malloc)(sizeof(INT) * 2U * (size_t)(M));
+    ths->index_x_sorted = 0;
+  }
 
-#ifdef _OPENMP
-    MACRO_adjoint_3d_B_OMP_BLOCKWISE(PRE_LIN_PSI)
-#endif
+  if (ths->flags & NFFT_REORDER_NODES)
+  {
+    Y(free)(ths->perm_x);
+    ths->perm_x = (INT*) Y(malloc)((size_t)(M) * sizeof(INT));
 
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k)
-#endif
-    for (k = 0; k < M; k++)
+    if (permute_f(ths))
     {
-      INT u,o,l;
-      INT ip_u;
-      R ip_y, ip_w;
-      INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-      R psij_const[3*(2*m+2)];
+      Y(free)(ths->f_perm);
+      ths->f_perm = (C*) Y(malloc)((size_t)(M * howmany) * sizeof(C));
+    }
+  }
+}
 
-      uo(ths,j,&u,&o,(INT)0);
-      ip_y = FABS((R)(n0) * ths->x[3*j+0] - (R)(u)) * ((R)ip_s);
-      ip_u = (INT)(LRINT(FLOOR(ip_y)));
-      ip_w = ip_y - (R)(ip_u);
-      for(l=0; l < 2*m+2; l++)
-        psij_const[l] = ths->psi[ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
-          ths->psi[ABS(ip_u-l*ip_s+1)]*(ip_w);
+/** Recomputes the precomputed data of the num_moved nodes in moved, whose
+ *  coordinates in x changed. The nodes are not reordered again. */
+static void update_moved_nodes(X(plan) *ths, const INT *moved,
+  const INT num_moved)
+{
+  precompute_psi_nodes(ths, moved, num_moved);
+  sort(ths);
+  precompute_tiles(ths);
+}
 
-      uo(ths,j,&u,&o,(INT)1);
-      ip_y = FABS((R)(n1) * ths->x[3*j+1] - (R)(u)) * ((R)ip_s);
-      ip_u = (INT)(LRINT(FLOOR(ip_y)));
-      ip_w = ip_y - (R)(ip_u);
-      for(l=0; l < 2*m+2; l++)
-        psij_const[2*m+2+l] = ths->psi[(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
-          ths->psi[(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w);
+static void set_nodes(X(plan) *ths, R *x, int M)
+{
+  const INT d = ths->d;
+  INT j, t, num_moved = 0;
+  INT *moved = NULL;
 
-      uo(ths,j,&u,&o,(INT)2);
-      ip_y = FABS((R)(n2) * ths->x[3*j+2] - (R)(u))*((R)ip_s);
-      ip_u = (INT)(LRINT(FLOOR(ip_y)));
-      ip_w = ip_y - (R)(ip_u);
-      for(l=0; l < 2*m+2; l++)
-        psij_const[2*(2*m+2)+l] = ths->psi[2*(K+1)+ABS(ip_u-l*ip_s)]*(K(1.0)-ip_w) +
-          ths->psi[2*(K+1)+ABS(ip_u-l*ip_s+1)]*(ip_w);
+  CK(M > 0);
 
-#ifdef _OPENMP
-      nfft_adjoint_3d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
-#else
-      nfft_adjoint_3d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
-#endif
-    }
-    return;
-  } /* if(PRE_LIN_PSI) */
+  if ((INT)M != ths->M_total)
+    resize_nodes(ths, (INT)M);
+  else if ((ths->flags & MALLOC_X) && ths->x != x
+    && !(ths->flags & NFFT_REORDER_NODES) && ths->psi_current
+    && (ths->flags & (PRE_PSI | PRE_FG_PSI | PRE_FULL_PSI)))
+  {
+    /* the window values of nodes that did not move are kept */
+    moved = (INT*) Y(malloc)((size_t)(M) * sizeof(INT));
 
-  /* no precomputed psi at all */
-  sort(ths);
+    for (j = 0; j < ths->M_total; j++)
+    {
+      for (t = 0; t < d; t++)
+        if (ths->x[d * j + t] != x[d * j + t])
+          break;
 
-#ifdef _OPENMP
-  MACRO_adjoint_3d_B_OMP_BLOCKWISE(NO_PSI)
-#endif
+      if (t < d)
+        moved[num_moved++] = j;
+    }
+  }
 
-#ifdef _OPENMP
-  #pragma omp parallel for default(shared) private(k)
-#endif
-  for (k = 0; k < M; k++)
+  if (ths->flags & MALLOC_X)
   {
-    INT u,o,l;
-    R psij_const[3*(2*m+2)];
-    INT j = (ths->flags & NFFT_SORT_NODES) ? ths->index_x[2*k+1] : k;
-
-    uo(ths,j,&u,&o,(INT)0);
-    for(l=0;l<=2*m+1;l++)
-      psij_const[l]=(PHI(ths->n[0], ths->x[3*j] - ((R)((u+l))) / (R)(n0),0));
+    if (ths->x != x)
+      memcpy(ths->x, x, (size_t)(d * ths->M_total) * sizeof(R));
+  }
+  else
+    ths->x = x;
 
-    uo(ths,j,&u,&o,(INT)1);
-    for(l=0;l<=2*m+1;l++)
-      psij_const[2*m+2+l]=(PHI(ths->n[1], ths->x[3*j+1] - ((R)((u+l))) / (R)(n1),1));
+  if (ths->flags & NFFT_REORDER_NODES)
+    for (j = 0; j < ths->M_total; j++)
+      ths->perm_x[j] = j;
 
-    uo(ths,j,&u,&o,(INT)2);
-    for(l=0;l<=2*m+1;l++)
-      psij_const[2*(2*m+2)+l]=(PHI(ths->n[2], ths->x[3*j+2] - ((R)((u+l))) / (R)(n2),2));
+  /* with few moved nodes, only these are recomputed */
+  if (moved && num_moved < ths->M_total / 2)
+    update_moved_nodes(ths, moved, num_moved);
+  else
+    precompute_one_psi(ths);
 
-#ifdef _OPENMP
-    nfft_adjoint_3d_compute_omp_atomic(ths->f[j], g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
-#else
-    nfft_adjoint_3d_compute_serial(ths->f+j, g, psij_const, psij_const+2*m+2, psij_const+(2*m+2)*2, ths->x+3*j, ths->x+3*j+1, ths->x+3*j+2, n0, n1, n2, m);
-#endif
-  }
+  Y(free)(moved);
 }
 
-
-void X(trafo_3d)(X(plan) *ths)
+static void set_moved_nodes(X(plan) *ths, const int *moved, const int num_moved)
 {
-  if((ths->N[0] <= ths->m) || (ths->N[1] <= ths->m) || (ths->N[2] <= ths->m) || (ths->n[0] <= 2*ths->m+2) || (ths->n[1] <= 2*ths->m+2) || (ths->n[2] <= 2*ths->m+2))
+  INT *nodes = (INT*) Y(malloc)((size_t)(MAX(num_moved, 1)) * sizeof(INT));
+  INT j;
+
+  CK(num_moved >= 0);
+
+  for (j = 0; j < num_moved; j++)
   {
-    X(trafo_direct)(ths);
-    return;
+    CK(moved[j] >= 0 && moved[j] < ths->M_total);
+    nodes[j] = (INT)moved[j];
   }
-  
-  INT k0,k1,k2,n0,n1,n2,N0,N1,N2;
-  C *g_hat,*f_hat;
-  R *c_phi_inv01, *c_phi_inv02, *c_phi_inv11, *c_phi_inv12, *c_phi_inv21, *c_phi_inv22;
-  R ck01, ck02, ck11, ck12, ck21, ck22;
-  C *g_hat111,*f_hat111,*g_hat211,*f_hat211,*g_hat121,*f_hat121,*g_hat221,*f_hat221;
-  C *g_hat112,*f_hat112,*g_hat212,*f_hat212,*g_hat122,*f_hat122,*g_hat222,*f_hat222;
 
-  ths->g_hat=ths->g1;
-  ths->g=ths->g2;
+  /* the nodes that did not move need psi precomputed before */
+  if (ths->psi_current)
+    update_moved_nodes(ths, nodes, (INT)num_moved);
+  else
+    precompute_one_psi(ths);
 
-  N0=ths->N[0];
-  N1=ths->N[1];
-  N2=ths->N[2];
-  n0=ths->n[0];
-  n1=ths->n[1];
-  n2=ths->n[2];
+  Y(free)(nodes);
+}
 
-  f_hat=(C*)ths->f_hat;
-  g_hat=(C*)ths->g_hat;
+/* ## FFTW plans shared between plans, flags NFFT_SHARED_FFTW_PLAN and
+ *    NFFT_SHARED_GRID ######################################################## */
 
-  TIC(0)
+/** FFTW plans for one grid, shared by all plans with flag
+ *  NFFT_SHARED_FFTW_PLAN and the same key. The plans are only run by the
+ *  new-array execute functions of FFTW, so they are valid for the grid of
+ *  every plan whose arrays have the same alignment. */
+typedef struct shared_fftw_s
+{
+  struct shared_fftw_s *next;
+  INT d;
+  INT *n;
+  INT howmany;
+  unsigned kind; /**< NFFT_REAL and FFT_OUT_OF_PLACE of the plans */
+  unsigned fftw_flags;
+  int nthreads;
+  int align1, align2; /**< grid_alignment of g1 and g2 */
+  FFTW(plan) plan1, plan2;
+  INT refs;
+  C *g1, *g2; /**< grids for flag NFFT_SHARED_GRID, NULL while unused */
+  unsigned grid_policy; /**< memory policy applied to g1 and g2 */
+  INT grid_refs;
+} shared_fftw;
+
+/** List of shared FFTW plans, guarded by the critical section
+ *  nfft_omp_critical_fftw_plan. */
+static shared_fftw *shared_fftw_list = NULL;
+
+static int fftw_nthreads(void)
+{
 #ifdef _OPENMP
-  #pragma omp parallel for default(shared) private(k0)
-  for (k0 = 0; k0 < ths->n_total; k0++)
-    ths->g_hat[k0] = 0.0;
+  return (int)Y(get_num_threads)();
 #else
-  memset(ths->g_hat, 0, (size_t)(ths->n_total) * sizeof(C));
+  return 1;
 #endif
+}
 
-  if(ths->flags & PRE_PHI_HUT)
-    {
-      c_phi_inv01=ths->c_phi_inv[0];
-      c_phi_inv02=&ths->c_phi_inv[0][N0/2];
-
-#ifdef _OPENMP
-      #pragma omp parallel for default(shared) private(k0,k1,k2,ck01,ck02,c_phi_inv11,c_phi_inv12,ck11,ck12,c_phi_inv21,c_phi_inv22,g_hat111,f_hat111,g_hat211,f_hat211,g_hat121,f_hat121,g_hat221,f_hat221,g_hat112,f_hat112,g_hat212,f_hat212,g_hat122,f_hat122,g_hat222,f_hat222,ck21,ck22)
+/** Alignment of the grid as seen by FFTW. A FFTW plan may only run on
+ *  arrays that are aligned like those it was planned for. */
+static int grid_alignment(C *g)
+{
+#if HAVE_DECL_FFTW_ALIGNMENT_OF
+  return FFTW(alignment_of)((R*)g);
+#else
+  /* FFTW before 3.3.5 aligns to at most 32 bytes (AVX) */
+  return (int)((uintptr_t)g % 32);
 #endif
-      for(k0=0;k0<N0/2;k0++)
-  {
-    ck01=c_phi_inv01[k0];
-    ck02=c_phi_inv02[k0];
-    c_phi_inv11=ths->c_phi_inv[1];
-    c_phi_inv12=&ths->c_phi_inv[1][N1/2];
+}
 
-    for(k1=0;k1<N1/2;k1++)
-      {
-        ck11=c_phi_inv11[k1];
-        ck12=c_phi_inv12[k1];
-        c_phi_inv21=ths->c_phi_inv[2];
-        c_phi_inv22=&ths->c_phi_inv[2][N2/2];
+/** Sizes in bytes of g1 and g2, returns whether the FFT is out of place. */
+static int grid_size(const X(plan) *ths, size_t *size1, size_t *size2)
+{
+  if (ths->flags & NFFT_REAL)
+  {
+    /* half-complex g_hat and real g, always out of place */
+    *size1 = (size_t)(real_n_hat(ths)) * sizeof(C);
+    *size2 = (size_t)(ths->n_total) * sizeof(R);
+    return 1;
+  }
 
-        g_hat111=g_hat + ((n0-(N0/2)+k0)*n1+n1-(N1/2)+k1)*n2+n2-(N2/2);
-        f_hat111=f_hat + (k0*N1+k1)*N2;
-        g_hat211=g_hat + (k0*n1+n1-(N1/2)+k1)*n2+n2-(N2/2);
-        f_hat211=f_hat + (((N0/2)+k0)*N1+k1)*N2;
-        g_hat121=g_hat + ((n0-(N0/2)+k0)*n1+k1)*n2+n2-(N2/2);
-        f_hat121=f_hat + (k0*N1+(N1/2)+k1)*N2;
-        g_hat221=g_hat + (k0*n1+k1)*n2+n2-(N2/2);
-        f_hat221=f_hat + (((N0/2)+k0)*N1+(N1/2)+k1)*N2;
+  *size1 = (size_t)(ths->n_total * ths->howmany) * sizeof(C);
+  *size2 = *size1;
+  return (ths->flags & FFT_OUT_OF_PLACE) != 0;
+}
 
-        g_hat112=g_hat + ((n0-(N0/2)+k0)*n1+n1-(N1/2)+k1)*n2;
-        f_hat112=f_hat + (k0*N1+k1)*N2+(N2/2);
-        g_hat212=g_hat + (k0*n1+n1-(N1/2)+k1)*n2;
-        f_hat212=f_hat + (((N0/2)+k0)*N1+k1)*N2+(N2/2);
-        g_hat122=g_hat + ((n0-(N0/2)+k0)*n1+k1)*n2;
-        f_hat122=f_hat + (k0*N1+N1/2+k1)*N2+(N2/2);
-        g_hat222=g_hat + (k0*n1+k1)*n2;
-        f_hat222=f_hat + (((N0/2)+k0)*N1+(N1/2)+k1)*N2+(N2/2);
+/** Allocate g1 and g2 of the plan with its memory policy, returns the parts
+ *  of the policy that took effect. Explicit huge pages are used for both
+ *  grids or for none. */
+static unsigned grid_malloc(X(plan) *ths)
+{
+  const unsigned policy = ths->memory_policy;
+  size_t size1, size2;
+  const int out_of_place = grid_size(ths, &size1, &size2);
+  unsigned applied = 0;
 
-        for(k2=0;k2<N2/2;k2++)
-    {
-      ck21=c_phi_inv21[k2];
-      ck22=c_phi_inv22[k2];
+  ths->g1 = NULL;
+  ths->g2 = NULL;
 
-      g_hat111[k2] = f_hat111[k2] * ck01 * ck11 * ck21;
-      g_hat211[k2] = f_hat211[k2] * ck02 * ck11 * ck21;
-      g_hat121[k2] = f_hat121[k2] * ck01 * ck12 * ck21;
-      g_hat221[k2] = f_hat221[k2] * ck02 * ck12 * ck21;
+  if (policy & NFFT_MEMORY_HUGE_PAGES_EXPLICIT)
+  {
+    ths->g1 = (C*) Y(malloc_huge)(size1);
+    ths->g2 = out_of_place ? (C*) Y(malloc_huge)(size2) : ths->g1;
 
-      g_hat112[k2] = f_hat112[k2] * ck01 * ck11 * ck22;
-      g_hat212[k2] = f_hat212[k2] * ck02 * ck11 * ck22;
-      g_hat122[k2] = f_hat122[k2] * ck01 * ck12 * ck22;
-      g_hat222[k2] = f_hat222[k2] * ck02 * ck12 * ck22;
+    if (ths->g1 && ths->g2)
+      applied = NFFT_MEMORY_HUGE_PAGES_EXPLICIT;
+    else
+    {
+      if (out_of_place)
+        Y(free_huge)(ths->g2, size2);
+      Y(free_huge)(ths->g1, size1);
     }
-      }
   }
-    }
-  else
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k0,k1,k2,ck01,ck02,ck11,ck12,ck21,ck22)
-#endif
-    for(k0=0;k0<N0/2;k0++)
-      {
-  ck01=K(1.0)/(PHI_HUT(ths->n[0],k0-N0/2,0));
-  ck02=K(1.0)/(PHI_HUT(ths->n[0],k0,0));
-  for(k1=0;k1<N1/2;k1++)
-    {
-      ck11=K(1.0)/(PHI_HUT(ths->n[1],k1-N1/2,1));
-      ck12=K(1.0)/(PHI_HUT(ths->n[1],k1,1));
-
-      for(k2=0;k2<N2/2;k2++)
-        {
-    ck21=K(1.0)/(PHI_HUT(ths->n[2],k2-N2/2,2));
-    ck22=K(1.0)/(PHI_HUT(ths->n[2],k2,2));
 
-    g_hat[((n0-N0/2+k0)*n1+n1-N1/2+k1)*n2+n2-N2/2+k2] = f_hat[(k0*N1+k1)*N2+k2]                  * ck01 * ck11 * ck21;
-    g_hat[(k0*n1+n1-N1/2+k1)*n2+n2-N2/2+k2]           = f_hat[((N0/2+k0)*N1+k1)*N2+k2]           * ck02 * ck11 * ck21;
-    g_hat[((n0-N0/2+k0)*n1+k1)*n2+n2-N2/2+k2]         = f_hat[(k0*N1+N1/2+k1)*N2+k2]             * ck01 * ck12 * ck21;
-    g_hat[(k0*n1+k1)*n2+n2-N2/2+k2]                   = f_hat[((N0/2+k0)*N1+N1/2+k1)*N2+k2]      * ck02 * ck12 * ck21;
+  if (!applied)
+  {
+    ths->g1 = (C*) Y(malloc)(size1);
+    ths->g2 = out_of_place ? (C*) Y(malloc)(size2) : ths->g1;
+  }
 
-    g_hat[((n0-N0/2+k0)*n1+n1-N1/2+k1)*n2+k2]         = f_hat[(k0*N1+k1)*N2+N2/2+k2]             * ck01 * ck11 * ck22;
-    g_hat[(k0*n1+n1-N1/2+k1)*n2+k2]                   = f_hat[((N0/2+k0)*N1+k1)*N2+N2/2+k2]      * ck02 * ck11 * ck22;
-    g_hat[((n0-N0/2+k0)*n1+k1)*n2+k2]                 = f_hat[(k0*N1+N1/2+k1)*N2+N2/2+k2]        * ck01 * ck12 * ck22;
-    g_hat[(k0*n1+k1)*n2+k2]                           = f_hat[((N0/2+k0)*N1+N1/2+k1)*N2+N2/2+k2] * ck02 * ck12 * ck22;
-        }
-    }
-      }
+  /* before the FFTW planner writes the grids */
+  if (policy & ~NFFT_MEMORY_HUGE_PAGES_EXPLICIT)
+  {
+    const unsigned rest = (applied ? policy & ~NFFT_MEMORY_HUGE_PAGES : policy)
+      & ~NFFT_MEMORY_HUGE_PAGES_EXPLICIT;
 
-  TOC(0)
+    applied |= Y(memory_policy_apply)(ths->g1, size1, rest);
 
-  TIC_FFTW(1)
-  FFTW(execute)(ths->my_fftw_plan1);
-  TOC_FFTW(1);
+    if (out_of_place)
+      applied |= Y(memory_policy_apply)(ths->g2, size2, rest);
+  }
 
-  TIC(2);
-  nfft_trafo_3d_B(ths);
-  TOC(2);
+  return applied;
 }
 
-void X(adjoint_3d)(X(plan) *ths)
+/** Free g1 and g2 of the plan, allocated with the memory policy applied. */
+static void grid_free(const X(plan) *ths, C *g1, C *g2, const unsigned applied)
 {
-  if((ths->N[0] <= ths->m) || (ths->N[1] <= ths->m) || (ths->N[2] <= ths->m) || (ths->n[0] <= 2*ths->m+2) || (ths->n[1] <= 2*ths->m+2) || (ths->n[2] <= 2*ths->m+2))
+  size_t size1, size2;
+
+  if (applied & NFFT_MEMORY_HUGE_PAGES_EXPLICIT)
   {
-    X(adjoint_direct)(ths);
+    grid_size(ths, &size1, &size2);
+
+    if (g2 != g1)
+      Y(free_huge)(g2, size2);
+
+    Y(free_huge)(g1, size1);
     return;
   }
-  
-  INT k0,k1,k2,n0,n1,n2,N0,N1,N2;
-  C *g_hat,*f_hat;
-  R *c_phi_inv01, *c_phi_inv02, *c_phi_inv11, *c_phi_inv12, *c_phi_inv21, *c_phi_inv22;
-  R ck01, ck02, ck11, ck12, ck21, ck22;
-  C *g_hat111,*f_hat111,*g_hat211,*f_hat211,*g_hat121,*f_hat121,*g_hat221,*f_hat221;
-  C *g_hat112,*f_hat112,*g_hat212,*f_hat212,*g_hat122,*f_hat122,*g_hat222,*f_hat222;
 
-  ths->g_hat=ths->g1;
-  ths->g=ths->g2;
+  if (g2 != g1)
+    Y(free)(g2);
 
-  N0=ths->N[0];
-  N1=ths->N[1];
-  N2=ths->N[2];
-  n0=ths->n[0];
-  n1=ths->n[1];
-  n2=ths->n[2];
+  Y(free)(g1);
+}
 
-  f_hat=(C*)ths->f_hat;
-  g_hat=(C*)ths->g_hat;
+/** Forward and backward FFTW plans on g1 and g2 of the plan, with nthreads
+ *  threads. */
+static void fftw_plans(const X(plan) *ths, const int nthreads,
+  FFTW(plan) *plan1, FFTW(plan) *plan2)
+{
+  INT t;
+  int *_n = Y(malloc)((size_t)(ths->d) * sizeof(int));
 
-  TIC(2);
-  nfft_adjoint_3d_B(ths);
-  TOC(2);
+  for (t = 0; t < ths->d; t++)
+    _n[t] = (int)(ths->n[t]);
 
-  TIC_FFTW(1)
-  FFTW(execute)(ths->my_fftw_plan2);
-  TOC_FFTW(1);
+#ifdef _OPENMP
+  FFTW(plan_with_nthreads)(nthreads);
+#else
+  UNUSED(nthreads);
+#endif
+
+  if (ths->flags & NFFT_REAL)
+  {
+    *plan1 = FFTW(plan_dft_c2r)((int)ths->d, _n, ths->g1,
+      (R*)ths->g2, ths->fftw_flags);
+    *plan2 = FFTW(plan_dft_r2c)((int)ths->d, _n,
+      (R*)ths->g2, ths->g1, ths->fftw_flags);
+  }
+  else if (ths->howmany > 1)
+  {
+    /* all vectors in one FFTW call, vector k starts at k*n_total */
+    *plan1 = FFTW(plan_many_dft)((int)ths->d, _n, (int)ths->howmany,
+      ths->g1, NULL, 1, (int)ths->n_total, ths->g2, NULL, 1, (int)ths->n_total,
+      FFTW_FORWARD, ths->fftw_flags);
+    *plan2 = FFTW(plan_many_dft)((int)ths->d, _n, (int)ths->howmany,
+      ths->g2, NULL, 1, (int)ths->n_total, ths->g1, NULL, 1, (int)ths->n_total,
+      FFTW_BACKWARD, ths->fftw_flags);
+  }
+  else
+  {
+    *plan1 = FFTW(plan_dft)((int)ths->d, _n, ths->g1, ths->g2, FFTW_FORWARD, ths->fftw_flags);
+    *plan2 = FFTW(plan_dft)((int)ths->d, _n, ths->g2, ths->g1, FFTW_BACKWARD, ths->fftw_flags);
+  }
+
+  Y(free)(_n);
+}
+
+/** Whether the entry matches the plan, alignment aside. */
+static int shared_fftw_match(const shared_fftw *e, const X(plan) *ths)
+{
+  INT t;
+
+  if (e->d != ths->d || e->howmany != ths->howmany
+    || e->kind != (ths->flags & (NFFT_REAL | FFT_OUT_OF_PLACE))
+    || e->fftw_flags != ths->fftw_flags || e->nthreads != fftw_nthreads())
+    return 0;
+
+  for (t = 0; t < ths->d; t++)
+    if (e->n[t] != ths->n[t])
+      return 0;
 
-  TIC(0)
-  if(ths->flags & PRE_PHI_HUT)
-    {
-      c_phi_inv01=ths->c_phi_inv[0];
-      c_phi_inv02=&ths->c_phi_inv[0][N0/2];
+  return 1;
+}
+
+/** Take g1, g2 and the FFTW plans from the list of shared plans. With flag
+ *  NFFT_SHARED_GRID an entry that already holds grids is used as it is,
+ *  otherwise the plan allocates its grids and looks for an entry with the
+ *  same alignment. A missing entry is planned on the grids of this plan. */
+static void shared_fftw_init(X(plan) *ths)
+{
+  shared_fftw *e;
+  int align1, align2;
 
 #ifdef _OPENMP
-      #pragma omp parallel for default(shared) private(k0,k1,k2,ck01,ck02,c_phi_inv11,c_phi_inv12,ck11,ck12,c_phi_inv21,c_phi_inv22,g_hat111,f_hat111,g_hat211,f_hat211,g_hat121,f_hat121,g_hat221,f_hat221,g_hat112,f_hat112,g_hat212,f_hat212,g_hat122,f_hat122,g_hat222,f_hat222,ck21,ck22)
+#pragma omp critical (nfft_omp_critical_fftw_plan)
 #endif
-      for(k0=0;k0<N0/2;k0++)
   {
-    ck01=c_phi_inv01[k0];
-    ck02=c_phi_inv02[k0];
-    c_phi_inv11=ths->c_phi_inv[1];
-    c_phi_inv12=&ths->c_phi_inv[1][N1/2];
+    e = NULL;
 
-    for(k1=0;k1<N1/2;k1++)
-      {
-        ck11=c_phi_inv11[k1];
-        ck12=c_phi_inv12[k1];
-        c_phi_inv21=ths->c_phi_inv[2];
-        c_phi_inv22=&ths->c_phi_inv[2][N2/2];
+    if (ths->flags & NFFT_SHARED_GRID)
+      for (e = shared_fftw_list; e; e = e->next)
+        if (e->g1 && shared_fftw_match(e, ths))
+          break;
 
-        g_hat111=g_hat + ((n0-(N0/2)+k0)*n1+n1-(N1/2)+k1)*n2+n2-(N2/2);
-        f_hat111=f_hat + (k0*N1+k1)*N2;
-        g_hat211=g_hat + (k0*n1+n1-(N1/2)+k1)*n2+n2-(N2/2);
-        f_hat211=f_hat + (((N0/2)+k0)*N1+k1)*N2;
-        g_hat121=g_hat + ((n0-(N0/2)+k0)*n1+k1)*n2+n2-(N2/2);
-        f_hat121=f_hat + (k0*N1+(N1/2)+k1)*N2;
-        g_hat221=g_hat + (k0*n1+k1)*n2+n2-(N2/2);
-        f_hat221=f_hat + (((N0/2)+k0)*N1+(N1/2)+k1)*N2;
+    if (e)
+    {
+      ths->g1 = e->g1;
+      ths->g2 = e->g2;
+      ths->memory_applied = e->grid_policy;
+      e->grid_refs++;
+    }
+    else
+    {
+      ths->memory_applied = grid_malloc(ths);
+      align1 = grid_alignment(ths->g1);
+      align2 = grid_alignment(ths->g2);
 
-        g_hat112=g_hat + ((n0-(N0/2)+k0)*n1+n1-(N1/2)+k1)*n2;
-        f_hat112=f_hat + (k0*N1+k1)*N2+(N2/2);
-        g_hat212=g_hat + (k0*n1+n1-(N1/2)+k1)*n2;
-        f_hat212=f_hat + (((N0/2)+k0)*N1+k1)*N2+(N2/2);
-        g_hat122=g_hat + ((n0-(N0/2)+k0)*n1+k1)*n2;
-        f_hat122=f_hat + (k0*N1+(N1/2)+k1)*N2+(N2/2);
-        g_hat222=g_hat + (k0*n1+k1)*n2;
-        f_hat222=f_hat + (((N0/2)+k0)*N1+(N1/2)+k1)*N2+(N2/2);
+      for (e = shared_fftw_list; e; e = e->next)
+        if (e->align1 == align1 && e->align2 == align2 && shared_fftw_match(e, ths))
+          break;
 
-        for(k2=0;k2<N2/2;k2++)
-    {
-      ck21=c_phi_inv21[k2];
-      ck22=c_phi_inv22[k2];
+      if (!e)
+      {
+        INT t;
 
-      f_hat111[k2] = g_hat111[k2] * ck01 * ck11 * ck21;
-      f_hat211[k2] = g_hat211[k2] * ck02 * ck11 * ck21;
-      f_hat121[k2] = g_hat121[k2] * ck01 * ck12 * ck21;
-      f_hat221[k2] = g_hat221[k2] * ck02 * ck12 * ck21;
+        e = (shared_fftw*) Y(malloc)(sizeof(shared_fftw));
+        e->d = ths->d;
+        e->n = (INT*) Y(malloc)((size_t)(ths->d) * sizeof(INT));
+        for (t = 0; t < ths->d; t++)
+          e->n[t] = ths->n[t];
+        e->howmany = ths->howmany;
+        e->kind = ths->flags & (NFFT_REAL | FFT_OUT_OF_PLACE);
+        e->fftw_flags = ths->fftw_flags;
+        e->nthreads = fftw_nthreads();
+        e->align1 = align1;
+        e->align2 = align2;
+        fftw_plans(ths, e->nthreads, &e->plan1, &e->plan2);
+        e->refs = 0;
+        e->g1 = NULL;
+        e->g2 = NULL;
+        e->grid_policy = 0;
+        e->grid_refs = 0;
+        e->next = shared_fftw_list;
+        shared_fftw_list = e;
+      }
 
-      f_hat112[k2] = g_hat112[k2] * ck01 * ck11 * ck22;
-      f_hat212[k2] = g_hat212[k2] * ck02 * ck11 * ck22;
-      f_hat122[k2] = g_hat122[k2] * ck01 * ck12 * ck22;
-      f_hat222[k2] = g_hat222[k2] * ck02 * ck12 * ck22;
-    }
+      /* an entry found here holds no grids, else the search above had
+       * found it */
+      if (ths->flags & NFFT_SHARED_GRID)
+      {
+        e->g1 = ths->g1;
+        e->g2 = ths->g2;
+        e->grid_policy = ths->memory_applied;
+        e->grid_refs = 1;
       }
-  }
     }
-  else
+
+    e->refs++;
+    ths->my_fftw_plan1 = e->plan1;
+    ths->my_fftw_plan2 = e->plan2;
+  }
+}
+
+/** Release g1, g2 and the FFTW plans of the plan. The last plan using an
+ *  entry destroys its FFTW plans, the last plan using its grids frees them. */
+static void shared_fftw_finalize(X(plan) *ths)
+{
+  shared_fftw **p, *e;
+
 #ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(k0,k1,k2,ck01,ck02,ck11,ck12,ck21,ck22)
+#pragma omp critical (nfft_omp_critical_fftw_plan)
 #endif
-    for(k0=0;k0<N0/2;k0++)
+  {
+    for (p = &shared_fftw_list; (*p)->plan1 != ths->my_fftw_plan1; p = &(*p)->next)
+      ;
+    e = *p;
+
+    if (ths->flags & NFFT_SHARED_GRID)
+    {
+      if (--e->grid_refs == 0)
       {
-  ck01=K(1.0)/(PHI_HUT(ths->n[0],k0-N0/2,0));
-  ck02=K(1.0)/(PHI_HUT(ths->n[0],k0,0));
-  for(k1=0;k1<N1/2;k1++)
+        grid_free(ths, e->g1, e->g2, e->grid_policy);
+        e->g1 = NULL;
+        e->g2 = NULL;
+      }
+    }
+    else
+      grid_free(ths, ths->g1, ths->g2, ths->memory_applied);
+
+    if (--e->refs == 0)
     {
-      ck11=K(1.0)/(PHI_HUT(ths->n[1],k1-N1/2,1));
-      ck12=K(1.0)/(PHI_HUT(ths->n[1],k1,1));
+      FFTW(destroy_plan)(e->plan2);
+      FFTW(destroy_plan)(e->plan1);
+      *p = e->next;
+      Y(free)(e->n);
+      Y(free)(e);
+    }
+  }
+}
 
-      for(k2=0;k2<N2/2;k2++)
-        {
-    ck21=K(1.0)/(PHI_HUT(ths->n[2],k2-N2/2,2));
-    ck22=K(1.0)/(PHI_HUT(ths->n[2],k2,2));
+/* ## threads of the plan ##################################################### */
 
-    f_hat[(k0*N1+k1)*N2+k2]                  = g_hat[((n0-N0/2+k0)*n1+n1-N1/2+k1)*n2+n2-N2/2+k2] * ck01 * ck11 * ck21;
-    f_hat[((N0/2+k0)*N1+k1)*N2+k2]           = g_hat[(k0*n1+n1-N1/2+k1)*n2+n2-N2/2+k2]           * ck02 * ck11 * ck21;
-    f_hat[(k0*N1+N1/2+k1)*N2+k2]             = g_hat[((n0-N0/2+k0)*n1+k1)*n2+n2-N2/2+k2]         * ck01 * ck12 * ck21;
-    f_hat[((N0/2+k0)*N1+N1/2+k1)*N2+k2]      = g_hat[(k0*n1+k1)*n2+n2-N2/2+k2]                   * ck02 * ck12 * ck21;
+/** Settings of the calling thread replaced by threads_enter. */
+typedef struct
+{
+  int nthreads; /**< Previous thread count of the calling task */
+  void *affinity; /**< Previous affinities of the pinned threads, or NULL */
+} threads_state;
+
+/** Set the thread count of the calling thread to that of the plan and, with
+ *  cpus, pin thread t of the team, the calling thread being thread 0, to
+ *  cpus[t]. The count is an OpenMP ICV of the calling task, so plans called
+ *  side by side from different threads each keep their own. threads_leave
+ *  gives the threads their previous settings back. OpenMP runs the regions of
+ *  a team of the same size on the same threads, so the pinning holds for the
+ *  regions in between. */
+static threads_state threads_enter(const X(plan) *ths)
+{
+  threads_state saved;
 
-    f_hat[(k0*N1+k1)*N2+N2/2+k2]             = g_hat[((n0-N0/2+k0)*n1+n1-N1/2+k1)*n2+k2]         * ck01 * ck11 * ck22;
-    f_hat[((N0/2+k0)*N1+k1)*N2+N2/2+k2]      = g_hat[(k0*n1+n1-N1/2+k1)*n2+k2]                   * ck02 * ck11 * ck22;
-    f_hat[(k0*N1+N1/2+k1)*N2+N2/2+k2]        = g_hat[((n0-N0/2+k0)*n1+k1)*n2+k2]                 * ck01 * ck12 * ck22;
-    f_hat[((N0/2+k0)*N1+N1/2+k1)*N2+N2/2+k2] = g_hat[(k0*n1+k1)*n2+k2]                           * ck02 * ck12 * ck22;
-        }
-    }
-      }
+#ifdef _OPENMP
+  saved.nthreads = omp_get_max_threads();
 
-  TOC(0)
+  if (ths->nthreads > 0)
+    omp_set_num_threads((int)ths->nthreads);
+
+  saved.affinity = ths->cpus ? Y(pin_threads)(ths->cpus, (int)ths->nthreads)
+    : NULL;
+#else
+  UNUSED(ths);
+  saved.nthreads = 1;
+  saved.affinity = NULL;
+#endif
+
+  return saved;
 }
 
-/** user routines
- */
-void X(trafo)(X(plan) *ths)
+static void threads_leave(const X(plan) *ths, const threads_state saved)
+{
+#ifdef _OPENMP
+  Y(unpin_threads)(saved.affinity, (int)ths->nthreads);
+  omp_set_num_threads(saved.nthreads);
+#else
+  UNUSED(ths);
+  UNUSED(saved);
+#endif
+}
+
+/** Plan the FFTs of the plan again, on new grids if new_grids is set. The
+ *  contents of the grids are lost. */
+static void fft_replan(X(plan) *ths, const int new_grids)
 {
-  /* use direct transform if degree N is too low */
-  for (int j = 0; j < ths->d; j++)
+  ths->g_hat_zero_padded = 0;
+
+  if (ths->flags & NFFT_SHARED_FFTW_PLAN)
   {
-    if((ths->N[j] <= ths->m) || (ths->n[j] <= 2*ths->m+2))
-    {
-      X(trafo_direct)(ths);
-      return;
-    }
+    /* allocates new grids unless they are shared */
+    shared_fftw_finalize(ths);
+    shared_fftw_init(ths);
+    return;
   }
-  
-  switch(ths->d)
+
+#ifdef _OPENMP
+#pragma omp critical (nfft_omp_critical_fftw_plan)
+#endif
   {
-    case 1: X(trafo_1d)(ths); break;
-    case 2: X(trafo_2d)(ths); break;
-    case 3: X(trafo_3d)(ths); break;
-    default:
+    if (ths->flags & NFFT_PRUNED_FFT)
+      pruned_fft_finalize(ths);
+    else
     {
-      /* use ths->my_fftw_plan1 */
-      ths->g_hat = ths->g1;
-      ths->g = ths->g2;
-
-      /** form \f$ \hat g_k = \frac{\hat f_k}{c_k\left(\phi\right)} \text{ for }
-       *  k \in I_N \f$
-       */
-      TIC(0)
-      D_A(ths);
-      TOC(0)
-
-      /** compute by d-variate discrete Fourier transform
-       *  \f$ g_l = \sum_{k \in I_N} \hat g_k {\rm e}^{-2\pi {\rm i} \frac{kl}{n}}
-       *  \text{ for } l \in I_n \f$
-       */
-      TIC_FFTW(1)
-      FFTW(execute)(ths->my_fftw_plan1);
-      TOC_FFTW(1)
-
-      /** set \f$ f_j =\sum_{l \in I_n,m(x_j)} g_l \psi\left(x_j-\frac{l}{n}\right)
-       *  \text{ for } j=0,\dots,M_total-1 \f$
-       */
-      TIC(2)
-      B_A(ths);
-      TOC(2)
+      FFTW(destroy_plan)(ths->my_fftw_plan2);
+      FFTW(destroy_plan)(ths->my_fftw_plan1);
     }
   }
-} /* nfft_trafo */
 
-void X(adjoint)(X(plan) *ths)
-{
-  /* use direct transform if degree N is too low */
-  for (int j = 0; j < ths->d; j++)
+  if (new_grids)
   {
-    if((ths->N[j] <= ths->m) || (ths->n[j] <= 2*ths->m+2))
-    {
-      X(adjoint_direct)(ths);
-      return;
-    }
+    grid_free(ths, ths->g1, ths->g2, ths->memory_applied);
+    ths->memory_applied = grid_malloc(ths);
   }
-  
-  switch(ths->d)
+
+#ifdef _OPENMP
+#pragma omp critical (nfft_omp_critical_fftw_plan)
+#endif
   {
-    case 1: X(adjoint_1d)(ths); break;
-    case 2: X(adjoint_2d)(ths); break;
-    case 3: X(adjoint_3d)(ths); break;
-    default:
+    if (ths->flags & NFFT_PRUNED_FFT)
     {
-      /* use ths->my_fftw_plan2 */
-      ths->g_hat=ths->g1;
-      ths->g=ths->g2;
-      
-      /** set \f$ g_l = \sum_{j=0}^{M_total-1} f_j \psi\left(x_j-\frac{l}{n}\right)
-       *  \text{ for } l \in I_n,m(x_j) \f$
-       */
-      TIC(2)
-      B_T(ths);
-      TOC(2)
-
-      /** compute by d-variate discrete Fourier transform
-       *  \f$ \hat g_k = \sum_{l \in I_n} g_l {\rm e}^{+2\pi {\rm i} \frac{kl}{n}}
-       *  \text{ for }  k \in I_N\f$
-       */
-      TIC_FFTW(1)
-      FFTW(execute)(ths->my_fftw_plan2);
-      TOC_FFTW(1)
-
-      /** form \f$ \hat f_k = \frac{\hat g_k}{c_k\left(\phi\right)} \text{ for }
-       *  k \in I_N \f$
-       */
-      TIC(0)
-      D_T(ths);
-      TOC(0)
+#ifdef _OPENMP
+      FFTW(plan_with_nthreads)(fftw_nthreads());
+#endif
+      pruned_fft_init(ths);
     }
+    else
+      fftw_plans(ths, fftw_nthreads(), &ths->my_fftw_plan1,
+        &ths->my_fftw_plan2);
   }
-} /* nfft_adjoint */
-
+}
 
-/** initialisation of direct transform
- */
-static void precompute_phi_hut(X(plan) *ths)
+/** Point the copy of the plan from execute_plan to the next input. */
+static void pipeline_arrays(X(plan) *p, C *f_hat, C *f)
 {
-  INT ks[ths->d]; /* index over all frequencies */
-  INT t; /* index over all dimensions */
+  p->f_hat = f_hat;
 
-  ths->c_phi_inv = (R**) Y(malloc)((size_t)(ths->d) * sizeof(R*));
+  if (p->flags & NFFT_REAL)
+    p->f_real = (R*) f;
+  else
+    p->f = f;
+}
 
-  for (t = 0; t < ths->d; t++)
+#ifdef _OPENMP
+/** Plan the FFTs of the copy p of a plan, see execute_plan, on its own grids
+ *  with nthreads threads. */
+static void pipeline_fft_init(X(plan) *p, const int nthreads)
+{
+#pragma omp critical (nfft_omp_critical_fftw_plan)
   {
-    ths->c_phi_inv[t] = (R*)Y(malloc)((size_t)(ths->N[t]) * sizeof(R));
+    if (p->flags & NFFT_PRUNED_FFT)
+    {
+      FFTW(plan_with_nthreads)(nthreads);
+      pruned_fft_init(p);
+    }
+    else
+      fftw_plans(p, nthreads, &p->my_fftw_plan1, &p->my_fftw_plan2);
+  }
+}
 
-    for (ks[t] = 0; ks[t] < ths->N[t]; ks[t]++)
+static void pipeline_fft_finalize(X(plan) *p)
+{
+#pragma omp critical (nfft_omp_critical_fftw_plan)
+  {
+    if (p->flags & NFFT_PRUNED_FFT)
+      pruned_fft_finalize(p);
+    else
     {
-      ths->c_phi_inv[t][ks[t]]= K(1.0) / (PHI_HUT(ths->n[t], ks[t] - ths->N[t] / 2,t));
+      FFTW(destroy_plan)(p->my_fftw_plan2);
+      FFTW(destroy_plan)(p->my_fftw_plan1);
     }
   }
-} /* nfft_phi_hut */
+}
 
-/** create a lookup table, but NOT for each node
- *  good idea K=2^xx
- *  assumes an EVEN window function
- */
-void X(precompute_lin_psi)(X(plan) *ths)
+/** Stage s of the transform of input k on the copy q of the plan: stage 0 is
+ *  the D-step and the FFT of the transform or the B-step of the adjoint,
+ *  stage 1 the rest. */
+static void pipeline_stage(X(plan) *q, const int s, C *f_hat, C *f,
+  const int is_adjoint)
 {
-  INT t;                                /**< index over all dimensions       */
-  INT j;                                /**< index over all nodes            */
-  R step;                          /**< step size in [0,(m+2)/n]        */
+  pipeline_arrays(q, f_hat, f);
 
-  for (t=0; t<ths->d; t++)
-    {
-      step = ((R)(ths->m+2)) / ((R)(ths->K * ths->n[t]));
-      for(j = 0;j <= ths->K; j++)
+  if (!is_adjoint && !s)
   {
-    ths->psi[(ths->K+1)*t + j] = PHI(ths->n[t], (R)(j) * step,t);
-  } /* for(j) */
-    } /* for(t) */
+    trafo_D(q);
+    trafo_fft(q);
+  }
+  else if (!is_adjoint)
+    trafo_B(q);
+  else if (!s)
+    adjoint_B(q);
+  else
+  {
+    adjoint_fft(q);
+    adjoint_D(q);
+  }
 }
+#endif
 
-void X(precompute_fg_psi)(X(plan) *ths)
+/**
+ * Transforms of count inputs in a pipeline of two stages: the D-step and the
+ * FFT of input i run next to the B-step of input i-1, on two copies of the
+ * plan with grids of their own. One team of two threads runs the stages for
+ * all inputs. If the caller allows nested parallelism, see
+ * omp_set_max_active_levels, the threads of the plan are split between the
+ * stages and the stage with the FFT gets the larger half, otherwise every
+ * stage runs on one thread. The FFTs of the copies are planned with the
+ * threads of their stage for each call. With a single thread the transforms
+ * run one after another.
+ */
+static void pipeline(const X(plan) *ths, const int count, C **f_hat, C **f,
+  const int is_adjoint)
 {
-  INT t;                                /**< index over all dimensions       */
-  INT u, o;                             /**< depends on x_j                  */
+  const size_t size = X(workspace_size)(ths);
+#ifdef _OPENMP
+  const int overlap = count > 1 && !direct_only(ths) && omp_get_max_threads() > 1
+    && omp_get_max_active_levels() > omp_get_active_level();
+#else
+  const int overlap = 0;
+#endif
+  char *work;
+  X(plan) p[2];
+  int i;
 
-  sort(ths);
+  if (count <= 0)
+    return;
 
-  for (t=0; t<ths->d; t++)
+  work = (char*) Y(malloc)(2 * size);
+  execute_plan(ths, &p[0], f_hat[0], f[0], work);
+
+  if (!overlap)
   {
-    INT j;
-#ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(j,u,o)
-#endif
-    for (j = 0; j < ths->M_total; j++)
-      {
-  uo(ths,j,&u,&o,t);
+    for (i = 0; i < count; i++)
+    {
+      pipeline_arrays(&p[0], f_hat[i], f[i]);
 
-        ths->psi[2*(j*ths->d+t)]=
-            (PHI(ths->n[t] ,(ths->x[j*ths->d+t] - ((R)u) / (R)(ths->n[t])),t));
+      if (is_adjoint)
+        adjoint(&p[0]);
+      else
+        trafo(&p[0]);
+    }
 
-        ths->psi[2*(j*ths->d+t)+1]=
-            EXP(K(2.0) * ((R)(ths->n[t]) * ths->x[j*ths->d+t] - (R)(u)) / ths->b[t]);
-      } /* for(j) */
+    Y(free)(work);
+    return;
   }
-  /* for(t) */
-} /* nfft_precompute_fg_psi */
-
-void X(precompute_psi)(X(plan) *ths)
-{
-  INT t; /* index over all dimensions */
-  INT l; /* index u<=l<=o */
-  INT lj; /* index 0<=lj<u+o+1 */
-  INT u, o; /* depends on x_j */
 
-  sort(ths);
+  execute_plan(ths, &p[1], f_hat[1], f[1], work + size);
 
-  for (t=0; t<ths->d; t++)
-  {
-    INT j;
 #ifdef _OPENMP
-    #pragma omp parallel for default(shared) private(j,l,lj,u,o)
-#endif
-    for (j = 0; j < ths->M_total; j++)
+  {
+    const int nthreads = omp_get_max_threads(),
+      nested = omp_get_max_active_levels() > omp_get_active_level() + 1;
+    /* threads of each stage, the FFT is in stage is_adjoint */
+    int share[2];
+
+    share[is_adjoint] = nested ? (nthreads + 1) / 2 : 1;
+    share[!is_adjoint] = nested ? nthreads / 2 : 1;
+
+    for (i = 0; i < 2; i++)
+      pipeline_fft_init(&p[i], share[is_adjoint]);
+
+    #pragma omp parallel num_threads(2) default(shared)
     {
-      uo(ths,j,&u,&o,t);
+      const int nteam = omp_get_num_threads();
+      int step, s;
 
-      for(l = u, lj = 0; l <= o; l++, lj++)
-        ths->psi[(j * ths->d + t) * (2 * ths->m + 2) + lj] =
-            (PHI(ths->n[t], (ths->x[j*ths->d+t] - ((R)l) / (R)(ths->n[t])), t));
-    } /* for(j) */
+      /* thread s runs stage s, of input step-s; a team of one runs both */
+      for (step = 0; step <= count; step++)
+      {
+        for (s = omp_get_thread_num(); s < 2; s += nteam)
+        {
+          const int k = step - s;
+
+          if (k >= 0 && k < count)
+          {
+            /* the thread count of the implicit task of this thread */
+            omp_set_num_threads(share[s]);
+            pipeline_stage(&p[k % 2], s, f_hat[k], f[k], is_adjoint);
+          }
+        }
+
+        #pragma omp barrier
+      }
+    }
+
+    for (i = 0; i < 2; i++)
+      pipeline_fft_finalize(&p[i]);
   }
-  /* for(t) */
-} /* nfft_precompute_psi */
+#endif
 
-#ifdef _OPENMP
-static void nfft_precompute_full_psi_omp(X(plan) *ths)
+  Y(free)(work);
+}
+
+void X(set_threads)(X(plan) *ths, int nthreads, const int *cpus)
 {
-  INT j;                                /**< index over all nodes            */
-  INT lprod;                            /**< 'bandwidth' of matrix B         */
+  INT t;
+  threads_state saved;
 
-  {
-    INT t;
-    for(t=0,lprod = 1; t<ths->d; t++)
-        lprod *= 2*ths->m+2;
-  }
+  Y(free)(ths->cpus);
+  ths->cpus = NULL;
+  ths->nthreads = MAX(nthreads, 0);
 
-  #pragma omp parallel for default(shared) private(j)
-  for(j=0; j<ths->M_total; j++)
-    {
-      INT t,t2;                             /**< index over all dimensions       */
-      INT l_L;                              /**< plain index 0<=l_L<lprod        */
-      INT lj[ths->d];                       /**< multi index 0<=lj<u+o+1         */
-      INT ll_plain[ths->d+1];               /**< postfix plain index             */
+  if (cpus && ths->nthreads > 0)
+  {
+    ths->cpus = (int*) Y(malloc)((size_t)(ths->nthreads) * sizeof(int));
 
-      INT u[ths->d], o[ths->d];             /**< depends on x_j                  */
+    for (t = 0; t < ths->nthreads; t++)
+      ths->cpus[t] = cpus[t];
+  }
 
-      R phi_prod[ths->d+1];
-      INT ix = j*lprod;
+  if (!(ths->flags & FFTW_INIT))
+    return;
 
-      phi_prod[0]=1;
-      ll_plain[0]=0;
+  /* plan the FFTs again for the new thread count, which may overwrite the
+   * grids */
+  saved = threads_enter(ths);
+  fft_replan(ths, 0);
+  threads_leave(ths, saved);
+}
 
-      MACRO_init_uo_l_lj_t;
+/** Sets the memory policy of the plan. The grids g1 and g2, psi and
+ *  psi_index_g are allocated and placed anew at once, before they are written,
+ *  so psi has to be precomputed again; nfft_memory_policy reports the parts
+ *  that took effect. */
+void X(set_memory_policy)(X(plan) *ths, unsigned policy)
+{
+  const threads_state saved = threads_enter(ths);
 
-      for(l_L=0; l_L<lprod; l_L++, ix++)
-      {
-        MACRO_update_phi_prod_ll_plain(without_PRE_PSI);
+  ths->memory_policy = policy;
+  ths->memory_applied = 0;
 
-        ths->psi_index_g[ix]=ll_plain[ths->d];
-        ths->psi[ix]=phi_prod[ths->d];
+  /* fresh pages of psi, placed before the next precomputation writes them */
+  psi_malloc(ths);
+  ths->psi_applied = psi_memory_policy(ths);
 
-        MACRO_count_uo_l_lj_t;
-      } /* for(l_L) */
+  /* new grids, placed before the planner writes them */
+  if (ths->flags & FFTW_INIT)
+    fft_replan(ths, 1);
 
-      ths->psi_index_f[j]=lprod;
-    } /* for(j) */
+  threads_leave(ths, saved);
 }
-#endif
 
-void X(precompute_full_psi)(X(plan) *ths)
+unsigned X(memory_policy)(const X(plan) *ths)
 {
-#ifdef _OPENMP
-  sort(ths);
+  return ths->memory_applied | ths->psi_applied;
+}
 
-  nfft_precompute_full_psi_omp(ths);
+unsigned X(set_simd)(X(plan) *ths, unsigned level)
+{
+#ifdef NFFT_SIMD
+  ths->simd = simd_supported(level);
 #else
-  INT t, t2; /* index over all dimensions */
-  INT j; /* index over all nodes */
-  INT l_L; /* plain index 0 <= l_L < lprod */
-  INT lj[ths->d]; /* multi index 0<=lj<u+o+1 */
-  INT ll_plain[ths->d+1]; /* postfix plain index */
-  INT lprod; /* 'bandwidth' of matrix B */
-  INT u[ths->d], o[ths->d]; /* depends on x_j */
-
-  R phi_prod[ths->d+1];
-
-  INT ix, ix_old;
+  UNUSED(level);
+  ths->simd = NFFT_SIMD_GENERIC;
+#endif
+  return ths->simd;
+}
 
-  sort(ths);
+/** Public entry points, run with the threads of the plan. */
+#define PLAN_THREADS(name, plan_type) \
+void X(name)(plan_type *ths) \
+{ \
+  const threads_state saved = threads_enter(ths); \
+  name(ths); \
+  threads_leave(ths, saved); \
+}
 
-  phi_prod[0] = K(1.0);
-  ll_plain[0] = 0;
+PLAN_THREADS(trafo_direct, const X(plan))
+PLAN_THREADS(adjoint_direct, const X(plan))
+PLAN_THREADS(trafo, X(plan))
+PLAN_THREADS(adjoint, X(plan))
+PLAN_THREADS(trafo_1d, X(plan))
+PLAN_THREADS(adjoint_1d, X(plan))
+PLAN_THREADS(trafo_2d, X(plan))
+PLAN_THREADS(adjoint_2d, X(plan))
+PLAN_THREADS(trafo_3d, X(plan))
+PLAN_THREADS(adjoint_3d, X(plan))
+PLAN_THREADS(precompute_lin_psi, X(plan))
+PLAN_THREADS(precompute_fg_psi, X(plan))
+PLAN_THREADS(precompute_psi, X(plan))
+PLAN_THREADS(precompute_full_psi, X(plan))
+PLAN_THREADS(precompute_one_psi, X(plan))
+PLAN_THREADS(trafo_D, X(plan))
+PLAN_THREADS(trafo_fft, X(plan))
+PLAN_THREADS(trafo_B, X(plan))
+PLAN_THREADS(adjoint_B, X(plan))
+PLAN_THREADS(adjoint_fft, X(plan))
+PLAN_THREADS(adjoint_D, X(plan))
+
+#undef PLAN_THREADS
+
+/** Sets M nodes x of the plan and updates the precomputed data.  With flag
+ *  MALLOC_X, x is copied into the plan.  Without it, the plan keeps the
+ *  pointer x, and with flag NFFT_REORDER_NODES every precomputation permutes
+ *  the array of the caller in place. */
+void X(set_nodes)(X(plan) *ths, R *x, int M)
+{
+  const threads_state saved = threads_enter(ths);
+  set_nodes(ths, x, M);
+  threads_leave(ths, saved);
+}
 
-  for (t = 0, lprod = 1; t < ths->d; t++)
-    lprod *= 2 * ths->m + 2;
+/** Updates the precomputed data after the caller changed the nodes
+ *  x[d*j],...,x[d*j+d-1] of the plan for the num_moved indices j in moved,
+ *  also for an x owned by the caller. With flag NFFT_REORDER_NODES, j is the
+ *  position in the reordered x, and the nodes are not reordered again. */
+void X(set_moved_nodes)(X(plan) *ths, const int *moved, int num_moved)
+{
+  const threads_state saved = threads_enter(ths);
+  set_moved_nodes(ths, moved, num_moved);
+  threads_leave(ths, saved);
+}
 
-  for (j = 0, ix = 0, ix_old = 0; j < ths->M_total; j++)
-  {
-    MACRO_init_uo_l_lj_t;
+/** The B-step alone on the grid g of the caller, which is laid out like g2:
+ *  howmany vectors of n_total values, or n_total reals for flag NFFT_REAL. */
+#define PLAN_GRID(name) \
+void X(name)(X(plan) *ths, C *g) \
+{ \
+  const threads_state saved = threads_enter(ths); \
+  C *g_plan = ths->g; \
+\
+  ths->g = g; \
+  name(ths); \
+  ths->g = g_plan; \
+  threads_leave(ths, saved); \
+}
 
-    for (l_L = 0; l_L < lprod; l_L++, ix++)
-    {
-      MACRO_update_phi_prod_ll_plain(without_PRE_PSI);
+PLAN_GRID(interp)
+PLAN_GRID(spread)
 
-      ths->psi_index_g[ix] = ll_plain[ths->d];
-      ths->psi[ix] = phi_prod[ths->d];
+#undef PLAN_GRID
 
-      MACRO_count_uo_l_lj_t;
-    } /* for(l_L) */
+void X(trafo_points)(const X(plan) *ths, int M, const R *x, C *f)
+{
+  const threads_state saved = threads_enter(ths);
+  trafo_points(ths, (INT)M, x, f);
+  threads_leave(ths, saved);
+}
 
-    ths->psi_index_f[j] = ix - ix_old;
-    ix_old = ix;
-  } /* for(j) */
-#endif
+void X(trafo_pipeline)(const X(plan) *ths, int count, C **f_hat, C **f)
+{
+  const threads_state saved = threads_enter(ths);
+  pipeline(ths, count, f_hat, f, 0);
+  threads_leave(ths, saved);
 }
 
-void X(precompute_one_psi)(X(plan) *ths)
+void X(adjoint_pipeline)(const X(plan) *ths, int count, C **f_hat, C **f)
 {
-  if(ths->flags & PRE_LIN_PSI)
-    X(precompute_lin_psi)(ths);
-  if(ths->flags & PRE_FG_PSI)
-    X(precompute_fg_psi)(ths);
-  if(ths->flags & PRE_PSI)
-    X(precompute_psi)(ths);
-  if(ths->flags & PRE_FULL_PSI)
-    X(precompute_full_psi)(ths);
+  const threads_state saved = threads_enter(ths);
+  pipeline(ths, count, f_hat, f, 1);
+  threads_leave(ths, saved);
 }
 
 static void init_help(X(plan) *ths)
@@ -5955,6 +10806,35 @@ static void init_help(X(plan) *ths)
   if (ths->flags & NFFT_OMP_BLOCKWISE_ADJOINT)
     ths->flags |= NFFT_SORT_NODES;
 
+#ifdef _OPENMP
+  /* every thread of the real adjoint finds the nodes of its block in index_x */
+  if (ths->flags & NFFT_REAL)
+    ths->flags |= NFFT_SORT_NODES;
+#endif
+
+  if (ths->flags & NFFT_SHARED_GRID)
+    ths->flags |= NFFT_SHARED_FFTW_PLAN;
+
+  ths->nthreads = 0;
+  ths->cpus = NULL;
+  ths->g_hat_zero_padded = 0;
+  ths->memory_policy = 0;
+  ths->memory_applied = 0;
+  ths->psi_applied = 0;
+  ths->grid_plan = NULL;
+  ths->index_x_sorted = 0;
+  ths->psi_current = 0;
+
+  /* the per-dimension plans of the pruned FFT are not shared */
+  if (ths->flags & NFFT_PRUNED_FFT)
+    ths->flags &= ~(NFFT_SHARED_FFTW_PLAN | NFFT_SHARED_GRID);
+
+#ifdef NFFT_SIMD
+  ths->simd = simd_supported(NFFT_SIMD_AVX512);
+#else
+  ths->simd = NFFT_SIMD_GENERIC;
+#endif
+
   ths->N_total = intprod(ths->N, 0, ths->d);
   ths->n_total = intprod(ths->n, 0, ths->d);
 
@@ -5963,16 +10843,45 @@ static void init_help(X(plan) *ths)
   for(t = 0;t < ths->d; t++)
     ths->sigma[t] = ((R)ths->n[t]) / (R)(ths->N[t]);
 
-  WINDOW_HELP_INIT;
+  window_init(ths);
+
+  /* window values in single precision are stored relative to the peak of
+   * the window, the tensor products of PRE_FULL_PSI would overflow */
+  ths->psi_scale = K(1.0);
+
+  if (ths->flags & NFFT_PSI_FLOAT)
+  {
+    for (t = 0; t < ths->d; t++)
+    {
+      const R phi_0 = PHI(ths->n[t], K(0.0), t);
+      ths->psi_scale = (ths->flags & PRE_FULL_PSI) ? ths->psi_scale * phi_0
+        : MAX(ths->psi_scale, phi_0);
+    }
+  }
+
+  ths->b_kernels = B_fixed_select(ths);
 
   if(ths->flags & MALLOC_X)
     ths->x = (R*)Y(malloc)((size_t)(ths->d * ths->M_total) * sizeof(R));
 
-  if(ths->flags & MALLOC_F_HAT)
-    ths->f_hat = (C*)Y(malloc)((size_t)(ths->N_total) * sizeof(C));
+  ths->f_real = NULL;
 
-  if(ths->flags & MALLOC_F)
-    ths->f = (C*)Y(malloc)((size_t)(ths->M_total) * sizeof(C));
+  if (ths->flags & NFFT_REAL)
+  {
+    if(ths->flags & MALLOC_F_HAT)
+      ths->f_hat = (C*)Y(malloc)((size_t)(real_N_hat(ths)) * sizeof(C));
+
+    if(ths->flags & MALLOC_F)
+      ths->f_real = (R*)Y(malloc)((size_t)(ths->M_total) * sizeof(R));
+  }
+  else
+  {
+    if(ths->flags & MALLOC_F_HAT)
+      ths->f_hat = (C*)Y(malloc)((size_t)(ths->N_total * ths->howmany) * sizeof(C));
+
+    if(ths->flags & MALLOC_F)
+      ths->f = (C*)Y(malloc)((size_t)(ths->M_total * ths->howmany) * sizeof(C));
+  }
 
   if(ths->flags & PRE_PHI_HUT)
     precompute_phi_hut(ths);
@@ -5990,50 +10899,75 @@ static void init_help(X(plan) *ths)
     ths->psi = (R*) Y(malloc)((size_t)(ths->M_total * ths->d * 2) * sizeof(R));
 
   if(ths->flags & PRE_PSI)
-    ths->psi = (R*) Y(malloc)((size_t)(ths->M_total * ths->d * (2 * ths->m + 2)) * sizeof(R));
+    ths->psi = (R*) Y(malloc)((size_t)(ths->M_total * ths->d * (2 * ths->m + 2)) * psi_size(ths));
+
+  if(ths->flags & PRE_POLY_PSI)
+    poly_psi_init(ths);
 
   if(ths->flags & PRE_FULL_PSI)
   {
       for (t = 0, lprod = 1; t < ths->d; t++)
         lprod *= 2 * ths->m + 2;
 
-      ths->psi = (R*) Y(malloc)((size_t)(ths->M_total * lprod) * sizeof(R));
+      ths->psi = (R*) Y(malloc)((size_t)(ths->M_total * lprod) * psi_size(ths));
 
       ths->psi_index_f = (INT*) Y(malloc)((size_t)(ths->M_total) * sizeof(INT));
-      ths->psi_index_g = (INT*) Y(malloc)((size_t)(ths->M_total * lprod) * sizeof(INT));
+      ths->psi_index_g = (INT*) Y(malloc)((size_t)(ths->M_total) * psi_index_size(ths, lprod));
+
+      /* offsets of the window relative to its first grid point */
+      if (ths->flags & NFFT_PSI_BASE_INDEX)
+      {
+        INT l_L, t2;
+
+        ths->psi_offset = (INT*) Y(malloc)((size_t)(lprod) * sizeof(INT));
+
+        for (l_L = 0; l_L < lprod; l_L++)
+        {
+          INT l_temp = l_L, stride = 1;
+
+          ths->psi_offset[l_L] = 0;
+
+          for (t2 = ths->d - 1; t2 >= 0; t2--)
+          {
+            ths->psi_offset[l_L] += (l_temp % (2 * ths->m + 2)) * stride;
+            l_temp /= 2 * ths->m + 2;
+            stride *= ths->n[t2];
+          }
+        }
+      }
   }
 
   if(ths->flags & FFTW_INIT)
   {
-#ifdef _OPENMP
-    INT nthreads = Y(get_num_threads)();
-#endif
+    Y(load_fftw_wisdom)();
 
-    ths->g1 = (C*)Y(malloc)((size_t)(ths->n_total) * sizeof(C));
-
-    if(ths->flags & FFT_OUT_OF_PLACE)
-      ths->g2 = (C*) Y(malloc)((size_t)(ths->n_total) * sizeof(C));
+    if (ths->flags & NFFT_SHARED_FFTW_PLAN)
+      shared_fftw_init(ths);
     else
-      ths->g2 = ths->g1;
+    {
+      ths->memory_applied = grid_malloc(ths);
 
 #ifdef _OPENMP
 #pragma omp critical (nfft_omp_critical_fftw_plan)
-{
-    FFTW(plan_with_nthreads)(nthreads);
 #endif
-    {
-      int *_n = Y(malloc)((size_t)(ths->d) * sizeof(int));
-
-      for (t = 0; t < ths->d; t++)
-        _n[t] = (int)(ths->n[t]);
-
-      ths->my_fftw_plan1 = FFTW(plan_dft)((int)ths->d, _n, ths->g1, ths->g2, FFTW_FORWARD, ths->fftw_flags);
-      ths->my_fftw_plan2 = FFTW(plan_dft)((int)ths->d, _n, ths->g2, ths->g1, FFTW_BACKWARD, ths->fftw_flags);
-      Y(free)(_n);
-    }
+      {
+        if (ths->flags & NFFT_PRUNED_FFT)
+        {
 #ifdef _OPENMP
-}
+          FFTW(plan_with_nthreads)(fftw_nthreads());
 #endif
+          pruned_fft_init(ths);
+        }
+        else
+          fftw_plans(ths, fftw_nthreads(), &ths->my_fftw_plan1,
+            &ths->my_fftw_plan2);
+      }
+    }
+
+    if (ths->flags & NFFT_GHOST_CELLS)
+      ths->g_ghost = (C*)Y(malloc)((size_t)(ghost_total(ths) * ths->howmany) * sizeof(C));
+    else
+      ths->g_ghost = NULL;
   }
 
   if(ths->flags & NFFT_SORT_NODES)
@@ -6041,11 +10975,38 @@ static void init_help(X(plan) *ths)
   else
     ths->index_x = NULL;
 
+  ths->perm_x = NULL;
+  ths->f_perm = NULL;
+  ths->tile_ptr = NULL;
+  ths->tile_nodes = NULL;
+
+  if(ths->flags & NFFT_REORDER_NODES)
+  {
+    INT j;
+
+    ths->perm_x = (INT*) Y(malloc)((size_t)(ths->M_total) * sizeof(INT));
+
+    for (j = 0; j < ths->M_total; j++)
+      ths->perm_x[j] = j;
+
+    if (permute_f(ths))
+      ths->f_perm = (C*) Y(malloc)((size_t)(ths->M_total * ths->howmany) * sizeof(C));
+  }
+
   ths->mv_trafo = (void (*) (void* ))X(trafo);
   ths->mv_adjoint = (void (*) (void* ))X(adjoint);
 }
 
 void X(init)(X(plan) *ths, int d, int *N, int M_total)
+{
+  X(init_many)(ths, d, N, M_total, 1);
+}
+
+/** Default plan, where sigma = 0 selects the power of two FFT lengths with
+ *  oversampling factor at least 2 and sigma > 1 the smallest 5-smooth FFT
+ *  lengths with oversampling factor at least sigma. */
+static void init_default(X(plan) *ths, int d, int *N, int M_total,
+  int howmany, R sigma)
 {
   INT t; /* index over all dimensions */
 
@@ -6060,11 +11021,26 @@ void X(init)(X(plan) *ths, int d, int *N, int M_total)
 
   ths->n = (INT*) Y(malloc)((size_t)(d) * sizeof(INT));
 
-  for (t = 0; t < d; t++)
-    ths->n[t] = 2 * (Y(next_power_of_2)(ths->N[t]));
-
   ths->m = WINDOW_HELP_ESTIMATE_m;
 
+  if (sigma > K(1.0) && sigma < K(2.0))
+  {
+    /* Keep the accuracy of sigma = 2 by a larger cut-off. The division by
+     * phi_hut amplifies rounding errors more with growing m for small sigma,
+     * so m grows by at most 2. */
+    ths->m = (INT)CEIL((R)WINDOW_HELP_ESTIMATE_m * WINDOW_HELP_DECAY(K(2.0))
+      / WINDOW_HELP_DECAY(sigma) - K(0.001));
+    ths->m = MIN(ths->m, WINDOW_HELP_ESTIMATE_m + 2);
+  }
+
+  for (t = 0; t < d; t++)
+  {
+    if (sigma > K(1.0))
+      ths->n[t] = Y(next_fft_size)((INT)CEIL(sigma * (R)ths->N[t]));
+    else
+      ths->n[t] = 2 * (Y(next_power_of_2)(ths->N[t]));
+  }
+
   if (d > 1)
   {
 #ifdef _OPENMP
@@ -6083,11 +11059,36 @@ void X(init)(X(plan) *ths, int d, int *N, int M_total)
   ths->fftw_flags= FFTW_ESTIMATE| FFTW_DESTROY_INPUT;
 
   ths->K = 0;
+  ths->window = NFFT_WINDOW_DEFAULT;
+  ths->howmany = (INT)howmany;
   init_help(ths);
 }
 
+void X(init_many)(X(plan) *ths, int d, int *N, int M_total, int howmany)
+{
+  init_default(ths, d, N, M_total, howmany, K(0.0));
+}
+
+void X(init_sigma)(X(plan) *ths, int d, int *N, int M_total, double sigma)
+{
+  init_default(ths, d, N, M_total, 1, (R)sigma);
+}
+
 void X(init_guru)(X(plan) *ths, int d, int *N, int M_total, int *n, int m,
   unsigned flags, unsigned fftw_flags)
+{
+  X(init_guru_window)(ths, d, N, M_total, n, m, NFFT_WINDOW_DEFAULT, flags,
+    fftw_flags);
+}
+
+void X(init_guru_window)(X(plan) *ths, int d, int *N, int M_total, int *n,
+  int m, unsigned window, unsigned flags, unsigned fftw_flags)
+{
+  X(init_guru_many)(ths, d, N, M_total, n, m, 1, window, flags, fftw_flags);
+}
+
+void X(init_guru_many)(X(plan) *ths, int d, int *N, int M_total, int *n,
+  int m, int howmany, unsigned window, unsigned flags, unsigned fftw_flags)
 {
   INT t; /* index over all dimensions */
 
@@ -6109,7 +11110,44 @@ void X(init_guru)(X(plan) *ths, int d, int *N, int M_total, int *n, int m,
   ths->fftw_flags = fftw_flags;
 
   ths->K = 0;
+  ths->window = window;
+  ths->howmany = (INT)howmany;
+  init_help(ths);
+}
+
+/** Plan for M_total further nodes that evaluate f_hat of grid_plan from the
+ *  grid of its last nfft_trafo. nfft_trafo of the node set runs the B-step
+ *  only; the adjoint of a node set fails the CK check. */
+void X(init_node_set)(X(plan) *ths, const X(plan) *grid_plan, int M_total)
+{
+  INT t;
+
+  ths->d = grid_plan->d;
+  ths->M_total = (INT)M_total;
+  ths->N = (INT*)Y(malloc)((size_t)(ths->d) * sizeof(INT));
+  ths->n = (INT*)Y(malloc)((size_t)(ths->d) * sizeof(INT));
+
+  for (t = 0; t < ths->d; t++)
+  {
+    ths->N[t] = grid_plan->N[t];
+    ths->n[t] = grid_plan->n[t];
+  }
+
+  ths->m = grid_plan->m;
+
+  /* neither FFT nor D-step of its own */
+  ths->flags = grid_plan->flags & ~(FFTW_INIT | MALLOC_F_HAT | PRE_PHI_HUT
+    | NFFT_PRUNED_FFT | NFFT_SHARED_FFTW_PLAN | NFFT_SHARED_GRID
+    | NFFT_GHOST_CELLS);
+  ths->fftw_flags = grid_plan->fftw_flags;
+
+  ths->K = grid_plan->K;
+  ths->window = grid_plan->window;
+  ths->howmany = grid_plan->howmany;
   init_help(ths);
+
+  ths->grid_plan = grid_plan;
+  node_set_arrays(ths);
 }
 
 void X(init_lin)(X(plan) *ths, int d, int *N, int M_total, int *n, int m, int K,
@@ -6135,6 +11173,8 @@ void X(init_lin)(X(plan) *ths, int d, int *N, int M_total, int *n, int m, int K,
   ths->fftw_flags = fftw_flags;
 
   ths->K = K;
+  ths->window = NFFT_WINDOW_DEFAULT;
+  ths->howmany = 1;
   init_help(ths);
 }
 
@@ -6170,7 +11210,7 @@ const char* X(check)(X(plan) *ths)
 {
   INT j;
 
-  if (!ths->f)
+  if ((ths->flags & NFFT_REAL) ? !ths->f_real : !ths->f)
       return "Member f not initialized.";
 
   if (!ths->x)
@@ -6182,6 +11222,27 @@ const char* X(check)(X(plan) *ths)
   if ((ths->flags & PRE_LIN_PSI) && ths->K < ths->M_total)
     return "Number of nodes too small to use PRE_LIN_PSI.";
 
+  if (ths->howmany < 1)
+    return "Number of vectors howmany has to be positive.";
+
+  if ((ths->flags & (FG_PSI | PRE_FG_PSI)) && ths->window != NFFT_WINDOW_GAUSSIAN)
+    return "FG_PSI and PRE_FG_PSI require the Gaussian window.";
+
+  if ((ths->flags & PRE_POLY_PSI) && (ths->flags & (PRE_ONE_PSI | FG_PSI)))
+    return "PRE_POLY_PSI cannot be combined with other precomputations of psi.";
+
+  if ((ths->flags & NFFT_PSI_INDEX_32) && ths->n_total > INT_MAX)
+    return "NFFT_PSI_INDEX_32 requires less than 2^31 grid points.";
+
+  if ((ths->flags & NFFT_REAL) && (ths->howmany > 1 || (ths->flags & NFFT_PRUNED_FFT)))
+    return "NFFT_REAL cannot be combined with howmany > 1 or NFFT_PRUNED_FFT.";
+
+  if ((ths->flags & NFFT_GHOST_CELLS) && (ths->flags & NFFT_REAL))
+    return "NFFT_GHOST_CELLS cannot be combined with NFFT_REAL.";
+
+  if ((ths->flags & NFFT_FFT_ORDER) && (ths->flags & NFFT_REAL))
+    return "NFFT_FFT_ORDER cannot be combined with NFFT_REAL.";
+
   for (j = 0; j < ths->M_total * ths->d; j++)
   {
     if ((ths->x[j]<-K(0.5)) || (ths->x[j]>= K(0.5)))
@@ -6213,25 +11274,47 @@ void X(finalize)(X(plan) *ths)
   if(ths->flags & NFFT_SORT_NODES)
     Y(free)(ths->index_x);
 
+  if(ths->flags & NFFT_REORDER_NODES)
+  {
+    Y(free)(ths->f_perm);
+    Y(free)(ths->perm_x);
+  }
+
+  Y(free)(ths->tile_nodes);
+  Y(free)(ths->tile_ptr);
+  Y(free)(ths->cpus);
+
   if(ths->flags & FFTW_INIT)
   {
+    if (ths->flags & NFFT_SHARED_FFTW_PLAN)
+      shared_fftw_finalize(ths);
+    else
+    {
 #ifdef _OPENMP
-    #pragma omp critical (nfft_omp_critical_fftw_plan)
-#endif
-    FFTW(destroy_plan)(ths->my_fftw_plan2);
-#ifdef _OPENMP
-    #pragma omp critical (nfft_omp_critical_fftw_plan)
+      #pragma omp critical (nfft_omp_critical_fftw_plan)
 #endif
-    FFTW(destroy_plan)(ths->my_fftw_plan1);
+      {
+        if (ths->flags & NFFT_PRUNED_FFT)
+          pruned_fft_finalize(ths);
+        else
+        {
+          FFTW(destroy_plan)(ths->my_fftw_plan2);
+          FFTW(destroy_plan)(ths->my_fftw_plan1);
+        }
+      }
 
-    if(ths->flags & FFT_OUT_OF_PLACE)
-      Y(free)(ths->g2);
+      grid_free(ths, ths->g1, ths->g2, ths->memory_applied);
+    }
 
-    Y(free)(ths->g1);
+    if(ths->flags & NFFT_GHOST_CELLS)
+      Y(free)(ths->g_ghost);
   }
 
   if(ths->flags & PRE_FULL_PSI)
   {
+    if(ths->flags & NFFT_PSI_BASE_INDEX)
+      Y(free)(ths->psi_offset);
+
     Y(free)(ths->psi_index_g);
     Y(free)(ths->psi_index_f);
     Y(free)(ths->psi);
@@ -6246,6 +11329,9 @@ void X(finalize)(X(plan) *ths)
   if(ths->flags & PRE_LIN_PSI)
     Y(free)(ths->psi);
 
+  if(ths->flags & PRE_POLY_PSI)
+    Y(free)(ths->psi);
+
   if(ths->flags & PRE_PHI_HUT)
   {
     for (t = 0; t < ths->d; t++)
@@ -6254,7 +11340,12 @@ void X(finalize)(X(plan) *ths)
   }
 
   if(ths->flags & MALLOC_F)
-    Y(free)(ths->f);
+  {
+    if(ths->flags & NFFT_REAL)
+      Y(free)(ths->f_real);
+    else
+      Y(free)(ths->f);
+  }
 
   if(ths->flags & MALLOC_F_HAT)
     Y(free)(ths->f_hat);
@@ -6262,7 +11353,7 @@ void X(finalize)(X(plan) *ths)
   if(ths->flags & MALLOC_X)
     Y(free)(ths->x);
 
-  WINDOW_HELP_FINALIZE;
+  window_finalize(ths);
 
   Y(free)(ths->sigma);
   Y(free)(ths->n);
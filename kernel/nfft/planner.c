@@ -0,0 +1,611 @@
+/*
+ * Copyright (c) 2002, 2017 Jens Keiner, Stefan Kunis, Daniel Potts
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Planner for the nonequispaced FFT: chooses window, cut-off, oversampling
+ * and precomputation for a requested accuracy. */
+
+/* configure header */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* complex datatype (maybe) */
+#ifdef HAVE_COMPLEX_H
+#include<complex.h>
+#endif
+
+/* NFFT headers */
+#include "nfft3.h"
+#include "infft.h"
+
+#undef X
+#define X(name) NFFT(name)
+
+/** Largest cut-off parameter m considered by the planner. */
+#define PLANNER_MAX_m 16
+
+/** Number of nodes used to time a candidate, the B-step time is scaled to
+ *  the actual number of nodes. */
+#define PLANNER_MEASURE_M 16384
+
+/** Version tag of the wisdom format. */
+#define WISDOM_HEADER "(nfft-wisdom-1"
+
+/** One configuration considered by the planner. */
+typedef struct
+{
+  unsigned window;
+  unsigned psi; /**< PRE_PSI, PRE_FULL_PSI, PRE_POLY_PSI or 0 */
+  INT m;
+  R sigma;
+} candidate;
+
+/** One decision of the planner, keyed by problem size, accuracy and memory
+ *  budget. */
+typedef struct wisdom_s
+{
+  INT d, M;
+  INT *N; /**< N[0],...,N[d-1] followed by the chosen n[0],...,n[d-1] */
+  double eps;
+  size_t memory;
+  unsigned window, flags;
+  INT m;
+  struct wisdom_s *next;
+} wisdom;
+
+static wisdom *wisdom_list = NULL;
+
+static const unsigned planner_windows[] = {NFFT_WINDOW_KAISER_BESSEL,
+  NFFT_WINDOW_ES};
+static const unsigned planner_psi[] = {PRE_PSI, PRE_FULL_PSI, PRE_POLY_PSI, 0U};
+static const R planner_sigma[] = {K(2.0), K(1.5), K(1.25)};
+
+/** Error bound of the nfft for cut-off m and oversampling factor sigma, cf.
+ *  Potts, Steidl, Tasche for the Kaiser-Bessel window. The exponential of
+ *  semicircle window decays alike with a larger constant. */
+static R planner_error(const unsigned window, const INT m, const R sigma)
+{
+  const R s = SQRT(K(1.0) - K(1.0) / sigma);
+  const R err = K(4.0) * KPI * (SQRT((R)m) + (R)m) * SQRT(s)
+    * EXP(-K2PI * (R)m * s);
+
+  return window == NFFT_WINDOW_ES ? K(4.0) * err : err;
+}
+
+/** Rounding error of the deconvolution in d dimensions, relative to
+ *  oversampling factor 2, where the range of 1/phi_hut grows like
+ *  exp(m (b - sqrt(b^2 - (pi/sigma)^2))) with b = pi (2 - 1/sigma). */
+static R planner_rounding(const INT d, const INT m, const R sigma)
+{
+  const R b = KPI * (K(2.0) - K(1.0) / sigma), b2 = KPI * K(1.5);
+  const R g = (R)m * (b - SQRT(b * b - (KPI / sigma) * (KPI / sigma))
+    - b2 + SQRT(b2 * b2 - KPI * KPI / K(4.0)));
+
+  return K(10.0) * EPSILON * EXP((R)d * g);
+}
+
+/** Smallest cut-off reaching accuracy eps, or 0 if rounding errors prevent
+ *  it up to PLANNER_MAX_m. */
+static INT planner_m(const INT d, const unsigned window, const R sigma,
+  const double eps)
+{
+  INT m;
+
+  for (m = 1; m <= PLANNER_MAX_m; m++)
+    if (planner_error(window, m, sigma) + planner_rounding(d, m, sigma)
+      <= (R)eps)
+      return m;
+
+  return 0;
+}
+
+/** FFT length with oversampling at least sigma, large enough for the fast
+ *  algorithm to be used. */
+static INT planner_n(const INT N, const R sigma, const INT m)
+{
+  INT n = Y(next_fft_size)((INT)CEIL(sigma * (R)N));
+
+  while (n <= MAX(N, 2 * m + 2))
+    n = Y(next_fft_size)(n + 1);
+
+  return n;
+}
+
+/** Flags of the plan for a candidate, as in nfft_init with the chosen
+ *  precomputation of psi. */
+static unsigned planner_flags(const INT d, const unsigned psi)
+{
+  unsigned flags = PRE_PHI_HUT | psi | MALLOC_X | MALLOC_F_HAT | MALLOC_F
+    | FFTW_INIT;
+
+  if (d > 1)
+  {
+    flags |= NFFT_SORT_NODES;
+#ifdef _OPENMP
+    flags |= NFFT_OMP_BLOCKWISE_ADJOINT;
+#endif
+  }
+  else
+    flags |= FFT_OUT_OF_PLACE;
+
+  return flags;
+}
+
+/** Memory in bytes of a plan with the given parameters. */
+static double planner_memory(const INT d, const INT *N, const INT M,
+  const INT *n, const INT m, const unsigned flags)
+{
+  const double w = (double)(2 * m + 2);
+  double n_total = 1.0, N_total = 1.0, wd = 1.0, mem;
+  INT t;
+
+  for (t = 0; t < d; t++)
+  {
+    n_total *= (double)n[t];
+    N_total *= (double)N[t];
+    wd *= w;
+  }
+
+  mem = (double)sizeof(C) * (n_total * ((flags & FFT_OUT_OF_PLACE) ? 2.0 : 1.0)
+    + N_total + (double)M) + (double)sizeof(R) * (double)(d * M);
+
+  if (flags & PRE_PHI_HUT)
+    for (t = 0; t < d; t++)
+      mem += (double)sizeof(R) * (double)N[t];
+
+  if (flags & PRE_PSI)
+    mem += (double)sizeof(R) * (double)(d * M) * w;
+
+  if (flags & PRE_FULL_PSI)
+    mem += ((double)sizeof(R) + (double)sizeof(INT)) * (double)M * wd
+      + (double)sizeof(INT) * (double)M;
+
+  if (flags & PRE_POLY_PSI)
+    mem += (double)sizeof(R) * (double)d * w * 32.0;
+
+  if (flags & NFFT_SORT_NODES)
+    mem += (double)sizeof(INT) * 2.0 * (double)M;
+
+  return mem;
+}
+
+/** Estimated cost in flops of one trafo and one adjoint. */
+static double planner_cost(const INT d, const INT M, const INT *n,
+  const INT m, const unsigned psi)
+{
+  const double w = (double)(2 * m + 2);
+  double n_total = 1.0, wd = 1.0, win;
+  INT t;
+
+  for (t = 0; t < d; t++)
+  {
+    n_total *= (double)n[t];
+    wd *= w;
+  }
+
+  switch (psi)
+  {
+    case PRE_PSI: win = 1.0; break;
+    case PRE_FULL_PSI: win = 0.0; break;
+    case PRE_POLY_PSI: win = 2.0 * (double)m; break;
+    default: win = 40.0;
+  }
+
+  return 10.0 * n_total * log2(n_total)
+    + (double)M * (wd * ((psi == PRE_FULL_PSI) ? 6.0 : 4.0)
+    + 2.0 * (double)d * w * win);
+}
+
+/** Measured time in seconds of one trafo and one adjoint, where the B-step
+ *  is timed for at most PLANNER_MEASURE_M nodes and scaled to M. */
+static double planner_measure(const int d, int *N, const INT M, int *n,
+  const INT m, const unsigned window, const unsigned flags,
+  const unsigned fftw_flags)
+{
+  const INT M_meas = MIN(M, PLANNER_MEASURE_M);
+  X(plan) p;
+  double t0, t_total, t_fft;
+
+  X(init_guru_window)(&p, d, N, (int)M_meas, n, (int)m, window, flags,
+    fftw_flags);
+
+  Y(vrand_shifted_unit_double)(p.x, p.d * p.M_total);
+
+  if (p.flags & PRE_ONE_PSI)
+    X(precompute_one_psi)(&p);
+
+  Y(vrand_unit_complex)(p.f_hat, p.N_total);
+  X(trafo)(&p);
+
+  t0 = (double)Y(clock_gettime_seconds)();
+  X(trafo)(&p);
+  X(adjoint)(&p);
+  t_total = (double)Y(clock_gettime_seconds)() - t0;
+
+  t0 = (double)Y(clock_gettime_seconds)();
+  if (p.flags & NFFT_PRUNED_FFT)
+  {
+    INT t;
+
+    for (t = 0; t < p.d; t++)
+    {
+      FFTW(execute)(p.pruned_plan1[t]);
+      FFTW(execute)(p.pruned_plan2[t]);
+    }
+  }
+  else
+  {
+    FFTW(execute)(p.my_fftw_plan1);
+    FFTW(execute)(p.my_fftw_plan2);
+  }
+  t_fft = (double)Y(clock_gettime_seconds)() - t0;
+
+  X(finalize)(&p);
+
+  return t_fft + ((double)M / (double)M_meas) * MAX(t_total - t_fft, 0.0);
+}
+
+/** Looks up a decision, returns NULL if there is none. */
+static const wisdom *wisdom_find(const INT d, const int *N, const INT M,
+  const double eps, const size_t memory)
+{
+  const wisdom *w;
+
+  for (w = wisdom_list; w; w = w->next)
+  {
+    INT t;
+
+    if (w->d != d || w->M != M || w->eps != eps || w->memory != memory)
+      continue;
+
+    for (t = 0; t < d && w->N[t] == (INT)N[t]; t++) ;
+
+    if (t == d)
+      return w;
+  }
+
+  return NULL;
+}
+
+/** Records a decision, newer decisions take precedence. */
+static void wisdom_add(wisdom *w)
+{
+#ifdef _OPENMP
+  #pragma omp critical (nfft_omp_critical_wisdom)
+#endif
+  {
+    w->next = wisdom_list;
+    wisdom_list = w;
+  }
+}
+
+static wisdom *wisdom_new(const INT d)
+{
+  wisdom *w = (wisdom*) Y(malloc)(sizeof(wisdom));
+
+  w->d = d;
+  w->N = (INT*) Y(malloc)((size_t)(2 * d) * sizeof(INT));
+  w->next = NULL;
+
+  return w;
+}
+
+static void wisdom_free(wisdom *w)
+{
+  while (w)
+  {
+    wisdom *next = w->next;
+    Y(free)(w->N);
+    Y(free)(w);
+    w = next;
+  }
+}
+
+void X(init_tol)(X(plan) *ths, int d, int *N, int M, double eps,
+  size_t memory, unsigned fftw_flags)
+{
+  const wisdom *found;
+  wisdom *w;
+  INT t, c;
+  INT NN[d], n[d];
+  int n_int[d];
+  double best_cost = -1.0, best_mem = -1.0;
+  candidate best = {NFFT_WINDOW_KAISER_BESSEL, PRE_PSI, PLANNER_MAX_m, K(2.0)};
+  int best_fits = 0;
+
+  for (t = 0; t < d; t++)
+    NN[t] = (INT)N[t];
+
+#ifdef _OPENMP
+  #pragma omp critical (nfft_omp_critical_wisdom)
+#endif
+  {
+    found = wisdom_find((INT)d, N, (INT)M, eps, memory);
+
+    if (found)
+    {
+      for (t = 0; t < d; t++)
+        n_int[t] = (int)found->N[d + t];
+
+      best.window = found->window;
+      best.m = found->m;
+      best.psi = found->flags;
+    }
+  }
+
+  if (found)
+  {
+    X(init_guru_window)(ths, d, N, M, n_int, (int)best.m, best.window,
+      best.psi, fftw_flags);
+    return;
+  }
+
+  for (c = 0; c < (INT)(SIZE(planner_windows) * SIZE(planner_sigma)
+    * SIZE(planner_psi)); c++)
+  {
+    candidate cand;
+    unsigned flags;
+    double mem, cost;
+    int fits;
+
+    cand.window = planner_windows[c % SIZE(planner_windows)];
+    cand.sigma = planner_sigma[(c / SIZE(planner_windows)) % SIZE(planner_sigma)];
+    cand.psi = planner_psi[c / (SIZE(planner_windows) * SIZE(planner_sigma))];
+    cand.m = planner_m((INT)d, cand.window, cand.sigma, eps);
+
+    if (cand.m == 0)
+      continue;
+
+    for (t = 0; t < d; t++)
+      n[t] = planner_n(NN[t], cand.sigma, cand.m);
+
+    flags = planner_flags((INT)d, cand.psi);
+    mem = planner_memory((INT)d, NN, (INT)M, n, cand.m, flags);
+    fits = (memory == 0 || mem <= (double)memory);
+
+    /* beyond the budget, only the smallest plan is of interest */
+    if (!fits)
+    {
+      if (!best_fits && (best_mem < 0.0 || mem < best_mem))
+      {
+        best = cand;
+        best_mem = mem;
+      }
+      continue;
+    }
+
+    if (fftw_flags & FFTW_ESTIMATE)
+      cost = planner_cost((INT)d, (INT)M, n, cand.m, cand.psi);
+    else
+    {
+      for (t = 0; t < d; t++)
+        n_int[t] = (int)n[t];
+      cost = planner_measure(d, N, (INT)M, n_int, cand.m, cand.window, flags,
+        fftw_flags);
+    }
+
+    if (!best_fits || cost < best_cost)
+    {
+      best = cand;
+      best_cost = cost;
+      best_fits = 1;
+    }
+  }
+
+  w = wisdom_new((INT)d);
+  w->M = (INT)M;
+  w->eps = eps;
+  w->memory = memory;
+  w->window = best.window;
+  w->m = best.m;
+  w->flags = planner_flags((INT)d, best.psi);
+
+  for (t = 0; t < d; t++)
+  {
+    w->N[t] = NN[t];
+    w->N[d + t] = planner_n(NN[t], best.sigma, best.m);
+    n_int[t] = (int)w->N[d + t];
+  }
+
+  /* The pruned FFT needs fewer flops, but FFTW's own multi-dimensional
+   * plans may still be faster when measured. */
+  if (d > 1)
+  {
+    if (fftw_flags & FFTW_ESTIMATE)
+      w->flags |= NFFT_PRUNED_FFT;
+    else if (best_fits && planner_measure(d, N, (INT)M, n_int, best.m,
+      best.window, w->flags | NFFT_PRUNED_FFT, fftw_flags) < best_cost)
+      w->flags |= NFFT_PRUNED_FFT;
+  }
+
+  X(init_guru_window)(ths, d, N, M, n_int, (int)w->m, w->window, w->flags,
+    fftw_flags);
+
+  /* timed decisions are worth keeping, estimates are cheap to repeat */
+  if (fftw_flags & FFTW_ESTIMATE)
+    wisdom_free(w);
+  else
+    wisdom_add(w);
+}
+
+/** Prints the wisdom into s of length len, or only counts the characters for
+ *  s = NULL. Returns the length without the terminating zero. The caller
+ *  holds the wisdom lock. */
+static size_t wisdom_print(char *s, const size_t len)
+{
+  const wisdom *w;
+  size_t pos = 0;
+
+  pos += (size_t)snprintf(s ? s + pos : NULL, s ? len - pos : 0,
+    WISDOM_HEADER " %d\n", (int)sizeof(R));
+
+  for (w = wisdom_list; w; w = w->next)
+  {
+    INT t;
+
+    pos += (size_t)snprintf(s ? s + pos : NULL, s ? len - pos : 0,
+      " (" __D__ " " __D__ " %.17g %lu %u " __D__ " %u", w->d, w->M, w->eps,
+      (unsigned long)w->memory, w->window, w->m, w->flags);
+
+    for (t = 0; t < 2 * w->d; t++)
+      pos += (size_t)snprintf(s ? s + pos : NULL, s ? len - pos : 0,
+        " " __D__, w->N[t]);
+
+    pos += (size_t)snprintf(s ? s + pos : NULL, s ? len - pos : 0, ")\n");
+  }
+
+  pos += (size_t)snprintf(s ? s + pos : NULL, s ? len - pos : 0, ")\n");
+
+  return pos;
+}
+
+char *X(export_wisdom_to_string)(void)
+{
+  char *s;
+
+  /* one critical section for both passes, so that the list cannot grow
+   * between computing the length and writing */
+#ifdef _OPENMP
+  #pragma omp critical (nfft_omp_critical_wisdom)
+#endif
+  {
+    const size_t len = wisdom_print(NULL, 0) + 1;
+
+    s = (char*) Y(malloc)(len);
+    wisdom_print(s, len);
+  }
+
+  return s;
+}
+
+int X(import_wisdom_from_string)(const char *s)
+{
+  wisdom *list = NULL, *last = NULL;
+  const char *p = s;
+  char *end;
+  INT t;
+  long size;
+
+  if (strncmp(p, WISDOM_HEADER, strlen(WISDOM_HEADER)) != 0)
+    return 0;
+
+  p += strlen(WISDOM_HEADER);
+  size = strtol(p, &end, 10);
+
+  if (end == p || size != (long)sizeof(R))
+    return 0;
+
+  for (p = end; ; )
+  {
+    wisdom *w;
+    long d;
+
+    while (*p == ' ' || *p == '\n' || *p == '\t')
+      p++;
+
+    if (*p == ')')
+      break;
+
+    if (*p != '(')
+      goto fail;
+
+    d = strtol(++p, &end, 10);
+    if (end == p || d < 1)
+      goto fail;
+
+    w = wisdom_new((INT)d);
+
+    if (last)
+      last->next = w;
+    else
+      list = w;
+    last = w;
+
+    p = end;
+    w->M = (INT)strtol(p, &end, 10);
+    if (end == p)
+      goto fail;
+    p = end;
+    w->eps = strtod(p, &end);
+    if (end == p)
+      goto fail;
+    p = end;
+    w->memory = (size_t)strtoul(p, &end, 10);
+    if (end == p)
+      goto fail;
+    p = end;
+    w->window = (unsigned)strtoul(p, &end, 10);
+    if (end == p)
+      goto fail;
+    p = end;
+    w->m = (INT)strtol(p, &end, 10);
+    if (end == p)
+      goto fail;
+    p = end;
+    w->flags = (unsigned)strtoul(p, &end, 10);
+    if (end == p)
+      goto fail;
+
+    for (t = 0, p = end; t < 2 * w->d; t++, p = end)
+    {
+      w->N[t] = (INT)strtol(p, &end, 10);
+      if (end == p)
+        goto fail;
+    }
+
+    while (*p == ' ')
+      p++;
+
+    if (*p++ != ')')
+      goto fail;
+  }
+
+  /* prepend in the stored order */
+  if (last)
+  {
+#ifdef _OPENMP
+    #pragma omp critical (nfft_omp_critical_wisdom)
+#endif
+    {
+      last->next = wisdom_list;
+      wisdom_list = list;
+    }
+  }
+
+  return 1;
+
+fail:
+  wisdom_free(list);
+  return 0;
+}
+
+void X(forget_wisdom)(void)
+{
+  wisdom *list;
+
+#ifdef _OPENMP
+  #pragma omp critical (nfft_omp_critical_wisdom)
+#endif
+  {
+    list = wisdom_list;
+    wisdom_list = NULL;
+  }
+
+  wisdom_free(list);
+}
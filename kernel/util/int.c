@@ -131,6 +131,37 @@ INT Y(next_power_of_2)(const INT x)
     }
 }
 
+/**
+ * Return the smallest even integer larger or equal to the input that has no
+ * prime factors other than 2, 3 and 5. Such lengths are handled efficiently
+ * by FFTW. If the input is negative, this method returns -1.
+ */
+INT Y(next_fft_size)(const INT x)
+{
+  INT p5, p3, best;
+
+  if (x < 0)
+    return -1;
+  else if (x <= 2)
+    return 2;
+
+  best = Y(next_power_of_2)(x);
+
+  for (p5 = 1; p5 < best; p5 *= 5)
+    for (p3 = p5; p3 < best; p3 *= 3)
+    {
+      INT n = 2 * p3;
+
+      while (n < x)
+        n *= 2;
+
+      if (n < best)
+        best = n;
+    }
+
+  return best;
+}
+
 /** Computes /f$n\ge N/f$ such that /f$n=2^j,\, j\in\mathhb{N}_0/f$.
  */
 void Y(next_power_of_2_exp)(const INT N, INT *N2, INT *t)
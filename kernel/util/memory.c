@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2002, 2017 Jens Keiner, Stefan Kunis, Daniel Potts
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Placement of large buffers: NUMA interleaving, huge pages and first touch
+ * by the threads that use them. Each part is a hint, the functions report
+ * which parts took effect. */
+
+#include "api.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#if defined(HAVE_LINUX_MEMPOLICY_H) && defined(HAVE_SYS_SYSCALL_H)
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#if defined(SYS_mbind) && defined(SYS_get_mempolicy)
+#define HAVE_MBIND 1
+#endif
+#endif
+
+/** Size of a huge page. */
+#define HUGE_PAGE ((size_t)2 << 20)
+
+static size_t page_size(void)
+{
+#if defined(HAVE_UNISTD_H) && defined(_SC_PAGESIZE)
+  return (size_t)sysconf(_SC_PAGESIZE);
+#else
+  return (size_t)4096;
+#endif
+}
+
+/** Round p up and p + n down to multiples of align, returns the length of
+ *  the range in between. */
+static size_t aligned_range(void *p, const size_t n, const size_t align,
+  char **lo)
+{
+  const uintptr_t a = ((uintptr_t)p + align - 1) & ~(uintptr_t)(align - 1),
+    b = ((uintptr_t)p + n) & ~(uintptr_t)(align - 1);
+
+  *lo = (char*)a;
+  return b > a ? (size_t)(b - a) : 0;
+}
+
+#ifdef HAVE_MBIND
+/** Interleave the pages of the range over the NUMA nodes the process may
+ *  use, if there are at least two. Pages already faulted in are migrated. */
+static int interleave(char *lo, const size_t len)
+{
+  unsigned long mask[16];
+  const unsigned long maxnode = (unsigned long)(8 * sizeof(mask));
+  size_t k;
+  int nodes = 0;
+
+  if (syscall(SYS_get_mempolicy, NULL, mask, maxnode, NULL, MPOL_F_MEMS_ALLOWED))
+    return 0;
+
+  for (k = 0; k < SIZE(mask); k++)
+    nodes += __builtin_popcountl(mask[k]);
+
+  if (nodes < 2)
+    return 0;
+
+  return syscall(SYS_mbind, lo, len, MPOL_INTERLEAVE, mask, maxnode,
+    MPOL_MF_MOVE) == 0;
+}
+#endif
+
+/** Write one byte of every page with the threads of the calling task in
+ *  contiguous chunks, as a static OpenMP schedule over the buffer assigns
+ *  them. The contents are kept. */
+#ifdef _OPENMP
+static void first_touch(char *lo, const size_t len, const size_t page)
+{
+  const INT pages = (INT)(len / page);
+  INT k;
+
+  #pragma omp parallel for default(shared) private(k) schedule(static)
+  for (k = 0; k < pages; k++)
+  {
+    volatile char *q = lo + (size_t)k * page;
+    *q = *q;
+  }
+}
+#endif
+
+unsigned Y(memory_policy_apply)(void *p, const size_t n, const unsigned policy)
+{
+  const size_t page = page_size();
+  unsigned applied = 0;
+  char *lo;
+  size_t len = aligned_range(p, n, page, &lo);
+
+  if (len == 0)
+    return 0;
+
+#ifdef HAVE_MBIND
+  if ((policy & NFFT_MEMORY_INTERLEAVE) && interleave(lo, len))
+    applied |= NFFT_MEMORY_INTERLEAVE;
+#endif
+
+#if defined(HAVE_MADVISE) && defined(MADV_HUGEPAGE)
+  if (policy & NFFT_MEMORY_HUGE_PAGES)
+  {
+    char *lo2;
+    const size_t len2 = aligned_range(p, n, HUGE_PAGE, &lo2);
+
+    if (len2 > 0 && madvise(lo2, len2, MADV_HUGEPAGE) == 0)
+      applied |= NFFT_MEMORY_HUGE_PAGES;
+  }
+#endif
+
+#ifdef _OPENMP
+  if (policy & NFFT_MEMORY_FIRST_TOUCH)
+  {
+    first_touch(lo, len, page);
+    applied |= NFFT_MEMORY_FIRST_TOUCH;
+  }
+#endif
+
+  return applied;
+}
+
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_HUGETLB)
+/** Size of the mapping for n bytes in huge pages. */
+static size_t huge_size(const size_t n)
+{
+  return (n + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+}
+#endif
+
+void *Y(malloc_huge)(const size_t n)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_HUGETLB)
+  void *p;
+
+  /* a custom allocator is not bypassed */
+  if (Y(malloc_hook) || n == 0)
+    return NULL;
+
+  p = mmap(NULL, huge_size(n), PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+  return p == MAP_FAILED ? NULL : p;
+#else
+  UNUSED(n);
+  return NULL;
+#endif
+}
+
+void Y(free_huge)(void *p, const size_t n)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_HUGETLB)
+  if (p)
+    munmap(p, huge_size(n));
+#else
+  UNUSED(p);
+  UNUSED(n);
+#endif
+}
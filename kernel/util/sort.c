@@ -105,7 +105,7 @@ void Y(sort_node_indices_radix_lsdf)(INT n, INT *keys0, INT *keys1, INT rhigh)
   INT i, k, l, h;
   INT *lcounts;
 
-  INT tid = 0, tnum = 1;
+  INT tid = 0, tnum = 1, tused = 1;
 
   STACK_MALLOC(INT*, lcounts, (size_t)(tmax * radix_n) * sizeof(INT));
 
@@ -119,6 +119,9 @@ void Y(sort_node_indices_radix_lsdf)(INT n, INT *keys0, INT *keys1, INT rhigh)
     {
       tid = omp_get_thread_num();
       tnum = omp_get_num_threads();
+
+      /* the team may be smaller than tmax, e.g. inside a parallel region */
+      if (tid == 0) tused = tnum;
 #endif
 
       for (i = 0; i < radix_n; ++i) lcounts[tid * radix_n + i] = 0;
@@ -134,11 +137,11 @@ void Y(sort_node_indices_radix_lsdf)(INT n, INT *keys0, INT *keys1, INT rhigh)
     k = 0;
     for (i = 0; i < radix_n; ++i)
     {
-      for (l = 0; l < tmax; ++l) lcounts[l * radix_n + i] = (k += lcounts[l * radix_n + i]) - lcounts[l * radix_n + i];
+      for (l = 0; l < tused; ++l) lcounts[l * radix_n + i] = (k += lcounts[l * radix_n + i]) - lcounts[l * radix_n + i];
     }
 
 #ifdef _OPENMP
-    #pragma omp parallel private(tid, tnum, i, l, h)
+    #pragma omp parallel num_threads(tused) private(tid, tnum, i, l, h)
     {
       tid = omp_get_thread_num();
       tnum = omp_get_num_threads();
@@ -187,7 +190,7 @@ void Y(sort_node_indices_radix_msdf)(INT n, INT *keys0, INT *keys1, INT rhigh)
 
   INT counts[radix_n], displs[radix_n];
 
-  INT tid = 0, tnum = 1;
+  INT tid = 0, tnum = 1, tused = 1;
 
   STACK_MALLOC(INT*, lcounts, (size_t)(tmax * radix_n) * sizeof(INT));
 
@@ -198,6 +201,9 @@ void Y(sort_node_indices_radix_msdf)(INT n, INT *keys0, INT *keys1, INT rhigh)
   {
     tid = omp_get_thread_num();
     tnum = omp_get_num_threads();
+
+    /* the team may be smaller than tmax, e.g. inside a parallel region */
+    if (tid == 0) tused = tnum;
 #endif
 
     for (i = 0; i < radix_n; ++i) lcounts[tid * radix_n + i] = 0;
@@ -213,7 +219,7 @@ void Y(sort_node_indices_radix_msdf)(INT n, INT *keys0, INT *keys1, INT rhigh)
   k = 0;
   for (i = 0; i < radix_n; ++i)
   {
-    for (l = 0; l < tmax; ++l) lcounts[l * radix_n + i] = (k += lcounts[l * radix_n + i]) - lcounts[l * radix_n + i];
+    for (l = 0; l < tused; ++l) lcounts[l * radix_n + i] = (k += lcounts[l * radix_n + i]) - lcounts[l * radix_n + i];
 
     displs[i] = lcounts[0 * radix_n + i];
     if (i > 0) counts[i - 1] = displs[i] - displs[i - 1];
@@ -221,7 +227,7 @@ void Y(sort_node_indices_radix_msdf)(INT n, INT *keys0, INT *keys1, INT rhigh)
   counts[radix_n - 1] = n - displs[radix_n - 1];
 
 #ifdef _OPENMP
-  #pragma omp parallel private(tid, tnum, i, l, h)
+  #pragma omp parallel num_threads(tused) private(tid, tnum, i, l, h)
   {
     tid = omp_get_thread_num();
     tnum = omp_get_num_threads();
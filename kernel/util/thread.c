@@ -16,12 +16,19 @@
  * Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
-#include "infft.h"
+/* CPU_SET and sched_setaffinity */
+#define _GNU_SOURCE
+
+#include "api.h"
 
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
+
 INT Y(get_num_threads)(void)
 {
 #ifdef _OPENMP
@@ -57,3 +64,74 @@ INT Y(has_threads_enabled)(void)
 #endif
 }
 
+void Y(pin_thread)(const int cpu)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+  cpu_set_t set;
+
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  sched_setaffinity(0, sizeof(set), &set);
+#else
+  UNUSED(cpu);
+#endif
+}
+
+void *Y(pin_threads)(const int *cpus, const int nthreads)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+  cpu_set_t *saved = (cpu_set_t*) Y(malloc)((size_t)(nthreads) * sizeof(cpu_set_t));
+
+  /* an empty set marks a thread that was not in the team */
+  memset(saved, 0, (size_t)(nthreads) * sizeof(cpu_set_t));
+
+#ifdef _OPENMP
+  #pragma omp parallel default(shared) num_threads(nthreads)
+#endif
+  {
+#ifdef _OPENMP
+    const int t = omp_get_thread_num();
+#else
+    const int t = 0;
+#endif
+
+    sched_getaffinity(0, sizeof(cpu_set_t), &saved[t]);
+    Y(pin_thread)(cpus[t]);
+  }
+
+  return saved;
+#else
+  UNUSED(cpus);
+  UNUSED(nthreads);
+  return NULL;
+#endif
+}
+
+void Y(unpin_threads)(void *saved, const int nthreads)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+  cpu_set_t *set = (cpu_set_t*) saved;
+
+  if (!set)
+    return;
+
+#ifdef _OPENMP
+  #pragma omp parallel default(shared) num_threads(nthreads)
+#endif
+  {
+#ifdef _OPENMP
+    const int t = omp_get_thread_num();
+#else
+    const int t = 0;
+#endif
+
+    if (CPU_COUNT(&set[t]) > 0)
+      sched_setaffinity(0, sizeof(cpu_set_t), &set[t]);
+  }
+
+  Y(free)(set);
+#else
+  UNUSED(saved);
+  UNUSED(nthreads);
+#endif
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2002, 2017 Jens Keiner, Stefan Kunis, Daniel Potts
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Library-wide FFTW wisdom file. The wisdom is imported once, before the
+ * first FFTW plan of any module, and exported on demand. */
+
+#include "infft.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(NFFT_SINGLE)
+#define WISDOM_ENV "NFFTF_WISDOM_FILE"
+#elif defined(NFFT_LDOUBLE)
+#define WISDOM_ENV "NFFTL_WISDOM_FILE"
+#else
+#define WISDOM_ENV "NFFT_WISDOM_FILE"
+#endif
+
+/** Name of the wisdom file, NULL for none. */
+static char *wisdom_file = NULL;
+
+/** Whether the environment variable has been read. */
+static int wisdom_env_read = 0;
+
+/** Whether the wisdom file has been imported. */
+static int wisdom_loaded = 0;
+
+static void wisdom_set(const char *filename)
+{
+  free(wisdom_file);
+  wisdom_file = NULL;
+
+  if (filename && filename[0])
+  {
+    wisdom_file = (char*) malloc(strlen(filename) + 1);
+    strcpy(wisdom_file, filename);
+  }
+
+  wisdom_loaded = 0;
+}
+
+void Y(set_fftw_wisdom_file)(const char *filename)
+{
+#ifdef _OPENMP
+  #pragma omp critical (nfft_omp_critical_fftw_plan)
+#endif
+  {
+    wisdom_env_read = 1;
+    wisdom_set(filename);
+  }
+}
+
+void Y(load_fftw_wisdom)(void)
+{
+#ifdef _OPENMP
+  #pragma omp critical (nfft_omp_critical_fftw_plan)
+#endif
+  {
+    if (!wisdom_env_read)
+    {
+      wisdom_env_read = 1;
+      wisdom_set(getenv(WISDOM_ENV));
+    }
+
+    if (!wisdom_loaded)
+    {
+      /* a missing file is not an error, it is written by the first export */
+      if (wisdom_file)
+        FFTW(import_wisdom_from_filename)(wisdom_file);
+
+      wisdom_loaded = 1;
+    }
+  }
+}
+
+int Y(export_fftw_wisdom)(void)
+{
+  int ok = 0;
+
+  /* the file has to hold the wisdom it had before, plus the new one */
+  Y(load_fftw_wisdom)();
+
+#ifdef _OPENMP
+  #pragma omp critical (nfft_omp_critical_fftw_plan)
+#endif
+  {
+    if (wisdom_file)
+      ok = FFTW(export_wisdom_to_filename)(wisdom_file);
+  }
+
+  return ok;
+}
@@ -26,5 +26,6 @@
 %   PRE_FULL_PSI        - Precomputation flag
 %   PRE_LIN_PSI         - Precomputation flag
 %   PRE_PHI_HUT         - Precomputation flag
+%   PRE_POLY_PSI        - Precomputation flag
 %   PRE_PSI             - Precomputation flag
 %   simple_test         - Example program: Basic usage principles
@@ -0,0 +1,24 @@
+%NFFT_OMP_TILED_ADJOINT Flag which results in usage of a tiled algorithm in adjoint NFFT.
+%   Nodes are spread into private tiles of the oversampled grid, so that the
+%   adjoint NFFT with OpenMP support needs no atomic operations and its result
+%   does not depend on the number of threads.
+%   Copyright (c) 2002, 2017 Jens Keiner, Stefan Kunis, Daniel Potts
+
+% Copyright (c) 2002, 2017 Jens Keiner, Stefan Kunis, Daniel Potts
+%
+% This program is free software; you can redistribute it and/or modify it under
+% the terms of the GNU General Public License as published by the Free Software
+% Foundation; either version 2 of the License, or (at your option) any later
+% version.
+%
+% This program is distributed in the hope that it will be useful, but WITHOUT
+% ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+% FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+% details.
+%
+% You should have received a copy of the GNU General Public License along with
+% this program; if not, write to the Free Software Foundation, Inc., 51
+% Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+function f = NFFT_OMP_TILED_ADJOINT()
+
+f = bitshift(1, 13);
@@ -0,0 +1,24 @@
+%NFFT_PRUNED_FFT FFT flag
+%   If this flag is set, the FFT skips the zero padded part of the oversampled
+%   grid in all but the last transformed dimension.
+%
+%   Copyright (c) 2002, 2017 Jens Keiner, Stefan Kunis, Daniel Potts
+
+% Copyright (c) 2002, 2017 Jens Keiner, Stefan Kunis, Daniel Potts
+%
+% This program is free software; you can redistribute it and/or modify it under
+% the terms of the GNU General Public License as published by the Free Software
+% Foundation; either version 2 of the License, or (at your option) any later
+% version.
+%
+% This program is distributed in the hope that it will be useful, but WITHOUT
+% ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+% FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+% details.
+%
+% You should have received a copy of the GNU General Public License along with
+% this program; if not, write to the Free Software Foundation, Inc., 51
+% Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+function f = NFFT_PRUNED_FFT()
+
+f = bitshift(1, 15);
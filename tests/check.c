@@ -48,6 +48,7 @@ int main(void)
   CU_add_test(util, "window_name", X(check_get_window_name));
   CU_add_test(util, "log2i", X(check_log2i));
   CU_add_test(util, "next_power_of_2", X(check_next_power_of_2));
+  CU_add_test(util, "next_fft_size", X(check_next_fft_size));
 
 #undef X
 #define X(name) NFFT(name)
@@ -70,6 +71,26 @@ int main(void)
   CU_add_test(nfft, "nfft_3d_fast_file", X(check_3d_fast_file));
   CU_add_test(nfft, "nfft_adjoint_3d_direct_file", X(check_adjoint_3d_direct_file));
   CU_add_test(nfft, "nfft_adjoint_3d_fast_file", X(check_adjoint_3d_fast_file));
+  CU_add_test(nfft, "nfft_many_vectors", X(check_many_vectors));
+  CU_add_test(nfft, "nfft_psi_float", X(check_psi_float));
+  CU_add_test(nfft, "nfft_ghost_cells", X(check_ghost_cells));
+  CU_add_test(nfft, "nfft_fixed_kernels", X(check_fixed_kernels));
+  CU_add_test(nfft, "nfft_adjoint_tiled", X(check_adjoint_tiled));
+  CU_add_test(nfft, "nfft_init_tol", X(check_init_tol));
+  CU_add_test(nfft, "nfft_real", X(check_real));
+  CU_add_test(nfft, "nfft_reorder_nodes", X(check_reorder_nodes));
+  CU_add_test(nfft, "nfft_execute", X(check_execute));
+  CU_add_test(nfft, "nfft_set_nodes", X(check_set_nodes));
+  CU_add_test(nfft, "nfft_shared_fftw", X(check_shared_fftw));
+  CU_add_test(nfft, "nfft_fftw_wisdom", X(check_fftw_wisdom));
+  CU_add_test(nfft, "nfft_set_threads", X(check_set_threads));
+  CU_add_test(nfft, "nfft_fft_order", X(check_fft_order));
+  CU_add_test(nfft, "nfft_zero_padding", X(check_zero_padding));
+  CU_add_test(nfft, "nfft_memory_policy", X(check_memory_policy));
+  CU_add_test(nfft, "nfft_simd", X(check_simd));
+  CU_add_test(nfft, "nfft_spread_interp", X(check_spread_interp));
+  CU_add_test(nfft, "nfft_pipeline", X(check_pipeline));
+  CU_add_test(nfft, "nfft_node_sets", X(check_node_sets));
 #ifdef NFFT_EXHAUSTIVE_UNIT_TESTS
   CU_add_test(nfft, "nfft_3d_online", X(check_3d_online));
   CU_add_test(nfft, "nfft_adjoint_3d_online", X(check_adjoint_3d_online));
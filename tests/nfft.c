@@ -16,14 +16,21 @@
  * Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+/* CPU_SET and sched_getaffinity */
+#define _GNU_SOURCE
+
 /* Standard headers. */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <complex.h>
 #include <CUnit/CUnit.h>
 
 #include "config.h"
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
 #include "nfft3.h"
 #include "infft.h"
 #include "cycle.h"
@@ -127,6 +134,8 @@ static void init_2d_(init_delegate_t *ego, X(plan) *p, const int d, const int *N
 static void init_3d_(init_delegate_t *ego, X(plan) *p, const int d, const int *N, const int M);
 static void init_(init_delegate_t *ego, X(plan) *p, const int d, const int *N, const int M);
 static void init_advanced_pre_psi_(init_delegate_t *ego, X(plan) *p, const int d, const int *N, const int M);
+static void init_advanced_es_(init_delegate_t *ego, X(plan) *p, const int d, const int *N, const int M);
+static void init_sigma_(init_delegate_t *ego, X(plan) *p, const int d, const int *N, const int M);
 
 #define DEFAULT_NFFT_FLAGS MALLOC_X | MALLOC_F | MALLOC_F_HAT | FFTW_INIT | FFT_OUT_OF_PLACE
 #define DEFAULT_FFTW_FLAGS FFTW_ESTIMATE | FFTW_DESTROY_INPUT
@@ -141,6 +150,11 @@ static init_delegate_t init_advanced_pre_lin_psi;
 #if defined(GAUSSIAN)
 static init_delegate_t init_advanced_pre_fg_psi;
 #endif
+static init_delegate_t init_advanced_es_pre_psi;
+static init_delegate_t init_advanced_pre_psi_tiled;
+static init_delegate_t init_advanced_pre_psi_pruned;
+static init_delegate_t init_advanced_pre_poly_psi;
+static init_delegate_t init_sigma;
 
 static check_delegate_t check_trafo;
 static check_delegate_t check_adjoint;
@@ -223,8 +237,27 @@ static R err_trafo(X(plan) *p)
   R eps = Y(float_property)(NFFT_EPSILON);
   R err;
   int i;
+  /* window values stored in single precision */
+  if (p->flags & NFFT_PSI_FLOAT)
+    eps = FMAX(eps, (R)FLT_EPSILON);
   for (i = 0, s = ((R)p->sigma[0]); i < p->d; i++)
     s = FMIN(s, ((R)p->sigma[i]));
+  if (p->window == NFFT_WINDOW_ES)
+  {
+    /* Same decay as Kaiser-Bessel, with a somewhat larger constant. */
+#if defined(NFFT_LDOUBLE)
+    a = K(6.0);
+    b = K(50.0);
+#elif defined(NFFT_SINGLE)
+    a = K(1.6);
+    b = K(2000.0);
+#else
+    a = K(1.2);
+    b = K(2100.0);
+#endif
+    err = KPI * (SQRT(m) + m) * SQRT(SQRT(K(1.0) - K(1.0)/K(2.0))) * EXP(-K2PI * m * SQRT(K(1.0) - K(1.0) / K(2.0)));
+    return FMAX(FMAX(a * err, b * eps), err_trafo_direct(p));
+  }
 #if defined(GAUSSIAN)
 #if defined(NFFT_LDOUBLE)
     a = K(0.6);
@@ -280,6 +313,23 @@ static R err_trafo(X(plan) *p)
     #error Unsupported window function.
   #endif
 
+  /* For oversampling below 2, rounding errors are amplified by the range of
+   * the deconvolution factors. */
+  if (s < K(2.0) && (p->flags & PRE_PHI_HUT))
+  {
+    int k;
+    for (i = 0; i < p->d; i++)
+    {
+      R lo = FABS(p->c_phi_inv[i][0]), hi = lo;
+      for (k = 1; k < p->N[i]; k++)
+      {
+        lo = FMIN(lo, FABS(p->c_phi_inv[i][k]));
+        hi = FMAX(hi, FABS(p->c_phi_inv[i][k]));
+      }
+      b *= hi / lo;
+    }
+  }
+
   return FMAX(FMAX(a * err, b * eps), err_trafo_direct(p));
 }
 
@@ -666,6 +716,12 @@ static void init_(init_delegate_t *ego, X(plan) *p, const int d, const int *N, c
   X(init)(p, d, N, M);
 }
 
+static void init_sigma_(init_delegate_t *ego, X(plan) *p, const int d, const int *N, const int M)
+{
+  UNUSED(ego);
+  X(init_sigma)(p, d, N, M, 1.25);
+}
+
 static void init_advanced_pre_psi_(init_delegate_t *ego, X(plan) *p, const int d, const int *N, const int M)
 {
   int *n = Y(malloc)((size_t)(d)*sizeof(int));
@@ -676,6 +732,16 @@ static void init_advanced_pre_psi_(init_delegate_t *ego, X(plan) *p, const int d
   Y(free)(n);
 }
 
+static void init_advanced_es_(init_delegate_t *ego, X(plan) *p, const int d, const int *N, const int M)
+{
+  int *n = Y(malloc)((size_t)(d)*sizeof(int));
+  int i;
+  for (i = 0; i < d; i++)
+    n[i] = 2 * (int)(Y(next_power_of_2)(N[i]));
+  X(init_guru_window)(p, d, N, M, n, ego->m, NFFT_WINDOW_ES, ego->flags, ego->fftw_flags);
+  Y(free)(n);
+}
+
 //static void init_advanced_pre_lin_psi_(init_delegate_t *ego, X(plan) *p, const int d, const int *N, const int M)
 //{
 //  int *n = Y(malloc)((size_t)(d)*sizeof(int));
@@ -706,6 +772,11 @@ static init_delegate_t init_advanced_pre_lin_psi = {"init_guru (PRE LIN PSI)", i
 #if defined(GAUSSIAN)
 static init_delegate_t init_advanced_pre_fg_psi = {"init_guru (PRE FG PSI)", init_advanced_pre_psi_, WINDOW_HELP_ESTIMATE_m, PRE_PHI_HUT | FG_PSI | PRE_FG_PSI | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS};
 #endif
+static init_delegate_t init_advanced_es_pre_psi = {"init_guru_window (ES PRE PSI)", init_advanced_es_, WINDOW_HELP_ESTIMATE_m, PRE_PHI_HUT | PRE_PSI | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS};
+static init_delegate_t init_advanced_pre_psi_tiled = {"init_guru (PRE PSI TILED)", init_advanced_pre_psi_, WINDOW_HELP_ESTIMATE_m, PRE_PHI_HUT | PRE_PSI | NFFT_OMP_TILED_ADJOINT | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS};
+static init_delegate_t init_advanced_pre_psi_pruned = {"init_guru (PRE PSI PRUNED)", init_advanced_pre_psi_, WINDOW_HELP_ESTIMATE_m, PRE_PHI_HUT | PRE_PSI | NFFT_PRUNED_FFT | MALLOC_X | MALLOC_F | MALLOC_F_HAT | FFTW_INIT, DEFAULT_FFTW_FLAGS};
+static init_delegate_t init_advanced_pre_poly_psi = {"init_guru (PRE POLY PSI)", init_advanced_pre_psi_, WINDOW_HELP_ESTIMATE_m, PRE_PHI_HUT | PRE_POLY_PSI | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS};
+static init_delegate_t init_sigma = {"init_sigma (1.25)", init_sigma_, 0, 0, 0};
 
 /* Check routines. */
 static void prepare_trafo(check_delegate_t *ego, X(plan) *p, const int NN, const int M, const C *f, const C *f_hat)
@@ -820,6 +891,10 @@ static const init_delegate_t* initializers_1d[] =
 #if defined(GAUSSIAN)
   &init_advanced_pre_fg_psi,
 #endif
+  &init_advanced_es_pre_psi,
+  &init_advanced_pre_psi_tiled,
+  &init_advanced_pre_poly_psi,
+  &init_sigma,
 };
 
 static const testcase_delegate_file_t nfft_1d_1_1 = {setup_file, destroy_file, ABSPATH("data/nfft_1d_1_1.txt")};
@@ -1046,6 +1121,11 @@ static const init_delegate_t* initializers_2d[] =
 #if defined(GAUSSIAN)
   &init_advanced_pre_fg_psi,
 #endif
+  &init_advanced_es_pre_psi,
+  &init_advanced_pre_psi_tiled,
+  &init_advanced_pre_psi_pruned,
+  &init_advanced_pre_poly_psi,
+  &init_sigma,
 };
 
 static const testcase_delegate_file_t nfft_2d_10_10_20 = {setup_file,destroy_file,ABSPATH("data/nfft_2d_10_10_20.txt")};
@@ -1196,6 +1276,11 @@ static const init_delegate_t* initializers_3d[] =
 #if defined(GAUSSIAN)
   &init_advanced_pre_fg_psi,
 #endif
+  &init_advanced_es_pre_psi,
+  &init_advanced_pre_psi_tiled,
+  &init_advanced_pre_psi_pruned,
+  &init_advanced_pre_poly_psi,
+  &init_sigma,
 };
 
 static const testcase_delegate_file_t nfft_3d_10_10_10_10 = {setup_file,destroy_file,ABSPATH("data/nfft_3d_10_10_10_10.txt")};
@@ -1299,6 +1384,11 @@ static const init_delegate_t* initializers_4d[] =
 #if defined(GAUSSIAN)
   &init_advanced_pre_fg_psi,
 #endif
+  &init_advanced_es_pre_psi,
+  &init_advanced_pre_psi_tiled,
+  &init_advanced_pre_psi_pruned,
+  &init_advanced_pre_poly_psi,
+  &init_sigma,
 };
 
 #ifdef NFFT_EXHAUSTIVE_UNIT_TESTS
@@ -1333,6 +1423,1681 @@ void X(check_adjoint_4d_online)(void)
 }
 #endif
 
+/* batched transforms */
+
+/** Compares the transform of the plan, whose nodes are set, for each of its
+ *  howmany vectors with the direct one. */
+static int check_many_vectors_plan(X(plan) *p, const int adjoint)
+{
+  const int howmany = (int)p->howmany;
+  int j, k, ok = 1;
+  C *ref;
+
+  if (p->flags & PRE_ONE_PSI)
+    X(precompute_one_psi)(p);
+
+  if (adjoint)
+  {
+    Y(vrand_unit_complex)(p->f, p->M_total * howmany);
+    X(adjoint_direct)(p);
+    ref = Y(malloc)((size_t)(p->N_total * howmany) * sizeof(C));
+    memcpy(ref, p->f_hat, (size_t)(p->N_total * howmany) * sizeof(C));
+    X(adjoint)(p);
+  }
+  else
+  {
+    Y(vrand_unit_complex)(p->f_hat, p->N_total * howmany);
+    X(trafo_direct)(p);
+    ref = Y(malloc)((size_t)(p->M_total * howmany) * sizeof(C));
+    memcpy(ref, p->f, (size_t)(p->M_total * howmany) * sizeof(C));
+    X(trafo)(p);
+  }
+
+  for (k = 0; k < howmany; k++)
+  {
+    const INT len = adjoint ? p->N_total : p->M_total;
+    const C *in = adjoint ? p->f + k * p->M_total : p->f_hat + k * p->N_total;
+    const C *out = adjoint ? p->f_hat + k * p->N_total : p->f + k * p->M_total;
+    const INT len_in = adjoint ? p->M_total : p->N_total;
+    R numerator = K(0.0), denominator = K(0.0), err, bound;
+
+    for (j = 0; j < len; j++)
+      numerator = MAX(numerator, CABS(ref[k * len + j] - out[j]));
+
+    for (j = 0; j < len_in; j++)
+      denominator += CABS(in[j]);
+
+    err = numerator / denominator;
+    bound = err_trafo(p);
+
+    printf("nfft_many d = %d, N = %-3d, M = %-4d, m = %-2d, howmany = %d, vector %d, %-7s -> %-4s " __FE__ " (" __FE__ ")\n",
+      (int)p->d, (int)p->N[0], (int)p->M_total, (int)p->m, howmany, k,
+      adjoint ? "adjoint" : "trafo", IF(err < bound, "OK", "FAIL"), err, bound);
+
+    if (!(err < bound))
+      ok = 0;
+  }
+
+  Y(free)(ref);
+
+  return ok;
+}
+
+static void init_many_vectors(X(plan) *p, const int d, const int N,
+  const int M, const int m, const int howmany, const unsigned flags)
+{
+  int NN[d], n[d], t;
+
+  for (t = 0; t < d; t++)
+  {
+    NN[t] = N;
+    n[t] = 2 * (int)(Y(next_power_of_2)(N));
+  }
+
+  X(init_guru_many)(p, d, NN, M, n, m, howmany,
+    NFFT_WINDOW_DEFAULT, flags | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS);
+
+  Y(vrand_shifted_unit_double)(p->x, p->d * p->M_total);
+}
+
+static int check_many_vectors_single(const int d, const int N, const int M,
+  const int howmany, const unsigned flags, const int adjoint)
+{
+  X(plan) p;
+  int ok;
+
+  init_many_vectors(&p, d, N, M, WINDOW_HELP_ESTIMATE_m, howmany, flags);
+  ok = check_many_vectors_plan(&p, adjoint);
+  X(finalize)(&p);
+
+  return ok;
+}
+
+void X(check_many_vectors)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI, PRE_PHI_HUT | PRE_FULL_PSI,
+    PRE_PHI_HUT | PRE_PSI | NFFT_SORT_NODES, PRE_PHI_HUT | PRE_POLY_PSI, PRE_PHI_HUT,
+    PRE_PHI_HUT | PRE_PSI | NFFT_PRUNED_FFT};
+  int d, i, adjoint;
+
+  for (d = 1; d <= 3; d++)
+    for (i = 0; i < (int)SIZE(flags); i++)
+      for (adjoint = 0; adjoint <= 1; adjoint++)
+        CU_ASSERT(check_many_vectors_single(d, d == 3 ? 20 : 40, 100, 5, flags[i], adjoint));
+}
+
+/* window values and grid indices stored in reduced precision */
+
+void X(check_psi_float)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI | NFFT_PSI_FLOAT,
+    PRE_PHI_HUT | PRE_FULL_PSI | NFFT_PSI_FLOAT, PRE_PHI_HUT | PRE_FULL_PSI | NFFT_PSI_INDEX_32,
+    PRE_PHI_HUT | PRE_FULL_PSI | NFFT_PSI_FLOAT | NFFT_PSI_INDEX_32,
+    PRE_PHI_HUT | PRE_PSI | NFFT_PSI_FLOAT | NFFT_SORT_NODES,
+    PRE_PHI_HUT | PRE_FULL_PSI | NFFT_PSI_BASE_INDEX,
+    PRE_PHI_HUT | PRE_FULL_PSI | NFFT_PSI_FLOAT | NFFT_PSI_BASE_INDEX | NFFT_SORT_NODES};
+  int d, i, adjoint, howmany;
+
+  for (d = 1; d <= 3; d++)
+    for (i = 0; i < (int)SIZE(flags); i++)
+      for (adjoint = 0; adjoint <= 1; adjoint++)
+        for (howmany = 1; howmany <= 3; howmany += 2)
+          CU_ASSERT(check_many_vectors_single(d, d == 3 ? 20 : 40, 100, howmany,
+            flags[i], adjoint));
+}
+
+/* B-step kernels specialised for d and m, m = 13 takes the generic B-step */
+
+static int check_fixed_kernels_single(const int d, const int N, const int m,
+  const int howmany, const unsigned flags, const int adjoint)
+{
+  X(plan) p;
+  int ok;
+
+  init_many_vectors(&p, d, N, 200, m, howmany, flags);
+
+  /* the plan picks the kernels of its d and m up to m = 12 */
+  ok = ((p.b_kernels != NULL) == (m <= 12));
+  if (!ok)
+    printf("nfft_many d = %d, m = %-2d, kernels %s -> FAIL\n", d, m,
+      p.b_kernels ? "fixed" : "generic");
+
+  ok &= check_many_vectors_plan(&p, adjoint);
+  X(finalize)(&p);
+
+  return ok;
+}
+
+void X(check_fixed_kernels)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI, PRE_PHI_HUT | PRE_POLY_PSI,
+    PRE_PHI_HUT | PRE_PSI | NFFT_SORT_NODES | NFFT_PSI_FLOAT};
+  static const int m[] = {3, 5, 12, 13};
+  static const int N[] = {64, 32, 16, 8, 8, 6};
+  int d, i, k, adjoint, howmany;
+
+  for (d = 1; d <= 6; d++)
+    for (k = 0; k < (int)SIZE(m); k++)
+    {
+      /* keep the windows of the higher dimensional cases small */
+      if ((d > 2 && m[k] > 5) || (d > 4 && m[k] > 3))
+        continue;
+
+      for (i = 0; i < (int)SIZE(flags); i++)
+        for (adjoint = 0; adjoint <= 1; adjoint++)
+          for (howmany = 1; howmany <= 2; howmany++)
+            CU_ASSERT(check_fixed_kernels_single(d, N[d-1], m[k], howmany,
+              flags[i], adjoint));
+    }
+}
+
+/* B-step on the grid with ghost cells */
+
+static int check_ghost_cells_single(const int d, const int N, const int howmany,
+  const unsigned flags, const int adjoint)
+{
+  X(plan) p;
+  int j, t, ok;
+
+  init_many_vectors(&p, d, N, 100, WINDOW_HELP_ESTIMATE_m, howmany,
+    flags | NFFT_GHOST_CELLS);
+
+  /* half of the nodes have coordinates close to the wrap at -0.5 and 0.5,
+   * whose stencils reach into the ghost cells */
+  for (j = 0; j < p.M_total / 2; j++)
+    for (t = 0; t < d; t++)
+    {
+      const R h = K(1.0) / (R)(p.n[t]);
+      const R wrap[] = {K(-0.5), K(-0.5) + K(0.25) * h, K(0.5) - K(0.25) * h,
+        K(0.5) - h, K(-0.5) + (R)(p.m) * h, K(0.5) - (R)(p.m) * h};
+
+      p.x[d * j + t] = wrap[(j + 2 * t) % 6];
+    }
+
+  ok = (p.g_ghost != NULL);
+  ok &= check_many_vectors_plan(&p, adjoint);
+  X(finalize)(&p);
+
+  return ok;
+}
+
+void X(check_ghost_cells)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI, PRE_PHI_HUT | PRE_FULL_PSI,
+    PRE_PHI_HUT | PRE_PSI | NFFT_SORT_NODES, PRE_PHI_HUT | PRE_POLY_PSI, PRE_PHI_HUT,
+    PRE_PHI_HUT | PRE_FULL_PSI | NFFT_PSI_FLOAT};
+  int d, i, adjoint, howmany;
+
+  for (d = 1; d <= 3; d++)
+    for (i = 0; i < (int)SIZE(flags); i++)
+      for (adjoint = 0; adjoint <= 1; adjoint++)
+        for (howmany = 1; howmany <= 3; howmany += 2)
+          CU_ASSERT(check_ghost_cells_single(d, d == 3 ? 20 : 40, howmany,
+            flags[i], adjoint));
+}
+
+/* tiled adjoint, with several tiles per dimension and with m close to n/2,
+ * where the 2m+1 ghost points of a tile reach through the next tile */
+
+/** Relative error of the adjoint of the plan against ref. */
+static R err_adjoint_plan(X(plan) *p, const C *ref)
+{
+  R numerator = K(0.0), denominator = K(0.0);
+  INT j;
+
+  X(adjoint)(p);
+
+  for (j = 0; j < p->N_total; j++)
+    numerator = MAX(numerator, CABS(ref[j] - p->f_hat[j]));
+
+  for (j = 0; j < p->M_total; j++)
+    denominator += CABS(p->f[j]);
+
+  return numerator / denominator;
+}
+
+/** Compares the tiled adjoint on nodes whose stencils start at and around the
+ *  tile boundaries with the direct one. Since the window loses accuracy for
+ *  large m, the tiled adjoint has to be about as accurate as the adjoint
+ *  without tiles there. */
+static int check_adjoint_tiled_single(const int d, const int N, const int m,
+  const unsigned flags)
+{
+  X(plan) p;
+  int j, t, ok;
+  R err, err_untiled, bound;
+  C *ref;
+
+  init_many_vectors(&p, d, N, 200, m, 1, flags | NFFT_OMP_TILED_ADJOINT);
+
+  /* the stencils of every other node start up to 3 points before or after a
+   * multiple of n/16, where the tiles start */
+  for (j = 0; j < p.M_total; j += 2)
+    for (t = 0; t < d; t++)
+    {
+      const int n = (int)p.n[t];
+      const int k = ((j / 2) * (n / 16) + m + n + j / 32 - 3) % n;
+
+      p.x[d * j + t] = (R)(k) / (R)(n) - K(0.5);
+    }
+
+  if (p.flags & PRE_ONE_PSI)
+    X(precompute_one_psi)(&p);
+
+  /* the nodes are binned by tile once per precomputation */
+  ok = !(flags & PRE_ONE_PSI) || (p.tile_ptr && p.tile_nodes);
+
+  Y(vrand_unit_complex)(p.f, p.M_total);
+  X(adjoint_direct)(&p);
+  ref = Y(malloc)((size_t)(p.N_total) * sizeof(C));
+  memcpy(ref, p.f_hat, (size_t)(p.N_total) * sizeof(C));
+
+  err = err_adjoint_plan(&p, ref);
+
+  p.flags &= ~NFFT_OMP_TILED_ADJOINT;
+  err_untiled = err_adjoint_plan(&p, ref);
+  p.flags |= NFFT_OMP_TILED_ADJOINT;
+
+  bound = MAX(err_trafo(&p), K(10.0) * err_untiled);
+  ok &= (err < bound);
+
+  printf("nfft_tiled d = %d, n = %-4d, m = %-2d, adjoint -> %-4s " __FE__ " (" __FE__ ")\n",
+    d, (int)p.n[0], m, IF(ok, "OK", "FAIL"), err, bound);
+
+  Y(free)(ref);
+  X(finalize)(&p);
+
+  return ok;
+}
+
+void X(check_adjoint_tiled)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI, PRE_PHI_HUT | PRE_FULL_PSI,
+    PRE_PHI_HUT | PRE_POLY_PSI, PRE_PHI_HUT};
+  static const int N[] = {2048, 128, 32};
+  /* d, N and m: two tiles with 2m+1 just below n/2, or one tile with 2m+1
+   * close to n, which wraps around onto itself; n > 2m+2 keeps the B-step */
+  static const int near[][3] = {{1, 16, 8}, {1, 16, 14}, {2, 64, 31}, {2, 64, 32},
+    {3, 16, 7}, {3, 16, 8}};
+  int d, i, k;
+
+  for (i = 0; i < (int)SIZE(flags); i++)
+  {
+    for (d = 1; d <= 3; d++)
+      CU_ASSERT(check_adjoint_tiled_single(d, N[d-1], WINDOW_HELP_ESTIMATE_m,
+        flags[i]));
+
+    for (k = 0; k < (int)SIZE(near); k++)
+      CU_ASSERT(check_adjoint_tiled_single(near[k][0], near[k][1], near[k][2],
+        flags[i]));
+  }
+}
+
+/* real-valued transforms, flag NFFT_REAL */
+
+static int check_real_single(const int d, const int N, const int M,
+  const unsigned flags, const int adjoint)
+{
+  X(plan) p;
+  int NN[d], n[d], j, ok;
+  INT len;
+  R numerator = K(0.0), denominator = K(0.0), err, bound;
+  R *f_ref = NULL;
+  C *f_hat_ref = NULL;
+
+  for (j = 0; j < d; j++)
+  {
+    NN[j] = N;
+    n[j] = 2 * (int)(Y(next_power_of_2)(N));
+  }
+
+  X(init_guru)(&p, d, NN, M, n, WINDOW_HELP_ESTIMATE_m,
+    flags | NFFT_REAL | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS);
+
+  len = p.N_total / N * (N / 2);
+  Y(vrand_shifted_unit_double)(p.x, p.d * p.M_total);
+
+  if (p.flags & PRE_ONE_PSI)
+    X(precompute_one_psi)(&p);
+
+  if (adjoint)
+  {
+    Y(vrand_shifted_unit_double)(p.f_real, p.M_total);
+    X(adjoint_direct)(&p);
+    f_hat_ref = Y(malloc)((size_t)(len) * sizeof(C));
+    memcpy(f_hat_ref, p.f_hat, (size_t)(len) * sizeof(C));
+    X(adjoint)(&p);
+
+    for (j = 0; j < len; j++)
+      numerator = MAX(numerator, CABS(f_hat_ref[j] - p.f_hat[j]));
+
+    for (j = 0; j < p.M_total; j++)
+      denominator += FABS(p.f_real[j]);
+  }
+  else
+  {
+    Y(vrand_unit_complex)(p.f_hat, len);
+    X(trafo_direct)(&p);
+    f_ref = Y(malloc)((size_t)(p.M_total) * sizeof(R));
+    memcpy(f_ref, p.f_real, (size_t)(p.M_total) * sizeof(R));
+    X(trafo)(&p);
+
+    for (j = 0; j < p.M_total; j++)
+      numerator = MAX(numerator, FABS(f_ref[j] - p.f_real[j]));
+
+    for (j = 0; j < len; j++)
+      denominator += K(2.0) * CABS(p.f_hat[j]);
+  }
+
+  err = numerator / denominator;
+  bound = err_trafo(&p);
+  ok = err < bound;
+
+  printf("nfft d = %d, N = %-3d, M = %-4d, real, %-7s -> %-4s " __FE__ " (" __FE__ ")\n",
+    d, N, M, adjoint ? "adjoint" : "trafo", IF(ok, "OK", "FAIL"), err, bound);
+
+  Y(free)(f_ref);
+  Y(free)(f_hat_ref);
+  X(finalize)(&p);
+
+  return ok;
+}
+
+/** Direct real transform against the complex one on the Hermitian extension
+ *  of f_hat. Coefficients with a component k_t = -N/2 are left out since
+ *  their mirror image lies outside the index set. */
+static int check_real_hermitian(const int d, const int N, const int M)
+{
+  X(plan) p, q;
+  int NN[d], n[d], j, t, ok;
+  INT k_L, len;
+  R err = K(0.0), denominator = K(0.0);
+
+  for (j = 0; j < d; j++)
+  {
+    NN[j] = N;
+    n[j] = 2 * N;
+  }
+
+  X(init_guru)(&p, d, NN, M, n, WINDOW_HELP_ESTIMATE_m,
+    NFFT_REAL | MALLOC_X | MALLOC_F | MALLOC_F_HAT, 0);
+  X(init_guru)(&q, d, NN, M, n, WINDOW_HELP_ESTIMATE_m,
+    MALLOC_X | MALLOC_F | MALLOC_F_HAT, 0);
+
+  len = p.N_total / N * (N / 2);
+  Y(vrand_shifted_unit_double)(p.x, p.d * p.M_total);
+  memcpy(q.x, p.x, (size_t)(p.d * p.M_total) * sizeof(R));
+  Y(vrand_unit_complex)(p.f_hat, len);
+  memset(q.f_hat, 0, (size_t)(q.N_total) * sizeof(C));
+
+  for (k_L = 0; k_L < len; k_L++)
+  {
+    INT k[d], k_temp = k_L, pos = 0, neg = 0;
+    int outside = 0;
+
+    for (t = d - 1; t >= 0; t--)
+    {
+      const INT N_t = (t == d - 1) ? N / 2 : N;
+      k[t] = k_temp % N_t - ((t == d - 1) ? 0 : N / 2);
+      k_temp /= N_t;
+      outside |= (k[t] == -N / 2);
+    }
+
+    if (outside)
+    {
+      p.f_hat[k_L] = K(0.0);
+      continue;
+    }
+
+    for (t = 0; t < d; t++)
+    {
+      pos = pos * N + k[t] + N / 2;
+      neg = neg * N - k[t] + N / 2;
+    }
+
+    if (k[d - 1] == 0)
+    {
+      q.f_hat[pos] += K(0.5) * p.f_hat[k_L];
+      q.f_hat[neg] += K(0.5) * CONJ(p.f_hat[k_L]);
+    }
+    else
+    {
+      q.f_hat[pos] = p.f_hat[k_L];
+      q.f_hat[neg] = CONJ(p.f_hat[k_L]);
+    }
+  }
+
+  X(trafo_direct)(&p);
+  X(trafo_direct)(&q);
+
+  for (j = 0; j < p.M_total; j++)
+    err = MAX(err, CABS(q.f[j] - p.f_real[j]));
+
+  for (k_L = 0; k_L < q.N_total; k_L++)
+    denominator += CABS(q.f_hat[k_L]);
+
+  err /= denominator;
+  ok = err < K(1000.0) * EPSILON;
+
+  printf("nfft d = %d, N = %-3d, M = %-4d, real, hermitian -> %-4s " __FE__ "\n",
+    d, N, M, IF(ok, "OK", "FAIL"), err);
+
+  X(finalize)(&q);
+  X(finalize)(&p);
+
+  return ok;
+}
+
+void X(check_real)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI, PRE_PHI_HUT | PRE_FULL_PSI,
+    PRE_PHI_HUT | PRE_PSI | NFFT_SORT_NODES, PRE_PHI_HUT | PRE_POLY_PSI, 0};
+  int d, i, adjoint;
+
+  for (d = 1; d <= 3; d++)
+  {
+    CU_ASSERT(check_real_hermitian(d, d == 3 ? 8 : 16, 50));
+
+    for (i = 0; i < (int)SIZE(flags); i++)
+      for (adjoint = 0; adjoint <= 1; adjoint++)
+        CU_ASSERT(check_real_single(d, d == 3 ? 20 : 40, 100, flags[i], adjoint));
+  }
+}
+
+/* physically reordered nodes, flag NFFT_REORDER_NODES */
+
+static int check_reorder_nodes_single(const int d, const int N, const int M,
+  const unsigned flags, const int adjoint)
+{
+  X(plan) p, q;
+  int NN[d], n[d], j, ok;
+  INT len, len_in;
+  R numerator = K(0.0), denominator = K(0.0), err, bound;
+
+  for (j = 0; j < d; j++)
+  {
+    NN[j] = N;
+    n[j] = 2 * (int)(Y(next_power_of_2)(N));
+  }
+
+  /* q is the reference in the caller order, evaluated directly */
+  X(init_guru)(&p, d, NN, M, n, WINDOW_HELP_ESTIMATE_m,
+    flags | NFFT_REORDER_NODES | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS);
+  X(init_guru)(&q, d, NN, M, n, WINDOW_HELP_ESTIMATE_m,
+    MALLOC_X | MALLOC_F | MALLOC_F_HAT, 0);
+
+  /* the nodes of a first precomputation are overwritten in place, perm_x
+   * must then refer to the new nodes only */
+  Y(vrand_shifted_unit_double)(p.x, p.d * p.M_total);
+  X(precompute_one_psi)(&p);
+
+  Y(vrand_shifted_unit_double)(q.x, q.d * q.M_total);
+  memcpy(p.x, q.x, (size_t)(q.d * q.M_total) * sizeof(R));
+
+  X(precompute_one_psi)(&p);
+
+  if (adjoint)
+  {
+    Y(vrand_unit_complex)(q.f, q.M_total);
+    X(adjoint_direct)(&q);
+
+    for (j = 0; j < q.M_total; j++)
+      p.f[j] = q.f[(flags & NFFT_SORTED_IO) ? p.perm_x[j] : j];
+
+    X(adjoint)(&p);
+    len = q.N_total;
+    len_in = q.M_total;
+  }
+  else
+  {
+    Y(vrand_unit_complex)(q.f_hat, q.N_total);
+    memcpy(p.f_hat, q.f_hat, (size_t)(q.N_total) * sizeof(C));
+    X(trafo_direct)(&q);
+    X(trafo)(&p);
+    len = q.M_total;
+    len_in = q.N_total;
+  }
+
+  for (j = 0; j < len; j++)
+  {
+    const C ref = adjoint ? q.f_hat[j]
+      : q.f[(flags & NFFT_SORTED_IO) ? p.perm_x[j] : j];
+    numerator = MAX(numerator, CABS(ref - (adjoint ? p.f_hat[j] : p.f[j])));
+  }
+
+  for (j = 0; j < len_in; j++)
+    denominator += CABS(adjoint ? q.f[j] : q.f_hat[j]);
+
+  err = numerator / denominator;
+  bound = err_trafo(&p);
+  ok = err < bound;
+
+  printf("nfft d = %d, N = %-3d, M = %-4d, reordered%s, %-7s -> %-4s " __FE__ " (" __FE__ ")\n",
+    d, N, M, (flags & NFFT_SORTED_IO) ? " sorted io" : "",
+    adjoint ? "adjoint" : "trafo", IF(ok, "OK", "FAIL"), err, bound);
+
+  X(finalize)(&q);
+  X(finalize)(&p);
+
+  return ok;
+}
+
+void X(check_reorder_nodes)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI, PRE_PHI_HUT | PRE_FULL_PSI,
+    PRE_PHI_HUT | PRE_PSI | NFFT_SORT_NODES, PRE_PHI_HUT | PRE_PSI | NFFT_SORTED_IO,
+    PRE_PHI_HUT | PRE_POLY_PSI, 0};
+  int d, i, adjoint;
+
+  for (d = 1; d <= 3; d++)
+    for (i = 0; i < (int)SIZE(flags); i++)
+      for (adjoint = 0; adjoint <= 1; adjoint++)
+        CU_ASSERT(check_reorder_nodes_single(d, d == 3 ? 20 : 40, 100, flags[i], adjoint));
+}
+
+/* re-entrant execute, several vectors transformed concurrently with one plan */
+
+static int check_execute_single(const int d, const int N, const int M,
+  const unsigned flags, const int adjoint)
+{
+  enum {NUM_VECTORS = 4};
+  X(plan) p;
+  int NN[d], n[d], j, v, ok = 1;
+  C *f_hat[NUM_VECTORS], *f[NUM_VECTORS], *ref[NUM_VECTORS];
+  R err[NUM_VECTORS], bound;
+
+  for (j = 0; j < d; j++)
+  {
+    NN[j] = N;
+    n[j] = 2 * (int)(Y(next_power_of_2)(N));
+  }
+
+  X(init_guru)(&p, d, NN, M, n, WINDOW_HELP_ESTIMATE_m,
+    flags | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS);
+
+  Y(vrand_shifted_unit_double)(p.x, p.d * p.M_total);
+  X(precompute_one_psi)(&p);
+
+  /* references by the direct transform on the arrays of the plan */
+  for (v = 0; v < NUM_VECTORS; v++)
+  {
+    f_hat[v] = Y(malloc)((size_t)(p.N_total) * sizeof(C));
+    f[v] = Y(malloc)((size_t)(p.M_total) * sizeof(C));
+
+    if (adjoint)
+    {
+      Y(vrand_unit_complex)(f[v], p.M_total);
+      memcpy(p.f, f[v], (size_t)(p.M_total) * sizeof(C));
+      X(adjoint_direct)(&p);
+      ref[v] = Y(malloc)((size_t)(p.N_total) * sizeof(C));
+      memcpy(ref[v], p.f_hat, (size_t)(p.N_total) * sizeof(C));
+    }
+    else
+    {
+      Y(vrand_unit_complex)(f_hat[v], p.N_total);
+      memcpy(p.f_hat, f_hat[v], (size_t)(p.N_total) * sizeof(C));
+      X(trafo_direct)(&p);
+      ref[v] = Y(malloc)((size_t)(p.M_total) * sizeof(C));
+      memcpy(ref[v], p.f, (size_t)(p.M_total) * sizeof(C));
+    }
+  }
+
+#ifdef _OPENMP
+  #pragma omp parallel for default(shared) private(v, j)
+#endif
+  for (v = 0; v < NUM_VECTORS; v++)
+  {
+    void *work = Y(malloc)(X(workspace_size)(&p));
+    const INT len = adjoint ? p.N_total : p.M_total;
+    const INT len_in = adjoint ? p.M_total : p.N_total;
+    const C *in = adjoint ? f[v] : f_hat[v];
+    const C *out = adjoint ? f_hat[v] : f[v];
+    R numerator = K(0.0), denominator = K(0.0);
+
+    if (adjoint)
+      X(adjoint_execute)(&p, f_hat[v], f[v], work);
+    else
+      X(trafo_execute)(&p, f_hat[v], f[v], work);
+
+    for (j = 0; j < len; j++)
+      numerator = MAX(numerator, CABS(ref[v][j] - out[j]));
+
+    for (j = 0; j < len_in; j++)
+      denominator += CABS(in[j]);
+
+    err[v] = numerator / denominator;
+    Y(free)(work);
+  }
+
+  bound = err_trafo(&p);
+
+  for (v = 0; v < NUM_VECTORS; v++)
+  {
+    printf("nfft d = %d, N = %-3d, M = %-4d, execute, vector %d, %-7s -> %-4s " __FE__ " (" __FE__ ")\n",
+      d, N, M, v, adjoint ? "adjoint" : "trafo", IF(err[v] < bound, "OK", "FAIL"),
+      err[v], bound);
+
+    if (!(err[v] < bound))
+      ok = 0;
+
+    Y(free)(ref[v]);
+    Y(free)(f[v]);
+    Y(free)(f_hat[v]);
+  }
+
+  X(finalize)(&p);
+
+  return ok;
+}
+
+void X(check_execute)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI, PRE_PHI_HUT | PRE_FULL_PSI,
+    PRE_PHI_HUT | PRE_PSI | NFFT_SORT_NODES, PRE_PHI_HUT | PRE_PSI | NFFT_REORDER_NODES,
+    PRE_PHI_HUT | PRE_PSI | NFFT_PRUNED_FFT, PRE_PHI_HUT | PRE_POLY_PSI, 0};
+  int d, i, adjoint;
+
+  for (d = 1; d <= 3; d++)
+    for (i = 0; i < (int)SIZE(flags); i++)
+      for (adjoint = 0; adjoint <= 1; adjoint++)
+        CU_ASSERT(check_execute_single(d, d == 3 ? 20 : 40, 100, flags[i], adjoint));
+}
+
+/* node updates by nfft_set_nodes and nfft_set_moved_nodes */
+
+static int check_trafo_plan(X(plan) *p, const char *what)
+{
+  INT j;
+  R numerator = K(0.0), denominator = K(0.0), err, bound;
+  C *ref = Y(malloc)((size_t)(p->M_total) * sizeof(C));
+
+  Y(vrand_unit_complex)(p->f_hat, p->N_total);
+  X(trafo_direct)(p);
+  memcpy(ref, p->f, (size_t)(p->M_total) * sizeof(C));
+  X(trafo)(p);
+
+  for (j = 0; j < p->M_total; j++)
+    numerator = MAX(numerator, CABS(ref[j] - p->f[j]));
+
+  for (j = 0; j < p->N_total; j++)
+    denominator += CABS(p->f_hat[j]);
+
+  err = numerator / denominator;
+  bound = err_trafo(p);
+
+  printf("nfft d = %d, M = %-4d, %-22s -> %-4s " __FE__ " (" __FE__ ")\n",
+    (int)p->d, (int)p->M_total, what, IF(err < bound, "OK", "FAIL"), err, bound);
+
+  Y(free)(ref);
+
+  return err < bound;
+}
+
+static int check_set_nodes_single(const int d, const int N, const unsigned flags)
+{
+  X(plan) p;
+  int NN[d], n[d], moved[10], j, ok = 1;
+  R *x = Y(malloc)((size_t)(d * 150) * sizeof(R));
+
+  for (j = 0; j < d; j++)
+  {
+    NN[j] = N;
+    n[j] = 2 * (int)(Y(next_power_of_2)(N));
+  }
+
+  X(init_guru)(&p, d, NN, 100, n, WINDOW_HELP_ESTIMATE_m,
+    flags | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS);
+
+  Y(vrand_shifted_unit_double)(x, d * 150);
+  X(set_nodes)(&p, x, 100);
+  ok &= check_trafo_plan(&p, "set_nodes initial");
+
+  /* a few nodes moved */
+  for (j = 0; j < 10 * d; j += 3)
+    x[5 * j] = -x[5 * j];
+  X(set_nodes)(&p, x, 100);
+  ok &= check_trafo_plan(&p, "set_nodes moved");
+
+  X(set_nodes)(&p, x, 150);
+  ok &= check_trafo_plan(&p, "set_nodes grown");
+
+  X(set_nodes)(&p, x + 20 * d, 60);
+  ok &= check_trafo_plan(&p, "set_nodes shrunk");
+
+  X(finalize)(&p);
+
+  /* nodes owned by the caller and changed in place */
+  X(init_guru)(&p, d, NN, 100, n, WINDOW_HELP_ESTIMATE_m,
+    (flags | DEFAULT_NFFT_FLAGS) & ~MALLOC_X, DEFAULT_FFTW_FLAGS);
+
+  X(set_nodes)(&p, x, 100);
+  ok &= check_trafo_plan(&p, "set_nodes caller x");
+
+  for (j = 0; j < 10; j++)
+  {
+    moved[j] = 7 * j + 3;
+    x[d * moved[j]] = -x[d * moved[j]];
+  }
+  X(set_moved_nodes)(&p, moved, 10);
+  ok &= check_trafo_plan(&p, "set_moved_nodes");
+
+  X(finalize)(&p);
+  Y(free)(x);
+
+  return ok;
+}
+
+void X(check_set_nodes)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI, PRE_PHI_HUT | PRE_FULL_PSI,
+#if defined(GAUSSIAN)
+    PRE_PHI_HUT | FG_PSI | PRE_FG_PSI,
+#endif
+    PRE_PHI_HUT | PRE_PSI | NFFT_SORT_NODES, PRE_PHI_HUT | PRE_PSI | NFFT_REORDER_NODES,
+    PRE_PHI_HUT | PRE_FULL_PSI | NFFT_PSI_BASE_INDEX, PRE_PHI_HUT | PRE_POLY_PSI, 0};
+  int d, i;
+
+  for (d = 1; d <= 3; d++)
+    for (i = 0; i < (int)SIZE(flags); i++)
+      CU_ASSERT(check_set_nodes_single(d, d == 3 ? 20 : 40, flags[i]));
+}
+
+/* FFTW plans and grids shared between plans */
+
+static int check_shared_fftw_single(const int d, const int N, const unsigned flags)
+{
+  X(plan) p[3];
+  int NN[d], n[d], j, k, ok = 1;
+
+  for (k = 0; k < 3; k++)
+  {
+    for (j = 0; j < d; j++)
+    {
+      /* the last plan has a grid of its own */
+      NN[j] = k < 2 ? N : N / 2;
+      n[j] = 2 * (int)(Y(next_power_of_2)(NN[j]));
+    }
+
+    X(init_guru)(&p[k], d, NN, 100, n, WINDOW_HELP_ESTIMATE_m,
+      flags | PRE_PHI_HUT | PRE_PSI | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS);
+    Y(vrand_shifted_unit_double)(p[k].x, d * p[k].M_total);
+    X(precompute_one_psi)(&p[k]);
+  }
+
+  ok &= p[0].my_fftw_plan1 == p[1].my_fftw_plan1;
+  ok &= p[0].my_fftw_plan1 != p[2].my_fftw_plan1;
+  ok &= (p[0].g1 == p[1].g1) == ((flags & NFFT_SHARED_GRID) != 0);
+  ok &= p[0].g1 != p[2].g1;
+
+  for (k = 0; k < 3; k++)
+    ok &= check_trafo_plan(&p[k], "shared FFTW plan");
+
+  /* the remaining plans keep the shared plans and grids */
+  X(finalize)(&p[0]);
+  ok &= check_trafo_plan(&p[1], "shared, one finalized");
+
+  X(finalize)(&p[1]);
+  X(finalize)(&p[2]);
+
+  return ok;
+}
+
+void X(check_shared_fftw)(void)
+{
+  int d;
+
+  for (d = 1; d <= 3; d++)
+  {
+    CU_ASSERT(check_shared_fftw_single(d, d == 3 ? 20 : 40, NFFT_SHARED_FFTW_PLAN));
+    CU_ASSERT(check_shared_fftw_single(d, d == 3 ? 20 : 40, NFFT_SHARED_GRID));
+    CU_ASSERT(check_shared_fftw_single(d, d == 3 ? 20 : 40,
+      NFFT_SHARED_GRID | NFFT_SORT_NODES));
+  }
+}
+
+/* threads of the plan */
+
+static int check_set_threads_single(const int d, const int N, const unsigned flags)
+{
+  static const int cpus[] = {0, 0, 0};
+  X(plan) p;
+  int NN[d], n[d], j, ok = 1;
+
+  for (j = 0; j < d; j++)
+  {
+    NN[j] = N;
+    n[j] = 2 * (int)(Y(next_power_of_2)(N));
+  }
+
+  X(init_guru)(&p, d, NN, 100, n, WINDOW_HELP_ESTIMATE_m,
+    flags | PRE_PHI_HUT | PRE_PSI | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS);
+  Y(vrand_shifted_unit_double)(p.x, d * p.M_total);
+
+  X(set_threads)(&p, 3, NULL);
+  X(precompute_one_psi)(&p);
+  ok &= check_trafo_plan(&p, "3 threads");
+
+  X(set_threads)(&p, 2, cpus);
+  {
+#ifdef HAVE_SCHED_SETAFFINITY
+    cpu_set_t before, after;
+
+    sched_getaffinity(0, sizeof(cpu_set_t), &before);
+#endif
+    ok &= check_trafo_plan(&p, "2 threads on cpu 0");
+#ifdef HAVE_SCHED_SETAFFINITY
+    /* the calling thread gets its affinity back */
+    sched_getaffinity(0, sizeof(cpu_set_t), &after);
+    ok &= CPU_EQUAL(&before, &after);
+#endif
+  }
+
+  X(set_threads)(&p, 0, NULL);
+  ok &= check_trafo_plan(&p, "global threads");
+
+  X(finalize)(&p);
+
+  return ok;
+}
+
+void X(check_set_threads)(void)
+{
+  static const unsigned flags[] = {0, NFFT_SORT_NODES, NFFT_PRUNED_FFT,
+    NFFT_SHARED_FFTW_PLAN, NFFT_SHARED_GRID};
+  int d, i;
+
+  for (d = 1; d <= 3; d++)
+    for (i = 0; i < (int)SIZE(flags); i++)
+      CU_ASSERT(check_set_threads_single(d, d == 3 ? 20 : 40, flags[i]));
+}
+
+/* f_hat in FFT order, flag NFFT_FFT_ORDER */
+
+static int check_fft_order_single(const int d, const int N, const int howmany,
+  const unsigned flags)
+{
+  X(plan) p, q; /* centred and FFT order */
+  int NN[d], n[d], j, k, direct, ok = 1;
+  R err = K(0.0);
+
+  for (j = 0; j < d; j++)
+  {
+    NN[j] = N;
+    n[j] = 2 * (int)(Y(next_power_of_2)(N));
+  }
+
+  X(init_guru_many)(&p, d, NN, 50, n, WINDOW_HELP_ESTIMATE_m, howmany,
+    NFFT_WINDOW_DEFAULT, flags | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS);
+  X(init_guru_many)(&q, d, NN, 50, n, WINDOW_HELP_ESTIMATE_m, howmany,
+    NFFT_WINDOW_DEFAULT, flags | NFFT_FFT_ORDER | DEFAULT_NFFT_FLAGS,
+    DEFAULT_FFTW_FLAGS);
+
+  Y(vrand_shifted_unit_double)(p.x, d * p.M_total);
+  memcpy(q.x, p.x, (size_t)(d * p.M_total) * sizeof(R));
+
+  if (p.flags & PRE_ONE_PSI)
+  {
+    X(precompute_one_psi)(&p);
+    X(precompute_one_psi)(&q);
+  }
+
+  for (direct = 0; direct <= 1; direct++)
+  {
+    Y(vrand_unit_complex)(p.f_hat, p.N_total * howmany);
+    memcpy(q.f_hat, p.f_hat, (size_t)(p.N_total * howmany) * sizeof(C));
+    for (k = 0; k < howmany; k++)
+      Y(fftshift_complex)(q.f_hat + k * q.N_total, d, q.N);
+
+    if (direct)
+    {
+      X(trafo_direct)(&p);
+      X(trafo_direct)(&q);
+    }
+    else
+    {
+      X(trafo)(&p);
+      X(trafo)(&q);
+    }
+
+    for (j = 0; j < p.M_total * howmany; j++)
+      err = MAX(err, CABS(p.f[j] - q.f[j]));
+
+    if (direct)
+    {
+      X(adjoint_direct)(&p);
+      X(adjoint_direct)(&q);
+    }
+    else
+    {
+      X(adjoint)(&p);
+      X(adjoint)(&q);
+    }
+
+    for (k = 0; k < howmany; k++)
+      Y(fftshift_complex)(q.f_hat + k * q.N_total, d, q.N);
+
+    for (j = 0; j < p.N_total * howmany; j++)
+      err = MAX(err, CABS(p.f_hat[j] - q.f_hat[j]));
+  }
+
+  ok = err < K(1e3) * EPSILON * (R)(p.N_total);
+  printf("nfft d = %d, N = %-3d, howmany = %d, flags = %5x, fft order -> %-4s " __FE__ "\n",
+    d, N, howmany, flags, IF(ok, "OK", "FAIL"), err);
+
+  X(finalize)(&p);
+  X(finalize)(&q);
+
+  return ok;
+}
+
+void X(check_fft_order)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI, PRE_PSI,
+    PRE_PHI_HUT | PRE_FULL_PSI};
+  static const int N[] = {64, 32, 16, 8};
+  int d, i;
+
+  for (d = 1; d <= 4; d++)
+    for (i = 0; i < (int)SIZE(flags); i++)
+    {
+      CU_ASSERT(check_fft_order_single(d, N[d-1], 1, flags[i]));
+      CU_ASSERT(check_fft_order_single(d, N[d-1], 2, flags[i]));
+    }
+}
+
+/* zero padding of g_hat kept across transforms with FFTW_PRESERVE_INPUT */
+
+static int check_zero_padding_single(const int d, const int N)
+{
+  X(plan) p, q; /* with and without the kept zero padding */
+  int NN[d], n[d], j, r, ok = 1;
+  R err = K(0.0);
+
+  for (j = 0; j < d; j++)
+  {
+    NN[j] = N;
+    n[j] = 2 * (int)(Y(next_power_of_2)(N));
+  }
+
+  X(init_guru)(&p, d, NN, 50, n, WINDOW_HELP_ESTIMATE_m,
+    PRE_PHI_HUT | PRE_PSI | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS);
+  X(init_guru)(&q, d, NN, 50, n, WINDOW_HELP_ESTIMATE_m,
+    PRE_PHI_HUT | PRE_PSI | DEFAULT_NFFT_FLAGS, FFTW_ESTIMATE | FFTW_PRESERVE_INPUT);
+
+  Y(vrand_shifted_unit_double)(p.x, d * p.M_total);
+  memcpy(q.x, p.x, (size_t)(d * p.M_total) * sizeof(R));
+  X(precompute_one_psi)(&p);
+  X(precompute_one_psi)(&q);
+
+  /* trafo, trafo, adjoint, trafo */
+  for (r = 0; r < 4; r++)
+  {
+    if (r == 2)
+    {
+      Y(vrand_unit_complex)(p.f, p.M_total);
+      memcpy(q.f, p.f, (size_t)(p.M_total) * sizeof(C));
+      X(adjoint)(&p);
+      X(adjoint)(&q);
+
+      for (j = 0; j < p.N_total; j++)
+        err = MAX(err, CABS(p.f_hat[j] - q.f_hat[j]));
+    }
+    else
+    {
+      Y(vrand_unit_complex)(p.f_hat, p.N_total);
+      memcpy(q.f_hat, p.f_hat, (size_t)(p.N_total) * sizeof(C));
+      X(trafo)(&p);
+      X(trafo)(&q);
+
+      for (j = 0; j < p.M_total; j++)
+        err = MAX(err, CABS(p.f[j] - q.f[j]));
+    }
+
+    ok &= r == 2 ? !q.g_hat_zero_padded : q.g_hat_zero_padded;
+  }
+
+  ok &= err < K(1e3) * EPSILON * (R)(p.N_total);
+  printf("nfft d = %d, N = %-3d, zero padding kept -> %-4s " __FE__ "\n",
+    d, N, IF(ok, "OK", "FAIL"), err);
+
+  X(finalize)(&p);
+  X(finalize)(&q);
+
+  return ok;
+}
+
+void X(check_zero_padding)(void)
+{
+  static const int N[] = {64, 32, 16, 16};
+  int d;
+
+  for (d = 1; d <= 4; d++)
+    CU_ASSERT(check_zero_padding_single(d, N[d-1]));
+}
+
+/* memory policy of the plan */
+
+static int check_memory_policy_single(const int d, const int N,
+  const unsigned flags, const unsigned policy)
+{
+  X(plan) p;
+  int NN[d], n[d], j, ok;
+  unsigned applied;
+  char what[40];
+  R *psi;
+
+  for (j = 0; j < d; j++)
+  {
+    NN[j] = N;
+    n[j] = 2 * (int)(Y(next_power_of_2)(N));
+  }
+
+  X(init_guru)(&p, d, NN, 100, n, WINDOW_HELP_ESTIMATE_m,
+    flags | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS);
+
+  Y(vrand_shifted_unit_double)(p.x, d * p.M_total);
+
+  /* psi is placed by the policy before the precomputation writes it */
+  X(set_memory_policy)(&p, policy);
+  X(precompute_one_psi)(&p);
+
+  applied = X(memory_policy)(&p);
+  ok = (applied & ~policy) == 0;
+
+  /* a second precomputation keeps psi and its placement */
+  psi = p.psi;
+  X(precompute_one_psi)(&p);
+  ok &= p.psi == psi && X(memory_policy)(&p) == applied;
+
+  /* first touch is available with threads only */
+  if ((policy & NFFT_MEMORY_FIRST_TOUCH) && Y(has_threads_enabled)())
+    ok &= (applied & NFFT_MEMORY_FIRST_TOUCH) != 0;
+
+  sprintf(what, "policy %x (applied %x)", policy, applied);
+  ok &= check_trafo_plan(&p, what);
+
+  X(finalize)(&p);
+
+  return ok;
+}
+
+void X(check_memory_policy)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI,
+    PRE_PHI_HUT | PRE_FULL_PSI, PRE_PHI_HUT | PRE_PSI | NFFT_SHARED_GRID};
+  static const unsigned policy[] = {NFFT_MEMORY_FIRST_TOUCH,
+    NFFT_MEMORY_FIRST_TOUCH | NFFT_MEMORY_INTERLEAVE | NFFT_MEMORY_HUGE_PAGES,
+    NFFT_MEMORY_HUGE_PAGES_EXPLICIT | NFFT_MEMORY_FIRST_TOUCH};
+  static const int N[] = {1024, 256, 32};
+  int d, i, k;
+
+  for (d = 1; d <= 3; d++)
+    for (i = 0; i < (int)SIZE(flags); i++)
+      for (k = 0; k < (int)SIZE(policy); k++)
+        CU_ASSERT(check_memory_policy_single(d, N[d-1], flags[i], policy[k]));
+}
+
+/* SIMD kernels of the trafo B-step for every instruction set */
+
+/** Compares the trafo of the plan with its SIMD kernel to the trafo of the
+ *  same plan with the generic kernel forced, for the same f_hat. Both sum
+ *  the same products, in another order. */
+static int check_simd_generic(X(plan) *p, const char *what)
+{
+  INT j;
+  R numerator = K(0.0), denominator = K(0.0), err, bound;
+  C *f_hat = Y(malloc)((size_t)(p->N_total) * sizeof(C));
+  C *f = Y(malloc)((size_t)(p->M_total) * sizeof(C));
+  int ok;
+
+  Y(vrand_unit_complex)(f_hat, p->N_total);
+  memcpy(p->f_hat, f_hat, (size_t)(p->N_total) * sizeof(C));
+  X(trafo)(p);
+  memcpy(f, p->f, (size_t)(p->M_total) * sizeof(C));
+
+  ok = (X(set_simd)(p, NFFT_SIMD_GENERIC) == NFFT_SIMD_GENERIC);
+  memcpy(p->f_hat, f_hat, (size_t)(p->N_total) * sizeof(C));
+  X(trafo)(p);
+
+  for (j = 0; j < p->M_total; j++)
+    numerator = MAX(numerator, CABS(f[j] - p->f[j]));
+
+  for (j = 0; j < p->N_total; j++)
+    denominator += CABS(f_hat[j]);
+
+  err = numerator / denominator;
+  bound = err_trafo(p);
+  ok &= (err < bound);
+
+  printf("nfft d = %d, M = %-4d, %-22s vs generic -> %-4s " __FE__ " (" __FE__ ")\n",
+    (int)p->d, (int)p->M_total, what, IF(ok, "OK", "FAIL"), err, bound);
+
+  Y(free)(f);
+  Y(free)(f_hat);
+
+  return ok;
+}
+
+static int check_simd_single(const int d, const int N, const int m,
+  const unsigned flags, const unsigned level)
+{
+  X(plan) p;
+  int NN[d], n[d], j, ok;
+  unsigned used;
+  char what[40];
+
+  for (j = 0; j < d; j++)
+  {
+    NN[j] = N;
+    n[j] = 2 * (int)(Y(next_power_of_2)(N));
+  }
+
+  X(init_guru)(&p, d, NN, 100, n, m, flags | DEFAULT_NFFT_FLAGS,
+    DEFAULT_FFTW_FLAGS);
+
+  Y(vrand_shifted_unit_double)(p.x, d * p.M_total);
+
+  if (p.flags & PRE_ONE_PSI)
+    X(precompute_one_psi)(&p);
+
+  used = X(set_simd)(&p, level);
+  ok = used <= level;
+
+  sprintf(what, "simd %u (used %u), m = %d", level, used, m);
+  ok &= check_trafo_plan(&p, what);
+
+  if (used != NFFT_SIMD_GENERIC)
+    ok &= check_simd_generic(&p, what);
+
+  X(finalize)(&p);
+
+  return ok;
+}
+
+void X(check_simd)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI, PRE_PHI_HUT};
+  static const unsigned level[] = {NFFT_SIMD_GENERIC, NFFT_SIMD_AVX2,
+    NFFT_SIMD_AVX512};
+  static const int N[] = {1024, 64, 16};
+  int d, i, k, m;
+
+  /* rows of 2m+2 values, odd and even m use the wide and narrow kernels */
+  for (d = 1; d <= 3; d++)
+    for (i = 0; i < (int)SIZE(flags); i++)
+      for (k = 0; k < (int)SIZE(level); k++)
+        for (m = WINDOW_HELP_ESTIMATE_m; m <= WINDOW_HELP_ESTIMATE_m + 1; m++)
+          CU_ASSERT(check_simd_single(d, N[d-1], m, flags[i], level[k]));
+}
+
+/* B-step on a grid of the caller */
+
+static int check_spread_interp_single(const int d, const int N,
+  const int howmany, const unsigned flags)
+{
+  X(plan) p;
+  int NN[d], n[d], j, ok;
+  C *g;
+  R *g_real, *ref;
+  R err = K(0.0), norm = K(0.0);
+  INT size;
+
+  for (j = 0; j < d; j++)
+  {
+    NN[j] = N;
+    n[j] = 2 * (int)(Y(next_power_of_2)(N));
+  }
+
+  /* g2 is left intact by both transforms */
+  X(init_guru_many)(&p, d, NN, 100, n, WINDOW_HELP_ESTIMATE_m, howmany,
+    NFFT_WINDOW_DEFAULT, flags | DEFAULT_NFFT_FLAGS,
+    FFTW_ESTIMATE | FFTW_PRESERVE_INPUT);
+
+  /* reals of the grid, g2 is real for flag NFFT_REAL */
+  size = (flags & NFFT_REAL) ? p.n_total : 2 * p.n_total * howmany;
+  g = (C*) Y(malloc)((size_t)(size) * sizeof(R));
+  g_real = (R*) g;
+  ref = (R*) Y(malloc)((size_t)(size) * sizeof(R));
+
+  Y(vrand_shifted_unit_double)(p.x, d * p.M_total);
+
+  if (p.flags & PRE_ONE_PSI)
+    X(precompute_one_psi)(&p);
+
+  /* interpolation from the grid of nfft_trafo */
+  if (flags & NFFT_REAL)
+    Y(vrand_unit_complex)(p.f_hat, p.N_total / N * (N / 2));
+  else
+    Y(vrand_unit_complex)(p.f_hat, p.N_total * howmany);
+
+  X(trafo)(&p);
+  memcpy(g, p.g2, (size_t)(size) * sizeof(R));
+
+  if (flags & NFFT_REAL)
+  {
+    memcpy(ref, p.f_real, (size_t)(p.M_total) * sizeof(R));
+    X(interp)(&p, g);
+
+    for (j = 0; j < p.M_total; j++)
+    {
+      err = MAX(err, FABS(ref[j] - p.f_real[j]));
+      norm = MAX(norm, FABS(ref[j]));
+    }
+  }
+  else
+  {
+    memcpy(ref, p.f, (size_t)(p.M_total * howmany) * sizeof(C));
+    X(interp)(&p, g);
+
+    for (j = 0; j < p.M_total * howmany; j++)
+    {
+      err = MAX(err, CABS(((C*)ref)[j] - p.f[j]));
+      norm = MAX(norm, CABS(((C*)ref)[j]));
+    }
+  }
+
+  /* spreading onto the grid of nfft_adjoint */
+  if (flags & NFFT_REAL)
+    Y(vrand_shifted_unit_double)(p.f_real, p.M_total);
+  else
+    Y(vrand_unit_complex)(p.f, p.M_total * howmany);
+
+  X(adjoint)(&p);
+  memcpy(ref, p.g2, (size_t)(size) * sizeof(R));
+  X(spread)(&p, g);
+
+  for (j = 0; j < size; j++)
+  {
+    err = MAX(err, FABS(ref[j] - g_real[j]));
+    norm = MAX(norm, FABS(ref[j]));
+  }
+
+  ok = err <= K(1e2) * EPSILON * norm;
+  printf("nfft d = %d, N = %-3d, howmany = %d, flags = %6x, spread/interp -> %-4s " __FE__ "\n",
+    d, N, howmany, flags, IF(ok, "OK", "FAIL"), err / norm);
+
+  Y(free)(ref);
+  Y(free)(g);
+  X(finalize)(&p);
+
+  return ok;
+}
+
+void X(check_spread_interp)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI,
+    PRE_PHI_HUT | PRE_FULL_PSI, PRE_PHI_HUT | PRE_PSI | NFFT_REORDER_NODES,
+    PRE_PHI_HUT | PRE_PSI | NFFT_GHOST_CELLS, PRE_PHI_HUT | PRE_LIN_PSI};
+  static const int N[] = {64, 32, 16};
+  int d, i;
+
+  for (d = 1; d <= 3; d++)
+  {
+    for (i = 0; i < (int)SIZE(flags); i++)
+    {
+      CU_ASSERT(check_spread_interp_single(d, N[d-1], 1, flags[i]));
+      CU_ASSERT(check_spread_interp_single(d, N[d-1], 2, flags[i]));
+    }
+  }
+
+  /* FFTW_PRESERVE_INPUT is not supported by multi-dimensional c2r FFTs */
+  CU_ASSERT(check_spread_interp_single(1, N[0], 1,
+    PRE_PHI_HUT | PRE_PSI | NFFT_REAL));
+}
+
+/* stages of the transforms and the pipelined batch */
+
+static int check_pipeline_single(const int d, const int N, const int howmany,
+  const unsigned flags, const int nthreads)
+{
+  enum {COUNT = 5};
+  X(plan) p;
+  int NN[d], n[d], j, k, ok;
+  R *f_hat_in[COUNT], *f_in[COUNT], *f_hat_out[COUNT], *f_out[COUNT];
+  R err = K(0.0), norm = K(0.0);
+  INT N_len, M_len; /* reals of f_hat and f */
+
+  for (j = 0; j < d; j++)
+  {
+    NN[j] = N;
+    n[j] = 2 * (int)(Y(next_power_of_2)(N));
+  }
+
+  X(init_guru_many)(&p, d, NN, 100, n, WINDOW_HELP_ESTIMATE_m, howmany,
+    NFFT_WINDOW_DEFAULT, flags | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS);
+  X(set_threads)(&p, nthreads, NULL);
+
+  N_len = 2 * ((flags & NFFT_REAL) ? p.N_total / N * (N / 2) : p.N_total * howmany);
+  M_len = (flags & NFFT_REAL) ? p.M_total : 2 * p.M_total * howmany;
+
+  Y(vrand_shifted_unit_double)(p.x, d * p.M_total);
+
+  if (p.flags & PRE_ONE_PSI)
+    X(precompute_one_psi)(&p);
+
+  for (k = 0; k < COUNT; k++)
+  {
+    f_hat_in[k] = (R*) Y(malloc)((size_t)(N_len) * sizeof(R));
+    f_hat_out[k] = (R*) Y(malloc)((size_t)(N_len) * sizeof(R));
+    f_in[k] = (R*) Y(malloc)((size_t)(M_len) * sizeof(R));
+    f_out[k] = (R*) Y(malloc)((size_t)(M_len) * sizeof(R));
+    Y(vrand_shifted_unit_double)(f_hat_in[k], N_len);
+    Y(vrand_shifted_unit_double)(f_in[k], M_len);
+  }
+
+  X(trafo_pipeline)(&p, COUNT, (C**)f_hat_in, (C**)f_out);
+  X(adjoint_pipeline)(&p, COUNT, (C**)f_hat_out, (C**)f_in);
+
+  /* the same by the stages for the first input, else by the transforms */
+  for (k = 0; k < COUNT; k++)
+  {
+    R *f = (flags & NFFT_REAL) ? p.f_real : (R*)p.f, *f_hat = (R*)p.f_hat;
+
+    memcpy(f_hat, f_hat_in[k], (size_t)(N_len) * sizeof(R));
+
+    if (k == 0)
+    {
+      X(trafo_D)(&p);
+      X(trafo_fft)(&p);
+      X(trafo_B)(&p);
+    }
+    else
+      X(trafo)(&p);
+
+    for (j = 0; j < M_len; j++)
+    {
+      err = MAX(err, FABS(f[j] - f_out[k][j]));
+      norm = MAX(norm, FABS(f[j]));
+    }
+
+    memcpy(f, f_in[k], (size_t)(M_len) * sizeof(R));
+
+    if (k == 0)
+    {
+      X(adjoint_B)(&p);
+      X(adjoint_fft)(&p);
+      X(adjoint_D)(&p);
+    }
+    else
+      X(adjoint)(&p);
+
+    for (j = 0; j < N_len; j++)
+    {
+      err = MAX(err, FABS(f_hat[j] - f_hat_out[k][j]));
+      norm = MAX(norm, FABS(f_hat[j]));
+    }
+  }
+
+  ok = err <= K(1e2) * EPSILON * norm;
+  printf("nfft d = %d, N = %-3d, howmany = %d, flags = %6x, threads = %d, pipeline -> %-4s " __FE__ "\n",
+    d, N, howmany, flags, nthreads, IF(ok, "OK", "FAIL"), err / norm);
+
+  for (k = 0; k < COUNT; k++)
+  {
+    Y(free)(f_out[k]);
+    Y(free)(f_in[k]);
+    Y(free)(f_hat_out[k]);
+    Y(free)(f_hat_in[k]);
+  }
+
+  X(finalize)(&p);
+
+  return ok;
+}
+
+void X(check_pipeline)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI,
+    PRE_PHI_HUT | PRE_FULL_PSI | NFFT_REORDER_NODES, PRE_PSI};
+  static const int N[] = {64, 32, 16};
+  int d, i, t;
+
+  for (t = 0; t <= 2; t += 2)
+  {
+    for (d = 1; d <= 3; d++)
+    {
+      for (i = 0; i < (int)SIZE(flags); i++)
+      {
+        CU_ASSERT(check_pipeline_single(d, N[d-1], 1, flags[i], t));
+        CU_ASSERT(check_pipeline_single(d, N[d-1], 2, flags[i], t));
+      }
+    }
+
+    CU_ASSERT(check_pipeline_single(2, N[1], 1, PRE_PHI_HUT | PRE_PSI | NFFT_REAL, t));
+
+    /* N <= m, computed directly by the B stage */
+    CU_ASSERT(check_pipeline_single(1, 4, 1, PRE_PHI_HUT | PRE_PSI, t));
+  }
+}
+
+/* node sets evaluated from the grid of one plan, and single points */
+
+static int check_node_sets_single(const int d, const int N, const int howmany,
+  const unsigned flags)
+{
+  static const int M[] = {50, 300};
+  X(plan) p, q[2];
+  int NN[d], n[d], i, j, ok = 1;
+  C *ref, *f;
+  R *x;
+
+  for (j = 0; j < d; j++)
+  {
+    NN[j] = N;
+    n[j] = 2 * (int)(Y(next_power_of_2)(N));
+  }
+
+  X(init_guru_many)(&p, d, NN, 100, n, WINDOW_HELP_ESTIMATE_m, howmany,
+    NFFT_WINDOW_DEFAULT, flags | DEFAULT_NFFT_FLAGS, DEFAULT_FFTW_FLAGS);
+
+  Y(vrand_shifted_unit_double)(p.x, d * p.M_total);
+
+  if (p.flags & PRE_ONE_PSI)
+    X(precompute_one_psi)(&p);
+
+  ref = (C*) Y(malloc)((size_t)(M[1] * howmany) * sizeof(C));
+  f = (C*) Y(malloc)((size_t)(M[1] * howmany) * sizeof(C));
+  x = (R*) Y(malloc)((size_t)(d * M[1]) * sizeof(R));
+
+  for (i = 0; i < 2; i++)
+  {
+    X(init_node_set)(&q[i], &p, M[i]);
+    Y(vrand_shifted_unit_double)(x, d * M[i]);
+
+    /* x keeps the caller order for trafo_points, the precomputation of q[i]
+     * permutes q[i].x in place for flag NFFT_REORDER_NODES */
+    memcpy(q[i].x, x, (size_t)(d * M[i]) * sizeof(R));
+
+    if (q[i].flags & PRE_ONE_PSI)
+      X(precompute_one_psi)(&q[i]);
+  }
+
+  Y(vrand_unit_complex)(p.f_hat, p.N_total * howmany);
+  X(trafo)(&p);
+
+  /* the node sets, then the nodes of q[1] as single points */
+  for (i = 0; i < 3; i++)
+  {
+    X(plan) *r = &q[i < 2 ? i : 1];
+    R numerator = K(0.0), denominator = K(0.0), err;
+
+    if (i < 2)
+    {
+      X(trafo)(r);
+      memcpy(f, r->f, (size_t)(r->M_total * howmany) * sizeof(C));
+    }
+    else
+      X(trafo_points)(&p, r->M_total, x, f);
+
+    X(trafo_direct)(r);
+    memcpy(ref, r->f, (size_t)(r->M_total * howmany) * sizeof(C));
+
+    for (j = 0; j < r->M_total * howmany; j++)
+      numerator = MAX(numerator, CABS(ref[j] - f[j]));
+
+    for (j = 0; j < p.N_total * howmany; j++)
+      denominator += CABS(p.f_hat[j]);
+
+    err = numerator / denominator;
+    ok &= err < err_trafo(&p);
+
+    printf("nfft d = %d, N = %-3d, howmany = %d, flags = %5x, %s M = %-3d -> %-4s " __FE__ "\n",
+      d, N, howmany, flags, i < 2 ? "node set" : "points  ", (int)r->M_total,
+      IF(err < err_trafo(&p), "OK", "FAIL"), err);
+  }
+
+  Y(free)(x);
+  Y(free)(f);
+  Y(free)(ref);
+
+  for (i = 0; i < 2; i++)
+    X(finalize)(&q[i]);
+  X(finalize)(&p);
+
+  return ok;
+}
+
+void X(check_node_sets)(void)
+{
+  static const unsigned flags[] = {PRE_PHI_HUT | PRE_PSI,
+    PRE_PHI_HUT | PRE_FULL_PSI | NFFT_SORT_NODES,
+    PRE_PHI_HUT | PRE_PSI | NFFT_REORDER_NODES};
+  static const int N[] = {64, 32, 16};
+  int d, i;
+
+  for (d = 1; d <= 3; d++)
+    for (i = 0; i < (int)SIZE(flags); i++)
+    {
+      CU_ASSERT(check_node_sets_single(d, N[d-1], 1, flags[i]));
+      CU_ASSERT(check_node_sets_single(d, N[d-1], 2, flags[i]));
+    }
+}
+
+/* FFTW wisdom file */
+
+void X(check_fftw_wisdom)(void)
+{
+  /* in the build directory of the tests, not the current directory */
+  static const char *filename = ABS_BUILDDIR "/" STRINGIZE(X(check_wisdom)) ".tmp";
+  int N[2] = {24, 20}, n[2] = {48, 40}, ok;
+  char header[6] = "";
+  FILE *f;
+  X(plan) p;
+
+  /* a missing file is created by the export */
+  remove(filename);
+  Y(set_fftw_wisdom_file)(filename);
+
+  X(init_guru)(&p, 2, N, 10, n, WINDOW_HELP_ESTIMATE_m,
+    PRE_PHI_HUT | PRE_PSI | DEFAULT_NFFT_FLAGS, FFTW_MEASURE);
+  X(finalize)(&p);
+  ok = Y(export_fftw_wisdom)();
+
+  f = fopen(filename, "r");
+  ok &= f != NULL && fread(header, 1, 5, f) == 5 && strcmp(header, "(fftw") == 0;
+  if (f)
+    fclose(f);
+
+  /* a plan after the import plans from the wisdom, the wisdom still in
+   * memory is forgotten so that it can only come from the file */
+  FFTW(forget_wisdom)();
+  Y(set_fftw_wisdom_file)(filename);
+  X(init_guru)(&p, 2, N, 10, n, WINDOW_HELP_ESTIMATE_m,
+    PRE_PHI_HUT | PRE_PSI | DEFAULT_NFFT_FLAGS, FFTW_MEASURE | FFTW_WISDOM_ONLY);
+  ok &= p.my_fftw_plan1 != NULL && p.my_fftw_plan2 != NULL;
+  X(finalize)(&p);
+
+  Y(set_fftw_wisdom_file)(NULL);
+  ok &= !Y(export_fftw_wisdom)();
+  remove(filename);
+
+  printf("nfft fftw wisdom file -> %s\n", IF(ok, "OK", "FAIL"));
+  CU_ASSERT(ok);
+}
+
+static int check_init_tol_single(const int d, const int N, const int M,
+  const double eps, const unsigned fftw_flags)
+{
+  X(plan) p;
+  int NN[d], j, ok;
+  R numerator = K(0.0), denominator = K(0.0), err;
+  C *ref;
+
+  for (j = 0; j < d; j++)
+    NN[j] = N;
+
+  X(init_tol)(&p, d, NN, M, eps, 0, fftw_flags);
+
+  Y(vrand_shifted_unit_double)(p.x, p.d * p.M_total);
+
+  if (p.flags & PRE_ONE_PSI)
+    X(precompute_one_psi)(&p);
+
+  Y(vrand_unit_complex)(p.f_hat, p.N_total);
+  X(trafo_direct)(&p);
+  ref = Y(malloc)((size_t)(p.M_total) * sizeof(C));
+  memcpy(ref, p.f, (size_t)(p.M_total) * sizeof(C));
+  X(trafo)(&p);
+
+  for (j = 0; j < p.M_total; j++)
+    numerator = MAX(numerator, CABS(ref[j] - p.f[j]));
+
+  for (j = 0; j < p.N_total; j++)
+    denominator += CABS(p.f_hat[j]);
+
+  err = numerator / denominator;
+  ok = err < (R)eps;
+
+  printf("nfft_init_tol d = %d, N = %-3d, M = %-4d, eps = %.0e, window = %u, m = %2d, n = %-4d, flags = %5u -> %-4s " __FE__ "\n",
+    d, N, M, eps, p.window, (int)p.m, (int)p.n[0], p.flags, IF(ok, "OK", "FAIL"), err);
+
+  Y(free)(ref);
+  X(finalize)(&p);
+
+  return ok;
+}
+
+void X(check_init_tol)(void)
+{
+  static const double eps[] = {1e-3, 1e-6, 1e-9, 1e-12};
+  int d, i, N[] = {64, 64}, n[2], m, ok;
+  unsigned window, flags;
+  char *wisdom;
+  X(plan) p;
+
+  for (d = 1; d <= 3; d++)
+    for (i = 0; i < (int)SIZE(eps); i++)
+      if (eps[i] > K(100.0) * EPSILON)
+        CU_ASSERT(check_init_tol_single(d, d == 3 ? 16 : 32, 200, eps[i],
+          FFTW_ESTIMATE | FFTW_DESTROY_INPUT));
+
+  /* A measured decision survives export and import of the wisdom. */
+  X(forget_wisdom)();
+  X(init_tol)(&p, 2, N, 1000, 1e-4, 0, FFTW_MEASURE | FFTW_DESTROY_INPUT);
+  n[0] = (int)p.n[0];
+  n[1] = (int)p.n[1];
+  m = (int)p.m;
+  window = p.window;
+  flags = p.flags;
+  X(finalize)(&p);
+
+  wisdom = X(export_wisdom_to_string)();
+  X(forget_wisdom)();
+  CU_ASSERT(!X(import_wisdom_from_string)("(nfft-wisdom-1 8\n (2 1000"));
+  ok = X(import_wisdom_from_string)(wisdom);
+  CU_ASSERT(ok);
+  Y(free)(wisdom);
+
+  X(init_tol)(&p, 2, N, 1000, 1e-4, 0, FFTW_MEASURE | FFTW_DESTROY_INPUT);
+  printf("nfft_init_tol wisdom: window = %u, m = %d, n = %d x %d, flags = %u -> %s\n",
+    window, m, n[0], n[1], flags, IF(ok && p.window == window && p.m == m
+    && p.n[0] == n[0] && p.n[1] == n[1] && p.flags == flags, "OK", "FAIL"));
+  CU_ASSERT(p.window == window && p.m == m && p.n[0] == n[0]
+    && p.n[1] == n[1] && p.flags == flags);
+  X(finalize)(&p);
+  X(forget_wisdom)();
+}
+
 /* accuracy */
 
 static int check_single_file(const testcase_delegate_t *testcase,
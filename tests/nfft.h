@@ -43,4 +43,25 @@ void X(check_adjoint_3d_fast_file)(void);
 void X(check_adjoint_3d_online)(void);
 void X(check_adjoint_4d_online)(void);
 
+void X(check_many_vectors)(void);
+void X(check_psi_float)(void);
+void X(check_ghost_cells)(void);
+void X(check_fixed_kernels)(void);
+void X(check_adjoint_tiled)(void);
+void X(check_init_tol)(void);
+void X(check_real)(void);
+void X(check_reorder_nodes)(void);
+void X(check_execute)(void);
+void X(check_set_nodes)(void);
+void X(check_shared_fftw)(void);
+void X(check_fftw_wisdom)(void);
+void X(check_set_threads)(void);
+void X(check_fft_order)(void);
+void X(check_zero_padding)(void);
+void X(check_memory_policy)(void);
+void X(check_simd)(void);
+void X(check_spread_interp)(void);
+void X(check_pipeline)(void);
+void X(check_node_sets)(void);
+
 void X(check_acc)(void);
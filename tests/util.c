@@ -151,3 +151,41 @@ void X(check_next_power_of_2)(void)
     }
 }
 
+
+/** Brute force reference for the smallest even 5-smooth n >= N. */
+static INT _next_fft_size(const INT N)
+{
+  INT n, k;
+
+  for (n = MAX(N, 2) + (MAX(N, 2) % 2); ; n += 2)
+  {
+    for (k = n; k % 2 == 0; k /= 2) ;
+    for (; k % 3 == 0; k /= 3) ;
+    for (; k % 5 == 0; k /= 5) ;
+
+    if (k == 1)
+      return n;
+  }
+}
+
+void X(check_next_fft_size)(void)
+{
+    INT j;
+
+    {
+        INT r = Y(next_fft_size)(-1);
+        int ok = r == -1;
+        printf("next_fft_size("__D__") = "__D__" -> %s\n", (INT)(-1), r, ok ? "OK" : "FAIL");
+        CU_ASSERT(ok)
+    }
+
+    for (j = 0; j <= 4100; j += (j < 200) ? 1 : 37)
+    {
+        INT r = Y(next_fft_size)(j);
+        INT r2 = _next_fft_size(j);
+        int ok = r == r2;
+        if (!ok || j % 100 == 0)
+          printf("next_fft_size("__D__") = "__D__" -> %s\n", j, r, ok ? "OK" : "FAIL");
+        CU_ASSERT(ok)
+    }
+}